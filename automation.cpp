@@ -0,0 +1,291 @@
+#include <math.h>
+#include "automation.h"
+#include "looper_layer.h"
+
+// Unsigned LEB128: 7 bits a byte, low first
+static size_t PutVarint(uint8_t* out, uint32_t v)
+{
+    size_t n = 0;
+    while(v >= 0x80)
+    {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static uint32_t GetVarint(const uint8_t* in, size_t& at)
+{
+    uint32_t v = 0;
+    for(int shift = 0; shift < 32; shift += 7)
+    {
+        uint8_t b = in[at++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80))
+            break;
+    }
+    return v;
+}
+
+// Small steps either way in few bytes: 0, -1, 1, -2, ...
+static uint32_t ZigZag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t UnZigZag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+void AutomationLane::Init(float range_lo, float range_hi, float range_detent)
+{
+    lo     = range_lo;
+    hi     = range_hi;
+    detent = range_detent;
+    Clear();
+}
+
+void AutomationLane::Clear()
+{
+    bytes    = 0;
+    points   = 0;
+    len      = 0;
+    active   = false;
+    overflow = false;
+    window   = false;
+}
+
+int32_t AutomationLane::Quantize(float value) const
+{
+    int32_t q = (int32_t)lroundf((value - lo) / (hi - lo) * (kAutomationLevels - 1));
+    return q < 0 ? 0 : (q >= kAutomationLevels ? kAutomationLevels - 1 : q);
+}
+
+void AutomationLane::Emit(int32_t t, int32_t q)
+{
+    if(bytes + kAutomationMaxPoint > kAutomationBytes)
+    {
+        overflow = true;
+        return;
+    }
+    bytes += PutVarint(&data[bytes], (uint32_t)(points == 0 ? t : t - end_t));
+    bytes += PutVarint(&data[bytes], ZigZag(points == 0 ? q : q - end_q));
+    end_t = t;
+    end_q = q;
+    points++;
+}
+
+bool AutomationLane::Decode(size_t& at, int32_t& t, int32_t& q) const
+{
+    if(at >= bytes)
+        return false;
+    t += (int32_t)GetVarint(data, at);
+    q += UnZigZag(GetVarint(data, at));
+    return true;
+}
+
+void AutomationLane::Begin()
+{
+    Clear();
+}
+
+void AutomationLane::Record(int32_t t, float value)
+{
+    if(overflow || (points > 0 && t < last_t))
+        return;
+    int32_t q = Quantize(value);
+    if(points == 0)
+    {
+        Emit(t, q);
+        anchor_t = last_t = t;
+        anchor_q = last_q = min_q = max_q = q;
+        return;
+    }
+    min_q = q < min_q ? q : min_q;
+    max_q = q > max_q ? q : max_q;
+    if(t == anchor_t)
+        return; // Same tick as the point kept
+
+    // Slopes from the anchor that stay within the error of this sample; on
+    // the detent, none: a line across a stretch held there is flat on its level
+    float error = value == detent ? 0.0f : kAutomationError;
+    float dt    = (float)(t - anchor_t);
+    float up    = ((float)(q - anchor_q) + error) / dt;
+    float dn    = ((float)(q - anchor_q) - error) / dt;
+    if(window && (dn > slope_hi || up < slope_lo))
+    {
+        // No line from the anchor fits every sample since: keep the last
+        // sample as it was (so the next line starts on the knob's path) and
+        // go on from there
+        Emit(last_t, last_q);
+        anchor_t = last_t;
+        anchor_q = last_q;
+        window   = false;
+        if(t != anchor_t)
+        {
+            dt = (float)(t - anchor_t);
+            up = ((float)(q - anchor_q) + error) / dt;
+            dn = ((float)(q - anchor_q) - error) / dt;
+        }
+    }
+    if(t != anchor_t)
+    {
+        slope_hi = window && slope_hi < up ? slope_hi : up;
+        slope_lo = window && slope_lo > dn ? slope_lo : dn;
+        window   = true;
+    }
+    last_t = t;
+    last_q = q;
+}
+
+void AutomationLane::End(int32_t ticks)
+{
+    if(points > 0 && window && !overflow)
+        Emit(last_t, last_q);
+    window = false;
+    len    = ticks;
+
+    // A knob left alone is not automated: it stays free to turn
+    active = points >= 2 && (float)(max_q - min_q) > kAutomationError;
+    if(active)
+        Rewind();
+    else
+        Clear();
+}
+
+void AutomationLane::Rewind()
+{
+    cursor = 0;
+    cur_t  = 0;
+    cur_q  = 0;
+    Decode(cursor, cur_t, cur_q);
+    first_q = cur_q;
+    LoadNext();
+}
+
+void AutomationLane::LoadNext()
+{
+    next_t = cur_t;
+    next_q = cur_q;
+    if(!Decode(cursor, next_t, next_q))
+    {
+        // Past the last point the line heads back to the first, a pass later
+        next_t = len;
+        next_q = first_q;
+    }
+}
+
+float AutomationLane::Value(float t)
+{
+    if(t < (float)cur_t)
+        Rewind(); // Wrapped
+    float q = (float)cur_q; // Before the first point (a pass that began off the knob): held there
+    if(t >= (float)cur_t)
+    {
+        while(t >= (float)next_t && next_t < len)
+        {
+            cur_t = next_t;
+            cur_q = next_q;
+            LoadNext();
+        }
+        float x = (t - (float)cur_t) / (float)(next_t - cur_t);
+        q       = (float)cur_q + x * (float)(next_q - cur_q);
+    }
+    float v = Level(q);
+
+    // 1.0x falls between two levels: held there it would play a hair off,
+    // drift against the other layers and leave the master cycle
+    return fabsf(v - detent) <= 0.5f * (hi - lo) / (kAutomationLevels - 1) ? detent : v;
+}
+
+void LayerAutomation::Init()
+{
+    for(int i = 0; i < kNumLanes; i++)
+        lanes[i].Init(kAutomationRange[i][0], kAutomationRange[i][1], kAutomationDetent[i]);
+    Clear();
+}
+
+void LayerAutomation::Clear()
+{
+    recording = false;
+    len       = 0;
+    for(AutomationLane& lane : lanes)
+        lane.Clear();
+}
+
+void LayerAutomation::Toggle(const LooperLayer& layer)
+{
+    if(Active())
+    {
+        Clear();
+        return;
+    }
+    if(!layer.recorded || layer.recording || layer.streaming || layer.record_len == 0)
+        return;
+    len       = (uint32_t)layer.record_len;
+    origin    = PhaseIndex(layer.play_phase);
+    last_pos  = origin;
+    travelled = 0;
+    recording = true;
+    for(AutomationLane& lane : lanes)
+        lane.Begin();
+}
+
+float LayerAutomation::Tick(uint32_t pos) const
+{
+    uint32_t rel = pos >= origin ? pos - origin : pos + len - origin;
+    return (float)rel * (1.0f / (1 << kAutomationTickBits));
+}
+
+void LayerAutomation::Block(LooperLayer& layer, size_t size)
+{
+    if(!Active())
+        return;
+    if(!layer.recorded || layer.streaming || layer.record_len != len)
+    {
+        Clear(); // Erased or replaced: the curves belonged to the old take
+        return;
+    }
+    if(layer.paused)
+        return;
+
+    uint32_t pos = PhaseIndex(layer.play_phase);
+    if(recording)
+    {
+        // More than half the loop is not a block played but the layer put
+        // back onto the transport counter or the grid: nothing travelled,
+        // and the samples behind the last one are dropped
+        uint32_t step = pos >= last_pos ? pos - last_pos : pos + len - last_pos;
+        travelled += step > len / 2 ? 0 : step;
+        last_pos = pos;
+        if(travelled < len)
+        {
+            // On the grid the speed is the lock's trim, not the knob: only
+            // recorded once the knob takes the layer off it
+            int32_t t = (int32_t)lroundf(Tick(pos));
+            if(layer.sync_beats == 0)
+                lanes[kLaneSpeed].Record(t, layer.speed);
+            lanes[kLanePan].Record(t, layer.pan);
+            return;
+        }
+        // One whole pass: replay from here on
+        recording     = false;
+        int32_t ticks = (int32_t)((len + (1 << kAutomationTickBits) - 1) >> kAutomationTickBits);
+        for(AutomationLane& lane : lanes)
+            lane.End(ticks);
+    }
+
+    // Speed holds for the block, as the resampler takes it; pan is the
+    // value where the block ends, which the gain ramps reach sample by sample
+    AutomationLane& speed = lanes[kLaneSpeed];
+    if(speed.active && !layer.recording && !layer.overdubbing && layer.sync_beats == 0)
+        layer.speed = speed.Value(Tick(pos));
+    AutomationLane& pan = lanes[kLanePan];
+    if(pan.active)
+    {
+        uint32_t end = pos + (uint32_t)((float)size * layer.speed);
+        layer.pan    = pan.Value(Tick(end % len));
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+struct LooperLayer;
+
+// Knob automation: a layer's speed and pan moves, recorded over one pass of
+// its loop and replayed on every pass after.
+//
+// Each lane is a piecewise-linear curve over the loop position, not a value
+// per block. While recording, a swing-door filter keeps a sample only once
+// no straight line from the last kept one passes within kAutomationError
+// levels of every sample since; the line between kept samples strays at most
+// about twice that. A steady sweep is two points, a knob left alone none.
+// Samples on a lane's detent (speed's 1.0x) get no error, so a stretch held
+// there replays flat on the detent's level, which reads back as the detent.
+// Points are stored as deltas from the previous one, position in ticks and
+// value in levels, each as a variable-length integer: two to four bytes a
+// point. Replay walks the points with a cursor and interpolates between them
+// once per block at the block's loop position; pan goes through the layer's
+// per-sample gain ramps, speed holds for the block as it does for a knob.
+// A layer locked to the MIDI clock's grid has its speed set by the lock, so
+// that lane is neither recorded nor replayed until the knob takes it off.
+//
+// Positions count loop frames, so the curve stays on the loop at any speed;
+// a pass may start anywhere in the loop and wraps around its end. The lanes
+// go with the take: erased, replaced, or bounced (the engine clears every
+// layer that took part when the mixdown swaps in).
+
+enum AutomationLaneId
+{
+    kLaneSpeed,
+    kLanePan,
+    kNumLanes,
+};
+
+constexpr int     kAutomationTickBits = 5;    // loop frames per position tick: 32
+constexpr int32_t kAutomationLevels   = 4096; // value steps across a lane's range
+constexpr float   kAutomationError    = 3.0f; // levels, see above
+constexpr size_t  kAutomationBytes    = 2048; // per lane, in internal RAM
+constexpr size_t  kAutomationMaxPoint = 10;   // two 32-bit varints
+constexpr float   kAutomationRange[kNumLanes][2] = {{0.3f, 2.0f}, {0.0f, 1.0f}}; // speed, pan
+constexpr float   kAutomationDetent[kNumLanes]   = {1.0f, -1.0f}; // speed's 1.0x; pan has none
+
+struct AutomationLane
+{
+    float lo = 0.0f, hi = 1.0f;
+    float detent = -1.0f; // replayed exactly within half a level, outside the range for none
+
+    uint8_t  data[kAutomationBytes];
+    size_t   bytes    = 0;
+    uint32_t points   = 0;
+    int32_t  end_t    = 0; // tick of the last point
+    int32_t  end_q    = 0;
+    int32_t  len      = 0; // ticks in a pass
+    bool     active   = false; // replaying
+    bool     overflow = false; // ran out of room; the rest of the pass was not kept
+
+    // Recording: the last point kept, the slopes a line from it may still
+    // take, and the last sample seen
+    int32_t anchor_t = 0, anchor_q = 0;
+    float   slope_lo = 0.0f, slope_hi = 0.0f;
+    bool    window   = false;
+    int32_t last_t = 0, last_q = 0;
+    int32_t min_q = 0, max_q = 0;
+
+    // Replay: the points either side of the position
+    size_t  cursor = 0;
+    int32_t cur_t = 0, cur_q = 0, next_t = 0, next_q = 0;
+    int32_t first_q = 0;
+
+    void Init(float range_lo, float range_hi, float range_detent = -1.0f);
+    void Clear();
+
+    void Begin();
+    // The knob's value at tick t of the pass; a t behind the last is dropped
+    void Record(int32_t t, float value);
+    // End of a pass of `ticks`; active when the knob moved during it
+    void End(int32_t ticks);
+
+    // The curve at tick t (fractional) of the loop, 0 <= t < len; a value
+    // within half a level of the detent is the detent
+    float Value(float t);
+
+    int32_t Quantize(float value) const;
+    float   Level(float q) const { return lo + q * (hi - lo) * (1.0f / (kAutomationLevels - 1)); }
+
+    // Append a point; read the one at byte `at` that follows (t, q), false
+    // past the last
+    void Emit(int32_t t, int32_t q);
+    bool Decode(size_t& at, int32_t& t, int32_t& q) const;
+
+    // Put the replay cursor on the first point, and past it on the next
+    void Rewind();
+    void LoadNext();
+};
+
+struct LayerAutomation
+{
+    AutomationLane lanes[kNumLanes];
+
+    bool     recording = false;
+    uint32_t len       = 0; // loop frames the lanes were recorded over
+    uint32_t origin    = 0; // loop frame the pass started at, tick 0
+    uint32_t last_pos  = 0;
+    uint32_t travelled = 0; // loop frames played since the pass started
+
+    void Init();
+    void Clear();
+
+    // kCmdAutomate: start a pass, or clear what there is
+    void Toggle(const LooperLayer& layer);
+
+    bool Active() const { return recording || lanes[kLaneSpeed].active || lanes[kLanePan].active; }
+    size_t Bytes() const { return lanes[kLaneSpeed].bytes + lanes[kLanePan].bytes; }
+
+    // Once per block before the layer renders: record its knobs at the loop
+    // position, or set them from the lanes
+    void Block(LooperLayer& layer, size_t size);
+
+    // Fractional tick of loop frame pos, counted from the origin
+    float Tick(uint32_t pos) const;
+};
@@ -0,0 +1,163 @@
+#include <string.h>
+#include "bounce.h"
+#include "profiler.h"
+
+void LayerBounce::Init(SampleArena* arena)
+{
+    result.Init(arena);
+    state.store(kBounceIdle);
+    done.store(0);
+    len = 0;
+}
+
+bool LayerBounce::Start(LooperLayer* layers, int num_layers, uint8_t mask, int to, uint32_t now, uint8_t refuse)
+{
+    if(Running())
+        return false;
+
+    const Phase unity = PhaseIncrement(1.0f);
+    int         count = 0;
+    sources           = 0;
+    len               = 0;
+    in_cycle          = true;
+    for(int i = 0; i < num_layers && i < kMaxBounceLayers; i++)
+    {
+        const LooperLayer& layer = layers[i];
+        if(!(mask & (1 << i)) || !layer.recorded || layer.paused)
+            continue;
+        inc[i] = PhaseIncrement(layer.speed);
+        if(layer.recording || layer.overdubbing || layer.loading || layer.streaming || inc[i] == 0
+           || (layer.stretch && inc[i] != unity && layer.record_len >= kStretchMinFrames) || (refuse & (1 << i)))
+        {
+            state.store(kBounceFailed, std::memory_order_release);
+            return false;
+        }
+        phase[i]      = layer.play_phase;
+        source_len[i] = (uint32_t)layer.record_len;
+        in_cycle      = in_cycle && layer.cycle_sync && inc[i] == unity;
+
+        // The take plays at centre pan, half the gain on each side
+        gain_l[i] = 2.0f * layer.volume * (1.0f - layer.pan);
+        gain_r[i] = 2.0f * layer.volume * layer.pan;
+
+        // One pass of this loop at its speed, in output frames
+        uint64_t frames = (PhaseFromIndex(source_len[i]) + inc[i] - 1) / inc[i];
+        len             = frames > len ? (uint32_t)frames : len;
+        sources |= (uint8_t)(1 << i);
+        count++;
+    }
+
+    // Into `to` when it takes part, otherwise the lowest source
+    dest = -1;
+    for(int i = 0; i < kMaxBounceLayers && dest < 0; i++)
+        if(sources & (1 << i))
+            dest = i;
+    if(to >= 0 && to < kMaxBounceLayers && (sources & (1 << to)))
+        dest = to;
+
+    result.Begin(2);
+    if(count < 2 || result.Reserve(len) < len)
+    {
+        result.Clear();
+        state.store(kBounceFailed, std::memory_order_release);
+        return false;
+    }
+
+    report               = {};
+    report.frames        = len;
+    report.voices_before = count;
+#if LOOPER_PROFILE
+    report.cycles_before_avg = audio_profiler.total.Avg();
+    report.cycles_before_max = audio_profiler.total.max;
+#endif
+    start_frame          = now;
+    done.store(0, std::memory_order_relaxed);
+    state.store(kBounceRunning, std::memory_order_release);
+    return true;
+}
+
+bool LayerBounce::SourceIntact(const LooperLayer& layer, int i) const
+{
+    return layer.recorded && !layer.recording && !layer.overdubbing && !layer.loading
+           && layer.record_len == source_len[i];
+}
+
+void LayerBounce::Step(LooperLayer* layers, uint32_t now, float master_gain)
+{
+    if(!Running())
+        return;
+    for(int i = 0; i < kMaxBounceLayers; i++)
+    {
+        if((sources & (1 << i)) && !SourceIntact(layers[i], i))
+        {
+            Cancel();
+            return;
+        }
+    }
+
+    uint32_t from = done.load(std::memory_order_relaxed);
+    size_t   n    = len - from < kBounceChunk ? len - from : kBounceChunk;
+    for(size_t k = 0; k < n; k++)
+        chunk_l[k] = chunk_r[k] = 0.0f;
+    for(int i = 0; i < kMaxBounceLayers; i++)
+    {
+        if(!(sources & (1 << i)))
+            continue;
+        const LoopStorage& storage = layers[i].storage;
+        LoopSource         src     = {storage.arena->pool,
+                                      storage.blocks,
+                                      kArenaBlockBytes,
+                                      storage.frames_per_block,
+                                      storage.channels,
+                                      source_len[i]};
+        ParamRamp          ramp_l  = {gain_l[i], gain_l[i], 0.0f};
+        ParamRamp          ramp_r  = {gain_r[i], gain_r[i], 0.0f};
+        ResampleBlock<LoopInterp, LoopFormat>(src, phase[i], inc[i], chunk_l, chunk_r, n, ramp_l, ramp_r);
+    }
+    for(size_t k = 0; k < n; k++)
+        result.Write(from + k, chunk_l[k], chunk_r[k]); // claimed at the start, cannot fail
+    done.store(from + (uint32_t)n, std::memory_order_relaxed);
+
+    if(from + n == len)
+        Finish(layers, now, master_gain);
+}
+
+void LayerBounce::Finish(LooperLayer* layers, uint32_t now, float master_gain)
+{
+    SampleArena* arena = result.arena;
+    size_t       used  = arena->UsedBlocks();
+    for(int i = 0; i < kMaxBounceLayers; i++)
+        if(sources & (1 << i))
+            layers[i].Erase();
+
+    // The destination takes over the rendered blocks
+    LooperLayer& layer             = layers[dest];
+    layer.storage.channels         = result.channels;
+    layer.storage.frames_per_block = result.frames_per_block;
+    layer.storage.num_blocks       = result.num_blocks;
+    memcpy(layer.storage.blocks, result.blocks, result.num_blocks * sizeof(result.blocks[0]));
+    result.num_blocks = 0;
+
+    layer.record_len = len;
+    layer.write_idx  = len;
+    layer.recorded   = true;
+    layer.speed      = 1.0f;
+    layer.volume     = 1.0f;
+    layer.pan        = 0.5f;
+    layer.stretch    = false;
+    layer.play_phase = PhaseFromIndex((now - start_frame) % len); // where the sources are now
+    layer.gain_l.Snap(0.5f * master_gain);
+    layer.gain_r.Snap(0.5f * master_gain);
+
+    report.blocks_freed = (uint32_t)(used - arena->UsedBlocks());
+    report.voices_after = 1;
+    state.store(kBounceDone, std::memory_order_release);
+}
+
+void LayerBounce::Cancel()
+{
+    if(!Running())
+        return;
+    result.Clear();
+    state.store(kBounceFailed, std::memory_order_release);
+}
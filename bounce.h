@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "looper_layer.h"
+#include "sample_arena.h"
+
+// Bounce: mix a set of playing layers, as heard (speed, pan, volume), into
+// one stereo take on one of them and give the rest of their memory back.
+//
+// The render runs on the audio side a chunk per block, so the arena and the
+// layers are only ever touched from there and the sources play on untouched
+// while it goes. Each source is read from where it was when the bounce
+// started; the take is as long as the longest source at its speed, shorter
+// loops wrap into it. Once the last chunk is in, the take replaces the
+// destination's at the position the sources have reached by then, at unity
+// volume and centre pan, and the other sources are erased. When every source
+// played on the master cycle at 1.0x, the engine puts the take back on it.
+//
+// Speed, pan and volume are taken at the start and sources are read dry, so
+// a source with automation or an effect on is refused. A source that is erased, re-recorded or overdubbed before the
+// end cancels the bounce, as does an arena too full to hold the take
+// alongside its sources.
+
+constexpr int    kMaxBounceLayers = 8;
+constexpr size_t kBounceChunk     = 96; // frames per audio block: twice real time at 48-frame blocks
+
+enum BounceState
+{
+    kBounceIdle,
+    kBounceRunning,
+    kBounceDone,
+    kBounceFailed,
+};
+
+struct BounceReport
+{
+    uint32_t frames;        // length of the bounced take
+    uint32_t blocks_freed;  // arena blocks back in the pool, undo history included
+    int      voices_before; // sources rendered every block before the bounce
+    int      voices_after;  // 1: the destination
+
+    // Audio callback, in profiler ticks (cycles on the Seed), with
+    // LOOPER_PROFILE: mean and peak over the profiler's window up to the
+    // start, and over the first whole window after the hand-over, which the
+    // profiler's reader fills in
+    uint32_t cycles_before_avg, cycles_before_max;
+    uint32_t cycles_after_avg, cycles_after_max;
+};
+
+struct LayerBounce
+{
+    LoopStorage result; // The take being rendered, claimed in full at the start
+
+    uint8_t  sources     = 0; // Layer bits
+    int      dest        = 0;
+    uint32_t start_frame = 0; // Engine frame the source positions were taken at
+    uint32_t len         = 0;
+    bool     in_cycle    = false; // every source played on the master cycle at 1.0x
+
+    Phase    phase[kMaxBounceLayers];
+    Phase    inc[kMaxBounceLayers];
+    float    gain_l[kMaxBounceLayers];
+    float    gain_r[kMaxBounceLayers];
+    uint32_t source_len[kMaxBounceLayers];
+
+    alignas(16) float chunk_l[kBounceChunk];
+    alignas(16) float chunk_r[kBounceChunk];
+
+    // Read by the control side for the display
+    std::atomic<int>      state{kBounceIdle};
+    std::atomic<uint32_t> done{0}; // frames rendered
+    BounceReport          report = {};
+
+    void Init(SampleArena* arena);
+
+    // Audio side: bounce the layers in mask that are playing into dest
+    // (which need not be one of them), from this block's positions. Paused
+    // layers are left out and kept. False when fewer than two layers would
+    // take part, one is recording, overdubbing, streaming in, time-stretched
+    // or in `refuse` (layer bits), or the take does not fit in the arena.
+    bool Start(LooperLayer* layers, int num_layers, uint8_t mask, int to, uint32_t now, uint8_t refuse = 0);
+
+    // Audio side, once per block before the layers render: one chunk, and
+    // the hand-over after the last
+    void Step(LooperLayer* layers, uint32_t now, float master_gain);
+
+    void Cancel();
+
+    bool  Running() const { return state.load(std::memory_order_acquire) == kBounceRunning; }
+    float Progress() const { return len > 0 ? (float)done.load(std::memory_order_relaxed) / (float)len : 0.0f; }
+
+    bool SourceIntact(const LooperLayer& layer, int i) const;
+    void Finish(LooperLayer* layers, uint32_t now, float master_gain);
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Thin control/IO boundary between the looper DSP and the board.
+// The target implementation lives in daisy_io.h, the host one in host/host_io.h,
+// so looper_layer.cpp builds without libDaisy.
+
+// Audio buffers, same layout as daisy::AudioHandle::InputBuffer / OutputBuffer
+typedef const float* const* AudioIn;
+typedef float**             AudioOut;
+
+// ADC layout: [0]=SPEED_POT, [1]=PAN_POT, [2]=MASTER_VOL, [3..7]=VOLUME1..5_POT
+constexpr int kAdcSpeed      = 0;
+constexpr int kAdcPan        = 1;
+constexpr int kAdcMasterVol  = 2;
+constexpr int kAdcLayerVol   = 3; // + layer index
+constexpr int kNumAdcChannels = 8;
+
+// Momentary push button (debounced)
+struct ButtonInput
+{
+    virtual ~ButtonInput() {}
+    virtual void  Debounce() = 0;
+    virtual bool  Pressed() const = 0;
+    virtual float TimeHeldMs() const = 0;     // since the press edge, 0 while released
+    virtual float TimeReleasedMs() const = 0; // since the release edge, 0 while pressed
+};
+
+// Knobs and system time
+struct ControlInput
+{
+    virtual ~ControlInput() {}
+    virtual float    GetAdc(int channel) const = 0; // raw 0.0 - 1.0, as read from the ADC
+    virtual uint32_t NowMs() const = 0;
+    virtual uint32_t NowUs() const = 0; // free-running, wraps
+};
+
+// Byte-addressed persistent store (a file on the SD card, or a QSPI region).
+// Calls may block for milliseconds; use them from the main loop only.
+struct StorageDevice
+{
+    virtual ~StorageDevice() {}
+    virtual bool Read(uint32_t offset, void* dst, size_t bytes) = 0;
+    virtual bool Write(uint32_t offset, const void* src, size_t bytes) = 0;
+    virtual bool Flush() = 0;
+};
+
+// Write-only SPI link to one chip select. Transmit() starts sending one frame
+// (chip select framed) and returns at once; the caller keeps `data` alive and
+// unchanged until Busy() goes false.
+struct SpiOutput
+{
+    virtual ~SpiOutput() {}
+    virtual bool Busy() const = 0;
+    virtual void Transmit(const uint8_t* data, size_t bytes) = 0;
+};
@@ -0,0 +1,64 @@
+#include "control_params.h"
+#include <math.h>
+
+void ControlParams::Init()
+{
+    for(int i = 0; i <= kTaperSize; i++)
+        taper[i] = powf((float)i / kTaperSize, 2.5f);
+
+    for(int i = 0; i < kNumAdcChannels; i++)
+        pots[i] = 0.0f;
+    for(int i = 0; i < kNumVolumePots; i++)
+        layer_gain[i] = 0.0f;
+    speed       = 1.0f;
+    pan         = 0.5f;
+    master_gain = 0.0f;
+    now_ms      = 0;
+}
+
+float ControlParams::Taper(float x) const
+{
+    if(x <= 0.0f)
+        return 0.0f;
+    if(x >= 1.0f)
+        return taper[kTaperSize];
+
+    float pos  = x * kTaperSize;
+    int   idx  = (int)pos;
+    float frac = pos - idx;
+    return taper[idx] + (taper[idx + 1] - taper[idx]) * frac;
+}
+
+void ControlParams::Snapshot(const ControlInput* controls)
+{
+    // Potentiometers are wired backwards (3V3 and GND swapped), so readings are inverted
+    for(int i = 0; i < kNumAdcChannels; i++)
+        pots[i] = 1.0f - controls->GetAdc(i);
+    now_ms = controls->NowMs();
+
+    // Speed: 0.3x - 1.0x below the center dead zone, 1.0x - 2.0x above it
+    const float center    = 0.5f;
+    const float dead_zone = 0.09f;
+    float       speed_pot = pots[kAdcSpeed];
+    if(speed_pot < center - dead_zone)
+    {
+        float tt = (speed_pot - 0.0f) / (center - dead_zone);
+        speed    = 0.3f + tt * (1.0f - 0.3f);
+    }
+    else if(speed_pot > center + dead_zone)
+    {
+        float tt = (speed_pot - (center + dead_zone)) / (1.0f - (center + dead_zone));
+        speed    = 1.0f + tt * (2.0f - 1.0f);
+    }
+    else
+    {
+        speed = 1.0f;
+    }
+
+    pan = pots[kAdcPan];
+
+    // Combined max: 1.4 * 1.43 ≈ 2.0x
+    master_gain = Taper(pots[kAdcMasterVol]) * 1.43f;
+    for(int i = 0; i < kNumVolumePots; i++)
+        layer_gain[i] = Taper(pots[kAdcLayerVol + i]) * 1.4f;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "control_io.h"
+
+// Control-rate parameter stage.
+// All 8 ADC channels are read once per control tick and mapped to ready-to-use
+// values, so nothing downstream touches the ADC or calls powf.
+
+constexpr int kNumVolumePots = kNumAdcChannels - kAdcLayerVol; // one per layer
+constexpr int kTaperSize     = 256;                            // LUT segments
+
+// Per-sample linear ramp from the current value to a new per-block target.
+// Sample i of the block gets value + step * (i + 1), so scalar and vector
+// renderers produce identical gains without a running accumulator.
+struct ParamRamp
+{
+    float value  = 0.0f;
+    float target = 0.0f;
+    float step   = 0.0f;
+
+    // Ramp to t over the next size samples
+    void SetTarget(float t, size_t size)
+    {
+        target = t;
+        step   = size > 0 ? (t - value) / (float)size : 0.0f;
+    }
+
+    // Jump straight to t (layer not audible, nothing to smooth)
+    void Snap(float t)
+    {
+        value  = t;
+        target = t;
+        step   = 0.0f;
+    }
+
+    inline float At(size_t i) const { return value + step * (float)(i + 1); }
+
+    // Call once the block has been rendered
+    void Finish()
+    {
+        value = target;
+        step  = 0.0f;
+    }
+};
+
+struct ControlParams
+{
+    // Snapshot of the current block
+    float    pots[kNumAdcChannels]; // pot positions 0.0 - 1.0 (inversion already applied)
+    float    speed;                 // speed knob mapped to 0.3x - 2.0x with a 1.0x detent
+    float    pan;                   // 0.0 = left, 1.0 = right
+    float    master_gain;           // 0.0 to 1.43x
+    float    layer_gain[kNumVolumePots]; // 0.0 to 1.4x, master not applied
+    uint32_t now_ms;
+
+    void Init();
+
+    // Read every ADC channel once and map them; LooperControl::Update() calls it
+    // at the top of each control tick, from the main loop
+    void Snapshot(const ControlInput* controls);
+
+    // x^2.5 volume taper through the lookup table
+    float Taper(float x) const;
+
+    float taper[kTaperSize + 1]; // x^2.5 sampled at kTaperSize + 1 points
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include "daisy_seed.h"
+#include "fatfs.h"
+#include "control_io.h"
+
+// Daisy Seed implementations of the control/IO interfaces
+
+// Edges are back-dated by the debounce delay: libDaisy reports one after 7
+// stable samples of the pin, which the control task polls about once per
+// ms. The stamp is therefore only as good as that polling: up to about 1 ms
+// (48 frames) either side of the edge, more when the main loop runs late,
+// and later by however long the contact bounced, since the stable run
+// starts after the last bounce. Timing the raw edges would take a pin
+// interrupt per button.
+struct SwitchButton : ButtonInput
+{
+    static constexpr uint32_t kDebounceUs = 7000;
+
+    daisy::Switch sw;
+    uint32_t      press_us   = 0;
+    uint32_t      release_us = 0;
+
+    void Init(daisy::Pin pin, float update_rate) { sw.Init(pin, update_rate); }
+
+    void Debounce() override
+    {
+        sw.Debounce();
+        if(sw.RisingEdge())
+            press_us = daisy::System::GetUs() - kDebounceUs;
+        if(sw.FallingEdge())
+            release_us = daisy::System::GetUs() - kDebounceUs;
+    }
+
+    bool  Pressed() const override { return sw.Pressed(); }
+    float TimeHeldMs() const override
+    {
+        return sw.Pressed() ? (daisy::System::GetUs() - press_us) * 1e-3f : 0.0f;
+    }
+    float TimeReleasedMs() const override
+    {
+        return sw.Pressed() ? 0.0f : (daisy::System::GetUs() - release_us) * 1e-3f;
+    }
+};
+
+struct SeedControls : ControlInput
+{
+    daisy::DaisySeed* hw = nullptr;
+
+    void Init(daisy::DaisySeed* seed) { hw = seed; }
+
+    float    GetAdc(int channel) const override { return hw->adc.GetFloat(channel); }
+    uint32_t NowMs() const override { return daisy::System::GetNow(); }
+    uint32_t NowUs() const override { return daisy::System::GetUs(); }
+};
+
+// One file on the SD card (FatFS), opened read/write. FIL must not live in
+// DTCM, the SDMMC DMA cannot reach it.
+struct SdFileDevice : StorageDevice
+{
+    FIL  file;
+    bool open = false;
+
+    // create: make the file when it does not exist yet
+    bool Open(const char* path, bool create = true)
+    {
+        open = f_open(&file, path, FA_READ | FA_WRITE | (create ? FA_OPEN_ALWAYS : FA_OPEN_EXISTING)) == FR_OK;
+        return open;
+    }
+
+    bool Read(uint32_t offset, void* dst, size_t bytes) override
+    {
+        UINT done = 0;
+        return open && f_lseek(&file, offset) == FR_OK && f_read(&file, dst, bytes, &done) == FR_OK
+               && done == bytes;
+    }
+
+    bool Write(uint32_t offset, const void* src, size_t bytes) override
+    {
+        UINT done = 0;
+        return open && f_lseek(&file, offset) == FR_OK && f_write(&file, src, bytes, &done) == FR_OK
+               && done == bytes;
+    }
+
+    bool Flush() override { return open && f_sync(&file) == FR_OK; }
+};
+
+// SPI frames sent by DMA with a software chip select. Busy() clears in the
+// DMA-complete interrupt; the frame is copied into D2 SRAM, which the DMA can
+// reach and the D-cache does not cover.
+struct SeedSpiOutput : SpiOutput
+{
+    daisy::SpiHandle* spi = nullptr;
+    daisy::GPIO       cs;
+    volatile bool     busy = false;
+
+    void Init(daisy::SpiHandle* spi_handle, daisy::Pin cs_pin)
+    {
+        spi = spi_handle;
+        cs.Init(cs_pin, daisy::GPIO::Mode::OUTPUT);
+        cs.Write(true);
+    }
+
+    bool Busy() const override { return busy; }
+
+    void Transmit(const uint8_t* data, size_t bytes) override
+    {
+        static uint8_t DMA_BUFFER_MEM_SECTION dma_frame[4];
+        for(size_t i = 0; i < bytes && i < sizeof(dma_frame); i++)
+            dma_frame[i] = data[i];
+        busy = true;
+        cs.Write(false);
+        if(spi->DmaTransmit(dma_frame, bytes, nullptr, &SeedSpiOutput::Done, this) != daisy::SpiHandle::Result::OK)
+            Done(this, daisy::SpiHandle::Result::ERR);
+    }
+
+    static void Done(void* context, daisy::SpiHandle::Result result)
+    {
+        SeedSpiOutput* self = static_cast<SeedSpiOutput*>(context);
+        self->cs.Write(true);
+        self->busy = false;
+    }
+};
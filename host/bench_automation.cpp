@@ -0,0 +1,137 @@
+// Knob automation: bytes a lane keeps per minute of knob motion for a few
+// ways of playing the knob, against a float per block, and the cost per
+// block of replaying and of recording both lanes of five layers, in ns and
+// share of the 1 ms budget.
+//
+//   bench_automation [seconds_per_case]
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "automation.h"
+#include "test_util.h"
+
+static constexpr size_t kBlock       = 48;
+static constexpr int    kNumLayers   = 5;
+static constexpr size_t kMinute      = 60 * 48000 / kBlock; // blocks
+static constexpr float  kTicksPerBlk = (float)kBlock / (1 << kAutomationTickBits);
+
+static TestRandom rng = {5};
+
+// Knob positions, one per block, t in seconds
+static float Sweeps(float t)
+{
+    return 0.5f + 0.45f * sinf(2.0f * (float)M_PI * 0.1f * t);
+}
+static float Vibrato(float t)
+{
+    return 0.5f + 0.1f * sinf(2.0f * (float)M_PI * 2.0f * t);
+}
+static float Moves(float t)
+{
+    // Settles somewhere new every 4 s, half a second to get there
+    float seg = floorf(t / 4.0f), x = t / 4.0f - seg;
+    float from = 0.5f + 0.4f * sinf(seg * 1.7f), to = 0.5f + 0.4f * sinf((seg + 1.0f) * 1.7f);
+    return x < 0.875f ? from : from + (to - from) * (x - 0.875f) * 8.0f;
+}
+static float Wander(float t)
+{
+    static float v = 0.5f;
+    v += rng.Noise(0.002f);
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return v;
+}
+
+struct Hand
+{
+    const char* name;
+    float (*knob)(float);
+};
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 2.0f;
+
+    printf("bench_automation: lane bytes per minute of motion (a float per block: %zu)\n", kMinute * sizeof(float));
+    const Hand hands[] = {{"slow sweeps, 0.1 Hz", Sweeps},
+                          {"moves between holds", Moves},
+                          {"vibrato, 2 Hz", Vibrato},
+                          {"random wander", Wander}};
+    static AutomationLane lane;
+    lane.Init(0.0f, 1.0f);
+    for(const Hand& hand : hands)
+    {
+        // Lanes hold kAutomationBytes: measured a chunk at a time that fits
+        size_t bytes = 0, points = 0, chunk = kMinute / 8;
+        bool   overflow = false;
+        for(size_t from = 0; from < kMinute; from += chunk)
+        {
+            lane.Begin();
+            for(size_t b = 0; b < chunk; b++)
+                lane.Record((int32_t)lroundf((float)b * kTicksPerBlk), hand.knob((float)(from + b) * 0.001f));
+            lane.End((int32_t)((float)chunk * kTicksPerBlk) + 1);
+            bytes += lane.bytes;
+            points += lane.points;
+            overflow = overflow || lane.overflow;
+        }
+        printf("  %-22s %6zu bytes/min  %5zu points  %.2f bytes/point%s\n", hand.name, bytes, points,
+               points > 0 ? (double)bytes / points : 0.0, overflow ? "  (overflowed)" : "");
+    }
+
+    // Replay and record cost: both lanes of five layers, a 30 s loop of moves
+    static LayerAutomation layers[kNumLayers];
+    const size_t           loop = 30000;
+    static float           knob[loop];
+    for(size_t b = 0; b < loop; b++)
+        knob[b] = Moves((float)b * 0.001f);
+    for(LayerAutomation& a : layers)
+    {
+        a.Init();
+        a.len = loop * kBlock;
+        for(int l = 0; l < kNumLanes; l++)
+        {
+            AutomationLane& lane = a.lanes[l];
+            lane.Begin();
+            for(size_t b = 0; b < loop; b++)
+                lane.Record((int32_t)lroundf((float)b * kTicksPerBlk), knob[(b + l * 1000) % loop]);
+            lane.End((int32_t)((float)loop * kTicksPerBlk));
+        }
+    }
+
+    size_t         blocks = (size_t)(seconds * 48000.0f) / kBlock;
+    volatile float sink   = 0.0f;
+    auto           start  = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < blocks; b++)
+        for(LayerAutomation& a : layers)
+        {
+            float t = (float)(b % loop) * kTicksPerBlk;
+            sink    = sink + a.lanes[kLaneSpeed].Value(t) + a.lanes[kLanePan].Value(t + kTicksPerBlk);
+        }
+    double replay = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / blocks;
+
+    for(LayerAutomation& a : layers)
+        for(AutomationLane& lane : a.lanes)
+            lane.Begin();
+    start = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < blocks; b++)
+    {
+        if(b % loop == 0)
+            for(LayerAutomation& a : layers)
+                for(AutomationLane& lane : a.lanes)
+                    lane.Begin();
+        int32_t t = (int32_t)lroundf((float)(b % loop) * kTicksPerBlk);
+        for(LayerAutomation& a : layers)
+        {
+            a.lanes[kLaneSpeed].Record(t, knob[b % loop]);
+            a.lanes[kLanePan].Record(t, knob[(b + 1000) % loop]);
+        }
+    }
+    double record = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / blocks;
+
+    printf("  %d layers x %d lanes: replay %.0f ns/block (%.3f%% of 1 ms), record %.0f ns/block (%.3f%%)\n",
+           kNumLayers, kNumLanes, replay, replay / 1e4, record, record / 1e4);
+    printf("  RAM: %zu bytes per layer, %zu for %d layers\n", sizeof(LayerAutomation),
+           kNumLayers * sizeof(LayerAutomation), kNumLayers);
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Bouncing five 33 s layers (two of them off unity speed) into one: ns per
+// 48-frame block before, while the bounce renders its chunk alongside the
+// live layers, and after, with the arena memory it gave back and how long
+// it ran in audio time.
+//
+//   bench_bounce [seconds_per_case]
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "looper_engine.h"
+#include "test_util.h"
+
+static constexpr float kSampleRate = 48000.0f;
+static const float     kSpeeds[]   = {1.0f, 1.5f, 1.0f, 0.5f, 1.0f};
+
+typedef LooperEngine<5, 48000 * 33, 48> Engine;
+
+static TestRandom rng = {8086};
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 2.0f;
+
+    // Room for the bounced take next to its sources: 33 s at half speed is 66 s
+    const size_t         pool_bytes = Engine::kPoolBytes + 2 * Engine::kLayerBlocks * kArenaBlockBytes;
+    std::vector<uint8_t> pool(pool_bytes);
+    static Engine        engine;
+    engine.Init(pool.data(), pool_bytes);
+    engine.master_gain = 0.5f;
+    for(int l = 0; l < Engine::kNumLayers; l++)
+    {
+        LooperLayer& layer = engine.layers[l];
+        layer.storage.Begin(2);
+        for(size_t i = 0; i < Engine::kMaxFrames; i++)
+            layer.storage.Write(i, rng.Noise(0.5f), rng.Noise(0.5f));
+        layer.record_len = layer.write_idx = Engine::kMaxFrames;
+        layer.recorded = true;
+        layer.volume   = 0.3f;
+        layer.speed    = kSpeeds[l];
+    }
+
+    static float in_l[Engine::kBlockSize], in_r[Engine::kBlockSize];
+    static float out_l[Engine::kBlockSize], out_r[Engine::kBlockSize];
+    const float* in[2]  = {in_l, in_r};
+    float*       out[2] = {out_l, out_r};
+    double       sink   = 0.0;
+
+    auto run = [&](size_t blocks) {
+        auto start = std::chrono::steady_clock::now();
+        for(size_t b = 0; b < blocks; b++)
+        {
+            engine.ProcessBlock(in, out, 0);
+            sink += out_l[0];
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / blocks;
+    };
+
+    size_t blocks = (size_t)(seconds * kSampleRate) / Engine::kBlockSize;
+    double before = run(blocks);
+    size_t used   = engine.arena.UsedBlocks();
+
+    LooperCommand cmd = {engine.Now(), kCmdBounce, 0, 2, 0x1F, 0.0f};
+    engine.Send(cmd);
+    size_t bouncing_blocks = 0;
+    auto   start           = std::chrono::steady_clock::now();
+    do
+    {
+        engine.ProcessBlock(in, out, 0);
+        sink += out_l[0];
+        bouncing_blocks++;
+    } while(engine.bounce.Running());
+    double during = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                    / bouncing_blocks;
+    double after = run(blocks);
+
+    const BounceReport& report = engine.bounce.report;
+    const double        budget = Engine::kBlockSize * 1e9 / kSampleRate;
+    const double        mb     = kArenaBlockBytes / (1024.0 * 1024.0);
+    printf("# ns per %zu-frame block (budget %.0f ns), %d layers of %.0f s\n", Engine::kBlockSize, budget,
+           Engine::kNumLayers, Engine::kMaxFrames / kSampleRate);
+    printf("  %-28s %10.1f %7.2f%%\n", "before", before, 100.0 * before / budget);
+    printf("  %-28s %10.1f %7.2f%%\n", "while bouncing", during, 100.0 * during / budget);
+    printf("  %-28s %10.1f %7.2f%%\n", "after", after, 100.0 * after / budget);
+    printf("# bounce %s: %u frames (%.1f s) rendered over %zu blocks (%.1f s), %zu frames a block\n",
+           engine.bounce.state.load() == kBounceDone ? "done" : "failed", report.frames, report.frames / kSampleRate,
+           bouncing_blocks, bouncing_blocks * Engine::kBlockSize / kSampleRate, kBounceChunk);
+    printf("# recovered: %.1f ns per block, voices %d -> %d, arena %.1f MB -> %.1f MB (%u blocks freed)\n",
+           before - after, report.voices_before, report.voices_after, used * mb, engine.arena.UsedBlocks() * mb,
+           report.blocks_freed);
+    printf("# sink %g\n", sink);
+    return 0;
+}
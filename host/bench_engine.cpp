@@ -0,0 +1,107 @@
+// LooperEngine<NumLayers, MaxFrames, BlockSize> against the same layers run
+// through a loop sized at runtime, for the configurations the firmware is
+// built in: five 33 s layers and eight 20 s layers at 48-frame blocks, and
+// two layers at a 4-frame block where the per-block overhead dominates.
+// Every layer plays a full-length stereo take of noise.
+//
+//   bench_engine [seconds_per_case]
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "looper_engine.h"
+#include "test_util.h"
+
+static constexpr float kSampleRate = 48000.0f;
+static const float     kSpeeds[]   = {1.0f, 1.5f};
+
+static TestRandom rng = {31337};
+
+// The engine's per-block work with the block size as a runtime argument
+static void ProcessRuntime(EngineCore& engine, AudioIn in, AudioOut out, size_t block)
+{
+    engine.BeginBlock(in, block);
+    for(size_t i = 0; i < block; i++)
+        out[0][i] = out[1][i] = 0.0f;
+    for(int i = 0; i < engine.num_layers; i++)
+        engine.layers[i].Render(in, out, block, engine.master_gain);
+    engine.EndBlock(block, 0);
+}
+
+template <typename Engine>
+static void Bench(const char* name, float seconds, double& checksum)
+{
+    const size_t         block = Engine::kBlockSize;
+    std::vector<uint8_t> pool(Engine::kPoolBytes);
+    static Engine        engine;
+    engine.Init(pool.data());
+    engine.master_gain = 0.5f;
+
+    for(int l = 0; l < Engine::kNumLayers; l++)
+    {
+        LooperLayer& layer = engine.layers[l];
+        layer.storage.Begin(2);
+        for(size_t i = 0; i < Engine::kMaxFrames; i++)
+            layer.storage.Write(i, rng.Noise(0.5f), rng.Noise(0.5f));
+        layer.record_len = layer.write_idx = Engine::kMaxFrames;
+        layer.recorded = true;
+        layer.volume   = 0.3f;
+    }
+
+    std::vector<float> in_l(block, 0.0f), in_r(block, 0.0f), out_l(block), out_r(block);
+    const float*       in[2]  = {in_l.data(), in_r.data()};
+    float*             out[2] = {out_l.data(), out_r.data()};
+    size_t             blocks = (size_t)(seconds * kSampleRate) / block;
+
+    for(float speed : kSpeeds)
+    {
+        double ns[2];
+        for(int fixed = 0; fixed < 2; fixed++)
+        {
+            for(int l = 0; l < Engine::kNumLayers; l++)
+            {
+                engine.layers[l].speed      = speed;
+                engine.layers[l].play_phase = 0;
+            }
+            auto start = std::chrono::steady_clock::now();
+            for(size_t b = 0; b < blocks; b++)
+            {
+                if(fixed)
+                    engine.Process(in, out, block, 0);
+                else
+                    ProcessRuntime(engine, in, out, block);
+                checksum += out_l[0] + out_r[block - 1];
+            }
+            ns[fixed] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                        / (blocks * block);
+        }
+        printf("  %-10s %6d %6zu %8.1f %5.2f %12.2f %12.2f %10.1f %7.2f\n",
+               name,
+               Engine::kNumLayers,
+               block,
+               Engine::kPoolBytes / 1e6,
+               speed,
+               ns[0],
+               ns[1],
+               1e9 / ns[1] / kSampleRate,
+               ns[0] / ns[1]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    float  seconds  = argc > 1 ? atof(argv[1]) : 2.0f;
+    double checksum = 0.0;
+
+    InterpSinc::InitTable();
+    printf("# %-10s %6s %6s %8s %5s %12s %12s %10s %7s\n",
+           "config", "layers", "block", "pool MB", "speed", "runtime ns", "fixed ns", "x realtime", "gain");
+    Bench<LooperEngine<5, 33 * 48000, 48>>("5x33s", seconds, checksum);
+    Bench<LooperEngine<8, 20 * 48000, 48>>("8x20s", seconds, checksum);
+    Bench<LooperEngine<2, 20 * 48000, 4>>("2x20s/4", seconds, checksum);
+    printf("# ns per output frame; x realtime for the fixed engine; gain = runtime / fixed\n");
+    printf("# the fixed engine also runs the output stage (meters, limiter), the runtime loop does not\n");
+    printf("# checksum %g\n", checksum);
+    return 0;
+}
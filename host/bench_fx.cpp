@@ -0,0 +1,180 @@
+// Cost of the per-layer effects for five layers, in ns per 48-frame block and
+// share of the 1 ms budget: the filter with per-block coefficients against
+// the same filter run sample by sample with its coefficients worked out
+// every sample (as a per-sample effect chain with a smoothed cutoff does),
+// the delay, both together, and the bypass with everything off or rung out;
+// then the peak cost per layer the engine's FxBudget measures for each.
+//
+//   bench_fx [seconds_per_case]
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "layer_fx.h"
+#include "test_util.h"
+
+static constexpr size_t kBlock     = 48;
+static constexpr int    kNumLayers = 5;
+static constexpr float  kRate      = 48000.0f;
+static constexpr size_t kLine      = 32768;
+
+static TestRandom rng = {77};
+
+// The filter a sample at a time, coefficients from a per-sample smoothed cutoff
+struct SampleSvf
+{
+    float cutoff = 1000.0f, smoothed = 1000.0f, q = 0.707f, mix = 1.0f;
+    float ic1[2] = {0.0f, 0.0f}, ic2[2] = {0.0f, 0.0f};
+
+    void Process(float* l, float* r, size_t size)
+    {
+        float* io[2] = {l, r};
+        for(size_t i = 0; i < size; i++)
+        {
+            smoothed += 0.005f * (cutoff - smoothed);
+            float g  = tanf((float)M_PI * smoothed / kRate);
+            float a1 = 1.0f / (1.0f + g * (g + 1.0f / q));
+            float a2 = g * a1;
+            float a3 = g * a2;
+            for(int c = 0; c < 2; c++)
+            {
+                float v0 = io[c][i];
+                float v3 = v0 - ic2[c];
+                float v1 = a1 * ic1[c] + a2 * v3;
+                float v2 = ic2[c] + a2 * ic1[c] + a3 * v3;
+                ic1[c]   = 2.0f * v1 - ic1[c];
+                ic2[c]   = 2.0f * v2 - ic2[c];
+                io[c][i] = v0 + mix * (v2 - v0);
+            }
+        }
+    }
+};
+
+static float source[kNumLayers][2][kBlock];
+static float voice[kNumLayers][2][kBlock];
+
+template <typename F>
+static double NsPerBlock(float seconds, F body)
+{
+    size_t blocks = (size_t)(seconds * kRate) / kBlock;
+    auto   start  = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < blocks; b++)
+    {
+        for(int v = 0; v < kNumLayers; v++)
+            for(int c = 0; c < 2; c++)
+                for(size_t i = 0; i < kBlock; i++)
+                    voice[v][c][i] = source[v][c][i];
+        body(b);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / blocks;
+}
+
+static uint32_t HostNs()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void Report(const char* name, double ns, double base)
+{
+    printf("  %-26s %8.0f ns/block  %5.2f%% of 1 ms\n", name, ns - base, (ns - base) / 1e4);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 2.0f;
+    for(int v = 0; v < kNumLayers; v++)
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            source[v][0][i] = rng.Noise(0.5f);
+            source[v][1][i] = rng.Noise(0.5f);
+        }
+
+    std::vector<float> lines(kNumLayers * 2 * kLine);
+    LayerFx            fx[kNumLayers];
+    SampleSvf          svf[kNumLayers];
+    for(int v = 0; v < kNumLayers; v++)
+        fx[v].Init(&lines[v * 2 * kLine], kLine, kRate);
+
+    volatile float sink = 0.0f;
+    auto           run  = [&](size_t b) {
+        for(int v = 0; v < kNumLayers; v++)
+            fx[v].Process(voice[v][0], voice[v][1], kBlock, true);
+        sink = sink + voice[b % kNumLayers][0][b % kBlock];
+    };
+    auto set_all = [&](int param, float value) {
+        for(int v = 0; v < kNumLayers; v++)
+            fx[v].Set(param, value, kBlock);
+    };
+
+    // The copy into the voice buffers, taken off every case
+    double base = NsPerBlock(seconds, [&](size_t b) { sink = sink + voice[b % kNumLayers][0][b % kBlock]; });
+
+    double bypass = NsPerBlock(seconds, run);
+
+    set_all(kFxFilterMix, 1.0f);
+    double filter = NsPerBlock(seconds, [&](size_t b) {
+        set_all(kFxFilterCutoff, 400.0f + (float)(b % 64) * 50.0f);
+        run(b);
+    });
+    double per_sample = NsPerBlock(seconds, [&](size_t b) {
+        for(int v = 0; v < kNumLayers; v++)
+        {
+            svf[v].cutoff = 400.0f + (float)(b % 64) * 50.0f;
+            svf[v].Process(voice[v][0], voice[v][1], kBlock);
+        }
+        sink = sink + voice[b % kNumLayers][0][b % kBlock];
+    });
+
+    set_all(kFxDelaySend, 0.5f);
+    set_all(kFxDelayTime, 300.0f);
+    double both = NsPerBlock(seconds, run);
+    set_all(kFxFilterMix, 0.0f);
+    double delay = NsPerBlock(seconds, run);
+
+    // Send off and silent: rings out, then costs what the bypass does
+    set_all(kFxDelaySend, 0.0f);
+    size_t ring = 0;
+    while(fx[0].Running())
+    {
+        for(int v = 0; v < kNumLayers; v++)
+            fx[v].Process(voice[v][0], voice[v][1], kBlock, false);
+        ring++;
+    }
+    double idle = NsPerBlock(seconds, [&](size_t b) {
+        for(int v = 0; v < kNumLayers; v++)
+            fx[v].Process(voice[v][0], voice[v][1], kBlock, true);
+        sink = sink + voice[b % kNumLayers][0][b % kBlock];
+    });
+
+    printf("bench_fx: %d layers, %zu-frame blocks, %s delay kernel\n", kNumLayers, kBlock,
+           LOOPER_RESAMPLE_SIMD ? "SSE" : "scalar");
+    Report("all off", bypass, base);
+    Report("filter, per block", filter, base);
+    Report("filter, per sample", per_sample, base);
+    Report("delay", delay, base);
+    Report("filter + delay", both, base);
+    Report("delay rung out", idle, base);
+    printf("  tail rang out in %zu blocks; filter per block %.1fx faster\n", ring,
+           (per_sample - base) / (filter - base));
+
+    // What the engine's budget charges each: the peak of one layer's block,
+    // here in host ns rather than M7 cycles, and with whatever preempted the
+    // bench in it
+    FxBudget budget;
+    budget.Init(0, kBlock);
+    budget.clock = HostNs;
+    set_all(kFxFilterMix, 1.0f);
+    set_all(kFxDelaySend, 0.5f);
+    NsPerBlock(seconds, [&](size_t b) {
+        for(int v = 0; v < kNumLayers; v++)
+            fx[v].Process(voice[v][0], voice[v][1], kBlock, true, &budget);
+        sink = sink + voice[b % kNumLayers][0][b % kBlock];
+    });
+    printf("  budget charges per layer and block: filter %u ns, delay %u ns (peak)\n", budget.cost[kFxFilter],
+           budget.cost[kFxDelay]);
+    return 0;
+}
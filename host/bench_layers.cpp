@@ -0,0 +1,148 @@
+// Cycles-per-sample benchmark for the LooperLayer audio path.
+// Mirrors AudioCallback, with the engine's per-block loop run at the block
+// size of each case rather than the one compiled into LooperEngine.
+// Reports ns per output frame and frames per second
+// for 1-5 active layers across block sizes, speeds and input channels.
+//
+//   bench_layers [seconds_per_case]
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "looper_engine.h"
+#include "host_io.h"
+#include "test_util.h"
+
+static constexpr int    kNumLayers  = 5;
+static constexpr size_t kLoopFrames = 48000 * 4; // 4 s per layer
+static constexpr float  kSampleRate = 48000.0f;
+
+static const size_t kBlockSizes[] = {4, 8, 16, 32, 48, 64, 128, 256};
+static const float  kSpeeds[]     = {0.3f, 0.5f, 1.0f, 1.5f, 2.0f};
+
+static constexpr size_t kPoolBytes  = 32 * 1024 * 1024;
+
+// Cheap deterministic noise source for input material
+static TestRandom rng = {22222};
+
+// Record kLoopFrames of noise into a layer through the engine's record path
+static void RecordLayer(LooperLayer& layer, int channel)
+{
+    const size_t block = 48;
+    float        in_l[block], in_r[block], out_l[block], out_r[block];
+    const float* in[2]  = {in_l, in_r};
+    float*       out[2] = {out_l, out_r};
+
+    layer.Reset();
+    layer.StartTake(channel);
+    while(layer.write_idx < kLoopFrames)
+    {
+        for(size_t i = 0; i < block; i++)
+        {
+            in_l[i] = rng.Noise(0.5f);
+            in_r[i] = rng.Noise(0.5f);
+        }
+        layer.Render(in, out, block, 1.0f);
+    }
+    layer.StopRecord();
+}
+
+// LooperEngine::ProcessBlock() with a runtime block size
+static void ProcessBlock(EngineCore& engine, AudioIn in, AudioOut out, size_t block)
+{
+    engine.BeginBlock(in, block);
+    for(size_t i = 0; i < block; i++)
+        out[0][i] = out[1][i] = 0.0f;
+    for(int i = 0; i < engine.num_layers; i++)
+        engine.layers[i].Render(in, out, block, engine.master_gain);
+    engine.EndBlock(block, 0);
+}
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 0.5f;
+
+    InterpSinc::InitTable();
+
+    HostControls controls;
+    for(int i = 0; i < kNumLayers; i++)
+        controls.adc[kAdcLayerVol + i] = 0.3f;
+    controls.adc[kAdcMasterVol] = 0.3f;
+
+    ControlParams params;
+    params.Init();
+
+    std::vector<uint8_t> pool(kPoolBytes);
+    static LooperEngine<kNumLayers, kLoopFrames, 4> engine;
+    engine.Init(pool.data(), pool.size());
+    LooperLayer* layers = engine.layers;
+
+    std::vector<float> in_l(256, 0.0f), in_r(256, 0.0f);
+    std::vector<float> out_l(256), out_r(256);
+    const float*       in[2]  = {in_l.data(), in_r.data()};
+    float*             out[2] = {out_l.data(), out_r.data()};
+
+    double checksum = 0.0;
+    size_t frames   = (size_t)(seconds * kSampleRate);
+
+    printf("# %-6s %7s %6s %5s %12s %14s %10s\n",
+           "layers", "channel", "block", "speed", "ns/sample", "samples/sec", "x realtime");
+
+    for(int channel = 0; channel < 3; channel++)
+    {
+        // Time the record path on its own, then reuse the takes for playback
+        auto rec_start = std::chrono::steady_clock::now();
+        for(int i = 0; i < kNumLayers; i++)
+            RecordLayer(layers[i], channel);
+        double rec_ns = std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - rec_start)
+                            .count();
+        printf("# record ch%d: %.2f ns/sample\n",
+               channel,
+               rec_ns / (kNumLayers * kLoopFrames));
+
+        for(int active = 1; active <= kNumLayers; active++)
+        {
+            for(size_t block : kBlockSizes)
+            {
+                for(float speed : kSpeeds)
+                {
+                    params.Snapshot(&controls);
+                    engine.master_gain = params.master_gain;
+                    for(int i = 0; i < kNumLayers; i++)
+                    {
+                        layers[i].volume     = params.layer_gain[i];
+                        layers[i].speed      = speed;
+                        layers[i].play_phase = 0;
+                        layers[i].paused     = i >= active;
+                    }
+
+                    size_t blocks = frames / block;
+                    auto   start  = std::chrono::steady_clock::now();
+                    for(size_t b = 0; b < blocks; b++)
+                    {
+                        ProcessBlock(engine, in, out, block);
+                        checksum += out_l[0] + out_r[block - 1];
+                    }
+                    double ns = std::chrono::duration<double, std::nano>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count();
+
+                    double ns_per_sample = ns / (blocks * block);
+                    printf("  %-6d %7d %6zu %5.2f %12.2f %14.0f %10.1f\n",
+                           active,
+                           channel,
+                           block,
+                           speed,
+                           ns_per_sample,
+                           1e9 / ns_per_sample,
+                           1e9 / ns_per_sample / kSampleRate);
+                }
+            }
+        }
+    }
+
+    printf("# checksum %g\n", checksum);
+    return 0;
+}
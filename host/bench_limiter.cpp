@@ -0,0 +1,121 @@
+// Cost of the output stage that runs on every callback: the block level
+// kernel (SIMD against a plain scalar loop), the five per-layer meters plus
+// the master meter, and the lookahead limiter at unity gain (delay only) and
+// while limiting. ns per 48-frame block and the share of the 1 ms budget.
+//
+//   bench_limiter [seconds_per_case]
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "limiter.h"
+#include "meter.h"
+#include "test_util.h"
+
+static constexpr size_t kBlock     = 48;
+static constexpr int    kNumLayers = 5;
+
+static TestRandom rng = {2024};
+
+// The kernel as a plain loop, for comparison
+static BlockLevel MeasureScalar(const float* l, const float* r, size_t size, float gain_l, float gain_r)
+{
+    BlockLevel level = {0.0f, 0.0f, 0};
+    for(size_t i = 0; i < size; i++)
+    {
+        float a = fabsf(l[i] * gain_l);
+        float b = fabsf(r[i] * gain_r);
+        level.peak = fmaxf(level.peak, fmaxf(a, b));
+        level.sum_sq += a * a + b * b;
+        level.clips += (a >= 1.0f) + (b >= 1.0f);
+    }
+    return level;
+}
+
+static float buffers[kNumLayers][2][kBlock];
+static float out_l[kBlock], out_r[kBlock];
+
+template <typename F>
+static double NsPerBlock(float seconds, F body)
+{
+    size_t blocks = (size_t)(seconds * 48000.0f) / kBlock;
+    auto   start  = std::chrono::steady_clock::now();
+    for(size_t b = 0; b < blocks; b++)
+        body(b);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / blocks;
+}
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 2.0f;
+    for(int v = 0; v < kNumLayers; v++)
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            buffers[v][0][i] = rng.Noise(0.5f);
+            buffers[v][1][i] = rng.Noise(0.5f);
+        }
+
+    volatile float sink = 0.0f;
+    LevelMeter     meters[kNumLayers + 1];
+    for(LevelMeter& m : meters)
+        m.Init(1000.0f);
+    static Limiter<kBlock> limiter;
+    limiter.Init();
+    float* out[2] = {out_l, out_r};
+
+    double kernel_simd = NsPerBlock(seconds, [&](size_t b) {
+        sink = sink + MeasureBlock(buffers[b % kNumLayers][0], buffers[b % kNumLayers][1], kBlock, 0.7f, 0.9f).sum_sq;
+    });
+    double kernel_scalar = NsPerBlock(seconds, [&](size_t b) {
+        sink = sink + MeasureScalar(buffers[b % kNumLayers][0], buffers[b % kNumLayers][1], kBlock, 0.7f, 0.9f).sum_sq;
+    });
+    double metering = NsPerBlock(seconds, [&](size_t b) {
+        for(int v = 0; v < kNumLayers; v++)
+            meters[v].Add(MeasureBlock(buffers[v][0], buffers[v][1], kBlock, 0.7f, 0.9f), kBlock);
+        meters[kNumLayers].Add(MeasureBlock(out_l, out_r, kBlock), kBlock);
+    });
+
+    // Unity: a quiet mix, the limiter only delays it
+    double unity = NsPerBlock(seconds, [&](size_t b) {
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            out_l[i] = buffers[b % kNumLayers][0][i];
+            out_r[i] = buffers[b % kNumLayers][1][i];
+        }
+        limiter.Process(out, 0.5f);
+        sink = sink + out_l[0];
+    });
+    double copy = NsPerBlock(seconds, [&](size_t b) {
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            out_l[i] = buffers[b % kNumLayers][0][i];
+            out_r[i] = buffers[b % kNumLayers][1][i];
+        }
+        sink = sink + out_l[0];
+    });
+
+    // Limiting: peaks between 1.5x and 3x full scale, the gain ramps every block
+    uint32_t limited = limiter.limited_blocks;
+    double   hot     = NsPerBlock(seconds, [&](size_t b) {
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            out_l[i] = buffers[b % kNumLayers][0][i] * 4.0f;
+            out_r[i] = buffers[b % kNumLayers][1][i] * 4.0f;
+        }
+        limiter.Process(out, 1.5f + (float)(b % 4) * 0.5f);
+        sink = sink + out_l[0];
+    });
+    limited = limiter.limited_blocks - limited;
+
+    const double budget = kBlock * 1e9 / 48000.0;
+    printf("# ns per %zu-frame block (budget %.0f ns)\n", kBlock, budget);
+    printf("  %-28s %10.1f\n", "level kernel, scalar", kernel_scalar);
+    printf("  %-28s %10.1f %8.2fx\n", "level kernel, SIMD", kernel_simd, kernel_scalar / kernel_simd);
+    printf("  %-28s %10.1f %7.3f%%\n", "meters, 5 layers + master", metering, 100.0 * metering / budget);
+    printf("  %-28s %10.1f %7.3f%%\n", "limiter, unity (delay)", unity - copy, 100.0 * (unity - copy) / budget);
+    printf("  %-28s %10.1f %7.3f%%\n", "limiter, limiting", hot - copy, 100.0 * (hot - copy) / budget);
+    printf("# limiter cost excludes filling the block (%.1f ns); %u of the hot blocks limited\n", copy, limited);
+    printf("# sink %g, master peak %g\n", (double)sink, meters[kNumLayers].peak);
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Cost of the output mix against the number of audible layers.
+// Eight layers are configured, each with a 4 s stereo take; of the silent
+// ones half are paused and half are at zero volume. The engine's mix bus
+// (only audible layers render, one store per output sample) runs against the
+// per-layer path, where every layer mixes itself into out. A second engine
+// runs the per-layer path on the same takes to check the two are
+// bit-identical.
+//
+//   bench_mix [seconds_per_case]
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "looper_engine.h"
+#include "test_util.h"
+
+static constexpr int    kNumLayers  = 8;
+static constexpr size_t kBlock      = 48;
+static constexpr size_t kLoopFrames = 48000 * 4;
+static constexpr float  kSampleRate = 48000.0f;
+
+typedef LooperEngine<kNumLayers, kLoopFrames, kBlock> Engine;
+
+// Every layer renders itself into out, paused and silent ones included
+static void ProcessPerLayer(Engine& engine, AudioIn in, AudioOut out)
+{
+    engine.BeginBlock(in, kBlock);
+    for(size_t i = 0; i < kBlock; i++)
+        out[0][i] = out[1][i] = 0.0f;
+    for(int i = 0; i < kNumLayers; i++)
+        engine.layers[i].Render(in, out, kBlock, engine.master_gain);
+    engine.EndBlock(kBlock, 0);
+}
+
+// The engine's block without its output stage (meters, limiter): only
+// audible layers render, the bus sums them
+static void ProcessMixBus(Engine& engine, AudioIn in, AudioOut out)
+{
+    engine.BeginBlock(in, kBlock);
+    for(int i = 0; i < kNumLayers; i++)
+        if(engine.layer_array[i].RenderVoice(in, engine.bus.Next(), kBlock, engine.master_gain))
+            engine.bus.Add();
+    engine.bus.Mix(out);
+    engine.EndBlock(kBlock, 0);
+}
+
+static void Setup(Engine& engine, std::vector<uint8_t>& pool, int audible)
+{
+    engine.Init(pool.data(), pool.size());
+    engine.master_gain = 0.8f;
+    TestRandom rng     = {4242};
+    for(int l = 0; l < kNumLayers; l++)
+    {
+        LooperLayer& layer = engine.layers[l];
+        layer.storage.Begin(2);
+        for(size_t i = 0; i < kLoopFrames; i++)
+        {
+            float x = rng.Noise(0.5f);
+            layer.storage.Write(i, x, -x);
+        }
+        layer.record_len = layer.write_idx = kLoopFrames;
+        layer.recorded = true;
+        layer.speed    = l % 2 ? 1.5f : 1.0f;
+        layer.pan      = 0.2f + 0.08f * l;
+        layer.volume   = l < audible || l % 2 ? 0.5f : 0.0f;
+        layer.paused   = l >= audible && l % 2;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 1.0f;
+    InterpSinc::InitTable();
+
+    std::vector<uint8_t> pool(Engine::kPoolBytes), check_pool(Engine::kPoolBytes);
+    static Engine        engine, check;
+
+    float        in_l[kBlock] = {}, in_r[kBlock] = {};
+    float        out_l[kBlock], out_r[kBlock], ref_l[kBlock], ref_r[kBlock];
+    const float* in[2]  = {in_l, in_r};
+    float*       out[2] = {out_l, out_r};
+    float*       ref[2] = {ref_l, ref_r};
+    size_t       blocks = (size_t)(seconds * kSampleRate) / kBlock;
+    double       checksum = 0.0;
+
+    printf("# %d layers configured, block %zu\n", kNumLayers, kBlock);
+    printf("# %-8s %14s %14s %8s %10s\n", "audible", "per-layer ns", "mix bus ns", "gain", "identical");
+    for(int audible = 0; audible <= kNumLayers; audible++)
+    {
+        Setup(engine, pool, audible);
+        Setup(check, check_pool, audible);
+        bool identical = true;
+        for(int b = 0; b < 2000; b++)
+        {
+            ProcessMixBus(engine, in, out);
+            ProcessPerLayer(check, in, ref);
+            identical = identical && memcmp(out_l, ref_l, sizeof(out_l)) == 0 && memcmp(out_r, ref_r, sizeof(out_r)) == 0;
+        }
+
+        double ns[2];
+        for(int fused = 0; fused < 2; fused++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for(size_t b = 0; b < blocks; b++)
+            {
+                if(fused)
+                    ProcessMixBus(engine, in, out);
+                else
+                    ProcessPerLayer(engine, in, out);
+                checksum += out_l[0] + out_r[kBlock - 1];
+            }
+            ns[fused] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                        / (blocks * kBlock);
+        }
+        printf("  %-8d %14.2f %14.2f %8.2f %10s\n", audible, ns[0], ns[1], ns[0] / ns[1], identical ? "yes" : "NO");
+    }
+    printf("# ns per output frame for the whole block: commands, every layer and the mix\n");
+    printf("# checksum %g\n", checksum);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Overdub with undo: ns per 48-frame block of one overdubbing layer through
+// the engine, the blocks where the head enters a storage block it has not
+// written this pass against the rest, and what copying a whole storage block
+// in one go costs on its own (what each of those blocks paid before the copy
+// was spread ahead of the head).
+//
+//   bench_overdub [passes]
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+static TestRandom rng = {4242};
+
+static double Percentile(std::vector<double> v, double p)
+{
+    if(v.empty())
+        return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (double)(v.size() - 1))];
+}
+
+int main(int argc, char** argv)
+{
+    int passes = argc > 1 ? atoi(argv[1]) : 4;
+
+    InterpSinc::InitTable();
+    LooperRig<kBlock> rig(256);
+    LooperLayer&      layer = rig.layers[0];
+    layer.StartTake(2);
+    for(int f = 0; f < 48000 * 8; f++)
+        layer.RecordFrame(rng.Noise(0.5f), rng.Noise(0.5f));
+    layer.StopRecord();
+
+    const float*        in[2]  = {rig.in_l, rig.in_r};
+    float*              out[2] = {rig.out_l, rig.out_r};
+    std::vector<double> entering, other;
+    for(int pass = 0; pass < passes; pass++)
+    {
+        layer.StartOverdub(2);
+        size_t blocks = layer.record_len / kBlock;
+        for(size_t b = 0; b < blocks; b++)
+        {
+            for(size_t i = 0; i < kBlock; i++)
+            {
+                rig.in_l[i] = rng.Noise(0.5f);
+                rig.in_r[i] = rng.Noise(0.5f);
+            }
+            size_t entries = layer.history.num_entries;
+            auto   start   = std::chrono::steady_clock::now();
+            rig.engine.Process(in, out, kBlock, rig.controls.now_us += 1000);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            (layer.history.num_entries != entries ? entering : other).push_back(ns);
+        }
+        layer.StopRecord();
+        for(int b = 0; b < 100 && layer.overdubbing; b++)
+            rig.engine.Process(in, out, kBlock, rig.controls.now_us += 1000);
+    }
+
+    // A whole storage block, SDRAM to SDRAM on the Seed
+    std::vector<uint8_t> from(kArenaBlockBytes, 1), to(kArenaBlockBytes);
+    std::vector<double>  copies;
+    for(int i = 0; i < 1000; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        memcpy(to.data(), from.data(), kArenaBlockBytes);
+        copies.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+        from[i % kArenaBlockBytes] = to[(i * 7) % kArenaBlockBytes];
+    }
+
+    printf("bench_overdub: one layer, %zu-frame blocks, %d passes of %.1f s, %zu-byte storage blocks\n", kBlock, passes,
+           layer.record_len / 48000.0, kArenaBlockBytes);
+    printf("  %-30s %6zu blocks  median %7.0f ns  p99 %7.0f ns\n", "entering an unwritten block", entering.size(),
+           Percentile(entering, 0.5), Percentile(entering, 0.99));
+    printf("  %-30s %6zu blocks  median %7.0f ns  p99 %7.0f ns\n", "the rest", other.size(), Percentile(other, 0.5),
+           Percentile(other, 0.99));
+    printf("  %-30s %u of %zu\n", "copied in one go", layer.history.whole_copies, entering.size());
+    printf("  %-30s median %7.0f ns\n", "one whole block copied", Percentile(copies, 0.5));
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Session save/restore timing on a simulated SD card.
+// Saves five stereo layers through the file-backed device, then boots a fresh
+// looper from the file. Time advances by the device's simulated transfer time
+// for each main-loop Poll() and by 1 ms per audio callback, so the figures
+// reflect the card's throughput rather than the host's page cache.
+// Reports time to the first audible block of each layer against the time to
+// load everything, plus the host cost of the audio-side AudioService().
+//
+//   bench_persist [seconds_per_layer]
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "session_store.h"
+#include "host_io.h"
+#include "test_util.h"
+
+static const size_t kBlock     = 48;
+static const double kBlockSec  = kBlock / 48000.0;
+static const int    kNumLayers = 5;
+static std::string  path       = std::string(P_tmpdir) + "/looper_bench_persist.bin";
+
+static TestRandom rng = {5};
+
+struct Box
+{
+    std::vector<uint8_t>      pool;
+    SampleArena               arena;
+    LooperLayer               layers[kNumLayers];
+    std::vector<PersistChunk> chunks;
+    HostFileDevice            device;
+    SessionStore              store;
+
+    double time_sec    = 0.0;
+    double next_block  = 0.0;
+    double service_max = 0.0; // host ns
+    int    first_audio[kNumLayers];
+
+    Box(size_t pool_bytes, bool truncate, double bytes_per_sec) : pool(pool_bytes), chunks(kPersistChunks)
+    {
+        arena.Init(pool.data(), pool.size());
+        for(int i = 0; i < kNumLayers; i++)
+        {
+            layers[i].Init(&arena);
+            first_audio[i] = -1;
+        }
+        device.Open(path.c_str(), truncate);
+        device.bytes_per_sec = bytes_per_sec;
+        store.Init(&device, layers, kNumLayers, chunks.data());
+    }
+
+    // Run every audio callback due by now
+    void Callbacks()
+    {
+        while(next_block <= time_sec)
+        {
+            auto start = std::chrono::steady_clock::now();
+            store.AudioService();
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            service_max = ns > service_max ? ns : service_max;
+
+            float out_l[kBlock], out_r[kBlock];
+            for(int i = 0; i < kNumLayers; i++)
+            {
+                for(size_t k = 0; k < kBlock; k++)
+                    out_l[k] = out_r[k] = 0.0f;
+                float*       out[2] = {out_l, out_r};
+                const float* in[2]  = {out_l, out_r};
+                layers[i].Render(in, out, kBlock, 1.0f);
+                if(first_audio[i] < 0 && out_l[kBlock - 1] != 0.0f)
+                    first_audio[i] = (int)(next_block * 1000.0 + 0.5);
+            }
+            next_block += kBlockSec;
+        }
+    }
+
+    // The idle main loop until the store goes idle; returns the elapsed time
+    double RunMainLoop()
+    {
+        double start = time_sec;
+        while(store.Busy())
+        {
+            double busy = device.busy_sec;
+            store.Poll();
+            // Nothing to do until the next callback hands over more work
+            time_sec = device.busy_sec > busy ? time_sec + (device.busy_sec - busy) : next_block;
+            Callbacks();
+        }
+        return time_sec - start;
+    }
+};
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 20.0f;
+    size_t frames = (size_t)(seconds * 48000.0f);
+    size_t pool   = (kNumLayers * frames * 2 * LoopFormat::kBytes / kArenaBlockBytes + kNumLayers + 1) * kArenaBlockBytes;
+
+    InterpSinc::InitTable();
+    printf("# %d stereo layers of %.0f s, %.1f MB of audio\n",
+           kNumLayers, seconds, kNumLayers * frames * 2.0 * LoopFormat::kBytes / 1e6);
+    printf("# %-8s %8s %12s %12s %12s %14s\n", "MB/s", "save s", "first ms", "all ms", "loaded ms", "service max ns");
+
+    const double rates[] = {4e6, 10e6, 20e6};
+    for(double rate : rates)
+    {
+        double save_sec;
+        {
+            Box box(pool, true, rate);
+            for(int l = 0; l < kNumLayers; l++)
+            {
+                LooperLayer& layer = box.layers[l];
+                layer.storage.Begin(2);
+                for(size_t i = 0; i < frames; i++)
+                    layer.storage.Write(i, rng.Noise(0.5f), rng.Noise(0.5f));
+                layer.record_len = layer.write_idx = frames;
+                layer.recorded = true;
+            }
+            box.store.RequestSave();
+            save_sec = box.RunMainLoop();
+        }
+
+        // Boot: header read, then the lazy restore
+        Box boot(pool, false, rate);
+        boot.store.BeginLoad();
+        boot.time_sec = boot.device.busy_sec;
+        boot.RunMainLoop();
+
+        int first = 1 << 30, all = 0;
+        for(int l = 0; l < kNumLayers; l++)
+        {
+            first = boot.first_audio[l] < first ? boot.first_audio[l] : first;
+            all   = boot.first_audio[l] > all ? boot.first_audio[l] : all;
+        }
+        printf("  %-8.0f %8.2f %12d %12d %12.0f %14.0f\n",
+               rate / 1e6,
+               save_sec,
+               first,
+               all,
+               boot.time_sec * 1000.0,
+               boot.service_max);
+    }
+    printf("# first/all: ms after boot until the first / every layer is audible;\n"
+           "# loaded: ms until every layer is fully resident (an eager load's time to first audio)\n");
+    remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,87 @@
+// The built-in profiler on the host (built with LOOPER_PROFILE=1).
+// Five playing layers, one overdubbing and one in hold+turn with the speed
+// knob sweeping, driven like the firmware: a control task tick, then an
+// audio block. Prints the per-stage table the firmware sends over USB serial
+// and the cost of one profiler lap.
+//
+//   bench_profile [seconds]
+
+#include <stdlib.h>
+#include "looper_rig.h"
+#include "profiler.h"
+#include "test_util.h"
+
+static const size_t kBlock     = 48;
+static const int    kNumLayers = 5;
+
+static const char* const kAudioStageNames[]   = {"session", "commands", "layer1", "layer2", "layer3", "layer4", "layer5", "output"};
+static const char* const kControlStageNames[] = {"control", "leds", "spi", "storage"};
+
+static TestRandom rng = {777};
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 5.0f;
+
+    InterpSinc::InitTable();
+    LooperRig<kBlock, kNumLayers> rig(1024);
+    for(int i = 0; i < kNumLayers; i++)
+    {
+        LooperLayer& layer = rig.layers[i];
+        layer.StartTake(2);
+        for(int f = 0; f < 48000 * 3 + 1000 * i; f++)
+            layer.RecordFrame(rng.Noise(0.5f), rng.Noise(0.5f));
+        layer.StopRecord();
+    }
+    for(int i = 0; i < kControlLayers; i++)
+        rig.controls.adc[kAdcLayerVol + i] = 0.3f;
+    rig.layers[0].StartOverdub(2);
+    rig.layer_buttons[2].Press(); // hold+turn on layer 3
+
+    audio_profiler.Init(kAudioStageNames, kProfileLayer0 + kNumLayers + 1, kBlock * 1e6f / 48000.0f);
+    control_profiler.Init(kControlStageNames, 4, 1000.0f);
+
+    size_t blocks = (size_t)(seconds * 1000.0f);
+    for(size_t b = 0; b < blocks; b++)
+    {
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            rig.in_l[i] = rng.Noise(0.5f);
+            rig.in_r[i] = rng.Noise(0.5f);
+        }
+        rig.controls.adc[kAdcSpeed] = 0.5f + 0.5f * (float)((b / 10) % 100) / 100.0f;
+        rig.controls.now_ms += 1;
+        rig.controls.now_us += 1000;
+        rig.layer_buttons[2].Tick(1.0f);
+
+        PROFILE_BEGIN(control_profiler);
+        rig.control.Update();
+        PROFILE_LAP(control_profiler, kProfileControl);
+        PROFILE_END(control_profiler);
+
+        const float* in[2]  = {rig.in_l, rig.in_r};
+        float*       out[2] = {rig.out_l, rig.out_r};
+        PROFILE_BEGIN(audio_profiler);
+        PROFILE_LAP(audio_profiler, kProfileSession);
+        rig.engine.Process(in, out, kBlock, rig.controls.now_us);
+        PROFILE_END(audio_profiler);
+    }
+
+    static char report[1024];
+    audio_profiler.Format(report, sizeof(report));
+    printf("# audio callback, %zu-frame blocks, ticks = ns\n%s", kBlock, report);
+    control_profiler.Format(report, sizeof(report));
+    printf("# control task\n%s", report);
+
+    // What one lap costs: the whole overhead of the enabled profiler per stage
+    Profiler probe;
+    probe.Init(kAudioStageNames, 1, 1000.0f);
+    const int kLaps = 1000000;
+    uint32_t  t0    = Profiler::Now();
+    for(int i = 0; i < kLaps; i++)
+        probe.Lap(0);
+    printf("# one lap: %.1f ns; speed commands sent: %u\n",
+           (double)(Profiler::Now() - t0) / kLaps,
+           (unsigned)rig.engine.stats.commands);
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Cost of one time-stretching layer against varispeed playback of the same
+// take, per 48-frame block: average and 99th-percentile block, and how many
+// such layers fit the block's real-time budget on this machine at the
+// percentile. The search is spread over the blocks of each grain hop, so the
+// slow blocks should stay close to the average.
+//
+//   bench_stretch [seconds_per_case]
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "looper_layer.h"
+
+static constexpr size_t kBlock      = 48;
+static constexpr size_t kTakeFrames = 48000 * 4;
+static const float      kSpeeds[]   = {0.5f, 0.75f, 1.5f, 2.0f};
+
+int main(int argc, char** argv)
+{
+    float seconds = argc > 1 ? atof(argv[1]) : 2.0f;
+    InterpSinc::InitTable();
+    TimeStretch::InitTable();
+
+    std::vector<uint8_t> pool(512 * kArenaBlockBytes);
+    SampleArena          arena;
+    arena.Init(pool.data(), pool.size());
+    static LooperLayer layer;
+    layer.Init(&arena);
+    layer.storage.Begin(2);
+    for(size_t i = 0; i < kTakeFrames; i++)
+    {
+        // A chord of decaying partials, re-struck every 0.5 s
+        float t = (i % 24000) / 48000.0f, x = 0.0f;
+        for(int k = 1; k <= 6; k++)
+            x += sinf(2.0f * 3.14159265f * 146.8f * k * t) * expf(-3.0f * k * t) / k;
+        layer.storage.Write(i, 0.3f * x, 0.25f * x);
+    }
+    layer.record_len = layer.write_idx = kTakeFrames;
+    layer.recorded = true;
+
+    float        in_l[kBlock] = {}, in_r[kBlock] = {}, out_l[kBlock], out_r[kBlock];
+    const float* in[2]    = {in_l, in_r};
+    float*       out[2]   = {out_l, out_r};
+    size_t       blocks   = (size_t)(seconds * 48000.0f) / kBlock;
+    double       budget   = kBlock / 48000.0 * 1e9;
+    double       checksum = 0.0;
+
+    printf("# one stereo layer, block %zu (%.0f ns budget)\n", kBlock, budget);
+    printf("# %-5s %-10s %12s %12s %12s %8s\n", "speed", "mode", "avg ns", "p99 ns", "ns/frame", "layers");
+    for(float speed : kSpeeds)
+    {
+        for(int stretch = 0; stretch < 2; stretch++)
+        {
+            layer.speed      = speed;
+            layer.stretch    = stretch != 0;
+            layer.play_phase = 0;
+            double              total = 0.0;
+            std::vector<double> times(blocks);
+            for(size_t b = 0; b < blocks; b++)
+            {
+                for(size_t i = 0; i < kBlock; i++)
+                    out_l[i] = out_r[i] = 0.0f;
+                auto start = std::chrono::steady_clock::now();
+                layer.Render(in, out, kBlock, 1.0f);
+                double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                total += ns;
+                times[b] = ns;
+                checksum += out_l[0] + out_r[kBlock - 1];
+            }
+            std::sort(times.begin(), times.end());
+            double p99 = times[blocks * 99 / 100];
+            printf("  %-5.2f %-10s %12.0f %12.0f %12.2f %8.0f\n",
+                   speed,
+                   stretch ? "stretch" : "varispeed",
+                   total / blocks,
+                   p99,
+                   total / blocks / kBlock,
+                   budget / p99);
+        }
+    }
+    const StretchStats& s = layer.stretcher.stats;
+    printf("# search: at most %u of %d candidates in one block, %u of %u hops finished late\n",
+           s.max_block_units, kStretchCoarse + kStretchFine, s.late, s.grains);
+    printf("# layers: how many fit the block budget at the p99 block on this host\n");
+    printf("# checksum %g\n", checksum);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// MIDI clock sync under read jitter: a stream (built in, or a capture file)
+// replayed through the control task and engine at several jitter and stall
+// levels. For each: the tempo the tracker settles on, the error of the beat
+// grid it sends the engine against the true beats, and how far a one-bar
+// layer recorded on the grid sits from them with and without grid lock.
+//
+//   clock_sync [capture.txt]      capture format in midi_stream.h
+//
+// The built-in stream is 120 bpm for 20 s, 121.2 for 40 s, then 118.8; the
+// errors are taken once the tracker has caught up with each change (a
+// capture is measured throughout, after the first 8 s).
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "midi_stream.h"
+
+typedef LooperRig<48, 1> Rig;
+
+struct Level
+{
+    const char* name;
+    double      jitter_us;
+    double      stall_us;
+    int         stall_every;
+};
+
+static const Level kLevels[] = {
+    {"none", 0.0, 0.0, 0},
+    {"usb 1 ms", 1000.0, 0.0, 0},
+    {"usb 1 ms + sd 3 ms 1/64", 1000.0, 3000.0, 64},
+    {"uart 0.1 ms", 100.0, 0.0, 0},
+    {"2 ms", 2000.0, 0.0, 0},
+};
+
+struct Stats
+{
+    double sum = 0.0, worst = 0.0;
+    int    n   = 0;
+
+    void   Add(double e) { sum += e * e, worst = fmax(worst, fabs(e)), n++; }
+    double Rms() const { return n > 0 ? sqrt(sum / n) : 0.0; }
+};
+
+static std::vector<double> tempo_changes_us;
+
+// Skip the first 8 s, and from the beat before each tempo change to 8 s after
+static bool Measured(const MidiStream& stream, double us)
+{
+    if(us < stream.events.front().us + 8e6)
+        return false;
+    for(double change : tempo_changes_us)
+        if(us > change - 1e6 && us < change + 8e6)
+            return false;
+    return true;
+}
+
+static void Run(const MidiStream& stream, const Level& level, bool lock, Stats& grid, Stats& layer, float& bpm)
+{
+    Rig             rig(64, 65536);
+    MidiReplay<Rig> replay(rig, stream);
+    replay.jitter_us      = level.jitter_us;
+    replay.stall_us       = level.stall_us;
+    replay.stall_every    = level.stall_every;
+    rig.control.grid_lock = lock;
+
+    // One bar from the first bar line after 4 s
+    double start_us = stream.events.front().us;
+    double end_us   = stream.events.back().us;
+    size_t bar      = 0;
+    while(bar < stream.beats_us.size() && stream.beats_us[bar] < start_us + 4e6)
+        bar += 4;
+    bool pressed = false, released = false;
+
+    while(rig.controls.now_us < end_us)
+    {
+        replay.Step();
+        double now_us = rig.controls.now_us;
+        if(!pressed && bar + 4 < stream.beats_us.size() && now_us >= stream.beats_us[bar] - 50000.0)
+            rig.record.Press(), pressed = true;
+        if(pressed && !released && now_us >= stream.beats_us[bar + 4])
+            rig.record.Release(), released = true;
+        if(!Measured(stream, now_us))
+            continue;
+
+        const ClockGrid& g = rig.engine.grid;
+        if(g.active && rig.controls.now_us % 100000 == 0)
+            grid.Add((TrueBeat(stream, g.frame) - g.beat) * g.frames_per_beat);
+
+        const LooperLayer& l = rig.layers[0];
+        if(l.sync_beats > 0 && !l.recording)
+        {
+            double len  = (double)l.record_len;
+            double beat = TrueBeat(stream, rig.engine.Now() + rig.engine.output_delay);
+            double want = fmod(beat - l.sync_start, l.sync_beats) / l.sync_beats * len;
+            double err  = (double)l.play_phase * (1.0 / 4294967296.0) - want;
+            layer.Add(err > 0.5 * len ? err - len : (err < -0.5 * len ? err + len : err));
+        }
+    }
+    bpm = rig.control.midi.Bpm();
+}
+
+int main(int argc, char** argv)
+{
+    InterpSinc::InitTable();
+    TimeStretch::InitTable();
+
+    MidiStream stream;
+    if(argc > 1)
+    {
+        if(!stream.Load(argv[1]) || stream.beats_us.size() < 16)
+        {
+            fprintf(stderr, "clock_sync: cannot read a clock stream from %s\n", argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        stream.Start(20000.0, 120.0f, 20.0);
+        stream.Continue(121.2f, 40.0);
+        stream.Continue(118.8f, 30.0);
+        tempo_changes_us = {20e6, 60e6};
+    }
+
+    printf("# %zu beats over %.1f s; errors in frames at 48 kHz (48 = 1 ms)\n", stream.beats_us.size(),
+           (stream.events.back().us - stream.events.front().us) * 1e-6);
+    printf("# %-26s %8s %16s %18s %18s\n", "read delay", "bpm", "grid rms/max", "locked rms/max", "free rms/max");
+    for(const Level& level : kLevels)
+    {
+        Stats grid, locked, free_running, unused;
+        float bpm = 0.0f, unused_bpm;
+        Run(stream, level, true, grid, locked, bpm);
+        Run(stream, level, false, unused, free_running, unused_bpm);
+        printf("  %-26s %8.2f %7.1f %8.1f %8.1f %9.1f %8.0f %9.0f\n", level.name, bpm, grid.Rms(), grid.worst,
+               locked.Rms(), locked.worst, free_running.Rms(), free_running.worst);
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "../control_io.h"
+
+// Host stand-ins for the control/IO interfaces. Values are set directly by
+// the benchmark or test driving the looper.
+
+struct HostButton : ButtonInput
+{
+    bool  pressed     = false;
+    float held_ms     = 0.0f;
+    float released_ms = 0.0f;
+
+    void  Debounce() override {}
+    bool  Pressed() const override { return pressed; }
+    float TimeHeldMs() const override { return pressed ? held_ms : 0.0f; }
+    float TimeReleasedMs() const override { return pressed ? 0.0f : released_ms; }
+
+    // ago_ms: the edge happened that long before the next Tick()
+    void Press(float ago_ms = 0.0f) { pressed = true; held_ms = ago_ms; }
+    void Release(float ago_ms = 0.0f) { pressed = false; released_ms = ago_ms; }
+
+    // Advance the edge timers by one audio block
+    void Tick(float block_ms)
+    {
+        if(pressed)
+            held_ms += block_ms;
+        else
+            released_ms += block_ms;
+    }
+};
+
+struct HostControls : ControlInput
+{
+    // Raw ADC readings, pots are wired inverted so 1.0 = knob fully down
+    float    adc[kNumAdcChannels] = {0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    uint32_t now_ms               = 0;
+    uint32_t now_us               = 0;
+
+    float    GetAdc(int channel) const override { return adc[channel]; }
+    uint32_t NowMs() const override { return now_ms; }
+    uint32_t NowUs() const override { return now_us; }
+};
+
+// StorageDevice backed by a host file. Also keeps a simulated device clock
+// (per-operation latency plus transfer time) so tests can report timings for
+// SD-card-like throughput independent of the host's page cache.
+struct HostFileDevice : StorageDevice
+{
+    FILE*  file           = nullptr;
+    double bytes_per_sec  = 10e6;   // sustained transfer rate
+    double op_latency_sec = 0.5e-3; // per read/write/flush
+    double busy_sec       = 0.0;    // simulated time spent in the device
+
+    bool Open(const char* path, bool truncate)
+    {
+        Close();
+        file = fopen(path, truncate ? "w+b" : "r+b");
+        if(file == nullptr && !truncate)
+            file = fopen(path, "w+b");
+        return file != nullptr;
+    }
+
+    void Close()
+    {
+        if(file != nullptr)
+            fclose(file);
+        file = nullptr;
+    }
+
+    ~HostFileDevice() override { Close(); }
+
+    bool Read(uint32_t offset, void* dst, size_t bytes) override
+    {
+        busy_sec += op_latency_sec + bytes / bytes_per_sec;
+        return file != nullptr && fseek(file, offset, SEEK_SET) == 0 && fread(dst, 1, bytes, file) == bytes;
+    }
+
+    bool Write(uint32_t offset, const void* src, size_t bytes) override
+    {
+        busy_sec += op_latency_sec + bytes / bytes_per_sec;
+        return file != nullptr && fseek(file, offset, SEEK_SET) == 0 && fwrite(src, 1, bytes, file) == bytes;
+    }
+
+    bool Flush() override
+    {
+        busy_sec += op_latency_sec;
+        return file != nullptr && fflush(file) == 0;
+    }
+};
+
+// StorageDevice held in memory that takes simulated time, for driving the
+// main-loop side of storage code against a card of a given speed. Each
+// operation costs latency_us plus its bytes at bytes_per_sec, and every
+// stall_every-th one stall_us more (the card's own housekeeping). The main
+// loop is blocked for that long while the audio callback keeps running, so
+// `wait` is called once for every tick_us that passes: the caller runs its
+// audio blocks (and advances its clock) there.
+struct HostBlockDevice : StorageDevice
+{
+    std::vector<uint8_t> image;
+    double               latency_us    = 500.0;
+    double               bytes_per_sec = 10e6;
+    double               stall_us      = 0.0;
+    int                  stall_every   = 0;
+    bool                 failing       = false; // every operation fails
+
+    std::function<void()> wait;
+    double                tick_us = 1000.0;
+
+    uint32_t ops     = 0;
+    double   busy_us = 0.0;
+    double   owed_us = 0.0; // blocked time not yet a whole tick
+
+    void Spend(size_t bytes)
+    {
+        ops++;
+        double us = latency_us + bytes * 1e6 / bytes_per_sec;
+        if(stall_every > 0 && ops % stall_every == 0)
+            us += stall_us;
+        busy_us += us;
+        owed_us += us;
+        for(; owed_us >= tick_us; owed_us -= tick_us)
+            if(wait)
+                wait();
+    }
+
+    bool Read(uint32_t offset, void* dst, size_t bytes) override
+    {
+        Spend(bytes);
+        if(failing || (size_t)offset + bytes > image.size())
+            return false;
+        memcpy(dst, image.data() + offset, bytes);
+        return true;
+    }
+
+    bool Write(uint32_t offset, const void* src, size_t bytes) override
+    {
+        Spend(bytes);
+        if(failing)
+            return false;
+        if((size_t)offset + bytes > image.size())
+            image.resize(offset + bytes);
+        memcpy(image.data() + offset, src, bytes);
+        return true;
+    }
+
+    bool Flush() override
+    {
+        Spend(0);
+        return !failing;
+    }
+};
+
+// SpiOutput that records every frame. A transfer stays in flight for
+// `busy_polls` Busy() calls, standing in for the DMA completing later.
+struct MockSpi : SpiOutput
+{
+    std::vector<std::vector<uint8_t>> frames;
+    int                               busy_polls = 0;
+    mutable int                       in_flight  = 0;
+
+    bool Busy() const override
+    {
+        if(in_flight == 0)
+            return false;
+        in_flight--;
+        return true;
+    }
+
+    void Transmit(const uint8_t* data, size_t bytes) override
+    {
+        frames.push_back(std::vector<uint8_t>(data, data + bytes));
+        in_flight = busy_polls;
+    }
+};
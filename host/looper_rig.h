@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include "looper_control.h"
+#include "looper_engine.h"
+#include "host_io.h"
+
+// The firmware's split on the host: one control task update, then one audio
+// block through the engine, per millisecond. Tests press the buttons and set
+// the knobs, then Run() blocks.
+template <size_t Block, int NumLayers = 1>
+struct LooperRig
+{
+    typedef LooperEngine<NumLayers, 48000 * 60, Block> Engine;
+
+    std::vector<uint8_t> pool;
+    std::vector<float>   preroll;
+    std::vector<float>   delay;
+    Engine               engine;
+    LooperLayer*         layers;
+    SampleArena&         arena;
+    LooperControl        control;
+    HostControls         controls;
+    HostButton           record, channel, bypass;
+    HostButton           layer_buttons[kControlLayers];
+    float                in_l[Block], in_r[Block], out_l[Block], out_r[Block];
+    int                  events = 0; // ControlEvent bits raised since the last Run()
+
+    // preroll_frames: power of two, 0 to record from the long press only;
+    // delay_frames: per layer, power of two, 0 for no delay effect
+    explicit LooperRig(size_t pool_blocks, size_t preroll_frames = 0, size_t delay_frames = 0)
+        : pool(pool_blocks * kArenaBlockBytes), preroll(2 * preroll_frames), delay(NumLayers * 2 * delay_frames),
+          layers(engine.layer_array), arena(engine.arena)
+    {
+        engine.Init(pool.data(), pool.size(), preroll_frames > 0 ? preroll.data() : nullptr, preroll_frames,
+                    delay_frames > 0 ? delay.data() : nullptr, delay_frames);
+
+        ControlButtons buttons;
+        buttons.record = &record;
+        for(int i = 0; i < kControlLayers; i++)
+            buttons.layer[i] = &layer_buttons[i];
+        buttons.channel = &channel;
+        buttons.bypass  = &bypass;
+        control.Init(&engine, &controls, buttons);
+    }
+
+    // One millisecond: control tick, then the audio block in in_l/in_r
+    void Step()
+    {
+        const float* in[2]  = {in_l, in_r};
+        float*       out[2] = {out_l, out_r};
+        controls.now_ms += 1;
+        controls.now_us += 1000;
+        record.Tick(1.0f);
+        channel.Tick(1.0f);
+        bypass.Tick(1.0f);
+        for(int i = 0; i < kControlLayers; i++)
+            layer_buttons[i].Tick(1.0f);
+        events = control.Update();
+        engine.Process(in, out, Block, controls.now_us);
+    }
+
+    void Run(float input_l, float input_r)
+    {
+        for(size_t i = 0; i < Block; i++)
+        {
+            in_l[i] = input_l;
+            in_r[i] = input_r;
+        }
+        Step();
+    }
+
+    void Run(float input = 0.0f) { Run(input, -input); }
+
+    // Long press of the record button held for `blocks` blocks, then released
+    void Hold(size_t blocks, float input)
+    {
+        record.Press();
+        for(size_t b = 0; b < blocks; b++)
+            Run(input);
+        record.Release();
+        Run(input);
+    }
+
+    void Click(HostButton& button)
+    {
+        button.Press();
+        Run();
+        button.Release();
+        Run();
+    }
+
+    void Click() { Click(record); }
+
+    // A command straight into the engine's queue, bypassing the control task:
+    // stamped now, or at `frame`; records from `channel` (2 = Line)
+    bool Send(CommandType type, int layer, float value = 0.0f, int arg = 0)
+    {
+        return SendAt(engine.Now(), type, layer, value, arg);
+    }
+
+    bool SendAt(uint32_t frame, CommandType type, int layer, float value = 0.0f, int arg = 0, int channel = 2)
+    {
+        LooperCommand cmd = {frame, (uint8_t)type, (uint8_t)layer, (uint8_t)channel, (uint8_t)arg, value};
+        return engine.Send(cmd);
+    }
+};
@@ -0,0 +1,43 @@
+// Convert a WAV file to a stream file for a streaming layer (layer_stream.h),
+// in the sample format this build stores loops in. Copy it to the card as
+// backing.bin to have it play on the last layer at boot.
+//
+//   make_stream in.wav backing.bin [mono]
+
+#include <stdio.h>
+#include <string.h>
+#include "stream_rig.h"
+#include "wav.h"
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: make_stream in.wav out.bin [mono]\n");
+        return 1;
+    }
+
+    std::vector<float> stereo;
+    WavInfo            info;
+    if(!ReadWav(argv[1], stereo, info) || stereo.empty())
+    {
+        fprintf(stderr, "make_stream: cannot read %s\n", argv[1]);
+        return 1;
+    }
+    if(info.sample_rate != 48000)
+        fprintf(stderr, "make_stream: %s is %u Hz, it will play at 48000 Hz\n", argv[1], info.sample_rate);
+
+    int                  channels = argc > 3 && strcmp(argv[3], "mono") == 0 ? 1 : 2;
+    std::vector<uint8_t> image    = MakeStreamImage(stereo, channels);
+    FILE*                f        = fopen(argv[2], "wb");
+    bool                 ok       = f != nullptr && fwrite(image.data(), 1, image.size(), f) == image.size();
+    if(f != nullptr)
+        ok = fclose(f) == 0 && ok;
+    if(!ok)
+    {
+        fprintf(stderr, "make_stream: cannot write %s\n", argv[2]);
+        return 1;
+    }
+    printf("%s: %zu frames, %d channel(s), %zu bytes\n", argv[2], stereo.size() / 2, channels, image.size());
+    return 0;
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+// MIDI clock streams for the host: generated at a tempo (with changes) or
+// loaded from a capture, then delivered to the control task as the main loop
+// would read them, late by a random amount.
+//
+// Capture file, one realtime byte per line, '#' comments:
+//
+//   <us> <hex byte>     e.g. "1520833 f8"; times from any origin, increasing
+//
+// Each event keeps the time it was sent, so a test can compare what the
+// looper made of the stream against the true beats.
+
+struct MidiStreamEvent
+{
+    double  us; // sent
+    uint8_t byte;
+};
+
+struct MidiStream
+{
+    std::vector<MidiStreamEvent> events;
+    std::vector<double>          beats_us; // true time of every beat since Start
+
+    // Start at start_us, then clock at bpm for `seconds`; more segments with
+    // Continue() change the tempo from where the last one ended
+    void Start(double start_us, float bpm, double seconds)
+    {
+        events.push_back({start_us, kMidiStart});
+        next_us = start_us + 1000.0; // the downbeat tick follows Start
+        ticks   = 0;
+        Continue(bpm, seconds);
+    }
+
+    void Continue(float bpm, double seconds)
+    {
+        double tick_us = 60e6 / (bpm * kMidiPpqn);
+        double end_us  = next_us + seconds * 1e6;
+        for(; next_us < end_us; next_us += tick_us, ticks++)
+        {
+            if(ticks % kMidiPpqn == 0)
+                beats_us.push_back(next_us);
+            events.push_back({next_us, kMidiTimingClock});
+        }
+    }
+
+    void Stop() { events.push_back({next_us, kMidiStop}); }
+
+    // False when the file cannot be read; beats are taken from the ticks
+    bool Load(const char* path)
+    {
+        FILE* f = fopen(path, "r");
+        if(f == nullptr)
+            return false;
+        char line[128];
+        while(fgets(line, sizeof(line), f))
+        {
+            double   us;
+            unsigned byte;
+            if(line[0] == '#' || sscanf(line, "%lf %x", &us, &byte) != 2)
+                continue;
+            if(byte == kMidiStart)
+                ticks = 0;
+            if(byte == kMidiTimingClock && ticks++ % kMidiPpqn == 0)
+                beats_us.push_back(us);
+            events.push_back({us, (uint8_t)byte});
+        }
+        fclose(f);
+        return true;
+    }
+
+    double next_us = 0.0;
+    int    ticks   = 0;
+};
+
+// Feeds a stream to a rig's control task block by block. Every byte is read
+// `late` after it was sent: up to jitter_us at random, plus a stall_us hold-up
+// (SD card I/O in the main loop) on one in stall_every.
+template <typename Rig>
+struct MidiReplay
+{
+    Rig&              rig;
+    const MidiStream& stream;
+    double            jitter_us   = 0.0;
+    double            stall_us    = 0.0;
+    int               stall_every = 0;
+    size_t            next        = 0;
+    double            read_us     = -1.0; // when the next byte is read, once drawn
+    double            last_us     = 0.0;
+    TestRandom        rng         = {2718};
+
+    MidiReplay(Rig& r, const MidiStream& s) : rig(r), stream(s) {}
+
+    double Late()
+    {
+        uint32_t r    = rng.Next();
+        double   late = jitter_us * (double)(r >> 8) / 16777216.0;
+        if(stall_every > 0 && (r >> 24) % stall_every == 0)
+            late += stall_us;
+        return late;
+    }
+
+    // Deliver what has arrived by the rig's current time, then run one block
+    void Step()
+    {
+        while(next < stream.events.size())
+        {
+            // Read in order: a byte held up holds up the ones behind it
+            if(read_us < 0.0)
+                read_us = fmax(stream.events[next].us + Late(), next > 0 ? last_us : 0.0);
+            if(read_us > rig.controls.now_us)
+                break;
+            rig.control.ReceiveMidi(stream.events[next].byte, (uint32_t)read_us);
+            last_us = read_us;
+            read_us = -1.0;
+            next++;
+        }
+        rig.Run();
+    }
+};
+
+// Where the true beats put frame f of the engine (rig time: 48 frames per ms),
+// in beats since Start; between or past the listed beats by straight lines
+inline double TrueBeat(const MidiStream& stream, double frame)
+{
+    double us = frame * (1000.0 / 48.0);
+    const std::vector<double>& b = stream.beats_us;
+    size_t i = std::lower_bound(b.begin() + 1, b.end() - 1, us) - b.begin();
+    return (double)(i - 1) + (us - b[i - 1]) / (b[i] - b[i - 1]);
+}
@@ -0,0 +1,124 @@
+// Renders a scripted session (session_replay.h) through the control task and
+// audio engine and writes the output as 32-bit float WAV. Reports the
+// real-time factor, so it doubles as an end-to-end throughput benchmark.
+//
+//   replay script.txt [out.wav]
+//   replay                         built-in 60 s session with 5 layers, no output file
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include "session_replay.h"
+
+// Five 2-4 s takes over a synthetic guitar line, two overdubs, an undo, a
+// held-layer speed sweep, pan moves and an erase, then everything playing
+static const char* const kDemoScript = R"(
+0     input demo_in.wav
+0     adc vol1 0.3
+0     adc vol2 0.3
+0     adc vol3 0.3
+0     adc vol4 0.3
+0     adc vol5 0.3
+0     adc master 0.3
+100   press channel
+150   release channel
+500   press record
+3000  release record
+3500  press layer2
+3550  release layer2
+4000  press record
+6500  release record
+7000  press layer3
+7050  release layer3
+7500  press record
+9000  release record
+9500  press layer4
+9550  release layer4
+10000 press record
+12000 release record
+12500 press layer5
+12550 release layer5
+13000 press record
+16000 release record
+17000 press layer1
+17050 release layer1
+17500 press record
+20000 release record
+21000 press record
+21100 release record
+21300 press record
+21400 release record
+23000 press layer2
+23500 adc speed 0.2
+25000 adc speed 0.8
+26000 adc pan 0.9
+27000 release layer2
+28000 press layer3
+28050 release layer3
+28500 press record
+31000 release record
+40000 press layer4
+40300 press bypass
+40350 release bypass
+40400 adc speed 0.35
+41000 release layer4
+50000 press layer5
+50050 release layer5
+50500 press record
+50600 release record
+50800 press record
+50900 release record
+60000 end
+)";
+
+int main(int argc, char** argv)
+{
+    InterpSinc::InitTable();
+    TimeStretch::InitTable();
+    static SessionReplay replay;
+
+    if(argc > 1)
+    {
+        if(!replay.Load(argv[1]))
+        {
+            fprintf(stderr, "replay: %s\n", replay.error.c_str());
+            return 1;
+        }
+    }
+    else
+    {
+        // A plucked line on the guitar input, a low hum on the mic
+        std::vector<float> in(48000 * 60 * 2);
+        for(size_t i = 0; i < in.size() / 2; i++)
+        {
+            float t     = (i % 12000) / 48000.0f;
+            float note  = 110.0f * powf(2.0f, (float)((i / 12000) % 5) / 12.0f);
+            in[2 * i]   = 0.1f * sinf(2.0f * 3.14159265f * 60.0f * i / 48000.0f);
+            in[2 * i + 1] = 0.5f * sinf(2.0f * 3.14159265f * note * t) * expf(-4.0f * t);
+        }
+        replay.base_dir = std::string(P_tmpdir) + "/";
+        WriteWav((replay.base_dir + "demo_in.wav").c_str(), in, 48000);
+        replay.Parse(kDemoScript);
+    }
+
+    if(!replay.Render())
+    {
+        fprintf(stderr, "replay: %s\n", replay.error.c_str());
+        return 1;
+    }
+    if(argc > 2 && !WriteWav(argv[2], replay.output, 48000))
+    {
+        fprintf(stderr, "replay: cannot write %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("# rendered %.1f s in %.3f s: %.1fx real time, hash %016llx\n",
+           replay.Seconds(),
+           replay.render_sec,
+           replay.RealTimeFactor(),
+           (unsigned long long)replay.Hash());
+    printf("# commands %u, dropped %u\n", replay.rig.engine.stats.commands, replay.rig.control.dropped);
+    if(argc <= 1)
+        remove((replay.base_dir + "demo_in.wav").c_str());
+    return 0;
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "looper_rig.h"
+#include "wav.h"
+
+// Deterministic replay of a performance on the host: a script of button
+// edges, knob positions and input files drives the firmware's control task
+// and audio engine one 1 ms block at a time, as fast as the CPU allows, and
+// the stereo output is collected for writing to WAV or hashing.
+//
+// Script, one event per line, times in ms from the start, '#' comments:
+//
+//   <ms> press <button>        record, channel, bypass, layer1 .. layer5
+//   <ms> release <button>
+//   <ms> adc <knob> <0..1>     speed, pan, master, vol1 .. vol5 (raw reading,
+//                              pots are inverted: 1.0 = knob fully down)
+//   <ms> input <file.wav>      play a 48 kHz WAV into the inputs from here
+//                              (left = mic, right = guitar), silence after it
+//   <ms> end                   stop rendering
+//
+// Edges land exactly on the block boundary of their ms, so the same script
+// always renders the same samples.
+
+constexpr size_t kReplayBlock = 48; // 1 ms at 48 kHz, the firmware's block
+
+enum ReplayAction
+{
+    kReplayPress,
+    kReplayRelease,
+    kReplayAdc,
+    kReplayInput,
+    kReplayEnd,
+};
+
+struct ReplayEvent
+{
+    uint32_t    ms;
+    int         action; // ReplayAction
+    int         target; // button or ADC channel
+    float       value;
+    std::string path;
+};
+
+struct SessionReplay
+{
+    typedef LooperRig<kReplayBlock, kControlLayers> Rig;
+
+    Rig                      rig;
+    std::vector<ReplayEvent> events;
+    std::vector<float>       input;  // interleaved stereo, current input file
+    size_t                   input_pos = 0;
+    std::vector<float>       output; // interleaved stereo
+    std::string              base_dir;
+    std::string              error;
+    double                   render_sec = 0.0; // wall time of the last Render()
+
+    // Configured as main.cpp ships the firmware: takes snap to the master cycle
+    SessionReplay() : rig(Rig::Engine::kPoolBytes / kArenaBlockBytes, 65536) { rig.control.cycle_sync = true; }
+
+    HostButton* Button(int target)
+    {
+        if(target == 0)
+            return &rig.record;
+        if(target == 1)
+            return &rig.channel;
+        if(target == 2)
+            return &rig.bypass;
+        return &rig.layer_buttons[target - 3];
+    }
+
+    static int ButtonIndex(const char* name)
+    {
+        if(strcmp(name, "record") == 0)
+            return 0;
+        if(strcmp(name, "channel") == 0)
+            return 1;
+        if(strcmp(name, "bypass") == 0)
+            return 2;
+        int n = 0;
+        if(sscanf(name, "layer%d", &n) == 1 && n >= 1 && n <= kControlLayers)
+            return 2 + n;
+        return -1;
+    }
+
+    static int AdcIndex(const char* name)
+    {
+        if(strcmp(name, "speed") == 0)
+            return kAdcSpeed;
+        if(strcmp(name, "pan") == 0)
+            return kAdcPan;
+        if(strcmp(name, "master") == 0)
+            return kAdcMasterVol;
+        int n = 0;
+        if(sscanf(name, "vol%d", &n) == 1 && n >= 1 && n <= kNumVolumePots)
+            return kAdcLayerVol + n - 1;
+        return -1;
+    }
+
+    // False with `error` set on the first line that does not parse
+    bool Parse(const char* text)
+    {
+        int line_no = 0;
+        while(*text != '\0')
+        {
+            const char* eol = strchr(text, '\n');
+            std::string line(text, eol ? eol - text : strlen(text));
+            text = eol ? eol + 1 : text + line.size();
+            line_no++;
+            line = line.substr(0, line.find('#'));
+
+            char        verb[16] = "", arg[256] = "";
+            float       value    = 0.0f;
+            unsigned    ms       = 0;
+            int         n        = sscanf(line.c_str(), "%u %15s %255s %f", &ms, verb, arg, &value);
+            ReplayEvent ev       = {ms, kReplayEnd, 0, value, ""};
+            if(n <= 0)
+                continue;
+            bool ok = n >= 2;
+            if(ok && (strcmp(verb, "press") == 0 || strcmp(verb, "release") == 0))
+            {
+                ev.action = verb[0] == 'p' ? kReplayPress : kReplayRelease;
+                ev.target = ButtonIndex(arg);
+                ok        = n >= 3 && ev.target >= 0;
+            }
+            else if(ok && strcmp(verb, "adc") == 0)
+            {
+                ev.action = kReplayAdc;
+                ev.target = AdcIndex(arg);
+                ok        = n == 4 && ev.target >= 0;
+            }
+            else if(ok && strcmp(verb, "input") == 0)
+            {
+                ev.action = kReplayInput;
+                ev.path   = arg[0] == '/' ? std::string(arg) : base_dir + arg;
+                ok        = n >= 3;
+            }
+            else
+                ok = ok && strcmp(verb, "end") == 0;
+
+            if(!ok)
+            {
+                error = "line " + std::to_string(line_no) + ": cannot parse '" + line + "'";
+                return false;
+            }
+            events.push_back(ev);
+        }
+        std::stable_sort(events.begin(), events.end(), [](const ReplayEvent& a, const ReplayEvent& b) {
+            return a.ms < b.ms;
+        });
+        return true;
+    }
+
+    bool Load(const char* path)
+    {
+        FILE* f = fopen(path, "rb");
+        if(f == nullptr)
+        {
+            error = std::string("cannot open ") + path;
+            return false;
+        }
+        std::string text;
+        char        buf[4096];
+        for(size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;)
+            text.append(buf, n);
+        fclose(f);
+
+        const char* slash = strrchr(path, '/');
+        base_dir          = slash ? std::string(path, slash + 1 - path) : std::string();
+        return Parse(text.c_str());
+    }
+
+    // Render to the end event, or a second past the last event
+    bool Render()
+    {
+        uint32_t end_ms = events.empty() ? 0 : events.back().ms + 1000;
+        for(const ReplayEvent& ev : events)
+            if(ev.action == kReplayEnd)
+            {
+                end_ms = ev.ms;
+                break;
+            }
+
+        output.clear();
+        output.reserve((size_t)end_ms * kReplayBlock * 2);
+        size_t next  = 0;
+        auto   start = std::chrono::steady_clock::now();
+        for(uint32_t ms = 0; ms < end_ms; ms++)
+        {
+            for(; next < events.size() && events[next].ms <= ms; next++)
+            {
+                const ReplayEvent& ev = events[next];
+                switch(ev.action)
+                {
+                    case kReplayPress: Button(ev.target)->Press(); break;
+                    case kReplayRelease: Button(ev.target)->Release(); break;
+                    case kReplayAdc: rig.controls.adc[ev.target] = ev.value; break;
+                    case kReplayInput:
+                    {
+                        WavInfo info;
+                        input.clear();
+                        input_pos = 0;
+                        if(!ReadWav(ev.path.c_str(), input, info) || info.sample_rate != 48000)
+                        {
+                            error = "cannot read " + ev.path + " as a 48 kHz WAV";
+                            return false;
+                        }
+                        break;
+                    }
+                    default: break;
+                }
+            }
+
+            for(size_t i = 0; i < kReplayBlock; i++, input_pos += 2)
+            {
+                bool have    = input_pos + 1 < input.size();
+                rig.in_l[i] = have ? input[input_pos] : 0.0f;
+                rig.in_r[i] = have ? input[input_pos + 1] : 0.0f;
+            }
+            rig.Step();
+            for(size_t i = 0; i < kReplayBlock; i++)
+            {
+                output.push_back(rig.out_l[i]);
+                output.push_back(rig.out_r[i]);
+            }
+        }
+        render_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    double Seconds() const { return output.size() / 2 / 48000.0; }
+    double RealTimeFactor() const { return render_sec > 0.0 ? Seconds() / render_sec : 0.0; }
+
+    // FNV-1a over the output's bits: equal hashes mean bit-identical renders
+    uint64_t Hash() const
+    {
+        uint64_t       h     = 1469598103934665603ull;
+        const uint8_t* bytes = (const uint8_t*)output.data();
+        for(size_t i = 0; i < output.size() * sizeof(float); i++)
+            h = (h ^ bytes[i]) * 1099511628211ull;
+        return h;
+    }
+};
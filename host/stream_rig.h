@@ -0,0 +1,122 @@
+#pragma once
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "../layer_stream.h"
+#include "host_io.h"
+
+// A stream file (layer_stream.h) in memory from interleaved stereo frames, in
+// the build's LoopFormat; mono keeps the left channel
+static inline std::vector<uint8_t> MakeStreamImage(const std::vector<float>& stereo, int channels)
+{
+    typedef LoopFormat::Unit Unit;
+
+    uint32_t             frames = (uint32_t)(stereo.size() / 2);
+    std::vector<uint8_t> image(kStreamHeaderBytes + (size_t)frames * channels * LoopFormat::kBytes);
+
+    StreamFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic        = kStreamMagic;
+    header.version      = kStreamVersion;
+    header.sample_bytes = LoopFormat::kBytes;
+    header.frames       = frames;
+    header.channels     = (uint32_t)channels;
+    header.data_offset  = kStreamHeaderBytes;
+    memcpy(image.data(), &header, sizeof(header));
+
+    Unit*    data = (Unit*)(image.data() + kStreamHeaderBytes);
+    uint32_t rng  = 1;
+    for(uint32_t f = 0; f < frames; f++)
+        for(int ch = 0; ch < channels; ch++)
+            LoopFormat::Store(data, (ptrdiff_t)f * channels + ch, stereo[2 * f + ch], rng);
+    return image;
+}
+
+// Sines of 220 Hz left and 330 Hz right at half scale
+static inline std::vector<float> StreamTrack(uint32_t frames)
+{
+    std::vector<float> stereo(2 * frames);
+    for(uint32_t f = 0; f < frames; f++)
+    {
+        stereo[2 * f]     = 0.5f * sinf(2.0f * (float)M_PI * 220.0f * f / 48000.0f);
+        stereo[2 * f + 1] = 0.5f * sinf(2.0f * (float)M_PI * 330.0f * f / 48000.0f);
+    }
+    return stereo;
+}
+
+// The looper's two threads on the host, streaming StreamTrack() into layer
+// 0: Poll() runs on the main loop and blocks in the simulated device while
+// 1 ms audio blocks keep coming. Every block of layer 0's output is checked
+// against the track, and for jumps a cut or a skip in the data would cause
+// (its gain ramps span whole blocks, so faded output moves smoothly).
+template <int NumLayers = 2>
+struct StreamRig
+{
+    static const size_t kBlock = 48;
+    static constexpr float kGain = 0.5f; // centre pan
+
+    std::vector<uint8_t>     pool;
+    SampleArena              arena;
+    LooperLayer              layers[NumLayers];
+    std::vector<StreamChunk> chunks;
+    HostBlockDevice          device;
+    HostControls             clock;
+    LayerStream              stream;
+    std::vector<float>       track;
+    float                    out_l[kBlock], out_r[kBlock];
+
+    uint64_t blocks = 0, audible = 0, mismatches = 0, jumps = 0;
+    float    last_l = 0.0f;
+
+    StreamRig(double bytes_per_sec, uint32_t frames = 5 * 48000, size_t pool_bytes = 4 * 1024 * 1024)
+        : pool(pool_bytes), chunks(kStreamChunks), track(StreamTrack(frames))
+    {
+        arena.Init(pool.data(), pool.size());
+        for(int i = 0; i < NumLayers; i++)
+            layers[i].Init(&arena);
+        device.image         = MakeStreamImage(track, 2);
+        device.bytes_per_sec = bytes_per_sec;
+        device.wait          = [this]() { Callback(); };
+        stream.Init(&device, &clock, layers, NumLayers, chunks.data(), 48000.0f);
+    }
+
+    void Callback()
+    {
+        clock.now_us += 1000;
+        stream.AudioService();
+
+        LooperLayer& l      = layers[0];
+        uint32_t     pos    = l.stream_pos;
+        bool         exact  = l.streaming && l.stream_primed && l.stream_fade.value == 1.0f;
+        float*       out[2] = {out_l, out_r};
+        const float* in[2]  = {out_l, out_r};
+        for(size_t i = 0; i < kBlock; i++)
+            out_l[i] = out_r[i] = 0.0f;
+        l.Render(in, out, kBlock, 1.0f);
+        exact = exact && l.stream_fade.value == 1.0f;
+
+        bool sound = false;
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            uint32_t f = (pos + (uint32_t)(i * l.speed)) % (uint32_t)(track.size() / 2);
+            if(exact && fabsf(out_l[i] - kGain * track[2 * f]) > 1e-3f)
+                mismatches++;
+            if(fabsf(out_l[i] - last_l) > 0.02f)
+                jumps++;
+            last_l = out_l[i];
+            sound  = sound || out_l[i] != 0.0f;
+        }
+        blocks++;
+        audible += sound;
+    }
+
+    // The main loop, idle between its polls
+    void Run(int ms)
+    {
+        for(uint32_t end = clock.now_us + ms * 1000; (int32_t)(clock.now_us - end) < 0;)
+        {
+            stream.Poll();
+            Callback();
+        }
+    }
+};
@@ -0,0 +1,64 @@
+// Prefetcher stress: a stereo stream played for 20 s per case through the
+// simulated block device, across card latencies, throughputs, stalls and
+// playback speeds. For each case: the underruns and the share of blocks
+// muted for want of data, frames skipped to catch up, the smallest lead
+// playback had, the read-ahead the stream settled on, and the slowest read.
+// Stereo 16-bit at 1x needs 192 KB/s, at 2x 384 KB/s.
+
+#include <stdio.h>
+#include "stream_rig.h"
+
+typedef StreamRig<1> Rig;
+
+struct Card
+{
+    const char* name;
+    double      latency_us;
+    double      bytes_per_sec;
+    double      stall_us;
+    int         stall_every;
+};
+
+static const Card kCards[] = {
+    {"fast 10 MB/s", 500.0, 10e6, 0.0, 0},
+    {"slow 1 MB/s, 5 ms", 5000.0, 1e6, 0.0, 0},
+    {"10 MB/s, 100 ms stalls", 500.0, 10e6, 100000.0, 50},
+    {"10 MB/s, 400 ms stalls", 500.0, 10e6, 400000.0, 200},
+    {"300 KB/s", 1000.0, 300e3, 0.0, 0},
+    {"150 KB/s", 1000.0, 150e3, 0.0, 0},
+};
+
+static const float kSpeeds[] = {1.0f, 1.5f, 2.0f};
+
+int main()
+{
+    printf("# %-24s %5s %9s %7s %9s %8s %8s %9s\n", "card", "speed", "underruns", "muted", "skipped", "min lead",
+           "depth", "worst rd");
+    for(const Card& card : kCards)
+    {
+        for(float speed : kSpeeds)
+        {
+            Rig rig(card.bytes_per_sec, 60 * 48000, 2 * 1024 * 1024);
+            rig.device.latency_us  = card.latency_us;
+            rig.device.stall_us    = card.stall_us;
+            rig.device.stall_every = card.stall_every;
+            rig.stream.Open(0);
+            rig.Run(200);
+            rig.layers[0].speed       = speed;
+            rig.stream.stats.min_lead = kStreamRingFrames; // past the start
+            rig.Run(20000);
+
+            const StreamStats& s = rig.stream.stats;
+            printf("  %-24s %5.1f %9u %6.1f%% %8.1fs %6.0fms %6.0fms %7.1fms\n", card.name, speed, s.underruns,
+                   100.0 * s.muted_blocks / rig.blocks, s.skipped_frames / 48000.0, s.min_lead / (48.0 * speed),
+                   s.depth_frames / (48.0 * speed), s.worst_read_ms);
+            if(rig.jumps > 0)
+            {
+                fprintf(stderr, "stream_stress: %s at %.1fx: output jumped %llu times\n", card.name, speed,
+                        (unsigned long long)rig.jumps);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
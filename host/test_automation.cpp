@@ -0,0 +1,327 @@
+// Knob automation: a lane keeps a knob's motion within its error in a few
+// points per move (a held knob costs nothing, a move after a hold does not
+// start early), a busy 33 s pass fits the lane, one that does not keeps what
+// fits; through the control task and the engine, a layer held + Record
+// records one pass of the pan knob and every later pass replays it at the
+// same loop positions, at any speed, until it is cleared or the take goes,
+// bounced included.
+// A speed sweep back to the 1.0x detent replays exactly 1.0x there, so a
+// layer in the master cycle stays on the transport counter.
+
+#include <math.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+typedef LooperRig<kBlock, 2> Rig;
+
+static TestRandom rng = {99};
+
+// A hand on a knob, one value per 48-frame block of a 33 s loop: holds,
+// slow and fast sweeps, small nudges
+static float Hand(size_t b)
+{
+    float s = (float)b / 1000.0f;
+    if(s < 3.0f)
+        return 0.5f;
+    if(s < 11.0f)
+        return 0.5f + 0.4f * sinf(2.0f * (float)M_PI * 0.25f * (s - 3.0f));
+    if(s < 14.0f)
+        return 0.5f;
+    if(s < 15.0f)
+        return 0.5f - 0.25f * (s - 14.0f); // fast sweep down
+    if(s < 20.0f)
+        return 0.25f;
+    if(s < 28.0f)
+        return 0.3f - 0.05f * cosf(2.0f * (float)M_PI * 1.5f * (s - 20.0f));
+    return 0.25f + 0.4f * (s - 28.0f) / 5.0f;
+}
+
+static const size_t  kPassBlocks = 33000;
+static const int32_t kPassTicks  = (int32_t)(kPassBlocks * kBlock >> kAutomationTickBits);
+
+static void TestLane()
+{
+    AutomationLane lane;
+    lane.Init(0.0f, 1.0f);
+    lane.Begin();
+    for(size_t b = 0; b < kPassBlocks; b++)
+        lane.Record((int32_t)lroundf((float)(b * kBlock) / (1 << kAutomationTickBits)), Hand(b));
+    lane.End(kPassTicks);
+    CHECK(lane.active && !lane.overflow);
+    CHECK(lane.bytes < kAutomationBytes);
+    CHECK(lane.bytes < 3 * lane.points); // two bytes a point while moving, more after a hold
+    printf("33 s pass: %u points, %zu bytes\n", lane.points, lane.bytes);
+
+    // Within the error (plus rounding) everywhere, the holds included
+    float tolerance = (2.0f * kAutomationError + 1.0f) / (kAutomationLevels - 1);
+    float worst     = 0.0f;
+    for(size_t b = 0; b < kPassBlocks; b++)
+    {
+        float v = lane.Value((float)(b * kBlock) / (1 << kAutomationTickBits));
+        worst   = fmaxf(worst, fabsf(v - Hand(b)));
+    }
+    CHECK(worst <= tolerance);
+
+    // A second pass reads the same
+    float again = 0.0f;
+    for(size_t b = 0; b < kPassBlocks; b += 7)
+    {
+        float v = lane.Value((float)(b * kBlock) / (1 << kAutomationTickBits));
+        again   = fmaxf(again, fabsf(v - Hand(b)));
+    }
+    CHECK(again <= tolerance);
+
+    // Never moved: nothing kept
+    lane.Begin();
+    for(size_t b = 0; b < 1000; b++)
+        lane.Record((int32_t)b, 0.7f + rng.Noise(0.0002f));
+    lane.End(1000);
+    CHECK(!lane.active && lane.bytes == 0);
+
+    // Noise far over the error: keeps what fits and says so
+    lane.Begin();
+    for(size_t b = 0; b < 5000; b++)
+        lane.Record((int32_t)b, 0.5f + rng.Noise(0.5f));
+    lane.End(5000);
+    CHECK(lane.overflow && lane.active);
+    CHECK(lane.bytes <= kAutomationBytes);
+    lane.Value(10.0f);
+    CHECK(lane.Value(4999.0f) >= 0.0f && lane.Value(4999.0f) <= 1.0f);
+}
+
+// A take of `frames` on layer 0, knobs in the middle
+static void Take(Rig& rig, size_t frames)
+{
+    LooperLayer& layer = rig.layers[0];
+    layer.StartTake(2);
+    for(size_t f = 0; f < frames; f++)
+        layer.RecordFrame(0.1f, 0.1f);
+    layer.StopRecord();
+    rig.controls.adc[kAdcSpeed] = 0.5f;
+    rig.controls.adc[kAdcPan]   = 0.5f;
+}
+
+static void TestReplay()
+{
+    Rig          rig(64);
+    LooperLayer& layer = rig.layers[0];
+    Take(rig, 48000);
+    rig.Run();
+
+    // Hold layer 1, press Record: the pass starts, nothing is recorded as a take
+    rig.layer_buttons[0].Press(rig.control.layer_hold_ms + 10.0f);
+    rig.Run();
+    rig.record.Press();
+    rig.Run();
+    rig.record.Release();
+    CHECK(rig.engine.automation[0].recording);
+    CHECK(!layer.recording && !layer.overdubbing);
+
+    // One pass of pan moves, sampled at the loop position of every block
+    std::vector<float> heard(48000 / kBlock + 1, -1.0f);
+    uint32_t           origin = rig.engine.automation[0].origin;
+    for(size_t b = 0; rig.engine.automation[0].recording && b < 2000; b++)
+    {
+        rig.controls.adc[kAdcPan] = 0.5f - 0.4f * sinf((float)b * 0.01f);
+        uint32_t pos              = PhaseIndex(layer.play_phase);
+        rig.Run();
+        heard[((pos + 48000 - origin) % 48000) / kBlock] = layer.pan; // recorded at the block's start
+    }
+    rig.layer_buttons[0].Release();
+    rig.Run();
+    const LayerAutomation& automation = rig.engine.automation[0];
+    CHECK(!automation.recording);
+    CHECK(automation.lanes[kLanePan].active && !automation.lanes[kLaneSpeed].active);
+    CHECK(automation.Bytes() < 1024);
+
+    // The knob went back to the middle; the pan follows the recording anyway,
+    // pass after pass (each value is where the block ends, one block on)
+    float worst = 0.0f;
+    for(size_t b = 0; b < 3000; b++)
+    {
+        uint32_t pos = PhaseIndex(layer.play_phase);
+        rig.Run();
+        size_t slot = ((pos + 48000 - origin) % 48000) / kBlock;
+        if(slot + 1 < heard.size() - 1 && heard[slot + 1] >= 0.0f)
+            worst = fmaxf(worst, fabsf(layer.pan - heard[slot + 1]));
+    }
+    CHECK(worst < 0.005f);
+
+    // At half speed the curve stays on the loop
+    rig.Send(kCmdSetSpeed, 0, 0.5f);
+    rig.Run();
+    float slow_worst = 0.0f;
+    for(size_t b = 0; b < 2000; b++)
+    {
+        rig.Run();
+        uint32_t pos  = PhaseIndex(layer.play_phase);
+        size_t   slot = ((pos + 48000 - origin) % 48000) / kBlock;
+        if(slot + 1 < heard.size() - 1 && heard[slot] >= 0.0f) // not across the wrap
+            slow_worst = fmaxf(slow_worst, fabsf(layer.pan - heard[slot]));
+    }
+    CHECK(layer.speed == 0.5f);
+    CHECK(slow_worst < 0.01f);
+
+    // Held + Record again clears it: the knob has the pan back
+    rig.layer_buttons[0].Press(rig.control.layer_hold_ms + 10.0f);
+    rig.Run();
+    rig.record.Press();
+    rig.Run();
+    rig.record.Release();
+    rig.Run();
+    rig.layer_buttons[0].Release();
+    CHECK(!rig.engine.automation[0].Active());
+    rig.controls.adc[kAdcPan] = 0.2f;
+    rig.layer_buttons[0].Press(rig.control.layer_hold_ms + 10.0f);
+    for(int b = 0; b < 5; b++)
+        rig.Run();
+    rig.layer_buttons[0].Release();
+    CHECK(fabsf(layer.pan - 0.8f) < 1e-6f);
+}
+
+static void TestLifetime()
+{
+    Rig rig(64);
+    Take(rig, 9600);
+    rig.Send(kCmdAutomate, 0);
+    for(int b = 0; b < 250; b++)
+    {
+        rig.Send(kCmdSetPan, 0, 0.5f + 0.4f * sinf((float)b * 0.05f));
+        rig.Run();
+    }
+    CHECK(rig.engine.automation[0].lanes[kLanePan].active);
+
+    // Paused: the pan holds; playing again it picks up where the loop is
+    rig.Send(kCmdPause, 0);
+    rig.Run();
+    float at_pause = rig.layers[0].pan;
+    for(int b = 0; b < 50; b++)
+        rig.Run();
+    CHECK(rig.layers[0].pan == at_pause);
+    rig.Send(kCmdPause, 0);
+    for(int b = 0; b < 50; b++)
+        rig.Run();
+    CHECK(rig.engine.automation[0].lanes[kLanePan].active);
+
+    // A layer with no take, or a streaming one, is never automated
+    rig.Send(kCmdAutomate, 1);
+    rig.Run();
+    CHECK(!rig.engine.automation[1].Active());
+
+    // Erased: gone with the take
+    rig.Send(kCmdErase, 0);
+    rig.Run();
+    CHECK(!rig.engine.automation[0].Active());
+
+    // A new take of another length drops what was recorded over the old one
+    Take(rig, 9600);
+    rig.Send(kCmdAutomate, 0);
+    for(int b = 0; b < 250; b++)
+    {
+        rig.Send(kCmdSetPan, 0, 0.5f + 0.4f * sinf((float)b * 0.05f));
+        rig.Run();
+    }
+    CHECK(rig.engine.automation[0].Active());
+    Take(rig, 4800);
+    rig.Run();
+    CHECK(!rig.engine.automation[0].Active());
+}
+
+// Bounced: a source with automation is refused, its knobs would move under
+// the render; and moves recorded on the destination while it renders are
+// gone with its old take, also when the new one is as long
+static void TestBounce()
+{
+    Rig rig(64);
+    Take(rig, 9600);
+    LooperLayer& other = rig.layers[1];
+    other.StartTake(2);
+    for(size_t f = 0; f < 9600; f++)
+        other.RecordFrame(0.1f, 0.1f);
+    other.StopRecord();
+
+    rig.Send(kCmdAutomate, 1);
+    rig.Run();
+    rig.Send(kCmdBounce, 0, 0.0f, 0x3);
+    rig.Run();
+    CHECK(rig.engine.bounce.state.load() == kBounceFailed);
+    rig.Send(kCmdAutomate, 1); // cleared
+    rig.Send(kCmdBounce, 0, 0.0f, 0x3);
+    rig.Run();
+    CHECK(rig.engine.bounce.Running());
+
+    rig.Send(kCmdAutomate, 0);
+    for(int b = 0; rig.engine.bounce.Running() && b < 200; b++)
+    {
+        rig.Send(kCmdSetPan, 0, 0.5f + 0.4f * sinf((float)b * 0.05f));
+        rig.Run();
+    }
+    CHECK(rig.engine.bounce.state.load() == kBounceDone && rig.layers[0].record_len == 9600);
+    CHECK(!rig.engine.automation[0].Active() && !rig.engine.automation[1].Active());
+    float worst = 0.0f;
+    for(int b = 0; b < 600; b++)
+    {
+        rig.Run();
+        worst = fmaxf(worst, fabsf(rig.layers[0].pan - 0.5f));
+    }
+    CHECK(worst == 0.0f);
+}
+
+// A take in the master cycle, a pass that sweeps the speed up and back to
+// 1.0x and leaves it there (the layer jumps back onto the counter, which
+// does not end the pass): replayed, the held stretch is exactly 1.0x and the
+// layer plays on the transport counter, pass after pass
+static void TestDetent()
+{
+    Rig          rig(64, 65536);
+    LooperLayer& layer = rig.layers[0];
+    rig.control.cycle_sync = true;
+    rig.Click(rig.layer_buttons[0]);
+    rig.Hold(1000, 0.25f);
+    for(int i = 0; i < 300 && layer.recording; i++)
+        rig.Run(0.25f);
+    CHECK(layer.recorded && layer.cycle_sync);
+
+    rig.Send(kCmdAutomate, 0);
+    rig.Run();
+    LayerAutomation& automation = rig.engine.automation[0];
+    float            swept      = 0.0f; // tick the sweep ended at
+    for(size_t b = 0; automation.recording && b < 3000; b++)
+    {
+        float speed = b < 300 ? 1.0f + 0.5f * sinf((float)M_PI * (float)b / 300.0f) : 1.0f;
+        if(b == 300)
+            swept = automation.Tick(PhaseIndex(layer.play_phase));
+        rig.Send(kCmdSetSpeed, 0, speed);
+        rig.Run();
+    }
+    CHECK(!automation.recording && automation.lanes[kLaneSpeed].active);
+
+    // Clear of the sweep and of the line back to its start at the wrap
+    float  ticks = (float)layer.record_len / (1 << kAutomationTickBits);
+    size_t held = 0, exact = 0, on_counter = 0;
+    for(size_t b = 0; b < 3000; b++)
+    {
+        rig.Run();
+        float t = automation.Tick(PhaseIndex(layer.play_phase));
+        if(t < swept + 20.0f || t > ticks - 20.0f)
+            continue;
+        held++;
+        exact += layer.speed == 1.0f;
+        on_counter += layer.play_phase
+                      == PhaseFromIndex(rig.engine.transport.Position(layer.cycle_anchor, (uint32_t)layer.record_len));
+    }
+    CHECK(held > 1000 && exact == held && on_counter == held);
+}
+
+int main()
+{
+    TestLane();
+    TestReplay();
+    TestLifetime();
+    TestBounce();
+    TestDetent();
+    return TestResult("test_automation");
+}
@@ -0,0 +1,252 @@
+// Bounce: three layers at different lengths, speeds, pans and volumes mixed
+// down into one. The bounced take has to match what the engine was playing
+// frame for frame (to 16-bit resolution), playback has to carry on through
+// the hand-over without a seam, and the sources' memory has to come back.
+// Also the cancel and refusal cases, effects that do not outlive their
+// source, and the two-layers-plus-Record gesture.
+
+#include <math.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+typedef LooperRig<kBlock, 3> Rig;
+
+static const size_t kOutputDelay = Rig::Engine::kOutputDelay;
+
+static TestRandom rng = {4242};
+
+// Stereo noise takes of the given lengths, mono for layer 1
+static void Record(Rig& rig, const size_t* lens, int n)
+{
+    for(int i = 0; i < n; i++)
+    {
+        LooperLayer& layer = rig.layers[i];
+        layer.StartTake(i == 1 ? 1 : 2);
+        for(size_t f = 0; f < lens[i]; f++)
+            layer.RecordFrame(rng.Noise(0.2f), rng.Noise(0.2f));
+        layer.StopRecord();
+    }
+    for(int i = 0; i < kControlLayers; i++)
+        rig.controls.adc[kAdcLayerVol + i] = 0.3f + 0.1f * (float)i;
+    rig.controls.adc[kAdcMasterVol] = 0.4f;
+}
+
+struct Capture
+{
+    Rig&               rig;
+    std::vector<float> out_l, out_r; // engine output by frame
+
+    explicit Capture(Rig& r) : rig(r) {}
+
+    void Step()
+    {
+        rig.Run();
+        out_l.insert(out_l.end(), rig.out_l, rig.out_l + kBlock);
+        out_r.insert(out_r.end(), rig.out_r, rig.out_r + kBlock);
+    }
+};
+
+static void TestMatchesMix()
+{
+    Rig          rig(256);
+    Capture      cap(rig);
+    const size_t lens[] = {9600, 4800, 7200};
+    Record(rig, lens, 3);
+    rig.Send(kCmdSetPan, 0, 0.3f);
+    rig.Send(kCmdSetPan, 2, 0.8f);
+    rig.Send(kCmdSetSpeed, 2, 0.6f);
+    for(int b = 0; b < 50; b++) // gains settle
+        cap.Step();
+
+    size_t   used   = rig.arena.UsedBlocks();
+    uint32_t start  = rig.engine.Now();
+    float    master = rig.engine.master_gain;
+    rig.Send(kCmdBounce, 0, 0.0f, 0x7);
+    cap.Step();
+    const LayerBounce& bounce = rig.engine.bounce;
+    CHECK(bounce.Running());
+    CHECK(bounce.report.voices_before == 3);
+    CHECK(bounce.len >= 11999 && bounce.len <= 12001); // 7200 frames at 0.6
+    CHECK(bounce.done.load() == kBounceChunk);
+
+    // The sources play on while it renders
+    int   blocks = 1;
+    float mid    = -1.0f;
+    while(bounce.Running() && blocks < 1000)
+    {
+        if(blocks == 60)
+            mid = bounce.Progress();
+
+        cap.Step();
+        blocks++;
+    }
+    CHECK(bounce.state.load() == kBounceDone);
+    CHECK(blocks == (int)((bounce.len + kBounceChunk - 1) / kBounceChunk));
+    CHECK(mid > 0.4f && mid < 0.6f);
+
+    // One stereo layer at unity and centre, the others erased with their memory
+    const LooperLayer& layer = rig.layers[0];
+    CHECK(layer.recorded && layer.record_len == bounce.len && layer.storage.channels == 2);
+    CHECK(layer.speed == 1.0f && layer.pan == 0.5f && layer.volume == 1.0f);
+    CHECK(!rig.layers[1].recorded && !rig.layers[2].recorded);
+    CHECK(rig.arena.UsedBlocks() == layer.storage.num_blocks);
+    CHECK(bounce.report.blocks_freed == used);
+    CHECK(bounce.report.voices_after == 1);
+
+    // Play on past the hand-over, then compare everything heard since the
+    // bounce started against the take: frame k of the output is frame k of
+    // the take at half gain a side
+    for(int b = 0; b < 200; b++)
+        cap.Step();
+    CHECK(rig.engine.limiter.limited_blocks == 0);
+    float worst = 0.0f, peak = 0.0f;
+    for(size_t k = 0; start + kOutputDelay + k < cap.out_l.size(); k++)
+    {
+        size_t f  = start + kOutputDelay + k;
+        size_t j  = k % layer.record_len;
+        float  el = fabsf(cap.out_l[f] - 0.5f * master * layer.storage.Read(j, 0));
+        float  er = fabsf(cap.out_r[f] - 0.5f * master * layer.storage.Read(j, 1));
+        worst     = fmaxf(worst, fmaxf(el, er));
+        peak      = fmaxf(peak, fabsf(cap.out_l[f]));
+    }
+    CHECK(peak > 0.03f);
+    CHECK(worst < 2e-4f);
+    if(worst >= 2e-4f)
+        printf("worst difference %g\n", worst);
+}
+
+static void TestCancel()
+{
+    Rig          rig(256);
+    Capture      cap(rig);
+    const size_t lens[] = {9600, 4800, 7200};
+    Record(rig, lens, 3);
+    cap.Step();
+    size_t used = rig.arena.UsedBlocks();
+
+    // Erasing a source part way through: nothing changes but the erase
+    rig.Send(kCmdBounce, 1, 0.0f, 0x7);
+    for(int b = 0; b < 10; b++)
+        cap.Step();
+    CHECK(rig.engine.bounce.Running());
+    CHECK(rig.arena.UsedBlocks() > used);
+    size_t erased = rig.layers[2].storage.num_blocks;
+    rig.Send(kCmdErase, 2);
+    cap.Step();
+    CHECK(rig.engine.bounce.state.load() == kBounceFailed);
+    CHECK(rig.arena.UsedBlocks() == used - erased);
+    CHECK(rig.layers[0].record_len == 9600 && rig.layers[1].record_len == 4800);
+
+    // An overdub on a source cancels too
+    rig.Send(kCmdBounce, 1, 0.0f, 0x3);
+    cap.Step();
+    CHECK(rig.engine.bounce.Running());
+    rig.Send(kCmdRecordStart, 0);
+    cap.Step();
+    CHECK(rig.engine.bounce.state.load() == kBounceFailed);
+    rig.Send(kCmdRecordStop, 0);
+    cap.Step();
+
+    // Refused: a single source, a paused one left out, a time-stretched one
+    rig.Send(kCmdBounce, 0, 0.0f, 0x1);
+    cap.Step();
+    CHECK(rig.engine.bounce.state.load() == kBounceFailed);
+    rig.Send(kCmdPause, 1);
+    rig.Send(kCmdBounce, 0, 0.0f, 0x3);
+    cap.Step();
+    CHECK(rig.engine.bounce.state.load() == kBounceFailed);
+    rig.Send(kCmdPause, 1);
+    rig.Send(kCmdSetStretch, 1, 0.0f, 1);
+    rig.Send(kCmdSetSpeed, 1, 1.5f);
+    rig.Send(kCmdBounce, 0, 0.0f, 0x3);
+    cap.Step();
+    CHECK(rig.engine.bounce.state.load() == kBounceFailed);
+    CHECK(rig.layers[0].recorded && rig.layers[1].recorded);
+
+    // Refused too: a source with an effect on, which the render would leave out
+    rig.Send(kCmdSetStretch, 1, 0.0f, 0);
+    rig.Send(kCmdSetSpeed, 1, 1.0f);
+    rig.Send(kCmdSetFx, 1, 0.5f, kFxFilterMix);
+    rig.Send(kCmdBounce, 0, 0.0f, 0x3);
+    cap.Step();
+    CHECK(rig.engine.bounce.state.load() == kBounceFailed);
+    rig.Send(kCmdSetFx, 1, 0.0f, kFxFilterMix);
+    cap.Step();
+    CHECK(rig.engine.fx_budget.Used() == 0);
+
+    // No room for the take next to its sources
+    Rig          small(4);
+    const size_t short_lens[] = {9000, 9000}; // two blocks, one mono block
+    Record(small, short_lens, 2);
+    small.Send(kCmdBounce, 0, 0.0f, 0x3);
+    small.Run();
+    CHECK(small.engine.bounce.state.load() == kBounceFailed);
+    CHECK(small.arena.UsedBlocks() == 3);
+}
+
+// Hold layer buttons 1 and 3, click Record: layers 1 and 3 go into layer 1
+// and neither the click nor the hold reaches the record gestures. The speed
+// and pan knobs are left where layer 2 was set: holding the others does not
+// hand them those settings, so they bounce as they play
+static void TestGesture()
+{
+    Rig          rig(256);
+    const size_t lens[] = {4800, 4800, 4800};
+    Record(rig, lens, 3);
+    rig.Run();
+
+    rig.layer_buttons[1].Press();
+    for(int t = 0; t < 250; t++)
+        rig.Run();
+    rig.controls.adc[kAdcSpeed] = 0.75f; // pots inverted: slower
+    rig.controls.adc[kAdcPan]   = 0.2f;
+    for(int t = 0; t < 50; t++)
+        rig.Run();
+    rig.layer_buttons[1].Release();
+    rig.Run();
+    CHECK(rig.layers[1].speed < 0.8f && rig.layers[1].pan > 0.7f);
+
+    rig.layer_buttons[0].Press();
+    rig.layer_buttons[2].Press();
+    for(int t = 0; t < 300; t++)
+        rig.Run();
+    CHECK(rig.layers[0].speed == 1.0f && rig.layers[0].pan == 0.5f);
+    CHECK(rig.layers[2].speed == 1.0f && rig.layers[2].pan == 0.5f);
+    rig.record.Press();
+    rig.Run();
+    CHECK(rig.engine.bounce.Running());
+    rig.Send(kCmdSetFx, 2, 0.5f, kFxFilterMix); // on while it renders
+    rig.Run();
+    CHECK(rig.engine.fx_array[2].Enabled(kFxFilter));
+    for(int t = 0; t < 600; t++) // held past the long press too
+        rig.Run();
+    rig.record.Release();
+    rig.Run();
+    rig.layer_buttons[0].Release();
+    rig.layer_buttons[2].Release();
+    for(int t = 0; t < 600 && rig.engine.bounce.Running(); t++)
+        rig.Run();
+
+    CHECK(rig.engine.bounce.state.load() == kBounceDone);
+    CHECK(rig.engine.bounce.dest == 0 && rig.engine.bounce.sources == 0x5);
+    CHECK(rig.engine.bounce.len == 4800); // both at 1.0x
+    CHECK(rig.layers[0].recorded && !rig.layers[0].paused && !rig.layers[0].overdubbing);
+    CHECK(rig.layers[1].recorded && !rig.layers[2].recorded);
+    CHECK(rig.layers[0].history.num_levels == 0);
+
+    // The filter went with its source, claim and all
+    CHECK(!rig.engine.fx_array[2].Enabled(kFxFilter) && rig.engine.fx_budget.Used() == 0);
+}
+
+int main()
+{
+    InterpSinc::InitTable();
+    TimeStretch::InitTable();
+    TestMatchesMix();
+    TestCancel();
+    TestGesture();
+    return TestResult("test_bounce");
+}
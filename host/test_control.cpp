@@ -0,0 +1,223 @@
+// Control task: gestures turned into engine commands, knobs sent only when
+// they move, a full queue dropping commands without blocking, and the
+// command latency into the audio engine.
+
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+typedef LooperRig<kBlock, 5> Rig;
+
+// Control ticks only, no audio: collect what the control task sent
+static std::vector<LooperCommand> Tick(Rig& rig, int ticks = 1)
+{
+    std::vector<LooperCommand> sent;
+    for(int t = 0; t < ticks; t++)
+    {
+        rig.controls.now_ms += 1;
+        rig.controls.now_us += 1000;
+        rig.record.Tick(1.0f);
+        rig.bypass.Tick(1.0f);
+        for(int i = 0; i < kControlLayers; i++)
+            rig.layer_buttons[i].Tick(1.0f);
+        rig.events |= rig.control.Update();
+        LooperCommand cmd;
+        while(rig.engine.commands.Pop(cmd))
+            sent.push_back(cmd);
+    }
+    return sent;
+}
+
+static int Count(const std::vector<LooperCommand>& cmds, int type)
+{
+    int n = 0;
+    for(const LooperCommand& c : cmds)
+        n += c.type == type;
+    return n;
+}
+
+static void TestKnobs()
+{
+    Rig rig(16);
+    std::vector<LooperCommand> cmds = Tick(rig);
+    CHECK(Count(cmds, kCmdSetGain) == 5);
+    CHECK(Count(cmds, kCmdSetMaster) == 1);
+    CHECK(Count(cmds, kCmdSetSpeed) == 0); // no layer held
+
+    // Still knobs: nothing more
+    CHECK(Tick(rig, 50).empty());
+
+    rig.controls.adc[kAdcLayerVol + 3] = 0.2f;
+    cmds = Tick(rig);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdSetGain && cmds[0].layer == 3);
+    CHECK(cmds[0].value == rig.control.params.layer_gain[3]);
+
+    // Hold layer 3 past 200 ms: speed and pan follow the knobs for it only,
+    // picked up from where they are, so the hold alone sends nothing
+    rig.layer_buttons[2].Press();
+    cmds = Tick(rig, 250);
+    CHECK(Count(cmds, kCmdSetSpeed) == 0 && Count(cmds, kCmdSetPan) == 0);
+    rig.controls.adc[kAdcSpeed] = 0.0f; // knob fully up: 2.0x
+    cmds = Tick(rig);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdSetSpeed && cmds[0].layer == 2 && cmds[0].value == 2.0f);
+
+    // Pressing another layer during the hold does not select it
+    rig.layer_buttons[4].Press();
+    Tick(rig);
+    rig.layer_buttons[4].Release();
+    CHECK(rig.control.selected_layer == 2);
+
+    rig.layer_buttons[2].Release();
+    rig.controls.adc[kAdcSpeed] = 1.0f;
+    CHECK(Tick(rig, 5).empty());
+}
+
+static void TestRecordGestures()
+{
+    Rig rig(16);
+    Tick(rig);
+
+    // Long press: one start when it passes 400 ms, one stop on release
+    rig.control.selected_channel = 2;
+    rig.record.Press();
+    std::vector<LooperCommand> cmds = Tick(rig, 399);
+    CHECK(cmds.empty());
+    cmds = Tick(rig, 300);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdRecordStart && cmds[0].layer == 0 && cmds[0].channel == 2);
+    rig.record.Release();
+    cmds = Tick(rig);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdRecordStop && cmds[0].layer == 0);
+
+    // Click toggles pause; a second click within 400 ms reverts it and undoes or erases
+    rig.record.Press();
+    Tick(rig, 20);
+    rig.record.Release();
+    cmds = Tick(rig, 100);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdPause);
+    rig.record.Press();
+    Tick(rig, 20);
+    rig.record.Release();
+    cmds = Tick(rig);
+    CHECK(cmds.size() == 2 && cmds[0].type == kCmdPause && cmds[1].type == kCmdUndo && cmds[1].arg == 1);
+
+    // Clicks further apart are two single clicks
+    Tick(rig, 500);
+    rig.Click();
+    Tick(rig, 500);
+    rig.record.Press();
+    Tick(rig);
+    rig.record.Release();
+    cmds = Tick(rig);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdPause);
+
+    // The stop goes to the layer the take started on, even after reselecting
+    rig.record.Press();
+    Tick(rig, 450);
+    rig.layer_buttons[4].Press();
+    Tick(rig);
+    rig.layer_buttons[4].Release();
+    CHECK(rig.control.selected_layer == 4);
+    rig.record.Release();
+    cmds = Tick(rig);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdRecordStop && cmds[0].layer == 0);
+}
+
+static void TestChannelAndBypass()
+{
+    Rig rig(16);
+    Tick(rig);
+    rig.events = 0;
+
+    rig.channel.Press();
+    Tick(rig);
+    rig.channel.Release();
+    Tick(rig);
+    CHECK(rig.control.selected_channel == 1 && rig.control.channel_override_active);
+    CHECK(rig.events & kEventRelays);
+
+    // Channel while a layer is held: redo on that layer, input unchanged
+    rig.layer_buttons[1].Press();
+    Tick(rig, 250);
+    rig.channel.Press();
+    std::vector<LooperCommand> cmds = Tick(rig);
+    CHECK(cmds.size() == 1 && cmds[0].type == kCmdRedo && cmds[0].layer == 1);
+    CHECK(rig.control.selected_channel == 1);
+    rig.channel.Release();
+    rig.layer_buttons[1].Release();
+    Tick(rig);
+
+    // Bypass toggles on release; a 2 s hold saves instead
+    rig.events = 0;
+    rig.bypass.Press();
+    Tick(rig, 10);
+    CHECK(rig.control.bypass_active);
+    rig.bypass.Release();
+    Tick(rig);
+    CHECK(!rig.control.bypass_active && (rig.events & kEventRelays) && !(rig.events & kEventSave));
+    rig.events = 0;
+    rig.bypass.Press();
+    Tick(rig, 2100);
+    CHECK(rig.events == kEventSave);
+    rig.bypass.Release();
+    Tick(rig);
+    CHECK(!rig.control.bypass_active);
+}
+
+// Audio stalled: the control task keeps running, drops and then catches up
+static void TestFullQueue()
+{
+    Rig rig(16);
+    for(int i = 0; i < 100; i++)
+    {
+        rig.controls.adc[kAdcMasterVol] = (i % 2) * 0.5f;
+        rig.controls.now_ms += 1;
+        rig.control.Update();
+    }
+    CHECK(rig.engine.commands.Size() == kCommandQueueSize);
+    CHECK(rig.control.dropped > 0);
+
+    // Once audio drains the queue every knob converges to its current value
+    for(int i = 0; i < 3; i++)
+        rig.Run();
+    CHECK(rig.engine.master_gain == rig.control.params.master_gain);
+    for(int i = 0; i < 5; i++)
+        CHECK(rig.layers[i].volume == rig.control.params.layer_gain[i]);
+}
+
+// End to end: a take through gestures, and how long commands wait for audio
+static void TestEngine()
+{
+    Rig rig(64);
+    rig.control.selected_channel = 2;
+    rig.Hold(1000, 0.25f);
+    LooperLayer& layer = rig.layers[0];
+    CHECK(layer.recorded && layer.storage.channels == 2 && layer.recorded_channel == 2);
+    CHECK(layer.record_len >= 598 * kBlock && layer.record_len <= 601 * kBlock);
+
+    rig.Click();
+    CHECK(layer.paused);
+    rig.Run();
+    rig.Click();
+    CHECK(!layer.recorded); // nothing to undo: erased
+    CHECK(rig.arena.UsedBlocks() == 0);
+
+    // Each command is applied at the next block: latency under one block
+    CHECK(rig.engine.stats.commands > 0);
+    CHECK(rig.engine.stats.max_latency == 0);
+    printf("control: %u commands, at most %u per block, latency <= %u frames\n",
+           (unsigned)rig.engine.stats.commands,
+           (unsigned)rig.engine.stats.max_commands_block,
+           (unsigned)rig.engine.stats.max_latency);
+}
+
+int main()
+{
+    TestKnobs();
+    TestRecordGestures();
+    TestChannelAndBypass();
+    TestFullQueue();
+    TestEngine();
+    return TestResult("test_control");
+}
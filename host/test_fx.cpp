@@ -0,0 +1,266 @@
+// Per-layer effects: the filter cuts above its cutoff and passes below it,
+// an effect at mix 0 leaves the voice untouched, the delay repeats an
+// impulse at its time and again through the feedback, its tail rings out and
+// then stops costing anything, a time change crossfades instead of jumping,
+// the engine measures what effects cost and what the rest of the block
+// leaves them, and refuses effects past that budget, and a paused layer's
+// echoes keep playing in the mix until they have died away.
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+static const float  kRate  = 48000.0f;
+
+typedef LooperRig<kBlock, 2> Rig;
+
+// RMS of a sine at hz through the effects, after a second to settle
+static float SineRms(LayerFx& fx, float hz)
+{
+    float  l[kBlock], r[kBlock];
+    double sum = 0.0;
+    size_t n   = 0;
+    for(size_t b = 0; b < 2000; b++)
+    {
+        for(size_t i = 0; i < kBlock; i++)
+            l[i] = r[i] = sinf(2.0f * (float)M_PI * hz * (float)(b * kBlock + i) / kRate);
+        fx.Process(l, r, kBlock, true);
+        if(b >= 1000)
+            for(size_t i = 0; i < kBlock; i++, n++)
+                sum += l[i] * l[i];
+    }
+    return (float)sqrt(sum / n);
+}
+
+static void TestFilter()
+{
+    LayerFx fx;
+    fx.Init(nullptr, 0, kRate);
+    fx.Set(kFxFilterMix, 1.0f, kBlock);
+    fx.Set(kFxFilterCutoff, 500.0f, kBlock);
+    CHECK(fx.Enabled(kFxFilter) && !fx.Enabled(kFxDelay));
+    float low  = SineRms(fx, 100.0f);
+    float high = SineRms(fx, 8000.0f);
+    CHECK(low > 0.68f && low < 0.73f); // 1/sqrt(2), passed
+    CHECK(high < 0.03f);               // 12 dB per octave above 500 Hz
+
+    // Mix back to 0: ramps out, then the voice goes through untouched
+    fx.Set(kFxFilterMix, 0.0f, kBlock);
+    float l[kBlock], r[kBlock], l0[kBlock];
+    for(size_t i = 0; i < kBlock; i++)
+        l[i] = r[i] = 0.5f;
+    fx.Process(l, r, kBlock, true);
+    CHECK(!fx.Running());
+    for(size_t i = 0; i < kBlock; i++)
+        l[i] = l0[i] = r[i] = sinf((float)i);
+    CHECK(fx.Process(l, r, kBlock, true));
+    CHECK(memcmp(l, l0, sizeof(l)) == 0);
+    CHECK(!fx.Process(l, r, kBlock, false)); // silent stays silent
+}
+
+// An impulse into a 10 ms delay with feedback 0.5: echoes at 480, 960, ...
+static void TestDelayEchoes()
+{
+    std::vector<float> line(2 * 4096);
+    LayerFx            fx;
+    fx.Init(line.data(), 4096, kRate);
+    fx.Set(kFxDelaySend, 1.0f, kBlock);
+    fx.Set(kFxDelayTime, 10.0f, kBlock);
+    fx.Set(kFxDelayFeedback, 0.5f, kBlock);
+
+    std::vector<float> out;
+    float              l[kBlock], r[kBlock];
+    for(size_t b = 0; b < 100; b++)
+    {
+        for(size_t i = 0; i < kBlock; i++)
+            l[i] = r[i] = (b == 2 && i == 0) ? 1.0f : 0.0f; // after the send has ramped in
+        fx.Process(l, r, kBlock, true);
+        out.insert(out.end(), l, l + kBlock);
+    }
+    const size_t t0 = 2 * kBlock;
+    CHECK(out[t0] == 1.0f);
+    CHECK(fabsf(out[t0 + 480] - 1.0f) < 1e-6f);
+    CHECK(fabsf(out[t0 + 960] - 0.5f) < 1e-6f);
+    CHECK(fabsf(out[t0 + 1440] - 0.25f) < 1e-6f);
+    float stray = 0.0f;
+    for(size_t i = 0; i < out.size(); i++)
+        if(i != t0 && (i < t0 || (i - t0) % 480 != 0))
+            stray = fmaxf(stray, fabsf(out[i]));
+    CHECK(stray == 0.0f);
+
+    // Send off and the layer silent: the tail keeps sounding, then stops
+    fx.Set(kFxDelaySend, 0.0f, kBlock);
+    size_t blocks = 0, heard = 0;
+    while(fx.Running() && blocks < 10000)
+    {
+        if(fx.Process(l, r, kBlock, false))
+            heard += fabsf(l[0]) + fabsf(l[kBlock - 1]) > 0.0f;
+        blocks++;
+    }
+    CHECK(!fx.Running());
+    CHECK(heard > 0);
+    CHECK(blocks < 1000); // 0.5 per 10 ms: under the floor within ~0.2 s more
+    CHECK(!fx.Process(l, r, kBlock, false));
+}
+
+// A slow sine through the delay while its time changes: no step in the output
+static void TestTimeChange()
+{
+    std::vector<float> line(2 * 8192);
+    LayerFx            fx;
+    fx.Init(line.data(), 8192, kRate);
+    fx.Set(kFxDelaySend, 1.0f, kBlock);
+    fx.Set(kFxDelayTime, 50.0f, kBlock);
+    fx.Set(kFxDelayFeedback, 0.0f, kBlock);
+
+    float l[kBlock], r[kBlock], last = 0.0f, worst = 0.0f;
+    for(size_t b = 0; b < 400; b++)
+    {
+        if(b % 50 == 49)
+            fx.Set(kFxDelayTime, b % 100 == 49 ? 23.0f : 71.0f, kBlock);
+        for(size_t i = 0; i < kBlock; i++)
+            l[i] = r[i] = 0.5f * sinf(2.0f * (float)M_PI * 40.0f * (float)(b * kBlock + i) / kRate);
+        fx.Process(l, r, kBlock, true);
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            if(b > 20)
+                worst = fmaxf(worst, fabsf(l[i] - last));
+            last = l[i];
+        }
+    }
+    CHECK(worst < 0.03f); // a cut between the taps would step by up to 1
+    CHECK(fx.delay.heard == (uint32_t)(0.071f * kRate + 0.5f));
+}
+
+// A cycle counter that moves on `step` every time it is read
+static uint32_t ticker = 0, step = 0;
+static uint32_t Ticker()
+{
+    return ticker += step;
+}
+
+static void TestBudget()
+{
+    Rig rig(64, 0, 4096);
+    FxBudget& budget = rig.engine.fx_budget;
+    CHECK(budget.cycles > 0 && budget.Used() == 0);
+    budget.cycles = budget.cost[kFxFilter] + budget.cost[kFxDelay];
+
+    rig.Send(kCmdSetFx, 0, 0.5f, kFxFilterMix);
+    rig.Send(kCmdSetFx, 0, 0.5f, kFxDelaySend);
+    rig.Send(kCmdSetFx, 0, 0.8f, kFxFilterMix); // already on: no second claim
+    rig.Send(kCmdSetFx, 1, 1.0f, kFxFilterMix);
+    rig.Run();
+    LayerFx* fx = rig.engine.fx_array;
+    CHECK(fx[0].Enabled(kFxFilter) && fx[0].Enabled(kFxDelay));
+    CHECK(!fx[1].Enabled(kFxFilter));
+    CHECK(budget.refused == 1 && budget.Used() == budget.cycles);
+
+    // Other parameters never need room
+    rig.Send(kCmdSetFx, 1, 300.0f, kFxFilterCutoff);
+    rig.Send(kCmdSetFx, 0, 0.0f, kFxFilterMix);
+    rig.Send(kCmdSetFx, 1, 1.0f, kFxFilterMix);
+    rig.Run();
+    CHECK(fx[1].Enabled(kFxFilter) && fx[1].filter.cutoff == 300.0f);
+    CHECK(!fx[0].Enabled(kFxFilter));
+    CHECK(budget.refused == 1 && budget.Used() == budget.cycles);
+
+    // Without delay memory the send stays off and claims nothing
+    Rig dry(64);
+    dry.Send(kCmdSetFx, 0, 1.0f, kFxDelaySend);
+    dry.Run();
+    CHECK(!dry.engine.fx_array[0].Enabled(kFxDelay) && dry.engine.fx_budget.Used() == 0);
+}
+
+// With a cycle counter the costs and the room left are measured: an effect
+// costs what it took, the budget is what the rest of the block leaves, and
+// once the rest of the block takes it all nothing more goes on
+static void TestMeasuredBudget()
+{
+    Rig       rig(64, 0, 4096);
+    FxBudget& budget = rig.engine.fx_budget;
+    LooperLayer& layer = rig.layers[0];
+    layer.StartTake(2);
+    for(size_t f = 0; f < 4800; f++)
+        layer.RecordFrame(0.1f, 0.1f);
+    layer.StopRecord();
+    rig.controls.adc[kAdcLayerVol] = 0.0f;
+
+    budget.Init(100000, kBlock);
+    budget.clock = Ticker;
+    step         = 1000; // every read of the counter: the effects, one each
+    rig.Send(kCmdSetFx, 0, 1.0f, kFxFilterMix);
+    for(int b = 0; b < 5; b++)
+        rig.Run();
+    CHECK(rig.engine.fx_array[0].Enabled(kFxFilter));
+    CHECK(budget.cost[kFxFilter] == 1000 && budget.cost[kFxDelay] == kFxSeedCycles[kFxDelay] * kBlock);
+    CHECK(budget.rest > 0 && budget.cycles == 100000 - budget.rest - 10000);
+    CHECK(budget.Used() == 1000);
+
+    // The rest of the callback grows to the whole block: no room for the delay
+    step = 50000;
+    rig.Run();
+    CHECK(budget.cycles == 0);
+    rig.Send(kCmdSetFx, 0, 0.5f, kFxDelaySend);
+    rig.Run();
+    CHECK(!rig.engine.fx_array[0].Enabled(kFxDelay) && budget.refused == 1);
+    CHECK(rig.engine.fx_array[0].Enabled(kFxFilter)); // already on: stays on
+}
+
+// A looping take with a delay, paused: the echoes play on after the loop
+// has faded out, then the layer drops out of the mix
+static void TestTailAfterPause()
+{
+    Rig rig(64, 0, 4096);
+    LooperLayer& layer = rig.layers[0];
+    layer.StartTake(2);
+    for(size_t f = 0; f < 4800; f++)
+        layer.RecordFrame(f % 480 == 0 ? 0.5f : 0.0f, 0.0f);
+    layer.StopRecord();
+    rig.controls.adc[kAdcLayerVol]  = 0.0f; // pots inverted: full up
+    rig.controls.adc[kAdcMasterVol] = 0.0f;
+
+    rig.Send(kCmdSetFx, 0, 1.0f, kFxDelaySend);
+    rig.Send(kCmdSetFx, 0, 30.0f, kFxDelayTime);
+    rig.Send(kCmdSetFx, 0, 0.6f, kFxDelayFeedback);
+    for(int b = 0; b < 300; b++)
+        rig.Run();
+    CHECK(rig.engine.fx_array[0].delay.Running());
+
+    rig.Send(kCmdPause, 0);
+    rig.Send(kCmdSetFx, 0, 0.0f, kFxDelaySend);
+    for(int b = 0; b < 20; b++)
+        rig.Run(); // loop faded out
+    CHECK(layer.paused);
+
+    size_t blocks = 0, heard = 0;
+    while(rig.engine.fx_array[0].delay.Running() && blocks < 5000)
+    {
+        rig.Run();
+        float peak = 0.0f;
+        for(size_t i = 0; i < kBlock; i++)
+            peak = fmaxf(peak, fabsf(rig.out_l[i]));
+        heard += peak > 1e-3f;
+        blocks++;
+    }
+    CHECK(heard > 10);
+    CHECK(blocks < 5000);
+    CHECK(!rig.engine.fx_array[0].Running());
+    for(int b = 0; b < 10; b++)
+        rig.Run();
+    CHECK(rig.out_l[0] == 0.0f && rig.out_l[kBlock - 1] == 0.0f);
+}
+
+int main()
+{
+    TestFilter();
+    TestDelayEchoes();
+    TestTimeChange();
+    TestBudget();
+    TestMeasuredBudget();
+    TestTailAfterPause();
+    return TestResult("test_fx");
+}
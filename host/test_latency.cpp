@@ -0,0 +1,289 @@
+// Latency compensation against a codec stand-in: a delay line feeds the
+// engine's output back to its input D frames later, like a loopback cable
+// or a performer playing along perfectly to what they hear. Checks that the
+// calibration measures the round trip (D plus the limiter's lookahead)
+// exactly, that takes and overdubs recorded through the delay line line up
+// sample for sample with the loop they were played against, and the direct
+// monitoring path.
+
+#include <math.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock   = 48;
+static const size_t kPreRoll = 32768;
+
+typedef LooperRig<kBlock, 2> Rig;
+
+// The limiter's lookahead delays the output: the engine's own round trip is
+// the codec's plus this
+static const size_t kOutputDelay = Rig::Engine::kOutputDelay;
+
+// Everything the engine played, and what arrives back at its input
+struct CodecLoop
+{
+    Rig&               rig;
+    size_t             delay;
+    float              gain  = 1.0f;
+    float              noise = 0.0f;  // added to the returning signal
+    bool               loop  = true;  // false: input is `external` only
+    std::vector<float> out_l, out_r;  // engine output by frame
+    TestRandom         rng   = {12345};
+
+    CodecLoop(Rig& r, size_t d) : rig(r), delay(d) {}
+
+    float Noise()
+    {
+        return rng.Noise(noise);
+    }
+
+    // One block; external(frame) is what the player adds at the input
+    template <typename F>
+    void Step(F external)
+    {
+        uint32_t start = rig.engine.Now();
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            size_t f    = start + i;
+            bool   back = loop && f >= delay;
+            rig.in_l[i] = (back ? gain * out_l[f - delay] : 0.0f) + external(f, 0) + Noise();
+            rig.in_r[i] = (back ? gain * out_r[f - delay] : 0.0f) + external(f, 1) + Noise();
+        }
+        rig.Step();
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            out_l.push_back(rig.out_l[i]);
+            out_r.push_back(rig.out_r[i]);
+        }
+    }
+
+    void Step()
+    {
+        Step([](size_t, int) { return 0.0f; });
+    }
+
+    void RunTo(uint32_t frame)
+    {
+        while(rig.engine.Now() < frame)
+            Step();
+    }
+};
+
+// Seeded noise, one value per frame and side, far above 16-bit resolution
+static float Material(size_t frame, int side)
+{
+    uint32_t x = (uint32_t)frame * 2654435761u + (uint32_t)side * 40503u;
+    x ^= x >> 15;
+    x *= 2246822519u;
+    x ^= x >> 13;
+    return 0.4f * ((float)(x & 0xFFFF) / 32768.0f - 1.0f);
+}
+
+static void TestCalibration()
+{
+    const size_t delays[] = {96, 131, 173, 500, 2047};
+    int          exact    = 0;
+    for(size_t d : delays)
+    {
+        Rig       rig(16);
+        CodecLoop codec(rig, d);
+        codec.gain  = 0.7f;
+        codec.noise = 0.005f;
+
+        // Hold Channel for 2 s: a calibration, not an input change
+        rig.channel.Press();
+        int events = 0;
+        for(int t = 0; t < 2100; t++, events |= rig.events)
+            codec.Step();
+        rig.channel.Release();
+        for(int t = 0; t < 400 && !(events & (kEventCalibrated | kEventCalibrationFailed)); t++)
+        {
+            codec.Step();
+            events |= rig.events;
+        }
+        CHECK(rig.control.selected_channel == 0);
+        CHECK(events & kEventCalibrated);
+        codec.Step();
+        size_t trip = d + kOutputDelay;
+        exact += rig.control.latency == trip && rig.engine.latency == trip && rig.layers[1].input_latency == trip;
+        if(rig.control.latency != trip)
+            printf("delay %zu: measured %u\n", d, rig.control.latency);
+    }
+    CHECK(exact == 5);
+
+    // No cable: nothing comes back, the latency is left alone
+    Rig       rig(16);
+    CodecLoop codec(rig, 100);
+    codec.loop  = false;
+    codec.noise = 0.005f;
+    rig.SendAt(0, kCmdSetLatency, 0, 77.0f);
+    codec.Step();
+    CHECK(rig.engine.calibrator.Start());
+    CHECK(!rig.engine.calibrator.Start()); // one at a time
+    int events = 0;
+    for(int t = 0; t < 400 && !(events & (kEventCalibrated | kEventCalibrationFailed)); t++)
+    {
+        codec.Step();
+        events |= rig.events;
+    }
+    CHECK(events & kEventCalibrationFailed);
+    CHECK(rig.engine.latency == 77);
+}
+
+// Layer 1: a take of Material from `press` to `release`, straight into the
+// input. The player hears it and nothing comes back through the loop yet.
+static void RecordBase(CodecLoop& codec, uint32_t press, uint32_t release)
+{
+    Rig& rig   = codec.rig;
+    codec.loop = false;
+    codec.RunTo(press - press % kBlock + kBlock);
+    rig.SendAt(press, kCmdRecordStart, 0);
+    auto play = [](size_t f, int side) { return Material(f, side); };
+    while(rig.engine.Now() < release - release % kBlock + kBlock)
+        codec.Step(play);
+    rig.SendAt(release, kCmdRecordStop, 0);
+    codec.Step();
+    codec.loop = true;
+}
+
+// Layer 2 recorded from what comes back while layer 1 plays: its first frame
+// is what the engine mixed at the press (out of the limiter kOutputDelay
+// later), its length the time the button was down
+static void TestTakeAlignment(size_t d, bool compensate, int& aligned)
+{
+    Rig       rig(64, kPreRoll);
+    CodecLoop codec(rig, d);
+    rig.SendAt(0, kCmdSetLatency, 0, compensate ? (float)(d + kOutputDelay) : 0.0f);
+    RecordBase(codec, 1000, 1000 + 9600);
+
+    uint32_t press = 20000 + 17, release = press + 7200 + 5;
+    codec.RunTo(press - press % kBlock + kBlock);
+    rig.SendAt(press, kCmdRecordStart, 1);
+    codec.RunTo(release - release % kBlock + kBlock);
+    rig.SendAt(release, kCmdRecordStop, 1);
+    codec.RunTo(release + d + kOutputDelay + 2 * kBlock);
+
+    const LooperLayer& layer = rig.layers[1];
+    bool               ok    = layer.recorded && layer.record_len == release - press;
+    float              peak  = 0.0f;
+    for(size_t k = 0; ok && k < layer.record_len; k++)
+        peak = fmaxf(peak, fabsf(codec.out_l[press + kOutputDelay + k]));
+    ok = ok && peak > 0.1f; // layer 1 was audible
+    for(size_t k = 0; ok && k < layer.record_len; k++)
+        ok = fabsf(layer.storage.Read(k, 0) - codec.out_l[press + kOutputDelay + k]) < 1e-4f
+             && fabsf(layer.storage.Read(k, 1) - codec.out_r[press + kOutputDelay + k]) < 1e-4f;
+    aligned += ok;
+}
+
+// One overdub pass over layer 1 of what comes back from its own playback:
+// the echo lands on the frames it was played from, so every frame becomes
+// old * (feedback + output gain)
+static void TestOverdubAlignment(size_t d, bool compensate, int& aligned)
+{
+    Rig       rig(64, kPreRoll);
+    CodecLoop codec(rig, d);
+    rig.SendAt(0, kCmdSetLatency, 0, compensate ? (float)(d + kOutputDelay) : 0.0f);
+    const size_t len = 9600;
+    RecordBase(codec, 960, 960 + len);
+
+    std::vector<float> old_l(len), old_r(len);
+    for(size_t k = 0; k < len; k++)
+    {
+        old_l[k] = rig.layers[0].storage.Read(k, 0);
+        old_r[k] = rig.layers[0].storage.Read(k, 1);
+    }
+
+    // A whole number of blocks per loop: the pass covers it exactly once
+    uint32_t start = 30000 - 30000 % kBlock;
+    codec.RunTo(start);
+    rig.SendAt(start, kCmdRecordStart, 0);
+    codec.RunTo(start + len);
+    rig.SendAt(start + len, kCmdRecordStop, 0);
+    codec.RunTo(start + len + d + kOutputDelay + 2 * kBlock);
+
+    const LooperLayer& layer = rig.layers[0];
+    float              fb    = layer.feedback;
+    bool               ok    = !layer.overdubbing && layer.record_len == len;
+    float              worst = 0.0f;
+    for(size_t k = 0; k < len; k++)
+    {
+        float el = fabsf(layer.storage.Read(k, 0) - old_l[k] * (fb + layer.gain_l.value));
+        float er = fabsf(layer.storage.Read(k, 1) - old_r[k] * (fb + layer.gain_r.value));
+        worst    = fmaxf(worst, fmaxf(el, er));
+    }
+    aligned += ok && worst < 1e-4f;
+}
+
+static void TestAlignment()
+{
+    const size_t delays[] = {96, 131, 500};
+    int          takes = 0, overdubs = 0, takes_off = 0, overdubs_off = 0;
+    for(size_t d : delays)
+    {
+        TestTakeAlignment(d, true, takes);
+        TestOverdubAlignment(d, true, overdubs);
+        TestTakeAlignment(d, false, takes_off);
+        TestOverdubAlignment(d, false, overdubs_off);
+    }
+    CHECK(takes == 3);
+    CHECK(overdubs == 3);
+
+    // Without the offset everything lands d frames late
+    CHECK(takes_off == 0);
+    CHECK(overdubs_off == 0);
+}
+
+static void TestMonitor()
+{
+    Rig       rig(16);
+    CodecLoop codec(rig, 96);
+    codec.loop  = false;
+    auto input  = [](size_t f, int side) { return Material(f, side); };
+
+    // Off by default: the analog path (bypass relay on) carries the input
+    codec.Step(input);
+    CHECK(rig.engine.monitor_gain == 0.0f);
+    CHECK(rig.out_l[10] == 0.0f && rig.out_r[10] == 0.0f);
+
+    // Guitar at 0.5: the right input in both sides, in the block it arrives
+    // (plus the limiter's lookahead)
+    rig.SendAt(0, kCmdSetMonitor, 0, 0.5f, 0, 1);
+    for(int b = 0; b < 3; b++) // ramps in, then one steady block out of the delay
+        codec.Step(input);
+    size_t from = rig.engine.Now() - kBlock - kOutputDelay;
+    bool   ok   = true;
+    for(size_t i = 0; i < kBlock; i++)
+        ok = ok && rig.out_l[i] == 0.5f * Material(from + i, 1) && rig.out_r[i] == 0.5f * Material(from + i, 1);
+    CHECK(ok);
+
+    // Line: stereo as it comes in
+    rig.SendAt(0, kCmdSetMonitor, 0, 0.5f);
+    for(int b = 0; b < 3; b++)
+        codec.Step(input);
+    from = rig.engine.Now() - kBlock - kOutputDelay;
+    ok   = true;
+    for(size_t i = 0; i < kBlock; i++)
+        ok = ok && rig.out_l[i] == 0.5f * Material(from + i, 0) && rig.out_r[i] == 0.5f * Material(from + i, 1);
+    CHECK(ok);
+
+    // The control task monitors at monitor_level whenever the bypass relay is off
+    rig.control.monitor_level = 0.8f;
+    rig.Click(rig.bypass);
+    rig.Run();
+    CHECK(!rig.control.bypass_active);
+    CHECK(rig.engine.monitor_gain == 0.8f && rig.engine.monitor_channel == rig.control.selected_channel);
+    rig.Click(rig.bypass);
+    rig.Run();
+    CHECK(rig.engine.monitor_gain == 0.0f);
+}
+
+int main()
+{
+    InterpSinc::InitTable();
+    TimeStretch::InitTable();
+    TestCalibration();
+    TestAlignment();
+    TestMonitor();
+    return TestResult("test_latency");
+}
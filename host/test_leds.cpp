@@ -0,0 +1,145 @@
+// MAX7219 driver: the init sequence, that only changed digits reach the bus,
+// that a busy bus defers frames without losing the latest value, and the SPI
+// traffic saved by the looper's per-block LED refresh.
+
+#include "max7219.h"
+#include "host_io.h"
+#include "test_util.h"
+
+static bool Frame(const MockSpi& spi, size_t i, uint8_t reg, uint8_t data)
+{
+    return i < spi.frames.size() && spi.frames[i].size() == 2 && spi.frames[i][0] == reg
+           && spi.frames[i][1] == data;
+}
+
+// Service until the driver reports the chip up to date
+static void Drain(Max7219& leds)
+{
+    for(int i = 0; i < 1000 && leds.Service(); i++) {}
+}
+
+static void TestInit()
+{
+    MockSpi spi;
+    Max7219 leds;
+    leds.Init(&spi);
+    CHECK(spi.frames.size() == 13);
+    CHECK(Frame(spi, 0, 0x09, 0x00));
+    CHECK(Frame(spi, 2, 0x0B, 0x07));
+    CHECK(Frame(spi, 3, 0x0C, 0x01));
+    for(uint8_t d = 1; d <= 8; d++)
+        CHECK(Frame(spi, 4 + d, d, 0x00));
+    CHECK(!leds.Service());
+    CHECK(leds.frames_sent == 0);
+}
+
+static void TestDirtyDigits()
+{
+    MockSpi spi;
+    Max7219 leds;
+    leds.Init(&spi);
+    spi.frames.clear();
+
+    // Unchanged values: no traffic
+    leds.SetDigit(1, 0x00);
+    leds.SetDigit(3, 0x00);
+    Drain(leds);
+    CHECK(spi.frames.empty());
+
+    // Only the digits that changed, one frame each
+    leds.SetDigit(1, 0x80);
+    leds.SetDigit(2, 0x00);
+    leds.SetDigit(3, 0x50);
+    Drain(leds);
+    CHECK(spi.frames.size() == 2);
+    CHECK(Frame(spi, 0, 1, 0x80));
+    CHECK(Frame(spi, 1, 3, 0x50));
+
+    // Several writes between services collapse to the last value
+    spi.frames.clear();
+    leds.SetDigit(2, 0x01);
+    leds.SetDigit(2, 0x02);
+    leds.SetDigit(2, 0x04);
+    Drain(leds);
+    CHECK(spi.frames.size() == 1);
+    CHECK(Frame(spi, 0, 2, 0x04));
+
+    // Changed and changed back before a service: nothing to send
+    spi.frames.clear();
+    leds.SetDigit(1, 0x00);
+    leds.SetDigit(1, 0x80);
+    Drain(leds);
+    CHECK(spi.frames.empty());
+    CHECK(leds.frames_sent == 3);
+    CHECK(leds.FramesAvoided() == leds.writes - 3);
+}
+
+static void TestBusyBus()
+{
+    MockSpi spi;
+    Max7219 leds;
+    leds.Init(&spi);
+    spi.frames.clear();
+    spi.busy_polls = 3;
+
+    leds.SetDigit(1, 0x11);
+    leds.SetDigit(2, 0x22);
+    CHECK(leds.Service());
+    CHECK(spi.frames.size() == 1);
+
+    // The first frame is still in flight: nothing new starts
+    leds.SetDigit(2, 0x33);
+    CHECK(leds.Service());
+    CHECK(leds.Service());
+    CHECK(spi.frames.size() == 1);
+
+    Drain(leds);
+    CHECK(spi.frames.size() == 2);
+    CHECK(Frame(spi, 0, 1, 0x11));
+    CHECK(Frame(spi, 1, 2, 0x33));
+}
+
+// The looper's pattern: three digits written every block, changing rarely
+static void TestLooperRefresh()
+{
+    MockSpi spi;
+    Max7219 leds;
+    leds.Init(&spi);
+    spi.frames.clear();
+    spi.busy_polls = 1;
+
+    const int kBlocks = 48000; // 48 s at 1 kHz blocks
+    uint8_t   dig0 = 0, dig1 = 0x20, dig2 = 0x80;
+    for(int b = 0; b < kBlocks; b++)
+    {
+        if(b % 1000 == 0)
+            dig0 ^= 0x40; // record LED every second
+        if(b % 5000 == 0)
+            dig1 = (uint8_t)(0x20 >> (b / 5000 % 5)); // selected layer
+        if(b % 12000 == 0)
+            dig2 ^= 0x10; // bypass
+        leds.SetDigit(1, dig0);
+        leds.SetDigit(2, dig1);
+        leds.SetDigit(3, dig2);
+        leds.Service(); // main loop runs a few times per block
+        leds.Service();
+    }
+    Drain(leds);
+    CHECK(leds.shown[0] == dig0 && leds.shown[1] == dig1 && leds.shown[2] == dig2);
+    CHECK(leds.writes == 3u * kBlocks);
+    CHECK(leds.frames_sent == spi.frames.size());
+    CHECK(leds.frames_sent <= 48 + 10 + 4);
+    printf("led refresh: %u writes, %u frames sent, %u avoided\n",
+           (unsigned)leds.writes,
+           (unsigned)leds.frames_sent,
+           (unsigned)leds.FramesAvoided());
+}
+
+int main()
+{
+    TestInit();
+    TestDirtyDigits();
+    TestBusyBus();
+    TestLooperRefresh();
+    return TestResult("test_leds");
+}
@@ -0,0 +1,177 @@
+// Metering and the output limiter: the SIMD block kernel against a plain
+// reference, meter ballistics and the LED bar, the limiter as a pure one-block
+// delay below the ceiling, no sample over the ceiling with five hot layers,
+// and per-layer and master meters and clip counters in the engine.
+
+#include <math.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+static TestRandom rng = {99};
+
+static void TestKernel()
+{
+    // Odd sizes exercise the scalar tail after the 4-wide loop
+    const size_t sizes[] = {1, 3, 4, 48, 61, 256};
+    int          good    = 0;
+    for(size_t n : sizes)
+    {
+        std::vector<float> l(n), r(n);
+        for(size_t i = 0; i < n; i++)
+        {
+            l[i] = rng.Noise(1.6f);
+            r[i] = rng.Noise(1.6f);
+        }
+        float    gl = 0.7f, gr = 1.1f;
+        float    peak = 0.0f;
+        double   sum  = 0.0;
+        uint32_t over = 0;
+        for(size_t i = 0; i < n; i++)
+        {
+            float a = fabsf(l[i] * gl), b = fabsf(r[i] * gr);
+            peak    = fmaxf(peak, fmaxf(a, b));
+            sum += (double)a * a + (double)b * b;
+            over += (a >= 1.0f) + (b >= 1.0f);
+        }
+        BlockLevel level = MeasureBlock(l.data(), r.data(), n, gl, gr);
+        good += level.peak == peak && level.clips == over && fabs(level.sum_sq - sum) < 1e-5 * sum;
+    }
+    CHECK(good == 6);
+
+    BlockLevel silent = MeasureBlock(std::vector<float>(48).data(), std::vector<float>(48).data(), 48);
+    CHECK(silent.peak == 0.0f && silent.sum_sq == 0.0f && silent.clips == 0);
+}
+
+static void TestBallistics()
+{
+    LevelMeter meter;
+    meter.Init(1000.0f); // 1 ms blocks
+
+    // A full-scale sine: RMS settles at 1/sqrt(2), the peak holds
+    std::vector<float> l(kBlock), r(kBlock);
+    for(int b = 0; b < 2000; b++)
+    {
+        for(size_t i = 0; i < kBlock; i++)
+            l[i] = r[i] = 0.9f * sinf(2.0f * 3.14159265f * 1000.0f * (float)(b * kBlock + i) / 48000.0f);
+        meter.Add(MeasureBlock(l.data(), r.data(), kBlock), kBlock);
+    }
+    CHECK(fabsf(meter.peak - 0.9f) < 0.01f);
+    CHECK(fabsf(meter.Rms() - 0.9f / sqrtf(2.0f)) < 0.01f);
+
+    // Then silence: the peak falls 20 dB in a second
+    for(int b = 0; b < 1000; b++)
+        meter.AddSilence();
+    CHECK(fabsf(LevelDb(meter.peak) - (LevelDb(0.9f) - 20.0f)) < 0.1f);
+    CHECK(meter.Rms() < 0.2f * 0.9f / sqrtf(2.0f)); // mean square down e^-3.3
+
+    CHECK(MeterBar(0.0f) == 0x00);
+    CHECK(MeterBar(1.0f) == 0x7F);
+    CHECK(MeterBar(0.5f) == 0x3F);  // -6 dB: all but the top segment
+    CHECK(MeterBar(0.01f) == 0x01); // -40 dB: bottom segment only
+}
+
+static void TestLimiter()
+{
+    // Below the ceiling: the output is the input one block later, bit for bit
+    static Limiter<kBlock> limiter;
+    limiter.Init();
+    std::vector<float> in_l, in_r, out_l, out_r;
+    float              l[kBlock], r[kBlock];
+    float*             out[2] = {l, r};
+    for(int b = 0; b < 200; b++)
+    {
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            l[i] = rng.Noise(0.9f);
+            r[i] = rng.Noise(0.9f);
+            in_l.push_back(l[i]);
+            in_r.push_back(r[i]);
+        }
+        limiter.Process(out, MeasureBlock(l, r, kBlock).peak);
+        out_l.insert(out_l.end(), l, l + kBlock);
+        out_r.insert(out_r.end(), r, r + kBlock);
+    }
+    bool delayed = true;
+    for(size_t f = kBlock; f < out_l.size(); f++)
+        delayed = delayed && out_l[f] == in_l[f - kBlock] && out_r[f] == in_r[f - kBlock];
+    CHECK(delayed);
+    CHECK(limiter.limited_blocks == 0);
+
+    // Bursts up to 4x full scale: nothing leaves over the ceiling, quiet
+    // parts come back to unity once the release has run
+    float worst = 0.0f;
+    for(int b = 0; b < 3600; b++)
+    {
+        float amp = (b / 100) % 3 == 1 && b < 3000 ? 4.0f * (float)(b % 7 + 1) / 7.0f : 0.5f;
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            l[i] = rng.Noise(amp);
+            r[i] = i == (size_t)b % kBlock ? amp : rng.Noise(amp); // a full-amplitude spike somewhere
+        }
+        limiter.Process(out, MeasureBlock(l, r, kBlock).peak);
+        for(size_t i = 0; i < kBlock; i++)
+            worst = fmaxf(worst, fmaxf(fabsf(l[i]), fabsf(r[i])));
+    }
+    CHECK(worst <= limiter.ceiling * 1.0001f);
+    CHECK(limiter.limited_blocks > 0 && limiter.min_gain < 0.3f);
+    CHECK(limiter.gain == 1.0f); // the last 700 blocks were quiet
+}
+
+// Five layers of loud noise summed: meters per layer and on the master, the
+// master's clip counter catching what the limiter kept off the output
+static void TestEngineMeters()
+{
+    typedef LooperRig<kBlock, 5> Rig;
+    Rig rig(512);
+    for(int i = 0; i < 5; i++)
+    {
+        LooperLayer& layer = rig.layers[i];
+        layer.StartTake(2);
+        for(int f = 0; f < 48000; f++)
+            layer.RecordFrame(rng.Noise(0.5f), rng.Noise(0.5f));
+        layer.StopRecord();
+    }
+    for(int i = 0; i < kControlLayers; i++)
+        rig.controls.adc[kAdcLayerVol + i] = 0.0f; // pots inverted: full volume
+    rig.controls.adc[kAdcMasterVol] = 0.0f;
+    rig.layers[4].paused = true;
+
+    float worst = 0.0f;
+    for(int b = 0; b < 2000; b++) // long enough for the RMS to settle
+    {
+        rig.Run();
+        for(size_t i = 0; i < kBlock; i++)
+            worst = fmaxf(worst, fmaxf(fabsf(rig.out_l[i]), fabsf(rig.out_r[i])));
+    }
+    const Rig::Engine& engine = rig.engine;
+    CHECK(worst <= engine.limiter.ceiling * 1.0001f);
+    CHECK(engine.master_meter.clips > 0);
+    CHECK(engine.master_meter.peak > 1.0f);
+    CHECK(engine.limiter.limited_blocks > 0);
+
+    // Each playing layer's meter reads its own level as heard
+    bool layers_ok = true;
+    for(int i = 0; i < 4; i++)
+    {
+        const LooperLayer& layer = rig.layers[i];
+        float              gl    = layer.gain_l.value, gr = layer.gain_r.value;
+        float              rms   = 0.5f / sqrtf(3.0f) * sqrtf(0.5f * (gl * gl + gr * gr)); // uniform noise
+        layers_ok = layers_ok && layer.meter.peak > 0.4f * fmaxf(gl, gr) && layer.meter.peak <= 0.5f * fmaxf(gl, gr)
+                    && fabsf(layer.meter.Rms() - rms) < 0.1f * rms;
+    }
+    CHECK(layers_ok);
+    CHECK(rig.layers[4].meter.peak < 1e-6f); // paused
+}
+
+int main()
+{
+    InterpSinc::InitTable();
+    TestKernel();
+    TestBallistics();
+    TestLimiter();
+    TestEngineMeters();
+    return TestResult("test_meter");
+}
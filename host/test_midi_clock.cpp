@@ -0,0 +1,290 @@
+// MIDI clock sync: the tempo tracker against clean and jittery streams,
+// dropped and doubled ticks, a tempo change and a clock that goes away;
+// then through the control task and engine, takes started and stopped on
+// the bar, held-layer gestures that leave a take on the grid, and a layer
+// that stays phase-locked to the true beats while the external tempo moves
+// away from the one it was recorded at.
+
+#include <math.h>
+#include <vector>
+#include "midi_stream.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+typedef LooperRig<kBlock, 2> Rig;
+
+// Ticks straight into a tracker, each `late` frames after it was sent
+static void Feed(MidiClock& clock, const MidiStream& stream, double jitter_frames, int& beats, double& worst,
+                 double* rms = nullptr, double after_us = 4e6)
+{
+    double     sum = 0.0;
+    int        n   = 0;
+    TestRandom rng = {99};
+    for(const MidiStreamEvent& e : stream.events)
+    {
+        double late = jitter_frames * ((double)(rng.Next() >> 8) / 16777216.0 - 0.5);
+        double sent = e.us * 0.048;
+        int    ev   = clock.Receive(e.byte, (uint32_t)floor(sent + late + 0.5));
+        if(!(ev & kClockBeat))
+            continue;
+        beats++;
+        double err = (double)(int32_t)(clock.BeatFrame() - (uint32_t)floor(stream.beats_us[clock.Beat()] * 0.048 + 0.5));
+        if(e.us > after_us)
+        {
+            worst = fmax(worst, fabs(err));
+            sum += err * err;
+            n++;
+        }
+    }
+    if(rms != nullptr)
+        *rms = n > 0 ? sqrt(sum / n) : 0.0;
+}
+
+static void TestTracker()
+{
+    // Clean 120 bpm: exact tempo, beats on the frame
+    MidiStream clean;
+    clean.Start(1000.0, 120.0f, 10.0);
+    MidiClock clock;
+    clock.Init(48000.0f);
+    int    beats = 0;
+    double worst = 0.0;
+    Feed(clock, clean, 0.0, beats, worst);
+    CHECK(fabsf(clock.Bpm() - 120.0f) < 0.001f);
+    CHECK(worst <= 1.0);
+    CHECK(beats == (int)clean.beats_us.size() - 2); // from the third beat, once settled
+
+    // +-1 ms of jitter (48 frames either way): the beats come out within a
+    // few frames, rms, and never as far off as a single tick can be
+    MidiStream jittery;
+    jittery.Start(1000.0, 97.0f, 30.0);
+    clock.Init(48000.0f);
+    worst      = 0.0;
+    double rms = 0.0;
+    Feed(clock, jittery, 96.0, beats, worst, &rms);
+    CHECK(fabsf(clock.Bpm() - 97.0f) < 0.05f);
+    CHECK(rms < 12.0 && worst < 36.0);
+    printf("beat error with +-1 ms jitter: rms %.1f, worst %.1f frames\n", rms, worst);
+
+    // A tempo change: 120 -> 132 bpm, back within 0.1 bpm after 4 s
+    MidiStream change;
+    change.Start(1000.0, 120.0f, 8.0);
+    change.Continue(132.0f, 4.0);
+    clock.Init(48000.0f);
+    Feed(clock, change, 48.0, beats, worst);
+    CHECK(fabsf(clock.Bpm() - 132.0f) < 0.1f);
+
+    // Dropped and doubled ticks: the beat count stays right
+    MidiStream holes;
+    holes.Start(1000.0, 120.0f, 10.0);
+    std::vector<MidiStreamEvent> events;
+    for(size_t i = 0; i < holes.events.size(); i++)
+    {
+        if(i % 50 == 7)
+            continue; // dropped
+        events.push_back(holes.events[i]);
+        if(i % 70 == 3)
+            events.push_back({holes.events[i].us + 300.0, kMidiTimingClock}); // doubled
+    }
+    holes.events = events;
+    clock.Init(48000.0f);
+    worst = 0.0;
+    Feed(clock, holes, 0.0, beats, worst);
+    CHECK(clock.outliers > 10);
+    CHECK(clock.Beat() == holes.beats_us.size() - 1);
+    CHECK(worst <= 2.0);
+    CHECK(fabsf(clock.Bpm() - 120.0f) < 0.01f);
+
+    // Stop, and a clock that just goes quiet
+    CHECK(clock.Receive(kMidiStop, 0) == kClockStopped);
+    CHECK(clock.Receive(kMidiContinue, 0) == kClockStarted);
+    uint32_t last = clock.TickFrame();
+    CHECK(clock.Expire(last + 2000) == 0);
+    CHECK(clock.Expire(last + 5000) == kClockStopped);
+    CHECK(!clock.running && !clock.Settled());
+}
+
+// Through the control task: hold Record between bars, release past the
+// middle of the second, and get a take of exactly two bars from a bar line
+static void TestQuantizedTake()
+{
+    Rig        rig(64, 65536);
+    MidiStream stream;
+    stream.Start(20000.0, 120.0f, 20.0); // 24000 frames a beat
+    MidiReplay<Rig> replay(rig, stream);
+    replay.jitter_us = 1000.0;
+
+    // Beat 8.3 (the long press lands a little later): the take reaches back
+    // into the pre-roll for bar 8
+    double press_us = stream.beats_us[8] + 0.3 * 500000.0;
+    while(rig.controls.now_us < press_us)
+        replay.Step();
+    CHECK(rig.engine.grid.active && rig.engine.grid.beats_per_bar == 4);
+    rig.record.Press();
+    while(rig.controls.now_us < press_us + 3200000) // 1.6 bars
+        replay.Step();
+    rig.record.Release();
+    while(rig.controls.now_us < press_us + 4500000)
+        replay.Step();
+
+    // Within the read jitter of the true bar and two bars long
+    const LooperLayer& layer = rig.layers[0];
+    double             bar   = stream.beats_us[8] * 0.048;
+    CHECK(layer.recorded && layer.sync_beats == 8 && layer.sync_start == 8);
+    CHECK(fabs((double)layer.take_start - bar) < 48.0);
+    CHECK(fabs((double)layer.record_len - 8 * 24000.0) < 8.0);
+
+    // Just before a bar, the take waits for it
+    Rig rig2(64, 65536);
+    MidiReplay<Rig> replay2(rig2, stream);
+    replay2.jitter_us = 1000.0;
+    press_us          = stream.beats_us[12] - 0.2 * 500000.0;
+    while(rig2.controls.now_us < press_us)
+        replay2.Step();
+    rig2.record.Press();
+    while(rig2.controls.now_us < press_us + 2000000)
+        replay2.Step();
+    rig2.record.Release();
+    while(rig2.controls.now_us < press_us + 3000000)
+        replay2.Step();
+    bar = stream.beats_us[12] * 0.048;
+    CHECK(rig2.layers[0].sync_beats == 4 && rig2.layers[0].sync_start == 12);
+    CHECK(fabs((double)rig2.layers[0].take_start - bar) < 48.0);
+}
+
+static void RunTo(MidiReplay<Rig>& replay, double us)
+{
+    while(replay.rig.controls.now_us < us)
+        replay.Step();
+}
+
+// A take on the grid, then the held-layer gestures through the buttons with
+// the speed and pan knobs left somewhere else: the hold picks the knobs up
+// where they are, so the layer keeps its speed, pan and place on the grid
+// until a knob is turned
+static void TestHeldGestures()
+{
+    Rig        rig(64, 65536);
+    MidiStream stream;
+    stream.Start(20000.0, 120.0f, 20.0);
+    MidiReplay<Rig> replay(rig, stream);
+    replay.jitter_us = 1000.0;
+
+    double press_us = stream.beats_us[12] - 0.2 * 500000.0;
+    RunTo(replay, press_us);
+    rig.record.Press();
+    RunTo(replay, press_us + 2000000);
+    rig.record.Release();
+    RunTo(replay, press_us + 3000000);
+    LooperLayer& layer = rig.layers[0];
+    CHECK(layer.recorded && layer.sync_beats == 4);
+    float pan = layer.pan;
+
+    rig.controls.adc[kAdcSpeed] = 0.0f; // 2.0x
+    rig.controls.adc[kAdcPan]   = 0.1f;
+    RunTo(replay, press_us + 3100000);
+    rig.layer_buttons[0].Press();
+    RunTo(replay, press_us + 3400000);
+    HostButton* gesture[] = {&rig.bypass, &rig.channel, &rig.record, &rig.record};
+    for(HostButton* button : gesture)
+    {
+        button->Press();
+        RunTo(replay, rig.controls.now_us + 50000);
+        button->Release();
+        RunTo(replay, rig.controls.now_us + 50000);
+    }
+    CHECK(layer.stretch);
+    CHECK(!rig.engine.automation[0].lanes[kLanePan].active);
+    CHECK(layer.sync_beats == 4 && fabsf(layer.speed - 1.0f) < 0.01f && layer.pan == pan); // the lock's trim only
+
+    // Turned: the speed is set by hand, off the grid
+    rig.controls.adc[kAdcSpeed] = 0.9f;
+    RunTo(replay, rig.controls.now_us + 10000);
+    rig.layer_buttons[0].Release();
+    RunTo(replay, rig.controls.now_us + 10000);
+    CHECK(layer.sync_beats == 0 && layer.speed < 0.5f && layer.pan == pan);
+}
+
+// Where the layer plays against where the true beats say it should, in
+// frames; output_delay after rendering is when the block is heard
+static double PhaseError(const Rig& rig, const MidiStream& stream)
+{
+    const LooperLayer& layer = rig.layers[0];
+    double             len   = (double)layer.record_len;
+    double             beat  = TrueBeat(stream, rig.engine.Now() + rig.engine.output_delay);
+    double             want  = fmod(beat - layer.sync_start, layer.sync_beats) / layer.sync_beats * len;
+    double             err   = (double)layer.play_phase * (1.0 / 4294967296.0) - want;
+    return err > 0.5 * len ? err - len : (err < -0.5 * len ? err + len : err);
+}
+
+// One bar recorded at 120 bpm, then the clock moves to 120.6 and on to
+// 119.4: locked, the layer follows to within the read jitter once the
+// tracker has caught up with each change; free, it walks off. Locked, a pass
+// of pan automation across the second change, through the buttons and the
+// pan knob with the speed knob left off 1.0x, leaves the speed to the lock:
+// the hold sends no speed, its trim is not recorded, and nothing stale is
+// replayed over it
+static void TestPhaseLock(bool lock, double& worst, double& final_speed)
+{
+    Rig        rig(64, 65536);
+    MidiStream stream;
+    stream.Start(20000.0, 120.0f, 10.0);
+    stream.Continue(120.6f, 30.0);
+    stream.Continue(119.4f, 30.0);
+    MidiReplay<Rig> replay(rig, stream);
+    replay.jitter_us   = 1000.0;
+    rig.control.grid_lock = lock;
+
+    while(rig.controls.now_us < 3000000)
+        replay.Step();
+    rig.record.Press();
+    while(rig.controls.now_us < 3000000 + 2000000)
+        replay.Step();
+    rig.record.Release();
+
+    worst = 0.0;
+    while(rig.controls.now_us < 68000000)
+    {
+        replay.Step();
+        uint32_t t = rig.controls.now_us;
+        if(lock && t == 38700000)
+        {
+            rig.controls.adc[kAdcSpeed] = 0.2f; // left off the 1.0x detent
+            rig.layer_buttons[0].Press();
+        }
+        if(lock && t == 39000000)
+            rig.record.Press();
+        if(lock && t == 39050000)
+            rig.record.Release();
+        if(lock && t > 39050000 && t <= 42000000)
+            rig.controls.adc[kAdcPan] = 0.5f + 0.3f * sinf((float)t * 2e-6f);
+        if(lock && t == 42000000)
+            rig.layer_buttons[0].Release();
+        if(t > 8000000 && (t < 10000000 || t > 16000000) && (t < 40000000 || t > 46000000))
+            worst = fmax(worst, fabs(PhaseError(rig, stream)));
+    }
+    CHECK(rig.layers[0].sync_beats == 4);
+    const LayerAutomation& automation = rig.engine.automation[0];
+    CHECK(!lock || (automation.lanes[kLanePan].active && !automation.lanes[kLaneSpeed].active));
+    final_speed = rig.layers[0].speed;
+}
+
+int main()
+{
+    InterpSinc::InitTable();
+    TimeStretch::InitTable();
+    TestTracker();
+    TestQuantizedTake();
+    TestHeldGestures();
+
+    double locked = 0.0, free_running = 0.0, speed = 0.0, free_speed = 0.0;
+    TestPhaseLock(true, locked, speed);
+    TestPhaseLock(false, free_running, free_speed);
+    CHECK(locked < 48.0); // the mean read delay, 24 frames, and a few either side
+    CHECK(free_running > 1000.0);
+    CHECK(fabs(speed - 119.4 / 120.0) < 0.001);
+    CHECK(free_speed == 1.0);
+    printf("phase error over 60 s: locked %.1f frames, free %.0f frames\n", locked, free_running);
+    return TestResult("test_midi_clock");
+}
@@ -0,0 +1,167 @@
+// Overdub and its copy-on-write history: sound on sound with feedback, undo
+// and redo restoring the take exactly, history memory proportional to the
+// blocks a pass touched, blocks copied ahead of the head rather than in one
+// go, level limits and running out of arena memory.
+
+#include <math.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+// One layer driven through the control task and engine, 1 ms per audio block
+struct Rig : LooperRig<kBlock>
+{
+    LooperLayer& layer;
+
+    explicit Rig(size_t pool_blocks) : LooperRig<kBlock>(pool_blocks), layer(layers[0])
+    {
+        control.selected_channel = 2; // Line: stereo takes
+    }
+
+    std::vector<float> Snapshot() const
+    {
+        std::vector<float> take;
+        for(size_t i = 0; i < layer.record_len; i++)
+            for(int ch = 0; ch < layer.storage.channels; ch++)
+                take.push_back(layer.storage.Read(i, ch));
+        return take;
+    }
+};
+
+static size_t ChangedFrames(const std::vector<float>& a, const std::vector<float>& b)
+{
+    size_t n = 0;
+    for(size_t i = 0; i < a.size(); i += 2)
+        n += a[i] != b[i] || a[i + 1] != b[i + 1];
+    return n;
+}
+
+static void TestOverdubUndoRedo()
+{
+    Rig rig(64);
+    rig.Hold(2000, 0.25f); // ~1.6 s stereo take
+    CHECK(rig.layer.recorded);
+    size_t take_blocks = rig.arena.UsedBlocks();
+    CHECK(take_blocks == rig.layer.storage.num_blocks);
+
+    std::vector<float> before = rig.Snapshot();
+    rig.layer.feedback        = 0.5f;
+
+    // 400 blocks of hold before the overdub starts, then 200 blocks of it
+    rig.Hold(600, 0.1f);
+    CHECK(!rig.layer.overdubbing);
+    std::vector<float> after   = rig.Snapshot();
+    size_t             changed = ChangedFrames(before, after);
+    CHECK(changed >= 199 * kBlock && changed <= 201 * kBlock);
+
+    bool mixed = true;
+    for(size_t i = 0; i < after.size(); i += 2)
+        if(after[i] != before[i])
+            mixed = mixed && fabsf(after[i] - (before[i] * 0.5f + 0.1f)) < 1e-4f
+                    && fabsf(after[i + 1] - (before[i + 1] * 0.5f - 0.1f)) < 1e-4f;
+    CHECK(mixed);
+
+    // Only the touched blocks were copied
+    HistoryStats stats = rig.layer.history.GetStats();
+    size_t       fpb   = rig.layer.storage.FramesPerBlock();
+    CHECK(stats.undo_levels == 1);
+    CHECK(stats.blocks >= 1 && stats.blocks <= (changed + fpb - 1) / fpb + 1);
+    CHECK(stats.bytes == stats.blocks * kArenaBlockBytes);
+    CHECK(rig.arena.UsedBlocks() == take_blocks + stats.blocks);
+
+    // Double click undoes without copying and keeps the loop playing
+    rig.Click();
+    rig.Click();
+    CHECK(!rig.layer.paused);
+    CHECK(rig.layer.recorded);
+    CHECK(rig.Snapshot() == before);
+    CHECK(rig.arena.UsedBlocks() == take_blocks + stats.blocks);
+    CHECK(rig.layer.history.GetStats().redo_levels == 1);
+
+    CHECK(rig.layer.Redo());
+    CHECK(rig.Snapshot() == after);
+    CHECK(!rig.layer.Redo());
+
+    // A new pass after an undo drops the redo level and its blocks
+    CHECK(rig.layer.Undo());
+    rig.Hold(450, 0.2f);
+    stats = rig.layer.history.GetStats();
+    CHECK(stats.undo_levels == 1 && stats.redo_levels == 0);
+    CHECK(rig.arena.UsedBlocks() == take_blocks + stats.blocks);
+
+    // With nothing left to undo a double click erases as before
+    rig.Click();
+    rig.Click();
+    CHECK(rig.Snapshot() == before);
+    rig.Click();
+    rig.Click();
+    CHECK(!rig.layer.recorded);
+    CHECK(rig.arena.UsedBlocks() == 0);
+}
+
+static void TestLevelLimit()
+{
+    Rig rig(64);
+    rig.Hold(2000, 0.25f);
+    for(int pass = 0; pass < kMaxUndoLevels + 3; pass++)
+        rig.Hold(420, 0.01f);
+
+    HistoryStats stats = rig.layer.history.GetStats();
+    CHECK(stats.undo_levels == kMaxUndoLevels);
+    CHECK(stats.dropped_levels == 3);
+    CHECK(rig.arena.UsedBlocks() == rig.layer.storage.num_blocks + stats.blocks);
+
+    int undone = 0;
+    while(rig.layer.Undo())
+        undone++;
+    CHECK(undone == kMaxUndoLevels);
+}
+
+// A pass over the whole loop and round again: every block but the first is
+// copied ahead of the head, a chunk per audio block, and undo still restores
+// the take exactly
+static void TestCopyAhead()
+{
+    Rig rig(64);
+    rig.Hold(2000, 0.25f);
+    std::vector<float> before = rig.Snapshot();
+    size_t             slots  = rig.layer.storage.num_blocks;
+    CHECK(slots >= 3);
+
+    rig.Hold(400 + 2500, 0.1f);
+    TakeHistory& history = rig.layer.history;
+    CHECK(history.GetStats().blocks == slots);
+    CHECK(history.whole_copies == 1);
+    CHECK(history.ahead_slot < 0);
+    CHECK(rig.arena.UsedBlocks() == slots + history.GetStats().blocks);
+    CHECK(rig.layer.Undo());
+    CHECK(rig.Snapshot() == before);
+}
+
+// A pass that cannot get blocks drops the older levels, then overdubs in place
+static void TestArenaFull()
+{
+    Rig rig(12);
+    rig.Hold(6000, 0.25f); // fills the arena
+    CHECK(rig.arena.FreeBlocks() <= 1);
+    std::vector<float> before = rig.Snapshot();
+
+    rig.Hold(400 + 1000, 0.1f);
+    HistoryStats stats = rig.layer.history.GetStats();
+    CHECK(stats.undo_levels == 0);
+    CHECK(stats.blocks == 0);
+    CHECK(!rig.layer.history.CanUndo());
+    CHECK(ChangedFrames(before, rig.Snapshot()) >= 999 * kBlock);
+    CHECK(rig.arena.UsedBlocks() == rig.layer.storage.num_blocks);
+}
+
+int main()
+{
+    TestOverdubUndoRedo();
+    TestLevelLimit();
+    TestCopyAhead();
+    TestArenaFull();
+    return TestResult("test_overdub");
+}
@@ -0,0 +1,247 @@
+// Session persistence: SPSC queue behaviour, save/restore round trip through
+// the file-backed device (latency included), loading a version 1 session,
+// lazy restore starting playback before the load completes, and an
+// interrupted save leaving no session behind.
+
+#include <string>
+#include <vector>
+#include "session_store.h"
+#include "host_io.h"
+#include "test_util.h"
+
+static const size_t kBlock      = 48;
+static const size_t kPoolBytes  = 16 * 1024 * 1024;
+static const int    kNumLayers  = 5;
+static std::string  session_path = std::string(P_tmpdir) + "/looper_test_persist.bin";
+
+static TestRandom rng = {99};
+
+// A booted device: arena, layers and a session store on the session file
+struct Box
+{
+    std::vector<uint8_t>      pool;
+    SampleArena               arena;
+    LooperLayer               layers[kNumLayers];
+    std::vector<PersistChunk> chunks;
+    HostFileDevice            device;
+    SessionStore              store;
+    float                     out_l[kBlock], out_r[kBlock];
+
+    Box(bool truncate) : pool(kPoolBytes), chunks(kPersistChunks)
+    {
+        arena.Init(pool.data(), pool.size());
+        for(int i = 0; i < kNumLayers; i++)
+            layers[i].Init(&arena);
+        device.Open(session_path.c_str(), truncate);
+        store.Init(&device, layers, kNumLayers, chunks.data());
+    }
+
+    void Take(int layer, size_t frames, int channels)
+    {
+        LooperLayer& l = layers[layer];
+        l.storage.Begin(channels);
+        for(size_t i = 0; i < frames; i++)
+            l.storage.Write(i, rng.Noise(0.5f), rng.Noise(0.5f));
+        l.record_len = l.write_idx = frames;
+        l.recorded = true;
+        l.recorded_channel = channels == 2 ? 2 : 1;
+    }
+
+    // One audio callback; returns the layers that made sound
+    int Callback()
+    {
+        store.AudioService();
+        int audible = 0;
+        for(int i = 0; i < kNumLayers; i++)
+        {
+            for(size_t k = 0; k < kBlock; k++)
+                out_l[k] = out_r[k] = 0.0f;
+            float*       out[2] = {out_l, out_r};
+            const float* in[2]  = {out_l, out_r};
+            layers[i].Render(in, out, kBlock, 1.0f);
+            bool sound = false;
+            for(size_t k = 0; k < kBlock; k++)
+                sound = sound || out_l[k] != 0.0f || out_r[k] != 0.0f;
+            audible |= sound << i;
+        }
+        return audible;
+    }
+
+    std::vector<uint8_t> Raw(int layer) const
+    {
+        const LooperLayer&   l = layers[layer];
+        std::vector<uint8_t> data(l.record_len * l.storage.FrameBytes());
+        l.storage.ReadRaw(0, data.data(), l.record_len);
+        return data;
+    }
+};
+
+static void TestQueue()
+{
+    SpscQueue<int, 4> q;
+    int               v = 0;
+    CHECK(!q.Pop(v));
+    bool ok = true;
+    for(int round = 0; round < 100; round++)
+    {
+        for(int i = 0; i < 4; i++)
+            ok = ok && q.Push(round * 10 + i);
+        ok = ok && !q.Push(-1) && q.Size() == 4;
+        for(int i = 0; i < 4; i++)
+            ok = ok && q.Pop(v) && v == round * 10 + i;
+        ok = ok && !q.Pop(v);
+    }
+    CHECK(ok);
+}
+
+static void TestRoundTrip()
+{
+    std::vector<uint8_t> saved[kNumLayers];
+    {
+        Box box(true);
+        box.Take(0, 48000 * 3 + 17, 2);
+        box.Take(2, 12345, 1);
+        box.Take(4, 100, 2);
+        box.layers[2].speed  = 1.5f;
+        box.layers[2].pan    = 0.2f;
+        box.layers[4].paused = true;
+        box.store.latency    = 187;
+        for(int i = 0; i < kNumLayers; i++)
+            saved[i] = box.Raw(i);
+
+        CHECK(box.store.RequestSave());
+        CHECK(!box.store.RequestSave()); // one at a time
+        for(int step = 0; step < 100000 && box.store.Busy(); step++)
+        {
+            box.store.Poll();
+            box.Callback();
+        }
+        CHECK(!box.store.Busy());
+        CHECK(box.store.stats.saves == 1);
+        CHECK(box.store.stats.io_errors == 0);
+    }
+
+    Box boot(false);
+    CHECK(boot.store.BeginLoad());
+    for(int step = 0; step < 100000 && boot.store.Busy(); step++)
+    {
+        boot.store.Poll();
+        boot.Callback();
+    }
+    CHECK(boot.store.stats.loads == 1);
+    for(int i = 0; i < kNumLayers; i++)
+    {
+        CHECK(boot.Raw(i) == saved[i]);
+        CHECK(!boot.layers[i].loading);
+    }
+    CHECK(boot.layers[0].recorded && boot.layers[0].storage.channels == 2);
+    CHECK(boot.layers[2].storage.channels == 1 && boot.layers[2].speed == 1.5f && boot.layers[2].pan == 0.2f);
+    CHECK(!boot.layers[1].recorded && !boot.layers[3].recorded);
+    CHECK(boot.layers[4].paused);
+    CHECK(boot.store.latency == 187);
+}
+
+// A session saved before the latency was kept loads, leaving it unmeasured
+static void TestVersion1()
+{
+    {
+        Box box(true);
+        box.Take(0, 4800, 2);
+        box.store.latency = 187;
+        box.store.RequestSave();
+        while(box.store.Busy())
+        {
+            box.store.Poll();
+            box.Callback();
+        }
+        SessionHeader old = box.store.header;
+        old.version       = 1;
+        old.latency       = 0xFFFFFFFFu; // whatever followed the shorter header
+        CHECK(box.device.Write(0, &old, sizeof(old)));
+    }
+    Box boot(false);
+    CHECK(boot.store.BeginLoad());
+    CHECK(boot.store.latency == 0);
+    while(boot.store.Busy())
+    {
+        boot.store.Poll();
+        boot.Callback();
+    }
+    CHECK(boot.layers[0].recorded && boot.layers[0].record_len == 4800);
+}
+
+// With one chunk read per callback, layers sound long before the load is done
+static void TestLazyLoad()
+{
+    {
+        Box box(true);
+        for(int i = 0; i < kNumLayers; i++)
+            box.Take(i, 48000 * 4, 2);
+        box.store.RequestSave();
+        while(box.store.Busy())
+        {
+            box.store.Poll();
+            box.Callback();
+        }
+    }
+
+    Box boot(false);
+    CHECK(boot.store.BeginLoad());
+    int first_audio[kNumLayers] = {-1, -1, -1, -1, -1};
+    int done                    = -1;
+    for(int block = 0; block < 20000 && done < 0; block++)
+    {
+        boot.store.Poll();
+        int audible = boot.Callback();
+        for(int i = 0; i < kNumLayers; i++)
+            if(first_audio[i] < 0 && (audible >> i & 1))
+                first_audio[i] = block;
+        if(!boot.store.Busy())
+            done = block;
+    }
+    printf("restore: first audio after %d..%d blocks, fully loaded after %d blocks\n",
+           first_audio[0], first_audio[kNumLayers - 1], done);
+    for(int i = 0; i < kNumLayers; i++)
+        CHECK(first_audio[i] >= 0 && first_audio[i] < 20);
+    CHECK(done > 100);
+}
+
+static void TestInterruptedSave()
+{
+    {
+        Box box(true);
+        box.Take(1, 48000, 2);
+        box.store.RequestSave();
+        while(box.store.Busy())
+        {
+            box.store.Poll();
+            box.Callback();
+        }
+    }
+    {
+        // Power lost halfway through a second save
+        Box box(false);
+        box.Take(1, 48000, 2);
+        box.store.RequestSave();
+        for(int step = 0; step < 5; step++)
+        {
+            box.store.Poll();
+            box.Callback();
+        }
+        CHECK(box.store.Busy());
+    }
+    Box boot(false);
+    CHECK(!boot.store.BeginLoad());
+    CHECK(!boot.store.Busy());
+}
+
+int main()
+{
+    TestQueue();
+    TestRoundTrip();
+    TestVersion1();
+    TestLazyLoad();
+    TestInterruptedSave();
+    remove(session_path.c_str());
+    return TestResult("test_persist");
+}
@@ -0,0 +1,139 @@
+// Pre-roll: takes start on the sample the record button went down and end on
+// the sample it came up, wherever the edges fall within a block, whether the
+// release is seen in time or late, and how far back the pre-roll reaches.
+
+#include <math.h>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t   kBlock   = 48;
+static const size_t   kPreRoll = 32768;
+static const uint32_t kPeriod  = 512;
+
+typedef LooperRig<kBlock> Rig;
+
+// A sawtooth whose value tells which frame (mod kPeriod) it was captured at,
+// with steps far above the 16-bit dither
+static float Saw(uint32_t frame)
+{
+    return ((float)(frame % kPeriod) - kPeriod / 2) / kPeriod;
+}
+
+static uint32_t FrameOf(float v)
+{
+    return (uint32_t)lroundf(v * kPeriod + kPeriod / 2) % kPeriod;
+}
+
+// Run blocks until the engine has rendered `frame`
+static void RunTo(Rig& rig, uint32_t frame)
+{
+    while(rig.engine.Now() < frame)
+    {
+        uint32_t start = rig.engine.Now();
+        for(size_t i = 0; i < kBlock; i++)
+        {
+            rig.in_l[i] = Saw(start + (uint32_t)i);
+            rig.in_r[i] = -Saw(start + (uint32_t)i);
+        }
+        rig.Step();
+    }
+}
+
+// Milliseconds between `frame` and the end of the block the next Step() runs,
+// less the one tick Step() adds: the control task then sees the edge at `frame`
+static float Ago(const Rig& rig, uint32_t frame)
+{
+    return ((float)(rig.engine.Now() + kBlock) - (float)frame) / 48.0f - 1.0f;
+}
+
+// Press at `press`, release at `release`; the release is noticed `late` blocks after it
+static void Take(Rig& rig, uint32_t press, uint32_t release, int late)
+{
+    RunTo(rig, press - press % kBlock);
+    rig.record.Press(Ago(rig, press));
+    RunTo(rig, release - release % kBlock + late * kBlock);
+    rig.record.Release(Ago(rig, release));
+    RunTo(rig, rig.engine.Now() + kBlock);
+}
+
+static bool TakeMatches(const LooperLayer& layer, uint32_t press, uint32_t release)
+{
+    if(!layer.recorded || layer.record_len != release - press)
+        return false;
+    return FrameOf(layer.storage.Read(0, 0)) == press % kPeriod
+           && FrameOf(layer.storage.Read(layer.record_len - 1, 0)) == (release - 1) % kPeriod
+           && FrameOf(layer.storage.Read(layer.record_len / 2, 0)) == (press + layer.record_len / 2) % kPeriod;
+}
+
+static void TestSampleAccurate()
+{
+    // Edges at arbitrary offsets, release seen within its block or up to 5 blocks late
+    const uint32_t offsets[][2] = {{0, 0}, {1, 47}, {17, 5}, {47, 1}, {23, 24}, {30, 0}};
+    int            all          = 0;
+    for(int late = 0; late <= 5; late++)
+    {
+        for(const auto& o : offsets)
+        {
+            Rig rig(64, kPreRoll);
+            rig.control.selected_channel = 2;
+            uint32_t press   = 4800 + o[0];
+            uint32_t release = press + 30000 + o[1];
+            Take(rig, press, release, late);
+            bool ok = TakeMatches(rig.layers[0], press, release);
+            if(!ok)
+                printf("press %u release %u late %d: %zu frames\n",
+                       press, release, late, rig.layers[0].record_len);
+            all += ok;
+        }
+    }
+    CHECK(all == 6 * 6);
+}
+
+// A quick long press: released just after recording started
+static void TestShortTake()
+{
+    Rig rig(64, kPreRoll);
+    rig.control.selected_channel = 2;
+    uint32_t press   = 1000 + 7;
+    uint32_t release = press + 48 * 401 + 3;
+    Take(rig, press, release, 0);
+    CHECK(TakeMatches(rig.layers[0], press, release));
+}
+
+// A hold longer than the pre-roll can only reach back kPreRoll frames; the
+// back-dated part is counted in the engine stats
+static void TestPreRollLimit()
+{
+    Rig rig(64, 16384);
+    rig.control.selected_channel = 2;
+    RunTo(rig, 48000);
+    rig.record.Press(500.0f); // pressed 24000 frames ago
+    RunTo(rig, 48000 + 48);
+    rig.record.Release(0.0f);
+    RunTo(rig, 48000 + 96);
+    const LooperLayer& layer = rig.layers[0];
+    CHECK(layer.record_len == 16384);
+    CHECK(FrameOf(layer.storage.Read(0, 0)) == (48000 + 48 - 16384) % kPeriod);
+    CHECK(rig.engine.stats.max_backdate == 16384 - 48);
+}
+
+// Without a pre-roll the take starts where the long press was recognised
+static void TestNoPreRoll()
+{
+    Rig rig(64);
+    rig.control.selected_channel = 2;
+    Take(rig, 4800, 4800 + 30000, 0);
+    const LooperLayer& layer = rig.layers[0];
+    CHECK(layer.recorded);
+    CHECK(layer.record_len < 30000 - 400 * 48 + kBlock);
+    CHECK(rig.engine.stats.max_backdate == 0);
+}
+
+int main()
+{
+    TestSampleAccurate();
+    TestShortTake();
+    TestPreRollLimit();
+    TestNoPreRoll();
+    return TestResult("test_preroll");
+}
@@ -0,0 +1,370 @@
+// Fixed-point resampler: the block kernel (scalar and SIMD runs) and the
+// staged playback path must match a straightforward per-sample reference bit
+// for bit, including loop wrap, storage block boundaries, mono/stereo layouts
+// and every storage format. The sinc's tables for faster speeds keep what
+// would fold back over Nyquist down.
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "playback_stage.h"
+#include "resampler.h"
+#include "test_util.h"
+
+static TestRandom rng = {12345};
+
+// Lays l/r out like LoopStorage: interleaved Fmt frames in fpb-frame blocks,
+// with the block table deliberately out of address order. dec_l/dec_r hold
+// the stored values decoded back to float for the reference.
+template <typename Fmt>
+struct TestLoop
+{
+    std::vector<uint8_t>  pool;
+    std::vector<uint16_t> blocks;
+    std::vector<float>    dec_l, dec_r;
+    LoopSource            src;
+
+    TestLoop(const std::vector<float>& l, const std::vector<float>& r, int channels, uint32_t fpb)
+    {
+        uint32_t len         = (uint32_t)l.size();
+        size_t   block_bytes = (size_t)fpb * channels * Fmt::kBytes;
+        size_t   num_blocks  = (len + fpb - 1) / fpb;
+        uint32_t dither      = 1;
+
+        pool.assign(num_blocks * block_bytes, 0);
+        for(size_t b = 0; b < num_blocks; b++)
+            blocks.push_back((uint16_t)(num_blocks - 1 - b));
+
+        for(uint32_t i = 0; i < len; i++)
+        {
+            typename Fmt::Unit* frame = (typename Fmt::Unit*)(pool.data() + blocks[i / fpb] * block_bytes)
+                                        + (i % fpb) * channels * Fmt::kUnits;
+            Fmt::Store(frame, 0, l[i], dither);
+            if(channels == 2)
+                Fmt::Store(frame, 1, r[i], dither);
+            dec_l.push_back(Fmt::Load(frame, 0));
+            dec_r.push_back(Fmt::Load(frame, channels - 1));
+        }
+        src = {pool.data(), blocks.data(), block_bytes, fpb, channels, len};
+    }
+};
+
+// Per-sample reference on the flat arrays: taps gathered modulo len and the
+// phase wrapped on every step
+template <typename Interp>
+static void ReferenceBlock(const std::vector<float>& l,
+                           const std::vector<float>& r,
+                           Phase&                    phase,
+                           Phase                     inc,
+                           float*                    out_l,
+                           float*                    out_r,
+                           size_t                    size,
+                           const ParamRamp&          gain_l,
+                           const ParamRamp&          gain_r)
+{
+    const int64_t len = (int64_t)l.size();
+    const Phase   end = PhaseFromIndex((uint32_t)len);
+    Interp::Prepare((float)inc * (1.0f / 4294967296.0f));
+    for(size_t i = 0; i < size; i++)
+    {
+        float tl[Interp::kTaps], tr[Interp::kTaps];
+        for(int k = 0; k < Interp::kTaps; k++)
+        {
+            int64_t j = ((int64_t)(phase >> 32) - Interp::kPre + k) % len;
+            j         = j < 0 ? j + len : j;
+            tl[k]     = l[j];
+            tr[k]     = r[j];
+        }
+        float frac = (float)((uint32_t)phase >> 8) * (1.0f / 16777216.0f);
+        float gl   = gain_l.value + gain_l.step * (float)(i + 1);
+        float gr   = gain_r.value + gain_r.step * (float)(i + 1);
+        out_l[i] += Interp::template Interpolate<FormatF32, 1>(tl + Interp::kPre, frac) * gl;
+        out_r[i] += Interp::template Interpolate<FormatF32, 1>(tr + Interp::kPre, frac) * gr;
+        phase = (phase + inc) % end;
+    }
+}
+
+static bool SameBits(const std::vector<float>& a, const std::vector<float>& b)
+{
+    return memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+template <typename Interp, typename Fmt, int C>
+static void TestMatchesReference()
+{
+    const uint32_t lens[]   = {1, 2, 3, 5, 8, 9, 17, 1000, 48001};
+    const uint32_t fpbs[]   = {3, 16, 1000, 1u << 24};
+    const float    speeds[] = {0.3f, 0.5f, 0.77f, 1.0f, 1.37f, 2.0f};
+    const size_t   sizes[]  = {1, 4, 7, 48, 256};
+
+    for(uint32_t len : lens)
+    {
+        std::vector<float> l(len), r(len);
+        for(uint32_t i = 0; i < len; i++)
+        {
+            l[i] = rng.Noise();
+            r[i] = C == 2 ? rng.Noise() : l[i];
+        }
+
+        for(uint32_t fpb : fpbs)
+        {
+            TestLoop<Fmt> loop(l, r, C, fpb);
+            for(float speed : speeds)
+            {
+                for(size_t size : sizes)
+                {
+                    Phase inc       = PhaseIncrement(speed);
+                    Phase start     = ((Phase)rng.Next() << 32 | rng.Next()) % PhaseFromIndex(len);
+                    Phase ref_phase = start, scalar_phase = start, simd_phase = start, staged_phase = start;
+
+                    std::vector<float> ref_l(size), ref_r(size);
+                    std::vector<float> scalar_l(size), scalar_r(size);
+                    std::vector<float> simd_l(size), simd_r(size);
+                    std::vector<float> staged_l(size), staged_r(size);
+                    PlaybackStage      stage;
+
+                    bool      exact = true;
+                    ParamRamp gain_l, gain_r;
+                    for(int b = 0; b < 20; b++)
+                    {
+                        gain_l.SetTarget(rng.Noise() + 1.0f, size);
+                        gain_r.SetTarget(rng.Noise() + 1.0f, size);
+                        for(size_t i = 0; i < size; i++)
+                        {
+                            float bed = rng.Noise();
+                            ref_l[i] = scalar_l[i] = simd_l[i] = staged_l[i] = bed;
+                            ref_r[i] = scalar_r[i] = simd_r[i] = staged_r[i] = -bed;
+                        }
+
+                        ReferenceBlock<Interp>(loop.dec_l, loop.dec_r, ref_phase, inc, ref_l.data(), ref_r.data(), size, gain_l, gain_r);
+                        ResampleBlockWith<Interp, Fmt, C, ResampleRunScalar<Interp, Fmt, C>>(
+                            loop.src, scalar_phase, inc, scalar_l.data(), scalar_r.data(), size, gain_l, gain_r);
+                        ResampleBlock<Interp, Fmt>(
+                            loop.src, simd_phase, inc, simd_l.data(), simd_r.data(), size, gain_l, gain_r);
+                        ResampleStaged<Interp, Fmt>(
+                            stage, loop.src, staged_phase, inc, staged_l.data(), staged_r.data(), size, gain_l, gain_r);
+
+                        exact = exact && SameBits(ref_l, scalar_l) && SameBits(ref_r, scalar_r);
+                        exact = exact && SameBits(ref_l, simd_l) && SameBits(ref_r, simd_r);
+                        exact = exact && SameBits(ref_l, staged_l) && SameBits(ref_r, staged_r);
+                        exact = exact && ref_phase == scalar_phase && ref_phase == simd_phase && ref_phase == staged_phase;
+                        gain_l.Finish();
+                        gain_r.Finish();
+                    }
+                    if(!exact)
+                        printf("mismatch: %d bytes channels %d len %u fpb %u speed %.2f size %zu\n",
+                               Fmt::kBytes, C, len, fpb, speed, size);
+                    CHECK(exact);
+                }
+            }
+        }
+    }
+}
+
+// At 1.0x the phase fraction stays exactly zero over a full-size loop, so the
+// output is the recording itself, including across the wrap point.
+static void TestLongLoopIsExact()
+{
+    const uint32_t     len = 1600000;
+    std::vector<float> l(len), r(len);
+    for(uint32_t i = 0; i < len; i++)
+    {
+        l[i] = rng.Noise();
+        r[i] = rng.Noise();
+    }
+    TestLoop<FormatF32> loop(l, r, 2, 4096);
+
+    ParamRamp unity;
+    unity.Snap(1.0f);
+
+    const size_t       block = 48;
+    std::vector<float> out_l(block), out_r(block);
+    Phase              phase  = PhaseFromIndex(len - 1000);
+    uint32_t           expect = len - 1000;
+    bool               exact  = true;
+    for(size_t b = 0; b < (2 * len) / block; b++)
+    {
+        for(size_t i = 0; i < block; i++)
+            out_l[i] = out_r[i] = 0.0f;
+        ResampleBlock<InterpLinear, FormatF32>(loop.src, phase, PhaseIncrement(1.0f), out_l.data(), out_r.data(), block, unity, unity);
+        for(size_t i = 0; i < block; i++)
+        {
+            exact  = exact && out_l[i] == l[expect] && out_r[i] == r[expect];
+            expect = (expect + 1) % len;
+        }
+    }
+    CHECK(exact);
+    CHECK(PhaseIndex(phase) == expect);
+    CHECK((uint32_t)phase == 0);
+}
+
+// RMS error against the ideal signal when replaying a 5 kHz sine at 0.5x
+template <typename Interp, typename Fmt = FormatF32>
+static float SineErrorRms()
+{
+    const uint32_t     len = 48000;
+    const float        w   = 2.0f * 3.14159265f * 5000.0f / 48000.0f;
+    std::vector<float> x(len);
+    for(uint32_t i = 0; i < len; i++)
+        x[i] = sinf(w * i);
+    TestLoop<Fmt> loop(x, x, 1, 8192);
+
+    ParamRamp unity;
+    unity.Snap(1.0f);
+
+    const size_t       frames = 4096;
+    std::vector<float> out_l(frames, 0.0f), out_r(frames, 0.0f);
+    Phase              phase = PhaseFromIndex(1000);
+    ResampleBlock<Interp, Fmt>(loop.src, phase, PhaseIncrement(0.5f), out_l.data(), out_r.data(), frames, unity, unity);
+
+    double err = 0.0;
+    for(size_t i = 0; i < frames; i++)
+    {
+        double e = out_l[i] - sin(w * (1000.0 + 0.5 * i));
+        err += e * e;
+    }
+    return (float)sqrt(err / frames);
+}
+
+static void TestQualityTiers()
+{
+    float linear  = SineErrorRms<InterpLinear>();
+    float hermite = SineErrorRms<InterpHermite>();
+    float sinc    = SineErrorRms<InterpSinc>();
+    printf("5 kHz sine at 0.5x, rms error: linear %.2e, hermite %.2e, sinc %.2e\n", linear, hermite, sinc);
+    CHECK(hermite < linear);
+    CHECK(sinc < hermite);
+}
+
+// At 2.0x a 19.2 kHz sine lands at 38.4 kHz, past the output's Nyquist, and
+// whatever the interpolator lets through folds back to 9.6 kHz: the sinc's
+// 2.0x bank, cut off at 0.225 of the source's rate, keeps that well down.
+// A 4 kHz sine at 2.0x still comes through
+template <typename Interp>
+static float SineRms(float hz, float speed)
+{
+    const uint32_t     len = 48000;
+    const float        w   = 2.0f * 3.14159265f * hz / 48000.0f;
+    std::vector<float> x(len);
+    for(uint32_t i = 0; i < len; i++)
+        x[i] = sinf(w * i);
+    TestLoop<FormatF32> loop(x, x, 1, 8192);
+
+    ParamRamp unity;
+    unity.Snap(1.0f);
+    const size_t       frames = 4096;
+    std::vector<float> out_l(frames, 0.0f), out_r(frames, 0.0f);
+    Phase              phase = PhaseFromIndex(1000);
+    ResampleBlock<Interp, FormatF32>(loop.src, phase, PhaseIncrement(speed), out_l.data(), out_r.data(), frames, unity,
+                                     unity);
+    double sum = 0.0;
+    for(size_t i = 0; i < frames; i++)
+        sum += out_l[i] * out_l[i];
+    return (float)sqrt(sum / frames) * 1.41421356f; // of a full-scale sine
+}
+
+static void TestAliasing()
+{
+    float hermite = SineRms<InterpHermite>(19200.0f, 2.0f);
+    float sinc    = SineRms<InterpSinc>(19200.0f, 2.0f);
+    float at_1x   = SineRms<InterpSinc>(19200.0f, 1.0f);
+    float pass    = SineRms<InterpSinc>(4000.0f, 2.0f);
+    printf("19.2 kHz sine at 2.0x, aliased level: hermite %.3f, sinc %.3f; 4 kHz at 2.0x: sinc %.3f\n", hermite, sinc,
+           pass);
+    CHECK(sinc < 0.1f && sinc < 0.2f * hermite);
+    CHECK(at_1x > 0.5f); // at 1.0x it is below Nyquist and kept
+    CHECK(pass > 0.9f);
+}
+
+// Steady playback is served by the previous block's prefetch; speeding up
+// or invalidation falls back to an on-demand fetch and stays exact
+static void TestStagePrefetch()
+{
+    const uint32_t     len = 20000;
+    std::vector<float> l(len), r(len);
+    for(uint32_t i = 0; i < len; i++)
+    {
+        l[i] = rng.Noise();
+        r[i] = rng.Noise();
+    }
+    TestLoop<FormatS16> loop(l, r, 2, 3000);
+
+    ParamRamp unity;
+    unity.Snap(1.0f);
+    PlaybackStage      stage;
+    const size_t       block = 48;
+    std::vector<float> ref_l(block), ref_r(block), out_l(block), out_r(block);
+    Phase              ref_phase = PhaseFromIndex(len - 300), phase = ref_phase;
+    bool               exact     = true;
+    for(int b = 0; b < 1000; b++)
+    {
+        Phase inc = PhaseIncrement(b < 500 ? 0.5f : 1.37f);
+        if(b == 700)
+            stage.Invalidate();
+        for(size_t i = 0; i < block; i++)
+            ref_l[i] = ref_r[i] = out_l[i] = out_r[i] = 0.0f;
+        ReferenceBlock<InterpHermite>(loop.dec_l, loop.dec_r, ref_phase, inc, ref_l.data(), ref_r.data(), block, unity, unity);
+        ResampleStaged<InterpHermite, FormatS16>(stage, loop.src, phase, inc, out_l.data(), out_r.data(), block, unity, unity);
+        exact = exact && SameBits(ref_l, out_l) && SameBits(ref_r, out_r) && ref_phase == phase;
+    }
+    CHECK(exact);
+    CHECK(stage.stats.fills == 3); // first block, speed change, invalidation
+    CHECK(stage.stats.prefetch_hits == 997);
+}
+
+// Integer storage adds its dithered quantization noise on top of the
+// interpolation error: ~-95 dBFS for 16-bit, negligible for 24-bit
+static void TestFormatNoise()
+{
+    float f32 = SineErrorRms<InterpSinc, FormatF32>();
+    float s16 = SineErrorRms<InterpSinc, FormatS16>();
+    float s24 = SineErrorRms<InterpSinc, FormatS24>();
+    printf("5 kHz sine at 0.5x, sinc, rms error: f32 %.2e, s16 %.2e, s24 %.2e\n", f32, s16, s24);
+    CHECK(s16 < f32 + 5e-5f);
+    CHECK(fabsf(s24 - f32) < 1e-6f);
+}
+
+// Store/Load round trip, clamping and sign handling of the integer formats
+template <typename Fmt>
+static void TestRoundTrip(float lsb)
+{
+    typename Fmt::Unit buf[4 * Fmt::kUnits];
+    uint32_t           dither = 1;
+    bool               ok     = true;
+    for(int i = 0; i < 10000; i++)
+    {
+        float x = rng.Noise() * 0.99f;
+        Fmt::Store(buf, 1, x, dither);
+        ok = ok && fabsf(Fmt::Load(buf, 1) - x) <= 1.5f * lsb;
+    }
+    CHECK(ok);
+
+    Fmt::Store(buf, 0, 2.0f, dither);
+    Fmt::Store(buf, 3, -2.0f, dither);
+    CHECK(Fmt::Load(buf, 0) == 1.0f - lsb);
+    CHECK(Fmt::Load(buf, 3) == -1.0f);
+}
+
+int main()
+{
+    InterpSinc::InitTable();
+    TestMatchesReference<InterpLinear, FormatF32, 1>();
+    TestMatchesReference<InterpLinear, FormatF32, 2>();
+    TestMatchesReference<InterpHermite, FormatF32, 1>();
+    TestMatchesReference<InterpHermite, FormatF32, 2>();
+    TestMatchesReference<InterpSinc, FormatF32, 1>();
+    TestMatchesReference<InterpSinc, FormatF32, 2>();
+    TestMatchesReference<InterpHermite, FormatS16, 1>();
+    TestMatchesReference<InterpHermite, FormatS16, 2>();
+    TestMatchesReference<InterpHermite, FormatS24, 1>();
+    TestMatchesReference<InterpHermite, FormatS24, 2>();
+    TestMatchesReference<InterpSinc, FormatS24, 2>();
+    TestLongLoopIsExact();
+    TestQualityTiers();
+    TestAliasing();
+    TestStagePrefetch();
+    TestFormatNoise();
+    TestRoundTrip<FormatS16>(1.0f / 32768.0f);
+    TestRoundTrip<FormatS24>(1.0f / 8388608.0f);
+    return TestResult("test_resampler");
+}
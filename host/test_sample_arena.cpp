@@ -0,0 +1,149 @@
+// Sample arena: block accounting, mono vs stereo footprint, one layer using
+// all free memory, erase returning blocks, and the utilization stats.
+
+#include <math.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kPoolBlocks = 64;
+
+static void TestAllocFree()
+{
+    std::vector<uint8_t> pool(kPoolBlocks * kArenaBlockBytes);
+    SampleArena          arena;
+    arena.Init(pool.data(), pool.size());
+    CHECK(arena.FreeBlocks() == kPoolBlocks);
+
+    std::vector<uint16_t> got;
+    for(size_t i = 0; i < kPoolBlocks; i++)
+        got.push_back(arena.Alloc());
+    CHECK(arena.UsedBlocks() == kPoolBlocks);
+    CHECK(arena.Alloc() == kNoBlock);
+    CHECK(arena.GetStats().alloc_failures == 1);
+
+    arena.Free(got[3]);
+    arena.Free(got[3]); // double free is ignored
+    CHECK(arena.FreeBlocks() == 1);
+    CHECK(arena.Alloc() == got[3]);
+
+    for(uint16_t b : got)
+        arena.Free(b);
+    ArenaStats stats = arena.GetStats();
+    CHECK(stats.used_blocks == 0);
+    CHECK(stats.peak_used_blocks == kPoolBlocks);
+    CHECK(stats.largest_free_run == kPoolBlocks);
+    CHECK(stats.fragmentation == 0.0f);
+}
+
+static void TestMonoUsesHalfTheBlocks()
+{
+    std::vector<uint8_t> pool(kPoolBlocks * kArenaBlockBytes);
+    SampleArena          arena;
+    arena.Init(pool.data(), pool.size());
+
+    LoopStorage mono, stereo;
+    mono.Init(&arena);
+    stereo.Init(&arena);
+    mono.Begin(1);
+    stereo.Begin(2);
+
+    const size_t frames = 48000;
+    for(size_t i = 0; i < frames; i++)
+    {
+        CHECK(mono.Write(i, i * 1e-5f, 0.0f));
+        CHECK(stereo.Write(i, i * 1e-5f, -(i * 1e-5f)));
+    }
+    CHECK(mono.FramesPerBlock() == kArenaBlockBytes / LoopFormat::kBytes);
+    CHECK(mono.num_blocks == (frames + mono.FramesPerBlock() - 1) / mono.FramesPerBlock());
+    CHECK(stereo.num_blocks == (frames + stereo.FramesPerBlock() - 1) / stereo.FramesPerBlock());
+    CHECK(stereo.num_blocks >= 2 * mono.num_blocks - 1);
+    // Within the dithered quantization error of the storage format
+    CHECK(fabsf(mono.Read(12345, 0) - 0.12345f) < 1e-4f);
+    CHECK(fabsf(stereo.Read(12345, 1) + 0.12345f) < 1e-4f);
+    CHECK(mono.SlackBytes(frames) == mono.num_blocks * kArenaBlockBytes - frames * LoopFormat::kBytes);
+
+    size_t used = arena.UsedBlocks();
+    size_t fpb  = stereo.FramesPerBlock();
+    stereo.Clear();
+    CHECK(arena.UsedBlocks() == used - (frames + fpb - 1) / fpb);
+}
+
+static void TestOneLayerTakesAllMemory()
+{
+    std::vector<uint8_t> pool(kPoolBlocks * kArenaBlockBytes);
+    SampleArena          arena;
+    arena.Init(pool.data(), pool.size());
+
+    LoopStorage take;
+    take.Init(&arena);
+    take.Begin(2);
+    size_t frames = 0;
+    while(take.Write(frames, 0.1f, 0.2f))
+        frames++;
+    CHECK(frames == kPoolBlocks * take.FramesPerBlock());
+    CHECK(arena.FreeBlocks() == 0);
+    CHECK(arena.GetStats().utilization == 1.0f);
+
+    take.Clear();
+    CHECK(arena.FreeBlocks() == kPoolBlocks);
+}
+
+static void TestFragmentationStats()
+{
+    std::vector<uint8_t> pool(kPoolBlocks * kArenaBlockBytes);
+    SampleArena          arena;
+    arena.Init(pool.data(), pool.size());
+
+    // Three takes growing in lockstep interleave their blocks in memory
+    LoopStorage takes[3];
+    for(LoopStorage& t : takes)
+    {
+        t.Init(&arena);
+        t.Begin(1);
+    }
+    size_t per_take = 10 * takes[0].FramesPerBlock();
+    for(size_t i = 0; i < per_take; i++)
+        for(LoopStorage& t : takes)
+            t.Write(i, 0.0f, 0.0f);
+
+    takes[1].Clear();
+    ArenaStats stats = arena.GetStats();
+    CHECK(stats.used_blocks == 20);
+    CHECK(stats.largest_free_run == kPoolBlocks - 30);
+    CHECK(stats.fragmentation > 0.0f);
+}
+
+// Recording and double-click erase through the control task and engine
+static void TestLayerRecordAndErase()
+{
+    LooperRig<48> rig(kPoolBlocks);
+    LooperLayer&  layer = rig.layers[0];
+    SampleArena&  arena = rig.arena;
+
+    // Guitar take: mono
+    rig.control.selected_channel = 1;
+    rig.Hold(1000, 0.25f);
+    CHECK(layer.recorded);
+    CHECK(layer.storage.channels == 1);
+    size_t fpb = layer.storage.FramesPerBlock();
+    CHECK(fpb == kArenaBlockBytes / LoopFormat::kBytes);
+    CHECK(layer.storage.num_blocks == (layer.record_len + fpb - 1) / fpb);
+    CHECK(arena.UsedBlocks() == layer.storage.num_blocks);
+
+    // Double click erases and frees immediately
+    rig.Click();
+    rig.Click();
+    CHECK(!layer.recorded);
+    CHECK(arena.UsedBlocks() == 0);
+}
+
+int main()
+{
+    TestAllocFree();
+    TestMonoUsesHalfTheBlocks();
+    TestOneLayerTakesAllMemory();
+    TestFragmentationStats();
+    TestLayerRecordAndErase();
+    return TestResult("test_sample_arena");
+}
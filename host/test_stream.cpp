@@ -0,0 +1,197 @@
+// Disk-streaming layers against the simulated block device: a fast card
+// plays the file through the ring exactly and without a gap, the read-ahead
+// follows the speed, a card too slow for 2x fades out and back in instead of
+// clicking while the track keeps time, read stalls are absorbed once the
+// depth has adapted to them, and the stream lets go of its layer and ring.
+
+#include <vector>
+#include "session_store.h"
+#include "stream_rig.h"
+#include "test_util.h"
+
+static const int kNumLayers = 2;
+
+typedef StreamRig<kNumLayers> Box;
+static const size_t kBlock = Box::kBlock;
+
+static void TestOpen()
+{
+    Box box(10e6);
+    CHECK(!box.stream.Open(kNumLayers)); // no such layer
+
+    box.device.image[0] ^= 1;
+    CHECK(!box.stream.Open(0));
+    box.device.image[0] ^= 1;
+
+    // Never over a take
+    box.layers[0].storage.Begin(1);
+    box.layers[0].storage.Write(0, 0.1f, 0.1f);
+    box.layers[0].record_len = 1;
+    box.layers[0].recorded   = true;
+    CHECK(box.stream.Open(0));
+    CHECK(!box.stream.Open(1)); // one at a time
+    box.Run(10);
+    CHECK(!box.stream.Active() && !box.layers[0].streaming && box.layers[0].record_len == 1);
+}
+
+static void TestFastCard()
+{
+    Box box(10e6);
+    CHECK(box.stream.Open(0));
+    box.Run(1000);
+    box.stream.stats.min_lead = kStreamRingFrames; // past the start
+    box.Run(11000);
+
+    const LooperLayer& l = box.layers[0];
+    const StreamStats& s = box.stream.stats;
+    CHECK(l.streaming && l.stream_primed);
+    CHECK(s.underruns == 0 && s.muted_blocks == 0 && s.skipped_frames == 0 && s.io_errors == 0);
+    CHECK(box.mismatches == 0);
+    CHECK(box.jumps == 0);
+    CHECK(box.audible > 11500);
+    CHECK(s.min_lead > 48000 / 20); // never under 50 ms ahead
+    CHECK(l.stream_pos > 11 * 48000u && l.stream_pos < 12 * 48000u);
+
+    // What the ring holds is the file, across its loop point
+    uint32_t             frames = (uint32_t)(box.track.size() / 2);
+    size_t               bytes  = l.storage.FrameBytes();
+    std::vector<uint8_t> raw(bytes);
+    bool                 same = true;
+    for(uint32_t f = l.stream_end - 40000; f != l.stream_end; f++)
+    {
+        l.storage.ReadRaw(f & (kStreamRingFrames - 1), raw.data(), 1);
+        same = same && memcmp(raw.data(), &box.device.image[kStreamHeaderBytes + (f % frames) * bytes], bytes) == 0;
+    }
+    CHECK(same);
+}
+
+static void TestDepthFollowsSpeed()
+{
+    Box box(10e6);
+    box.stream.Open(0);
+    box.Run(2000);
+    uint32_t at_1x = box.stream.stats.depth_frames;
+
+    box.stream.stats.min_lead = kStreamRingFrames; // from here on
+    box.layers[0].speed       = 2.0f;
+    box.Run(4000);
+    uint32_t at_2x = box.stream.stats.depth_frames;
+    CHECK(at_2x > 19 * at_1x / 10 && at_2x < 21 * at_1x / 10);
+    CHECK(box.stream.stats.underruns == 0);
+    CHECK(box.stream.stats.min_lead > 48000 / 10);
+
+    box.layers[0].speed = 0.3f;
+    box.Run(2000);
+    CHECK(box.stream.stats.depth_frames < at_1x); // down to the 0.5x floor
+    CHECK(box.stream.stats.depth_frames >= at_1x / 2 - 48);
+    CHECK(box.stream.stats.underruns == 0);
+}
+
+// 300 KB/s: enough for stereo at 1x (192 KB/s), not at 2x
+static void TestStarvedCard()
+{
+    Box box(300e3);
+    box.stream.Open(0);
+    box.Run(500);
+    CHECK(box.layers[0].stream_primed);
+
+    box.layers[0].speed = 2.0f;
+    uint32_t from   = box.layers[0].stream_pos;
+    uint64_t start  = box.blocks;
+    box.jumps       = 0;
+    box.Run(10000);
+
+    const StreamStats& s = box.stream.stats;
+    CHECK(s.underruns > 0 && s.skipped_frames > 0);
+    CHECK(box.jumps == 0); // faded, never cut
+    CHECK(box.mismatches == 0);
+    CHECK(box.audible > 5000); // and plays most of the time
+
+    // The position kept time throughout: 2 frames per output frame
+    uint64_t played = (box.blocks - start) * kBlock * 2;
+    uint32_t moved  = box.layers[0].stream_pos - from;
+    CHECK(moved + 4 * kBlock >= played && moved <= played + 4 * kBlock);
+
+    // Back to 1x it catches up for good
+    box.layers[0].speed = 1.0f;
+    box.Run(3000);
+    uint32_t underruns = s.underruns;
+    box.Run(5000);
+    CHECK(s.underruns == underruns);
+}
+
+// A 300 ms stall every 64 reads: the first may get through to the output,
+// after that the read-ahead covers them
+static void TestStalls()
+{
+    Box box(10e6);
+    box.device.stall_us    = 300000.0;
+    box.device.stall_every = 64;
+    box.stream.Open(0);
+    box.Run(10000);
+    uint32_t early = box.stream.stats.underruns;
+    CHECK(early <= 1);
+    box.Run(20000);
+    CHECK(box.stream.stats.underruns == early);
+    CHECK(box.stream.stats.worst_read_ms >= 300.0f);
+    CHECK(box.stream.stats.depth_frames > 48000 * 3 / 10);
+    CHECK(box.jumps == 0);
+}
+
+static void TestReadErrors()
+{
+    Box box(10e6);
+    box.stream.Open(0);
+    box.Run(1000);
+    box.device.failing = true;
+    box.Run(500);
+    box.device.failing = false;
+    box.Run(1000);
+    CHECK(box.stream.stats.io_errors > 5);
+    CHECK(box.stream.stats.underruns == 0); // a gap in the audio, not in time
+    CHECK(box.layers[0].stream_pos > 2 * 48000u);
+}
+
+static void TestRelease()
+{
+    Box box(10e6);
+    size_t free_blocks = box.arena.FreeBlocks();
+    box.stream.Open(0);
+    box.Run(1000);
+    CHECK(box.arena.FreeBlocks() < free_blocks);
+
+    // Not saved with the session, not bounced
+    std::vector<PersistChunk> persist(kPersistChunks);
+    SessionStore              store;
+    store.Init(&box.device, box.layers, kNumLayers, persist.data());
+    store.SnapshotLayers();
+    CHECK(store.header.layers[0].record_len == 0);
+
+    // Erased: the stream lets go, the ring goes back to the arena
+    box.layers[0].Erase();
+    box.Run(10);
+    CHECK(!box.stream.Active());
+    CHECK(box.arena.FreeBlocks() == free_blocks);
+    CHECK(box.stream.empty.Size() == kStreamChunks);
+
+    // Closed from outside, and opened again
+    CHECK(box.stream.Open(0));
+    box.Run(1000);
+    CHECK(box.layers[0].streaming && box.stream.Active());
+    box.stream.Close();
+    box.Run(10);
+    CHECK(!box.stream.Active() && !box.layers[0].recorded);
+    CHECK(box.arena.FreeBlocks() == free_blocks);
+}
+
+int main()
+{
+    TestOpen();
+    TestFastCard();
+    TestDepthFollowsSpeed();
+    TestStarvedCard();
+    TestStalls();
+    TestReadErrors();
+    TestRelease();
+    return TestResult("test_stream");
+}
@@ -0,0 +1,194 @@
+// Time-stretch: pitch stays put while the tempo follows the speed, on a sine
+// and on a plucked-string fixture (Karplus-Strong, re-plucked every 0.4 s);
+// varispeed playback of the same take moves the pitch, as a check on the
+// estimator. Also the play position against plain playback, the search
+// staying within its per-block share, the first block after switching on
+// matching varispeed at 1.0x, and the layer + bypass gesture.
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock      = 48;
+static const float  kRate       = 48000.0f;
+static const size_t kTakeFrames = 48000 * 3;
+static const float  kSpeeds[]   = {0.5f, 0.75f, 1.5f, 2.0f};
+
+// A layer holding one stereo take, rendered block by block
+struct StretchBox
+{
+    std::vector<uint8_t> pool;
+    SampleArena          arena;
+    LooperLayer          layer;
+
+    StretchBox(const std::vector<float>& take) : pool(512 * kArenaBlockBytes)
+    {
+        arena.Init(pool.data(), pool.size());
+        layer.Init(&arena);
+        layer.storage.Begin(2);
+        for(size_t i = 0; i < take.size(); i++)
+            layer.storage.Write(i, take[i], take[i]);
+        layer.record_len = layer.write_idx = take.size();
+        layer.recorded = true;
+    }
+
+    // Left channel of `frames` output frames
+    std::vector<float> Play(size_t frames)
+    {
+        std::vector<float> left;
+        float              in_l[kBlock] = {}, in_r[kBlock] = {}, out_l[kBlock], out_r[kBlock];
+        const float*       in[2]  = {in_l, in_r};
+        float*             out[2] = {out_l, out_r};
+        for(size_t done = 0; done < frames; done += kBlock)
+        {
+            for(size_t i = 0; i < kBlock; i++)
+                out_l[i] = out_r[i] = 0.0f;
+            layer.Render(in, out, kBlock, 1.0f);
+            left.insert(left.end(), out_l, out_l + kBlock);
+        }
+        return left;
+    }
+};
+
+static std::vector<float> Sine(float hz)
+{
+    std::vector<float> take(kTakeFrames);
+    for(size_t i = 0; i < take.size(); i++)
+        take[i] = 0.5f * sinf(2.0f * 3.14159265f * hz * i / kRate);
+    return take;
+}
+
+static std::vector<float> Pluck(int period)
+{
+    std::vector<float> take(kTakeFrames), line(period);
+    TestRandom         rng = {7};
+    size_t             pos = 0;
+    for(size_t i = 0; i < take.size(); i++)
+    {
+        if(i % 19200 == 0)
+            for(int k = 0; k < period; k++)
+                line[k] = rng.Noise(0.5f);
+        float y   = line[pos];
+        size_t nx = (pos + 1) % period;
+        line[pos] = 0.996f * 0.5f * (line[pos] + line[nx]);
+        pos       = nx;
+        take[i]   = y;
+    }
+    return take;
+}
+
+// Fundamental by normalised autocorrelation, searched between lo and hi Hz,
+// with a parabolic fit around the best lag
+static float Pitch(const std::vector<float>& x, size_t start, size_t n, float lo, float hi)
+{
+    int   min_lag = (int)(kRate / hi), max_lag = (int)(kRate / lo) + 1;
+    float best = -2.0f;
+    int   best_lag = min_lag;
+    std::vector<float> r(max_lag + 2, 0.0f);
+    for(int lag = min_lag - 1; lag <= max_lag + 1; lag++)
+    {
+        double num = 0.0, ea = 0.0, eb = 0.0;
+        for(size_t i = start; i < start + n; i++)
+        {
+            num += x[i] * x[i + lag];
+            ea += x[i] * x[i];
+            eb += x[i + lag] * x[i + lag];
+        }
+        r[lag] = (float)(num / sqrt(ea * eb + 1e-20));
+        if(lag >= min_lag && lag <= max_lag && r[lag] > best)
+        {
+            best     = r[lag];
+            best_lag = lag;
+        }
+    }
+    float a = r[best_lag - 1], b = r[best_lag], c = r[best_lag + 1];
+    float d = a - 2.0f * b + c;
+    float shift = d != 0.0f ? 0.5f * (a - c) / d : 0.0f;
+    return kRate / (best_lag + shift);
+}
+
+// Median pitch over several windows, clear of the first grain
+static float MedianPitch(const std::vector<float>& x, float lo, float hi)
+{
+    std::vector<float> p;
+    for(size_t start = 4800; start + 4096 + 1200 < x.size(); start += 6000)
+        p.push_back(Pitch(x, start, 2048, lo, hi));
+    std::sort(p.begin(), p.end());
+    return p[p.size() / 2];
+}
+
+static void TestPitch(const char* name, const std::vector<float>& take, float hz, float tolerance)
+{
+    float source = MedianPitch(take, hz / 1.3f, hz * 1.3f);
+    for(float speed : kSpeeds)
+    {
+        StretchBox stretched(take), varispeed(take);
+        stretched.layer.stretch = true;
+        stretched.layer.speed = varispeed.layer.speed = speed;
+
+        std::vector<float> out = stretched.Play(48000 * 2);
+        std::vector<float> ref = varispeed.Play(48000 * 2);
+        float              f   = MedianPitch(out, source / 1.3f, source * 1.3f);
+        float              v   = MedianPitch(ref, source * speed / 1.3f, source * speed * 1.3f);
+        printf("%-6s %.2fx: source %.2f Hz, stretched %.2f Hz (%+.2f%%), varispeed %.2f Hz\n",
+               name, speed, source, f, 100.0f * (f / source - 1.0f), v);
+        CHECK(fabsf(f / source - 1.0f) < tolerance);
+        CHECK(fabsf(v / (source * speed) - 1.0f) < tolerance);
+
+        // Tempo: the play position moves exactly as varispeed's
+        CHECK(stretched.layer.play_phase == varispeed.layer.play_phase);
+
+        // The search kept within its share of each block
+        const StretchStats& s = stretched.layer.stretcher.stats;
+        CHECK(s.late == 0);
+        CHECK(s.grains >= 48000 * 2 / kStretchHop - 1);
+        CHECK(s.max_block_units <= (kStretchCoarse + kStretchFine) / (kStretchHop / kBlock) + 1);
+    }
+}
+
+// Switching on mid-loop plays the loop as it is for the first hop
+static void TestSeamless()
+{
+    std::vector<float> take = Pluck(200);
+    StretchBox         a(take), b(take);
+    a.layer.speed = b.layer.speed = 1.25f;
+    a.Play(48000);
+    b.Play(48000);
+    a.layer.stretch = true;
+    // Grain 0 fades in from where varispeed is, read at 1.0x
+    Phase              start = a.layer.play_phase;
+    std::vector<float> out   = a.Play(kBlock);
+    bool               same  = true;
+    for(size_t i = 0; i < kBlock; i++)
+        same = same && fabsf(out[i] - 0.5f * a.layer.storage.Read(PhaseIndex(start) + i, 0)) < 1e-6f;
+    CHECK(same);
+}
+
+static void TestGesture()
+{
+    LooperRig<kBlock> rig(64);
+    rig.layer_buttons[0].Press(rig.control.layer_hold_ms + 50.0f);
+    rig.Run();
+    rig.Click(rig.bypass);
+    CHECK(rig.layers[0].stretch);
+    CHECK(rig.control.bypass_active); // The bypass relay is left alone
+    rig.Click(rig.bypass);
+    CHECK(!rig.layers[0].stretch);
+    rig.layer_buttons[0].Release();
+    rig.Run();
+    rig.Click(rig.bypass);
+    CHECK(!rig.control.bypass_active);
+}
+
+int main()
+{
+    TimeStretch::InitTable();
+    InterpSinc::InitTable();
+    TestPitch("sine", Sine(440.0f), 440.0f, 0.005f);
+    TestPitch("pluck", Pluck(218), kRate / 218.5f, 0.01f);
+    TestSeamless();
+    TestGesture();
+    return TestResult("test_stretch");
+}
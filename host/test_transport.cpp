@@ -0,0 +1,196 @@
+// Master transport: the cycle the first take sets, the lengths later takes
+// snap to, and hours of playback with every layer's position checked
+// against the shared frame counter. The engine's 32-bit frame clock is
+// started a minute short of wrapping, so the run crosses the wrap too.
+// A bounce of layers on the cycle stays on it. Without cycle sync the same
+// performance drifts apart within minutes.
+
+#include "looper_rig.h"
+#include "test_util.h"
+
+static const size_t kBlock = 48;
+
+typedef LooperRig<kBlock, 3> Rig;
+
+static void TestSnap()
+{
+    CHECK(MasterTransport::Round(96013) == 96024);
+    CHECK(MasterTransport::Round(5) == kCycleGrain);
+
+    MasterTransport t;
+    t.cycle = 96000;
+    CHECK(t.Snap(100000) == 96000);
+    CHECK(t.Snap(150000) == 192000);
+    CHECK(t.Snap(290000) == 288000);
+    CHECK(t.Snap(50000) == 48000);
+    CHECK(t.Snap(30000) == 32000); // a third
+    CHECK(t.Snap(1000) == 12000);  // an eighth is the shortest
+    for(uint32_t d : kCycleDivisions)
+        CHECK(MasterTransport::Round(123457) % d == 0);
+
+    t.frames = 1000;
+    CHECK(t.Position(400, 500) == 100);
+    CHECK(t.Position(1200, 500) == 300); // anchor still to come
+    CHECK(t.At(7, 0xFFFFFFF0u) == 1000 + 23); // across the 32-bit wrap
+}
+
+// Select the layer and hold Record for `ms`, then let the take finish
+static void Take(Rig& rig, int layer, int ms)
+{
+    rig.Click(rig.layer_buttons[layer]);
+    rig.Hold(ms, 0.25f);
+    for(int i = 0; i < 300 && rig.layers[layer].recording; i++)
+        rig.Run(0.25f);
+}
+
+// Loop frame each layer is at, from its phase and from the counter
+static bool OnCounter(const Rig& rig, const LooperLayer& layer)
+{
+    uint32_t at = PhaseIndex(layer.play_phase);
+    return (layer.play_phase & 0xFFFFFFFFu) == 0
+           && at == rig.engine.transport.Position(layer.cycle_anchor, (uint32_t)layer.record_len);
+}
+
+// Where b is while a is at frame 0, in frames of the shorter loop: constant
+// while the two keep step
+static uint32_t Relation(const LooperLayer& a, const LooperLayer& b)
+{
+    uint32_t g = (uint32_t)(a.record_len < b.record_len ? a.record_len : b.record_len);
+    return (PhaseIndex(b.play_phase) + g - PhaseIndex(a.play_phase) % g) % g;
+}
+
+// Three takes of about 2 s, 4.1 s and 1.1 s: one cycle, two, and a half
+static void Perform(Rig& rig, bool sync)
+{
+    rig.control.cycle_sync = sync;
+    Take(rig, 0, 2000);
+    Take(rig, 1, 4100);
+    Take(rig, 2, 1100);
+
+    // Knobs down: playback only keeps time, which is all this test reads
+    for(int i = 0; i < 3; i++)
+        rig.controls.adc[kAdcLayerVol + i] = 1.0f;
+    for(int i = 0; i < 10; i++)
+        rig.Run();
+}
+
+// Straight through the engine, a second at a time; the control task has
+// nothing to do
+static void Play(Rig& rig, int seconds)
+{
+    static float in_l[48000], in_r[48000], out_l[48000], out_r[48000];
+    const float* in[2]  = {in_l, in_r};
+    float*       out[2] = {out_l, out_r};
+    for(int s = 0; s < seconds; s++)
+        rig.engine.Process(in, out, 48000, rig.controls.now_us += 1000000);
+}
+
+static void TestLongRun()
+{
+    Rig rig(256, 65536);
+    rig.engine.frame_clock = 0xFFFFFFFFu - 60u * 48000u;
+    Perform(rig, true);
+
+    const LooperLayer* l     = rig.layers;
+    uint32_t           cycle = rig.engine.transport.cycle;
+    CHECK(cycle > 95000 && cycle < 97000 && cycle % kCycleGrain == 0);
+    CHECK(l[0].record_len == cycle);
+    CHECK(l[1].record_len == 2 * cycle);
+    CHECK(l[2].record_len == cycle / 2);
+    CHECK(l[0].cycle_sync && l[1].cycle_sync && l[2].cycle_sync);
+    CHECK(OnCounter(rig, l[0]) && OnCounter(rig, l[1]) && OnCounter(rig, l[2]));
+
+    // Each later take's frame 0 plays with what was heard at its press (no
+    // round trip here)
+    CHECK(l[1].cycle_anchor == rig.engine.transport.At(l[1].take_start, rig.engine.Now()));
+
+    uint32_t ab = Relation(l[0], l[1]), ac = Relation(l[0], l[2]);
+
+    // Three hours, checked every simulated minute; along the way layer 2
+    // goes to half speed and back, and layer 3 is paused for a while
+    int    off_counter = 0, off_relation = 0;
+    size_t checks      = 0;
+    for(int minute = 0; minute < 3 * 60; minute++)
+    {
+        if(minute == 30)
+            rig.Send(kCmdSetSpeed, 1, 0.5f);
+        if(minute == 31)
+            rig.Send(kCmdSetSpeed, 1, 1.0f);
+        if(minute == 45 || minute == 47)
+            rig.Send(kCmdPause, 2);
+        Play(rig, 60);
+
+        bool moving = minute == 30 || minute == 45 || minute == 46;
+        if(moving)
+            continue;
+        for(int i = 0; i < 3; i++)
+            off_counter += !OnCounter(rig, l[i]);
+        off_relation += Relation(l[0], l[1]) != ab || Relation(l[0], l[2]) != ac;
+        checks++;
+    }
+    CHECK(off_counter == 0);
+    CHECK(off_relation == 0);
+    CHECK(checks > 170);
+    CHECK(rig.engine.transport.frames > 3ull * 3600 * 48000);
+    CHECK(rig.engine.Now() < 0x80000000u); // the frame clock did wrap
+
+    // The cycle outlives its first layer, and goes with the last
+    rig.Send(kCmdErase, 0);
+    Play(rig, 1);
+    CHECK(rig.engine.transport.cycle == cycle);
+    rig.Send(kCmdErase, 1);
+    rig.Send(kCmdErase, 2);
+    Play(rig, 1);
+    CHECK(rig.engine.transport.cycle == 0);
+}
+
+// Layers 2 and 3 bounced into 2: the take stays on the cycle from where the
+// sources were, and holds it once layer 1, which set it, is gone
+static void TestBounce()
+{
+    Rig rig(256, 65536);
+    Perform(rig, true);
+    const LooperLayer* l     = rig.layers;
+    uint32_t           cycle = rig.engine.transport.cycle;
+
+    rig.Send(kCmdBounce, 1, 0.0f, 0x6);
+    Play(rig, 1);
+    CHECK(rig.engine.bounce.Running());
+    uint64_t anchor = rig.engine.transport.At(rig.engine.bounce.start_frame, rig.engine.Now());
+    Play(rig, 4);
+    CHECK(rig.engine.bounce.state.load() == kBounceDone);
+    CHECK(l[1].record_len == 2 * cycle && !l[2].recorded);
+    CHECK(l[1].cycle_sync && l[1].cycle_anchor == anchor);
+    CHECK(OnCounter(rig, l[0]) && OnCounter(rig, l[1]));
+    uint32_t ab = Relation(l[0], l[1]);
+    Play(rig, 60);
+    CHECK(OnCounter(rig, l[1]) && Relation(l[0], l[1]) == ab);
+
+    rig.Send(kCmdErase, 0);
+    Play(rig, 1);
+    CHECK(rig.engine.transport.cycle == cycle);
+    CHECK(OnCounter(rig, l[1]));
+}
+
+// The same takes at their own lengths: the layers slide against each other
+static void TestFreeRunning()
+{
+    Rig rig(256, 65536);
+    Perform(rig, false);
+    const LooperLayer* l = rig.layers;
+    CHECK(!l[0].cycle_sync && rig.engine.transport.cycle == 0);
+    CHECK(l[1].record_len % l[0].record_len != 0);
+
+    uint32_t ab = Relation(l[0], l[1]);
+    Play(rig, 600);
+    CHECK(Relation(l[0], l[1]) != ab);
+}
+
+int main()
+{
+    TestSnap();
+    TestLongRun();
+    TestBounce();
+    TestFreeRunning();
+    return TestResult("test_transport");
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+// Minimal assertion helpers for the host tests. Each test is its own
+// executable; main() returns TestResult() so `make test` stops on failure.
+
+static int test_checks   = 0;
+static int test_failures = 0;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        test_checks++;                                                       \
+        if(!(cond))                                                          \
+        {                                                                    \
+            test_failures++;                                                 \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        }                                                                    \
+    } while(0)
+
+static inline int TestResult(const char* name)
+{
+    printf("%s: %d checks, %d failed\n", name, test_checks, test_failures);
+    return test_failures == 0 ? 0 : 1;
+}
+
+// Seeded 32-bit LCG for test signals and jitter: the same values on every run
+// and host. Each file keeps its own, so one test's draws never shift another's.
+struct TestRandom
+{
+    uint32_t state;
+
+    uint32_t Next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return state;
+    }
+
+    // Uniform in [-amp, amp)
+    float Noise(float amp = 1.0f) { return (float)(int32_t)Next() * (1.0f / 2147483648.0f) * amp; }
+};
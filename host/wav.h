@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Minimal RIFF/WAVE reading and writing for the host tools: 16-bit PCM and
+// 32-bit float in, 32-bit float out (so rendered output round-trips bit for
+// bit). Frames are interleaved stereo; mono files are duplicated to both
+// channels on reading.
+
+struct WavInfo
+{
+    uint32_t sample_rate = 0;
+    int      channels    = 0;
+};
+
+static inline bool ReadWav(const char* path, std::vector<float>& stereo, WavInfo& info)
+{
+    FILE* f = fopen(path, "rb");
+    if(f == nullptr)
+        return false;
+
+    char riff[12];
+    bool ok = fread(riff, 1, 12, f) == 12 && memcmp(riff, "RIFF", 4) == 0 && memcmp(riff + 8, "WAVE", 4) == 0;
+    int  format = 0, bits = 0;
+    while(ok)
+    {
+        char     id[4];
+        uint32_t size;
+        if(fread(id, 1, 4, f) != 4 || fread(&size, 4, 1, f) != 1)
+        {
+            ok = false;
+            break;
+        }
+        if(memcmp(id, "fmt ", 4) == 0)
+        {
+            uint8_t fmt[40] = {};
+            ok = size >= 16 && size <= sizeof(fmt) && fread(fmt, 1, size, f) == size;
+            uint16_t tag, ch, bps;
+            memcpy(&tag, fmt, 2);
+            memcpy(&ch, fmt + 2, 2);
+            memcpy(&info.sample_rate, fmt + 4, 4);
+            memcpy(&bps, fmt + 14, 2);
+            format        = tag == 0xFFFE ? (bps == 32 ? 3 : 1) : tag; // Extensible: go by the bit depth
+            bits          = bps;
+            info.channels = ch;
+        }
+        else if(memcmp(id, "data", 4) == 0)
+        {
+            ok = info.channels >= 1 && info.channels <= 2 && ((format == 1 && bits == 16) || (format == 3 && bits == 32));
+            if(!ok)
+                break;
+            size_t              samples = size / (bits / 8);
+            std::vector<uint8_t> raw(size);
+            ok = fread(raw.data(), 1, size, f) == size;
+            stereo.resize(samples / info.channels * 2);
+            for(size_t i = 0; i < samples; i++)
+            {
+                float x;
+                if(format == 1)
+                {
+                    int16_t s;
+                    memcpy(&s, &raw[i * 2], 2);
+                    x = s * (1.0f / 32768.0f);
+                }
+                else
+                    memcpy(&x, &raw[i * 4], 4);
+                if(info.channels == 2)
+                    stereo[i] = x;
+                else
+                    stereo[2 * i] = stereo[2 * i + 1] = x;
+            }
+            break;
+        }
+        else
+            ok = fseek(f, size + (size & 1), SEEK_CUR) == 0;
+    }
+    fclose(f);
+    return ok;
+}
+
+static inline bool WriteWav(const char* path, const std::vector<float>& stereo, uint32_t sample_rate)
+{
+    FILE* f = fopen(path, "wb");
+    if(f == nullptr)
+        return false;
+
+    uint32_t data_bytes = (uint32_t)(stereo.size() * 4);
+    uint32_t riff_bytes = 36 + data_bytes;
+    uint32_t fmt_bytes  = 16, byte_rate = sample_rate * 8;
+    uint16_t tag = 3, channels = 2, align = 8, bits = 32;
+    bool     ok = fwrite("RIFF", 1, 4, f) == 4 && fwrite(&riff_bytes, 4, 1, f) == 1 && fwrite("WAVEfmt ", 1, 8, f) == 8
+              && fwrite(&fmt_bytes, 4, 1, f) == 1 && fwrite(&tag, 2, 1, f) == 1 && fwrite(&channels, 2, 1, f) == 1
+              && fwrite(&sample_rate, 4, 1, f) == 1 && fwrite(&byte_rate, 4, 1, f) == 1
+              && fwrite(&align, 2, 1, f) == 1 && fwrite(&bits, 2, 1, f) == 1 && fwrite("data", 1, 4, f) == 4
+              && fwrite(&data_bytes, 4, 1, f) == 1 && fwrite(stereo.data(), 4, stereo.size(), f) == stereo.size();
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,37 @@
+#include "interpolation.h"
+#include <math.h>
+
+const float InterpSinc::kBankSpeed[InterpSinc::kBanks] = {1.0f, 1.25f, 1.6f, 2.0f};
+float       InterpSinc::table[InterpSinc::kBanks][InterpSinc::kPhases + 1][InterpSinc::kTaps];
+const float (*InterpSinc::rows)[InterpSinc::kTaps] = InterpSinc::table[0];
+
+void InterpSinc::InitTable()
+{
+    const float pi   = 3.14159265358979f;
+    const float half = (float)kPost; // window half-width in samples
+
+    for(int bank = 0; bank < kBanks; bank++)
+    {
+        float cutoff = 0.45f / kBankSpeed[bank]; // fraction of the source's rate
+        for(int p = 0; p <= kPhases; p++)
+        {
+            float* w    = table[bank][p];
+            float  frac = (float)p / kPhases;
+            float  sum  = 0.0f;
+            for(int k = 0; k < kTaps; k++)
+            {
+                float t    = (float)(k - kPre) - frac;
+                float arg  = 2.0f * cutoff * t;
+                float sinc = fabsf(arg) < 1e-6f ? 1.0f : sinf(pi * arg) / (pi * arg);
+                float win  = 0.42f + 0.5f * cosf(pi * t / half) + 0.08f * cosf(2.0f * pi * t / half);
+                if(fabsf(t) >= half)
+                    win = 0.0f;
+                w[k] = 2.0f * cutoff * sinc * win;
+                sum += w[k];
+            }
+            for(int k = 0; k < kTaps; k++)
+                w[k] /= sum;
+        }
+    }
+    rows = table[0];
+}
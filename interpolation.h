@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include "sample_format.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Interpolation policies for varispeed playback, selected at compile time as
+// the Interp template parameter of the resampler. Each policy reads taps
+// -kPre * S .. kPost * S around the integer position x, where S is the frame
+// stride (1 for mono, 2 for interleaved stereo); frac is in [0, 1). Taps are
+// loaded through the storage format Fmt (sample_format.h), which fuses the
+// int16/int24 to float conversion into the kernel. The resampler calls
+// Prepare() with the speed before each block it renders.
+//
+//   InterpLinear   2 taps, cheapest, dull highs and strong aliasing at 2.0x
+//   InterpHermite  4-point, 3rd-order Hermite (Catmull-Rom)
+//   InterpSinc     8-tap Blackman-windowed sinc, polyphase table with
+//                  linear interpolation between the 256 phases; one table
+//                  per speed range, its cutoff lowered with the speed
+//
+// Interpolate4() renders four frames at once for the SSE2 host path and must
+// use the same operation order as Interpolate() to stay bit-exact with it.
+
+#if defined(__SSE2__)
+// Tap i of four frames as one vector
+template <typename Fmt>
+inline __m128 LoadTap4(const typename Fmt::Unit* const x[4], ptrdiff_t i)
+{
+    return _mm_set_ps(Fmt::Load(x[3], i), Fmt::Load(x[2], i), Fmt::Load(x[1], i), Fmt::Load(x[0], i));
+}
+#endif
+
+struct InterpLinear
+{
+    static constexpr int kPre  = 0;
+    static constexpr int kPost = 1;
+    static constexpr int kTaps = kPre + kPost + 1;
+
+    static inline void Prepare(float) {}
+
+    template <typename Fmt, int S>
+    static inline float Interpolate(const typename Fmt::Unit* x, float frac)
+    {
+        return Fmt::Load(x, 0) * (1.0f - frac) + Fmt::Load(x, S) * frac;
+    }
+
+#if defined(__SSE2__)
+    template <typename Fmt, int S>
+    static inline __m128 Interpolate4(const typename Fmt::Unit* const x[4], __m128 frac)
+    {
+        __m128 x0 = LoadTap4<Fmt>(x, 0);
+        __m128 x1 = LoadTap4<Fmt>(x, S);
+        return _mm_add_ps(_mm_mul_ps(x0, _mm_sub_ps(_mm_set1_ps(1.0f), frac)), _mm_mul_ps(x1, frac));
+    }
+#endif
+};
+
+struct InterpHermite
+{
+    static constexpr int kPre  = 1;
+    static constexpr int kPost = 2;
+    static constexpr int kTaps = kPre + kPost + 1;
+
+    static inline void Prepare(float) {}
+
+    template <typename Fmt, int S>
+    static inline float Interpolate(const typename Fmt::Unit* x, float frac)
+    {
+        float xm1 = Fmt::Load(x, -S);
+        float x0  = Fmt::Load(x, 0);
+        float x1  = Fmt::Load(x, S);
+        float x2  = Fmt::Load(x, 2 * S);
+        float c1  = 0.5f * (x1 - xm1);
+        float c2  = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+        float c3  = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+        return ((c3 * frac + c2) * frac + c1) * frac + x0;
+    }
+
+#if defined(__SSE2__)
+    template <typename Fmt, int S>
+    static inline __m128 Interpolate4(const typename Fmt::Unit* const x[4], __m128 frac)
+    {
+        __m128 xm1 = LoadTap4<Fmt>(x, -S);
+        __m128 x0  = LoadTap4<Fmt>(x, 0);
+        __m128 x1  = LoadTap4<Fmt>(x, S);
+        __m128 x2  = LoadTap4<Fmt>(x, 2 * S);
+
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128 c1   = _mm_mul_ps(half, _mm_sub_ps(x1, xm1));
+        __m128 c2   = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(xm1, _mm_mul_ps(_mm_set1_ps(2.5f), x0)),
+                                            _mm_mul_ps(_mm_set1_ps(2.0f), x1)),
+                               _mm_mul_ps(half, x2));
+        __m128 c3   = _mm_add_ps(_mm_mul_ps(half, _mm_sub_ps(x2, xm1)),
+                               _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(x0, x1)));
+        __m128 y    = _mm_add_ps(_mm_mul_ps(c3, frac), c2);
+        y           = _mm_add_ps(_mm_mul_ps(y, frac), c1);
+        return _mm_add_ps(_mm_mul_ps(y, frac), x0);
+    }
+#endif
+};
+
+struct InterpSinc
+{
+    static constexpr int kPre    = 3;
+    static constexpr int kPost   = 4;
+    static constexpr int kTaps   = kPre + kPost + 1;
+    static constexpr int kPhases = 256;
+    static constexpr int kBanks  = 4;
+
+    // Faster than 1.0x the source's top end folds back over the output's
+    // Nyquist, so each bank's cutoff is 0.45 of the output rate at the top
+    // of its speed range: 1.0x, 1.25x, 1.6x, 2.0x and above
+    static const float kBankSpeed[kBanks];
+
+    // Row p of a bank holds the tap weights for frac = p / kPhases, rows
+    // normalized to unity DC gain
+    static float table[kBanks][kPhases + 1][kTaps];
+    static const float (*rows)[kTaps]; // the bank in use
+
+    // Fill the polyphase tables; call once at startup
+    static void InitTable();
+
+    static inline void Prepare(float speed)
+    {
+        int bank = 0;
+        while(bank < kBanks - 1 && speed > kBankSpeed[bank])
+            bank++;
+        rows = table[bank];
+    }
+
+    template <typename Fmt, int S>
+    static inline float Interpolate(const typename Fmt::Unit* x, float frac)
+    {
+        float        pos = frac * kPhases;
+        int          row = (int)pos;
+        float        t   = pos - row;
+        const float* a   = rows[row];
+        const float* b   = rows[row + 1];
+
+        float sum = 0.0f;
+        for(int k = 0; k < kTaps; k++)
+            sum += Fmt::Load(x, (k - kPre) * S) * (a[k] + (b[k] - a[k]) * t);
+        return sum;
+    }
+
+#if defined(__SSE2__)
+    template <typename Fmt, int S>
+    static inline __m128 Interpolate4(const typename Fmt::Unit* const x[4], __m128 frac)
+    {
+        alignas(16) float f[4];
+        _mm_store_ps(f, frac);
+        return _mm_set_ps(Interpolate<Fmt, S>(x[3], f[3]),
+                          Interpolate<Fmt, S>(x[2], f[2]),
+                          Interpolate<Fmt, S>(x[1], f[1]),
+                          Interpolate<Fmt, S>(x[0], f[0]));
+    }
+#endif
+};
+
+// Interpolation used by LooperLayer playback. Override with
+// -DLOOPER_INTERP=InterpLinear / InterpSinc to trade quality for cycles.
+#ifndef LOOPER_INTERP
+#define LOOPER_INTERP InterpHermite
+#endif
+typedef LOOPER_INTERP LoopInterp;
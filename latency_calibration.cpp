@@ -0,0 +1,89 @@
+#include <math.h>
+#include "latency_calibration.h"
+
+void LatencyCalibrator::Init()
+{
+    uint32_t rng = 0x5EED;
+    for(size_t i = 0; i < kCalibrationBurst; i++)
+    {
+        rng      = rng * 1664525u + 1013904223u;
+        burst[i] = (float)(int32_t)rng * (1.0f / 2147483648.0f);
+    }
+    state.store(kCalibrationIdle);
+}
+
+bool LatencyCalibrator::Start()
+{
+    int idle = kCalibrationIdle;
+    return state.compare_exchange_strong(idle, kCalibrationRunning, std::memory_order_acq_rel);
+}
+
+void LatencyCalibrator::Process(AudioIn in, AudioOut out, size_t size)
+{
+    if(state.load(std::memory_order_acquire) != kCalibrationRunning)
+        return;
+
+    for(size_t i = 0; i < size; i++)
+    {
+        float x   = pos < kCalibrationBurst ? burst[pos] * level : 0.0f;
+        out[0][i] = x;
+        out[1][i] = x;
+        if(pos < kCalibrationFrames)
+            capture[pos++] = 0.5f * (in[0][i] + in[1][i]);
+    }
+    if(pos == kCalibrationFrames)
+    {
+        pos = 0;
+        state.store(kCalibrationCaptured, std::memory_order_release);
+    }
+}
+
+bool LatencyCalibrator::Measure(uint32_t& latency)
+{
+    if(!Captured())
+        return false;
+
+    // Normalised cross-correlation of the burst against every lag; the
+    // capture's energy under the burst is kept as a sliding sum
+    float energy = 0.0f;
+    for(size_t i = 0; i < kCalibrationBurst; i++)
+        energy += capture[i] * capture[i];
+
+    float  best = 0.0f, second = 0.0f;
+    size_t best_lag = 0;
+    for(size_t lag = 0; lag <= kMaxLatency; lag++)
+    {
+        if(lag > 0)
+        {
+            float in  = capture[lag + kCalibrationBurst - 1];
+            float out = capture[lag - 1];
+            energy    = fmaxf(energy + in * in - out * out, 0.0f);
+        }
+        float num = 0.0f;
+        for(size_t i = 0; i < kCalibrationBurst; i++)
+            num += burst[i] * capture[lag + i];
+        float score = num > 0.0f ? num / sqrtf(energy + 1e-12f) : 0.0f;
+        if(score > best)
+        {
+            // Keep the runner-up outside the main peak's immediate neighbourhood
+            if(lag > best_lag + 2)
+                second = best;
+            best     = score;
+            best_lag = lag;
+        }
+        else if(score > second && lag > best_lag + 2)
+            second = score;
+    }
+
+    state.store(kCalibrationIdle, std::memory_order_release);
+
+    // The burst's own correlation is sqrt(sum burst^2); demand most of it,
+    // well clear of any other lag
+    float self = 0.0f;
+    for(size_t i = 0; i < kCalibrationBurst; i++)
+        self += burst[i] * burst[i];
+    if(best < 0.5f * sqrtf(self) || second > 0.5f * best)
+        return false;
+    latency = (uint32_t)best_lag;
+    return true;
+}
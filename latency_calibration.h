@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "control_io.h"
+
+// Round-trip latency measurement through a loopback cable (output to input).
+//
+// The audio side replaces the output with a short noise burst and captures
+// the input for kCalibrationFrames; the control side then finds the burst in
+// the capture by cross-correlation. The lag of the peak is the codec round
+// trip in frames: DAC and ADC group delay plus the buffering on either side.
+// A peak that does not clearly stand out (no cable, feedback, noise) is
+// rejected.
+
+constexpr size_t kCalibrationBurst  = 256;  // frames of noise sent
+constexpr size_t kCalibrationFrames = 8192; // frames captured, ~170 ms at 48kHz
+constexpr size_t kMaxLatency        = kCalibrationFrames - kCalibrationBurst;
+
+enum CalibrationState
+{
+    kCalibrationIdle,
+    kCalibrationRunning,  // audio sends the burst and captures
+    kCalibrationCaptured, // capture complete, waiting for Measure()
+};
+
+struct LatencyCalibrator
+{
+    float burst[kCalibrationBurst];
+    float capture[kCalibrationFrames];
+    float level = 0.25f; // burst peak, well below clipping through the loopback
+
+    std::atomic<int> state{kCalibrationIdle};
+    size_t           pos = 0; // audio side: frames sent and captured so far
+
+    void Init();
+
+    // Control side: start a measurement; false while one is under way
+    bool Start();
+    bool Captured() const { return state.load(std::memory_order_acquire) == kCalibrationCaptured; }
+
+    // Audio side, once per block after the mix: while running, the burst
+    // replaces the output and the input (both channels) is captured
+    void Process(AudioIn in, AudioOut out, size_t size);
+
+    // Control side, once Captured(): the latency in frames, or false when the
+    // burst was not found. Returns the calibrator to idle either way.
+    bool Measure(uint32_t& latency);
+};
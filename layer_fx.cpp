@@ -0,0 +1,236 @@
+#include <math.h>
+#include "layer_fx.h"
+
+static float Clamp(float x, float lo, float hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+void FxFilter::Reset()
+{
+    ic1[0] = ic1[1] = 0.0f;
+    ic2[0] = ic2[1] = 0.0f;
+    smoothed = cutoff;
+}
+
+void FxFilter::Process(float* l, float* r, size_t size, float sample_rate)
+{
+    // Cutoff moves are smoothed from block to block; within one the
+    // coefficients hold, so tanf() runs once per block
+    wet.SetTarget(mix, size);
+    smoothed += 0.25f * (cutoff - smoothed);
+    float g = tanf((float)M_PI * smoothed / sample_rate);
+    float k = 1.0f / q;
+    a1      = 1.0f / (1.0f + g * (g + k));
+    a2      = g * a1;
+    a3      = g * a2;
+
+    float* io[2] = {l, r};
+    for(size_t i = 0; i < size; i++)
+    {
+        float w = wet.At(i);
+        for(int c = 0; c < 2; c++)
+        {
+            float v0 = io[c][i];
+            float v3 = v0 - ic2[c];
+            float v1 = a1 * ic1[c] + a2 * v3;
+            float v2 = ic2[c] + a2 * ic1[c] + a3 * v3;
+            ic1[c]   = 2.0f * v1 - ic1[c];
+            ic2[c]   = 2.0f * v2 - ic2[c];
+            io[c][i] = v0 + w * (v2 - v0);
+        }
+    }
+    wet.Finish();
+    if(!Running())
+        Reset(); // Ramped out: starts clean when it comes back
+}
+
+void FxDelay::Init(float* memory, uint32_t line_frames)
+{
+    line_l  = memory;
+    line_r  = memory != nullptr ? memory + line_frames : nullptr;
+    frames  = memory != nullptr ? line_frames : 0;
+    write   = 0;
+    running = false;
+    send    = 0.0f;
+    level.Snap(0.0f);
+}
+
+// Steady state over a run where neither the read nor the write position
+// wraps: out += delayed, line = in * send + delayed * feedback. Returns the
+// peak written to the line.
+static float DelayRun(float*       l,
+                      float*       r,
+                      const float* read_l,
+                      const float* read_r,
+                      float*       write_l,
+                      float*       write_r,
+                      size_t       n,
+                      float        gain,
+                      float        step,
+                      float        feedback)
+{
+    float  peak = 0.0f;
+    size_t i    = 0;
+#if LOOPER_RESAMPLE_SIMD
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 fb       = _mm_set1_ps(feedback);
+    __m128       g        = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set1_ps(step), _mm_set_ps(4, 3, 2, 1)));
+    const __m128 g_step   = _mm_set1_ps(4.0f * step);
+    __m128       top      = _mm_setzero_ps();
+    const size_t tail     = n & ~(size_t)3;
+    for(; i < tail; i += 4)
+    {
+        __m128 dl = _mm_loadu_ps(read_l + i);
+        __m128 dr = _mm_loadu_ps(read_r + i);
+        __m128 xl = _mm_loadu_ps(l + i);
+        __m128 xr = _mm_loadu_ps(r + i);
+        __m128 yl = _mm_add_ps(_mm_mul_ps(xl, g), _mm_mul_ps(dl, fb));
+        __m128 yr = _mm_add_ps(_mm_mul_ps(xr, g), _mm_mul_ps(dr, fb));
+        _mm_storeu_ps(write_l + i, yl);
+        _mm_storeu_ps(write_r + i, yr);
+        _mm_storeu_ps(l + i, _mm_add_ps(xl, dl));
+        _mm_storeu_ps(r + i, _mm_add_ps(xr, dr));
+        top = _mm_max_ps(top, _mm_max_ps(_mm_and_ps(yl, abs_mask), _mm_and_ps(yr, abs_mask)));
+        g   = _mm_add_ps(g, g_step);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, top);
+    peak = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+#endif
+    for(; i < n; i++)
+    {
+        float gi = gain + step * (float)(i + 1);
+        float yl = l[i] * gi + read_l[i] * feedback;
+        float yr = r[i] * gi + read_r[i] * feedback;
+        write_l[i] = yl;
+        write_r[i] = yr;
+        l[i] += read_l[i];
+        r[i] += read_r[i];
+        peak = fmaxf(peak, fmaxf(fabsf(yl), fabsf(yr)));
+    }
+    return peak;
+}
+
+void FxDelay::Process(float* l, float* r, size_t size)
+{
+    if(!running)
+    {
+        // Whatever the line held from before reads as silence
+        running = true;
+        filled  = 0;
+        quiet   = 0;
+        heard   = delay;
+    }
+    level.SetTarget(send, size);
+
+    const uint32_t mask = frames - 1;
+    float          peak = 0.0f;
+    if(heard == delay && filled >= delay)
+    {
+        for(size_t done = 0; done < size;)
+        {
+            uint32_t w = (write + (uint32_t)done) & mask;
+            uint32_t rd = (w - delay) & mask;
+            size_t   n  = size - done;
+            n           = n < frames - w ? n : frames - w;
+            n           = n < frames - rd ? n : frames - rd;
+            float g     = level.value + level.step * (float)done;
+            float p     = DelayRun(l + done, r + done, line_l + rd, line_r + rd, line_l + w, line_r + w, n, g,
+                                   level.step, feedback);
+            peak        = fmaxf(peak, p);
+            done += n;
+        }
+    }
+    else
+    {
+        // Starting, or the time changed: crossfade from the old tap to the new
+        float k = 1.0f / (float)size;
+        for(size_t i = 0; i < size; i++)
+        {
+            float    x  = heard == delay ? 1.0f : (float)(i + 1) * k;
+            float    dl = Tap(line_l, heard, i) * (1.0f - x) + Tap(line_l, delay, i) * x;
+            float    dr = Tap(line_r, heard, i) * (1.0f - x) + Tap(line_r, delay, i) * x;
+            float    g  = level.At(i);
+            float    yl = l[i] * g + dl * feedback;
+            float    yr = r[i] * g + dr * feedback;
+            uint32_t w  = (write + (uint32_t)i) & mask;
+            line_l[w]   = yl;
+            line_r[w]   = yr;
+            l[i] += dl;
+            r[i] += dr;
+            peak = fmaxf(peak, fmaxf(fabsf(yl), fabsf(yr)));
+        }
+        heard = delay;
+    }
+    level.Finish();
+    write  = (write + (uint32_t)size) & mask;
+    filled = filled + size < frames ? filled + (uint32_t)size : frames;
+
+    // Done once nothing goes in and all the line can still play is below the floor
+    quiet = peak < kFxTailLevel ? quiet + (uint32_t)size : 0;
+    if(send == 0.0f && level.value == 0.0f && quiet >= delay)
+        running = false;
+}
+
+void LayerFx::Init(float* memory, uint32_t line_frames, float rate)
+{
+    sample_rate = rate;
+    filter      = FxFilter();
+    filter.Reset();
+    delay.Init(memory, line_frames);
+    delay.delay = delay.heard = (uint32_t)(0.25f * rate) < delay.frames / 2 ? (uint32_t)(0.25f * rate)
+                                                                            : delay.frames / 2;
+}
+
+void LayerFx::Set(int param, float value, size_t block)
+{
+    switch(param)
+    {
+        case kFxFilterMix: filter.mix = Clamp(value, 0.0f, 1.0f); break;
+        case kFxFilterCutoff: filter.cutoff = Clamp(value, 20.0f, 0.45f * sample_rate); break;
+        case kFxFilterQ: filter.q = Clamp(value, 0.5f, 20.0f); break;
+        case kFxDelaySend: delay.send = delay.frames > 0 ? Clamp(value, 0.0f, 1.0f) : 0.0f; break;
+        case kFxDelayTime:
+        {
+            if(delay.frames <= 2 * block)
+                break;
+            // At least a block, so a block never reads what it writes
+            float f     = Clamp(value * 0.001f * sample_rate, (float)block, (float)(delay.frames - block));
+            delay.delay = (uint32_t)(f + 0.5f);
+            break;
+        }
+        case kFxDelayFeedback: delay.feedback = Clamp(value, 0.0f, 0.95f); break;
+        default: break;
+    }
+}
+
+bool LayerFx::Process(float* l, float* r, size_t size, bool audible, FxBudget* budget)
+{
+    if(!audible)
+    {
+        // Nothing to filter; a filter comes back from silence with a clean state
+        if(filter.Running())
+            filter.Reset();
+        if(!delay.Running())
+            return false;
+        for(size_t i = 0; i < size; i++)
+            l[i] = r[i] = 0.0f;
+    }
+    else if(filter.Running())
+    {
+        uint32_t since = budget != nullptr ? budget->Now() : 0;
+        filter.Process(l, r, size, sample_rate);
+        if(budget != nullptr)
+            budget->Charge(kFxFilter, since);
+    }
+
+    if(delay.Running() || (audible && delay.Enabled()))
+    {
+        uint32_t since = budget != nullptr ? budget->Now() : 0;
+        delay.Process(l, r, size);
+        if(budget != nullptr)
+            budget->Charge(kFxDelay, since);
+    }
+    return true;
+}
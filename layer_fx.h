@@ -0,0 +1,217 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "control_params.h"
+#include "resampler.h"
+
+// Per-layer effects, run on the layer's unit-gain voice buffer once per block
+// before the mix: a state-variable low-pass filter with a dry/wet mix, and a
+// feedback delay send.
+//
+// Both work a block at a time instead of once per sample per layer. The
+// filter's coefficients are worked out once per block from the smoothed
+// cutoff, and its two channels run side by side from one state array. The
+// delay is never shorter than a block, so every frame a block reads from the
+// line was written by an earlier block: read, feedback and write are a
+// plain loop over contiguous runs with no recursion inside the block, four
+// frames at a time where SSE is available.
+//
+// Whatever is not heard costs nothing: the filter is skipped once its mix has
+// ramped to 0, the delay once its send is 0 and everything left in the line
+// has decayed below kFxTailLevel. While a tail still rings the layer stays in
+// the mix after its loop has stopped.
+//
+// Enabling an effect (mix or send from 0 to more) claims its measured cycle
+// cost from the engine's FxBudget, and is refused when that would go over.
+
+enum FxType
+{
+    kFxFilter,
+    kFxDelay,
+    kNumFxTypes,
+};
+
+// kCmdSetFx arg; value in the unit given
+enum FxParam : uint8_t
+{
+    kFxFilterMix,      // 0 - 1, dry to filtered; 0 turns the filter off
+    kFxFilterCutoff,   // Hz
+    kFxFilterQ,        // 0.5 - 20
+    kFxDelaySend,      // 0 - 1, level into the line; at 0 the tail rings out
+    kFxDelayTime,      // ms, from one block up to the line's length
+    kFxDelayFeedback,  // 0 - 0.95
+};
+
+inline int FxTypeOf(int param)
+{
+    return param <= kFxFilterQ ? kFxFilter : kFxDelay;
+}
+
+constexpr float kFxTailLevel = 1.0f / 32768.0f; // -90 dBFS: below the 16-bit floor
+
+// Cycle budget for the effects of all layers, per block. Both sides are
+// measured with the cycle counter the firmware hands it (the DWT counter on
+// the Seed): an effect costs the most one of its kind has taken in a block,
+// and what is available is the block less the most the rest of the callback
+// has taken in one, less kFxReserve of it for what has not been seen yet. So
+// the budget shrinks as layers play, stretch or overdub; an effect already on
+// stays on. Until an effect has run once it costs kFxSeedCycles. Without a
+// counter (the host tests) nothing is measured and `cycles` stays as set.
+constexpr uint32_t kFxSeedCycles[kNumFxTypes] = {80, 60}; // per frame: a first guess, on the high side
+constexpr float    kFxReserve                 = 0.1f;     // of the block: interrupts, the session hand-off
+constexpr float    kFxCpuHz                   = 480e6f;   // block length in cycles until the firmware sets it
+
+struct FxBudget
+{
+    uint32_t (*clock)() = nullptr; // cycle counter, nullptr: nothing is measured
+
+    uint32_t block   = 0; // cycles in one block
+    uint32_t cycles  = 0; // available to the effects, 0 = no effects
+    uint32_t rest    = 0; // most cycles a block took besides its effects
+    uint32_t refused = 0; // effects that did not fit
+    uint32_t cost[kNumFxTypes]     = {}; // per effect and block
+    bool     measured[kNumFxTypes] = {}; // cost is a measurement, not the seed
+    uint32_t enabled[kNumFxTypes]  = {}; // effects switched on
+
+    uint32_t start = 0, spent = 0; // this block: when it began, cycles in effects
+
+    // block_cycles: one block of `frames` at the core clock
+    void Init(uint32_t block_cycles, size_t frames)
+    {
+        block  = block_cycles;
+        cycles = block - (uint32_t)(block * kFxReserve);
+        rest = refused = 0;
+        for(int i = 0; i < kNumFxTypes; i++)
+        {
+            cost[i]     = kFxSeedCycles[i] * (uint32_t)frames;
+            measured[i] = false;
+            enabled[i]  = 0;
+        }
+    }
+
+    uint32_t Used() const { return cost[kFxFilter] * enabled[kFxFilter] + cost[kFxDelay] * enabled[kFxDelay]; }
+
+    bool Claim(int type)
+    {
+        if(Used() + cost[type] > cycles)
+        {
+            refused++;
+            return false;
+        }
+        enabled[type]++;
+        return true;
+    }
+
+    void Release(int type) { enabled[type]--; }
+
+    uint32_t Now() const { return clock != nullptr ? clock() : 0; }
+
+    // One effect of `type` ran from `since` to now
+    void Charge(int type, uint32_t since)
+    {
+        uint32_t took = Now() - since;
+        spent += took;
+        cost[type]     = measured[type] && cost[type] > took ? cost[type] : took;
+        measured[type] = true;
+    }
+
+    void BeginBlock()
+    {
+        spent = 0;
+        start = Now();
+    }
+
+    void EndBlock()
+    {
+        if(clock == nullptr)
+            return;
+        uint32_t took  = Now() - start;
+        uint32_t other = took > spent ? took - spent : 0;
+        rest           = other > rest ? other : rest;
+        uint32_t taken = rest + (uint32_t)(block * kFxReserve);
+        cycles         = block > taken ? block - taken : 0;
+    }
+};
+
+struct FxFilter
+{
+    float cutoff = 1000.0f; // Hz, target
+    float q      = 0.707f;
+    float mix    = 0.0f;    // target
+
+    float     smoothed = 1000.0f; // cutoff the coefficients were worked out for
+    ParamRamp wet;                // this block's mix ramp
+
+    // Per-block coefficients (Zavalishin/Simper trapezoidal SVF) and the two
+    // integrator states per channel
+    float a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+    alignas(8) float ic1[2] = {0.0f, 0.0f};
+    alignas(8) float ic2[2] = {0.0f, 0.0f};
+
+    bool Enabled() const { return mix > 0.0f; }
+    bool Running() const { return mix > 0.0f || wet.value > 0.0f; }
+
+    void Reset();
+    void Process(float* l, float* r, size_t size, float sample_rate);
+};
+
+struct FxDelay
+{
+    // Planar stereo line of a power-of-two number of frames, in SDRAM on the Seed
+    float*   line_l = nullptr;
+    float*   line_r = nullptr;
+    uint32_t frames = 0;
+    uint32_t write  = 0;
+
+    uint32_t delay    = 0;  // frames, target
+    uint32_t heard    = 0;  // frames the last block read at
+    float    send     = 0.0f;
+    float    feedback = 0.5f;
+    ParamRamp level;         // this block's send ramp
+
+    bool     running = false; // line holds sound, or is being fed
+    uint32_t filled  = 0;     // frames written since it started, up to `frames`
+    uint32_t quiet   = 0;     // frames in a row written below kFxTailLevel
+
+    bool Enabled() const { return send > 0.0f; }
+    bool Running() const { return running; }
+
+    void Init(float* memory, uint32_t line_frames);
+    void Process(float* l, float* r, size_t size);
+
+    // The line sample `back` frames before write + i, 0 where nothing has
+    // been written since the start
+    float Tap(const float* line, uint32_t back, size_t i) const
+    {
+        return back > filled + i ? 0.0f : line[(write + i - back) & (frames - 1)];
+    }
+};
+
+struct LayerFx
+{
+    FxFilter filter;
+    FxDelay  delay;
+    float    sample_rate = 48000.0f;
+
+    // memory: 2 * line_frames floats for the delay (line_frames a power of
+    // two), nullptr to go without
+    void Init(float* memory, uint32_t line_frames, float rate);
+
+    // Both off and silent, settings back to the defaults; the caller
+    // releases any budget claims
+    void Reset() { Init(delay.line_l, delay.frames, sample_rate); }
+
+    // Apply one parameter; the budget is the engine's business
+    void Set(int param, float value, size_t block);
+
+    bool Enabled(int type) const { return type == kFxFilter ? filter.Enabled() : delay.Enabled(); }
+
+    // Anything to do this block: an effect on, or a tail still ringing
+    bool Running() const { return filter.Running() || delay.Running(); }
+
+    // Run the chain over the voice buffers. audible: the layer rendered into
+    // them this block; otherwise they are cleared here when a tail still
+    // rings. budget, when given, is charged what each effect took. Returns
+    // whether they now hold sound.
+    bool Process(float* l, float* r, size_t size, bool audible, FxBudget* budget = nullptr);
+};
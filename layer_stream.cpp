@@ -0,0 +1,171 @@
+#include <string.h>
+#include "layer_stream.h"
+
+void LayerStream::Init(StorageDevice* dev, const ControlInput* clk, LooperLayer* layer_array, int count,
+                       StreamChunk* chunk_pool, float rate)
+{
+    device      = dev;
+    clock       = clk;
+    layers      = layer_array;
+    num_layers  = count;
+    pool        = chunk_pool;
+    sample_rate = rate;
+    for(int i = 0; i < kStreamChunks; i++)
+        empty.Push(&pool[i]);
+    state.store(kStreamIdle);
+}
+
+bool LayerStream::Open(int to)
+{
+    if(device == nullptr || to < 0 || to >= num_layers || state.load() != kStreamIdle)
+        return false;
+
+    if(!device->Read(0, &header, sizeof(header)))
+    {
+        stats.io_errors++;
+        return false;
+    }
+    if(header.magic != kStreamMagic || header.version != kStreamVersion || header.sample_bytes != LoopFormat::kBytes
+       || (header.channels != 1 && header.channels != 2) || header.frames == 0)
+        return false;
+
+    layer      = to;
+    next_frame = 0;
+    file_frame = 0;
+    read_ms    = 0.0f;
+    play_frame.store(0, std::memory_order_relaxed);
+    play_speed.store(1.0f, std::memory_order_relaxed);
+    stats.min_lead = kStreamRingFrames;
+    resume_frames.store(Depth() / 4, std::memory_order_relaxed);
+    stop.store(false, std::memory_order_relaxed);
+    state.store(kStreamOpening, std::memory_order_release);
+    return true;
+}
+
+uint32_t LayerStream::Depth() const
+{
+    // Time ahead at up to 2x consumption; slower than 0.5x gains nothing
+    float speed = play_speed.load(std::memory_order_relaxed);
+    speed       = speed < 0.5f ? 0.5f : (speed > 2.0f ? 2.0f : speed);
+    float    ms = kStreamLeadMs + 2.0f * read_ms;
+    uint32_t frames = (uint32_t)(ms * 0.001f * sample_rate * speed);
+    uint32_t limit  = kStreamRingFrames - ChunkFrames() - kStreamGuardFrames;
+    return frames < limit ? frames : limit;
+}
+
+void LayerStream::Poll()
+{
+    switch(state.load(std::memory_order_acquire))
+    {
+        case kStreamPlaying: PollRead(); break;
+        case kStreamClosing:
+            // Done once audio has handed every chunk back
+            if(empty.Size() == kStreamChunks)
+                state.store(kStreamIdle, std::memory_order_release);
+            break;
+        default: break;
+    }
+}
+
+void LayerStream::PollRead()
+{
+    uint32_t play  = play_frame.load(std::memory_order_acquire);
+    uint32_t depth = Depth();
+    stats.depth_frames = depth;
+    resume_frames.store(depth / 4, std::memory_order_relaxed);
+
+    // Playback has passed the next read: skip a whole read-ahead past it. The
+    // layer fades back in once a quarter of that is there, so a card with a
+    // quarter of the throughput it needs still gets there first
+    if((int32_t)(next_frame - play) < 0)
+    {
+        uint32_t skip = play + depth - next_frame;
+        stats.skipped_frames += skip;
+        next_frame += skip;
+        file_frame = (uint32_t)((file_frame + (uint64_t)skip) % header.frames);
+    }
+    if(next_frame - play >= depth)
+        return;
+
+    StreamChunk* chunk;
+    if(!empty.Pop(chunk))
+        return;
+
+    size_t   bytes = header.channels * LoopFormat::kBytes;
+    uint32_t n     = ChunkFrames();
+    if(n > header.frames - file_frame)
+        n = header.frames - file_frame; // The rest up to the loop point
+
+    chunk->frame  = next_frame;
+    chunk->frames = n;
+    uint32_t start = clock->NowUs();
+    if(!device->Read(header.data_offset + file_frame * bytes, chunk->data, n * bytes))
+    {
+        stats.io_errors++;
+        memset(chunk->data, 0, n * bytes); // Keep time, with a gap
+    }
+    float ms = (uint32_t)(clock->NowUs() - start) * 0.001f;
+    read_ms  = ms > read_ms * kStreamReadDecay ? ms : read_ms * kStreamReadDecay;
+    if(ms > stats.worst_read_ms)
+        stats.worst_read_ms = ms;
+    stats.reads++;
+    stats.bytes += n * bytes;
+
+    next_frame += n;
+    file_frame += n;
+    if(file_frame == header.frames)
+        file_frame = 0;
+    filled.Push(chunk);
+}
+
+void LayerStream::AudioService()
+{
+    int s = state.load(std::memory_order_acquire);
+    if(s == kStreamIdle)
+        return;
+
+    LooperLayer& l = layers[layer];
+    if(s == kStreamOpening)
+    {
+        // Never replace a take; a full arena leaves the stream closed
+        bool claimed = !l.recorded && !l.recording && l.BeginStream(kStreamRingFrames, header.channels);
+        state.store(claimed ? kStreamPlaying : kStreamClosing, std::memory_order_release);
+        return;
+    }
+
+    StreamChunk* chunk;
+    if(s == kStreamPlaying && (stop.load(std::memory_order_acquire) || !l.streaming))
+    {
+        // Closed, or the layer was erased or re-recorded under the stream
+        if(l.streaming)
+            l.Erase();
+        stop.store(false, std::memory_order_relaxed);
+        state.store(kStreamClosing, std::memory_order_release);
+        s = kStreamClosing;
+    }
+    if(s == kStreamClosing)
+    {
+        while(filled.Pop(chunk))
+            empty.Push(chunk);
+        return;
+    }
+
+    for(int k = 0; k < kStreamChunksPerBlock && filled.Pop(chunk); k++)
+    {
+        l.StreamFrames(chunk->frame, chunk->data, chunk->frames);
+        empty.Push(chunk);
+    }
+
+    l.stream_resume = resume_frames.load(std::memory_order_relaxed);
+    play_frame.store(l.stream_pos, std::memory_order_release);
+    play_speed.store(l.paused ? 0.0f : l.speed, std::memory_order_relaxed);
+
+    stats.underruns    = l.stream_underruns;
+    stats.muted_blocks = l.stream_muted;
+    if(l.stream_primed)
+    {
+        uint32_t lead = (int32_t)(l.stream_end - l.stream_pos) > 0 ? l.stream_end - l.stream_pos : 0;
+        if(lead < stats.min_lead)
+            stats.min_lead = lead;
+    }
+}
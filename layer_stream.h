@@ -0,0 +1,136 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "control_io.h"
+#include "looper_layer.h"
+#include "spsc_queue.h"
+
+// A layer that plays a file from the SD card, for backing tracks and beds
+// longer than the loop memory.
+//
+// The layer's take is a ring of kStreamRingFrames frames in the arena that
+// the resampler plays like any loop; stream frame f sits in slot f mod the
+// ring. As with SessionStore, storage I/O only happens in Poll() on the
+// main loop, which reads the file in chunks ahead of the play position, and
+// the audio callback's AudioService() copies the chunks into the ring.
+//
+// The read-ahead is kept in time rather than frames: kStreamLeadMs plus
+// twice the slowest recent read, times the layer's speed (up to 2x), as
+// far as the ring allows. When playback still catches up with the data the
+// layer fades out a block ahead of the gap and back in once the ring holds
+// enough again; the play position keeps moving meanwhile, so the track stays
+// in time with the loops, and the main loop skips its reads ahead to it.
+//
+// File layout: one 512-byte StreamFileHeader, then the frames as raw
+// LoopFormat data (host/make_stream converts a WAV). The file loops.
+
+constexpr uint32_t kStreamMagic       = 0x4D525453; // "STRM"
+constexpr uint16_t kStreamVersion     = 1;
+constexpr size_t   kStreamHeaderBytes = 512;
+constexpr size_t   kStreamChunkBytes  = 8192;
+constexpr int      kStreamChunks      = 4;
+constexpr int      kStreamChunksPerBlock = 2; // audio-side copies per callback
+constexpr uint32_t kStreamRingFrames  = 131072; // power of two: 2.7 s at 1x, 512 KB stereo 16-bit
+constexpr uint32_t kStreamGuardFrames = 2048;   // never refilled ahead of: staged and tapped frames
+constexpr float    kStreamLeadMs      = 150.0f;
+constexpr float    kStreamReadDecay   = 0.999f; // per read: a stall is remembered for tens of seconds
+
+struct StreamFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sample_bytes; // LoopFormat::kBytes the frames were written in
+    uint32_t frames;
+    uint32_t channels;     // 1 or 2
+    uint32_t data_offset;  // bytes from the start of the file
+};
+static_assert(sizeof(StreamFileHeader) <= kStreamHeaderBytes, "stream header must fit its sector");
+
+struct StreamChunk
+{
+    uint32_t frame;  // stream frame of the first one, counting on across file loops
+    uint32_t frames;
+    alignas(4) uint8_t data[kStreamChunkBytes];
+};
+
+enum StreamState
+{
+    kStreamIdle,
+    kStreamOpening, // main has the header, audio claims the ring
+    kStreamPlaying, // main reads chunks, audio installs them
+    kStreamClosing, // audio hands the chunks back
+};
+
+struct StreamStats
+{
+    uint32_t reads;
+    uint32_t io_errors;
+    uint64_t bytes;
+    uint32_t skipped_frames;  // stream frames passed over to catch up after an underrun
+    float    worst_read_ms;   // slowest single read
+    uint32_t depth_frames;    // read-ahead the main loop is aiming for now
+
+    // Audio side
+    uint32_t underruns;       // times playback faded out for want of data
+    uint32_t muted_blocks;    // blocks silent for want of data once it had started
+    uint32_t min_lead;        // fewest frames held ahead of the play position once started
+};
+
+struct LayerStream
+{
+    StorageDevice*      device = nullptr;
+    const ControlInput* clock  = nullptr; // times the reads
+    LooperLayer*        layers = nullptr;
+    int                 num_layers = 0;
+    float               sample_rate = 48000.0f;
+
+    StreamChunk*                           pool = nullptr;
+    SpscQueue<StreamChunk*, kStreamChunks> filled;
+    SpscQueue<StreamChunk*, kStreamChunks> empty;
+
+    std::atomic<int>  state{kStreamIdle};
+    std::atomic<bool> stop{false};
+    StreamFileHeader  header;
+    int               layer = 0;
+
+    // Main side: the next read
+    uint32_t next_frame = 0; // stream frame
+    uint32_t file_frame = 0; // where that is in the file
+    float    read_ms    = 0.0f; // slowest recent read, decaying by kStreamReadDecay
+
+    // Published by audio every block for the main side's read-ahead
+    std::atomic<uint32_t> play_frame{0};
+    std::atomic<float>    play_speed{1.0f};
+
+    // Published by main: frames to hold ahead before playback (re)starts
+    std::atomic<uint32_t> resume_frames{0};
+
+    StreamStats stats = {};
+
+    // pool holds kStreamChunks buffers; on the Seed they must be DMA-reachable
+    void Init(StorageDevice* dev, const ControlInput* clk, LooperLayer* layer_array, int count, StreamChunk* chunk_pool,
+              float rate);
+
+    // Main thread: read the header and start streaming into layer `to`, which
+    // must be empty; false when there is no valid stream file or one is running
+    bool Open(int to);
+
+    // Any thread: end the stream; the layer is erased on the next block
+    void Close() { stop.store(true, std::memory_order_release); }
+
+    // Main thread, from the idle loop: at most one storage read per call
+    void Poll();
+
+    // Audio thread, once per block before the layers are processed
+    void AudioService();
+
+    bool Active() const { return state.load(std::memory_order_acquire) != kStreamIdle; }
+
+    uint32_t ChunkFrames() const { return (uint32_t)(kStreamChunkBytes / (header.channels * LoopFormat::kBytes)); }
+
+    // Frames to hold ahead of playback at the current speed and read times
+    uint32_t Depth() const;
+
+    void PollRead();
+};
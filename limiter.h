@@ -0,0 +1,97 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "control_io.h"
+#include "control_params.h"
+#include "meter.h"
+
+// Brickwall limiter on the output bus with one block of lookahead.
+//
+// The output is delayed by a block. Each block's peak (from the master
+// meter's MeasureBlock) gives the gain that block needs, ceiling / peak;
+// the delayed block is then played with a gain ramp that ends at the lower
+// of its own and the incoming block's gain. Both ends of every ramp are at or
+// below what the block needs, so no sample leaves above the ceiling, and
+// the gain is already down when a peak comes out of the delay. Recovery is
+// limited to a fraction of the distance to unity per block.
+//
+// At unity gain the block is only delayed, bit for bit.
+template <size_t Block>
+struct Limiter
+{
+    alignas(16) float delay[2][Block];
+
+    float ceiling = 0.966f; // -0.3 dBFS
+    float release = 0.02f;  // fraction of the way back to unity per block (~50 ms at 1 ms blocks)
+    float gain    = 1.0f;   // at the end of the last output block
+    float held    = 1.0f;   // gain the delayed block needs
+
+    uint32_t limited_blocks = 0; // blocks played below unity gain
+    float    min_gain       = 1.0f; // deepest reduction since the control side reset it
+
+    void Init()
+    {
+        for(size_t i = 0; i < Block; i++)
+            delay[0][i] = delay[1][i] = 0.0f;
+        gain = held = min_gain = 1.0f;
+        limited_blocks = 0;
+    }
+
+    // out: the block just mixed, with its peak; replaced by the limited
+    // previous block
+    void Process(AudioOut out, float peak)
+    {
+        float need = peak > ceiling ? ceiling / peak : 1.0f;
+        float end  = held < need ? held : need;
+        float up   = gain + (1.0f - gain) * release;
+        up         = up > 0.9999f ? 1.0f : up; // back to the bit-exact path
+        end        = end < up ? end : up;
+
+        if(gain == 1.0f && end == 1.0f)
+        {
+            for(size_t i = 0; i < Block; i++)
+            {
+                float l     = out[0][i];
+                float r     = out[1][i];
+                out[0][i]   = delay[0][i];
+                out[1][i]   = delay[1][i];
+                delay[0][i] = l;
+                delay[1][i] = r;
+            }
+        }
+        else
+        {
+            ParamRamp ramp = {gain, end, (end - gain) / (float)Block};
+            size_t    i    = 0;
+#if LOOPER_RESAMPLE_SIMD
+            const __m128 step = _mm_set1_ps(ramp.step);
+            const size_t tail = Block & ~(size_t)3;
+            for(; i < tail; i += 4)
+            {
+                __m128 pos = _mm_set_ps((float)(i + 4), (float)(i + 3), (float)(i + 2), (float)(i + 1));
+                __m128 g   = _mm_add_ps(_mm_set1_ps(ramp.value), _mm_mul_ps(step, pos));
+                __m128 l   = _mm_loadu_ps(out[0] + i);
+                __m128 r   = _mm_loadu_ps(out[1] + i);
+                _mm_storeu_ps(out[0] + i, _mm_mul_ps(_mm_load_ps(delay[0] + i), g));
+                _mm_storeu_ps(out[1] + i, _mm_mul_ps(_mm_load_ps(delay[1] + i), g));
+                _mm_store_ps(delay[0] + i, l);
+                _mm_store_ps(delay[1] + i, r);
+            }
+#endif
+            for(; i < Block; i++)
+            {
+                float g     = ramp.At(i);
+                float l     = out[0][i];
+                float r     = out[1][i];
+                out[0][i]   = delay[0][i] * g;
+                out[1][i]   = delay[1][i] * g;
+                delay[0][i] = l;
+                delay[1][i] = r;
+            }
+            limited_blocks++;
+            min_gain = end < min_gain ? end : min_gain;
+        }
+        gain = end;
+        held = need;
+    }
+};
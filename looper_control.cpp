@@ -0,0 +1,291 @@
+#include <math.h>
+#include "looper_control.h"
+
+void LooperControl::Init(EngineCore* eng, const ControlInput* input, const ControlButtons& btns)
+{
+    engine   = eng;
+    controls = input;
+    buttons  = btns;
+    params.Init();
+    midi.Init(engine->sample_rate);
+
+    // Negative: every knob is sent on the first update
+    for(int i = 0; i < kControlLayers; i++)
+        sent_gain[i] = -1.0f;
+    sent_master = -1.0f;
+    sent_speed  = -1.0f;
+    sent_pan    = -1.0f;
+    sent_monitor         = -1.0f;
+    sent_monitor_channel = -1;
+}
+
+uint32_t LooperControl::EventFrame(float ms_ago) const
+{
+    return engine->FrameAtUs(controls->NowUs() - (uint32_t)(ms_ago * 1000.0f + 0.5f));
+}
+
+bool LooperControl::Send(CommandType type, int layer, float value, int arg)
+{
+    return SendAt(EventFrame(0.0f), type, layer, value, arg);
+}
+
+bool LooperControl::SendAt(uint32_t frame, CommandType type, int layer, float value, int arg)
+{
+    LooperCommand cmd;
+    cmd.frame   = frame;
+    cmd.type    = type;
+    cmd.layer   = (uint8_t)layer;
+    cmd.channel = (uint8_t)selected_channel;
+    cmd.arg     = (uint8_t)arg;
+    cmd.value   = value;
+    if(engine->Send(cmd))
+        return true;
+    dropped++;
+    return false;
+}
+
+int LooperControl::Update()
+{
+    int events = 0;
+    params.Snapshot(controls);
+
+    buttons.record->Debounce();
+    buttons.channel->Debounce();
+    buttons.bypass->Debounce();
+    bool layer_pressed[kControlLayers];
+    for(int i = 0; i < kControlLayers; i++)
+    {
+        buttons.layer[i]->Debounce();
+        layer_pressed[i] = buttons.layer[i]->Pressed();
+    }
+
+    // A layer button held past 200 ms hands that layer the speed/pan knobs
+    int held = -1;
+    for(int i = 0; i < kControlLayers && held < 0; i++)
+        if(layer_pressed[i] && buttons.layer[i]->TimeHeldMs() > layer_hold_ms)
+            held = i;
+    if(held != held_layer)
+    {
+        // Pick up from where the knobs are: only a move is sent to the newly
+        // held layer, so a hold for another gesture leaves its speed, pan
+        // and place on the grid alone
+        sent_speed = params.speed;
+        sent_pan   = params.pan;
+        held_layer = held;
+    }
+
+    // Select on press, not while another layer button is held for speed/pan
+    for(int i = 0; i < kControlLayers; i++)
+    {
+        if(!last_layer[i] && layer_pressed[i] && held_layer == -1)
+        {
+            selected_layer          = i;
+            channel_override_active = false; // Reset override when switching layers
+            // Set selected_channel to match the recorded channel (if any)
+            const LooperLayer& layer = engine->layers[i];
+            if(layer.recorded)
+                selected_channel = layer.recorded_channel;
+            events |= kEventRelays;
+        }
+        last_layer[i] = layer_pressed[i];
+    }
+
+    UpdateRecordButton();
+    UpdateKnobs();
+
+    // Channel button: redo while a layer button is held, otherwise cycle the
+    // input on release, unless the press was held long enough to calibrate
+    bool channel_pressed = buttons.channel->Pressed();
+    if(!last_channel && channel_pressed && held_layer >= 0)
+    {
+        Send(kCmdRedo, held_layer);
+        channel_fired = true;
+    }
+    if(channel_pressed && !channel_fired && buttons.channel->TimeHeldMs() > calibrate_hold_ms)
+    {
+        engine->calibrator.Start();
+        channel_fired = true;
+    }
+    if(last_channel && !channel_pressed)
+    {
+        if(!channel_fired)
+        {
+            // Cycling order: Mic(0) -> Guitar(1) -> Line(2) -> Mic(0)
+            selected_channel        = (selected_channel + 1) % 3;
+            channel_override_active = true; // User has manually changed channel
+            events |= kEventRelays;
+        }
+        channel_fired = false;
+    }
+    last_channel = channel_pressed;
+
+    // Bypass: time-stretch toggle while a layer button is held, otherwise
+    // toggle on release, unless the press was held long enough to save
+    bool bypass_pressed = buttons.bypass->Pressed();
+    if(!last_bypass && bypass_pressed && held_layer >= 0)
+    {
+        Send(kCmdSetStretch, held_layer, 0.0f, !engine->layers[held_layer].stretch);
+        stretch_fired = true;
+    }
+    if(bypass_pressed && !save_fired && !stretch_fired && buttons.bypass->TimeHeldMs() > save_hold_ms)
+    {
+        save_fired = true;
+        events |= kEventSave;
+    }
+    if(last_bypass && !bypass_pressed)
+    {
+        if(!save_fired && !stretch_fired)
+        {
+            bypass_active = !bypass_active;
+            events |= kEventRelays;
+        }
+        save_fired    = false;
+        stretch_fired = false;
+    }
+    last_bypass = bypass_pressed;
+
+    events |= UpdateCalibration();
+
+    // The clock went quiet without a Stop: free-run from here
+    if(midi.Expire(engine->Now()) & kClockStopped)
+        Send(kCmdSetGrid, 0, 0.0f);
+    return events;
+}
+
+int LooperControl::ReceiveMidi(uint8_t byte, uint32_t now_us)
+{
+    int events = midi.Receive(byte, engine->FrameAtUs(now_us));
+    if(events & kClockBeat)
+        SendGrid();
+    if(events & kClockStopped)
+        Send(kCmdSetGrid, 0, 0.0f);
+    return events;
+}
+
+void LooperControl::SendGrid()
+{
+    uint8_t  arg   = (uint8_t)midi.beats_per_bar | (grid_lock ? kGridLock : 0);
+    uint32_t frame = midi.BeatFrame();
+    if(midi.restart)
+    {
+        // The first grid since Start carries beat 0, however late it comes
+        frame -= (uint32_t)(int32_t)floor(midi.Beat() * midi.FramesPerBeat() + 0.5);
+        arg |= kGridRestart;
+    }
+    if(SendAt(frame, kCmdSetGrid, 0, (float)midi.FramesPerBeat(), arg))
+        midi.restart = false;
+}
+
+int LooperControl::UpdateCalibration()
+{
+    if(!engine->calibrator.Captured())
+        return 0;
+    uint32_t frames = 0;
+    if(!engine->calibrator.Measure(frames))
+        return kEventCalibrationFailed;
+    latency = frames;
+    Send(kCmdSetLatency, 0, (float)frames);
+    return kEventCalibrated;
+}
+
+void LooperControl::UpdateRecordButton()
+{
+    bool pressed = buttons.record->Pressed();
+
+    // Layer buttons held: the press bounces two or more of them, or starts
+    // or clears one's automation, and is not a record gesture
+    if(!last_record && pressed)
+    {
+        int mask = 0, first = -1, count = 0;
+        for(int i = 0; i < kControlLayers; i++)
+        {
+            if(!buttons.layer[i]->Pressed() || buttons.layer[i]->TimeHeldMs() <= layer_hold_ms)
+                continue;
+            mask |= 1 << i;
+            first = first < 0 ? i : first;
+            count++;
+        }
+        if(count >= 2 && Send(kCmdBounce, first, 0.0f, mask))
+            bounce_fired = true;
+        else if(count == 1 && Send(kCmdAutomate, first))
+            bounce_fired = true;
+    }
+    if(bounce_fired)
+    {
+        bounce_fired = pressed;
+        last_record  = pressed;
+        return;
+    }
+
+    // Long press: the engine overdubs a playing layer, otherwise records a
+    // new take starting back at the press
+    float held = buttons.record->TimeHeldMs();
+    if(pressed && !record_active && held > long_press_ms)
+    {
+        int arg = quantize | (cycle_sync ? kQuantizeCycle : 0);
+        if(SendAt(EventFrame(held), kCmdRecordStart, selected_layer, 0.0f, arg))
+        {
+            record_active = true;
+            record_layer  = selected_layer;
+            click_count   = 0;
+        }
+    }
+
+    // On release
+    if(last_record && !pressed)
+    {
+        if(record_active)
+        {
+            SendAt(EventFrame(buttons.record->TimeReleasedMs()), kCmdRecordStop, record_layer);
+            record_active = false;
+        }
+        else
+        {
+            uint32_t now = params.now_ms;
+            click_count  = now - last_release < double_click_time ? click_count + 1 : 1;
+            last_release = now;
+
+            if(click_count == 2)
+            {
+                // Revert the first click's pause toggle, then undo the last
+                // overdub, or erase the take when there is nothing to undo
+                Send(kCmdPause, selected_layer);
+                Send(kCmdUndo, selected_layer, 0.0f, 1);
+                click_count = 0;
+            }
+            else if(click_count == 1)
+            {
+                Send(kCmdPause, selected_layer);
+            }
+        }
+    }
+    last_record = pressed;
+}
+
+void LooperControl::UpdateKnobs()
+{
+    for(int i = 0; i < kControlLayers && i < engine->num_layers; i++)
+    {
+        float gain = params.layer_gain[i];
+        if(fabsf(gain - sent_gain[i]) > knob_epsilon && Send(kCmdSetGain, i, gain))
+            sent_gain[i] = gain;
+    }
+    if(fabsf(params.master_gain - sent_master) > knob_epsilon && Send(kCmdSetMaster, 0, params.master_gain))
+        sent_master = params.master_gain;
+
+    // Monitoring follows the bypass relay, and the input selection while on
+    float monitor = bypass_active ? 0.0f : monitor_level;
+    bool  moved   = monitor != sent_monitor || (monitor > 0.0f && selected_channel != sent_monitor_channel);
+    if(moved && Send(kCmdSetMonitor, 0, monitor))
+    {
+        sent_monitor         = monitor;
+        sent_monitor_channel = selected_channel;
+    }
+
+    if(held_layer < 0)
+        return;
+    if(fabsf(params.speed - sent_speed) > knob_epsilon && Send(kCmdSetSpeed, held_layer, params.speed))
+        sent_speed = params.speed;
+    if(fabsf(params.pan - sent_pan) > knob_epsilon && Send(kCmdSetPan, held_layer, params.pan))
+        sent_pan = params.pan;
+}
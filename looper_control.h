@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include "control_io.h"
+#include "control_params.h"
+#include "looper_engine.h"
+
+// The control task: runs from the main loop, never from the audio callback.
+// Debounces the buttons, reads the knobs, turns gestures into engine commands
+// and reports the side effects (relays, save) for the caller to carry out.
+//
+//   Record long press (> 400 ms)  overdub a playing layer, else record a new take
+//   Record click / double click   pause toggle / undo, or erase with nothing to undo
+//   Layer button                  select; held (> 200 ms) + speed/pan knob sets that layer
+//   Layer held + Channel          redo
+//   Layer held + Bypass           time-stretch on/off: speed keeps the pitch
+//   Layer held + Record           record its speed/pan knob moves over one loop
+//                                 pass and replay them, or clear them
+//   Layers held (2+) + Record     bounce them into the lowest of them
+//   Channel click / 2 s hold      cycle the input: Mic -> Guitar -> Line /
+//                                 measure the round trip (loopback cable out -> in)
+//   Bypass click / 2 s hold       toggle the bypass relay / save the session
+//
+// With the bypass relay off only the looper's output is heard, so the
+// selected input is monitored digitally at monitor_level instead.
+//
+// MIDI clock bytes from the UART/USB handlers go through ReceiveMidi(); while
+// a clock runs, the beat grid goes to the engine on every beat and takes
+// start and stop on the `quantize` grid. Without one, cycle_sync snaps them
+// to the first take's length instead.
+//
+// Layer flags (recorded, recorded_channel) are only read here, for the
+// selection and LEDs; all changes go through the engine.
+
+constexpr int kControlLayers = kNumVolumePots;
+
+enum ControlEvent
+{
+    kEventRelays            = 1 << 0, // selected_channel or bypass_active changed
+    kEventSave              = 1 << 1, // bypass held for 2 s
+    kEventCalibrated        = 1 << 2, // latency measured and sent to the engine
+    kEventCalibrationFailed = 1 << 3, // no clear loopback signal, latency unchanged
+};
+
+struct ControlButtons
+{
+    ButtonInput* record;
+    ButtonInput* layer[kControlLayers];
+    ButtonInput* channel;
+    ButtonInput* bypass;
+};
+
+struct LooperControl
+{
+    EngineCore*         engine   = nullptr;
+    const ControlInput* controls = nullptr;
+    ControlButtons      buttons  = {};
+    ControlParams       params;
+
+    int  selected_layer          = 0;     // 0 = Layer 1, ..., 4 = Layer 5
+    int  selected_channel        = 0;     // 0 = Mic, 1 = Guitar, 2 = Line
+    bool channel_override_active = false; // Channel changed by hand since the layer was selected
+    bool bypass_active           = true;  // True = loop + wet signal, False = only loop
+
+    // Gesture state
+    bool     last_record                = false;
+    bool     record_active              = false; // long press sent kCmdRecordStart
+    int      record_layer               = 0;     // layer that gets the kCmdRecordStop
+    uint32_t last_release               = 0;
+    int      click_count                = 0;
+    bool     last_layer[kControlLayers] = {};
+    bool     last_channel               = false;
+    bool     last_bypass                = false;
+    bool     save_fired                 = false;
+    bool     stretch_fired              = false; // this bypass press toggled time-stretch
+    bool     channel_fired              = false; // this channel press did a redo or calibration
+    bool     bounce_fired               = false; // this record press went to held layers
+    int      held_layer                 = -1; // layer whose speed/pan follow the knobs
+
+    // Knob values last delivered to the engine; a failed send is retried next
+    // update. Speed and pan restart from the reading when a layer is held
+    float sent_gain[kControlLayers];
+    float sent_master;
+    float sent_speed;
+    float sent_pan;
+    float sent_monitor;
+    int   sent_monitor_channel;
+
+    float    monitor_level = 1.0f; // direct monitoring gain while the bypass relay is off
+    uint32_t latency       = 0;    // last measured round trip, frames
+
+    MidiClock midi;
+    int       quantize  = kQuantizeBar; // takes recorded while a clock runs
+    bool      grid_lock = true;         // keep them on the beat by trimming their speed
+
+    // Without a clock: snap takes to the master cycle the first one sets
+    // (transport.h). Off here so takes keep the length they were played at;
+    // the firmware turns it on
+    bool cycle_sync = false;
+
+    uint32_t dropped = 0; // commands lost to a full queue
+
+    static constexpr uint32_t double_click_time = 400; // ms
+    static constexpr float    long_press_ms     = 400.0f;
+    static constexpr float    layer_hold_ms     = 200.0f;
+    static constexpr float    save_hold_ms      = 2000.0f;
+    static constexpr float    calibrate_hold_ms = 2000.0f;
+    static constexpr float    knob_epsilon      = 0.001f; // smaller moves are not sent
+
+    void Init(EngineCore* eng, const ControlInput* input, const ControlButtons& btns);
+
+    // One control tick (about 1 ms); returns the ControlEvent bits raised
+    int Update();
+
+    // Stamped with the engine frame of now, or of an edge ms_ago in the past
+    bool Send(CommandType type, int layer, float value = 0.0f, int arg = 0);
+    bool SendAt(uint32_t frame, CommandType type, int layer, float value = 0.0f, int arg = 0);
+    uint32_t EventFrame(float ms_ago) const;
+    void UpdateKnobs();
+    void UpdateRecordButton();
+
+    // A MIDI byte read at system time now_us; returns MidiClockEvent bits
+    int  ReceiveMidi(uint8_t byte, uint32_t now_us);
+    void SendGrid();
+
+    // Hand a finished calibration capture to the calibrator's search (a few
+    // ms of work, once) and send the result to the engine
+    int UpdateCalibration();
+};
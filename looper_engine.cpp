@@ -0,0 +1,378 @@
+#include <math.h>
+#include "looper_engine.h"
+
+uint32_t EngineCore::FrameAtUs(uint32_t now_us) const
+{
+    uint32_t seq, frame, us;
+    do
+    {
+        seq   = clock_seq.load(std::memory_order_acquire);
+        frame = clock_frame;
+        us    = clock_us;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while((seq & 1) != 0 || seq != clock_seq.load(std::memory_order_relaxed));
+
+    float since = (float)(int32_t)(now_us - us) * (sample_rate * 1e-6f);
+    return frame + (int32_t)(since + (since < 0.0f ? -0.5f : 0.5f));
+}
+
+void EngineCore::BeginBlock(AudioIn in, size_t size)
+{
+    fx_budget.BeginBlock();
+    uint32_t now = Now();
+    uint32_t end = now + (uint32_t)size;
+
+    // Capture first: a take starting now reads this block from the pre-roll
+    preroll.Write(in, size, now);
+
+    uint32_t      n = 0;
+    LooperCommand cmd;
+    while(commands.Pop(cmd))
+    {
+        Apply(cmd, now, size);
+        bool stamped = cmd.type == kCmdRecordStart || cmd.type == kCmdRecordStop || cmd.type == kCmdSetGrid;
+        if(!stamped && (int32_t)(end - cmd.frame) > 0)
+        {
+            uint32_t lag      = end - cmd.frame;
+            stats.max_latency = lag > stats.max_latency ? lag : stats.max_latency;
+        }
+        n++;
+    }
+    stats.commands += n;
+    stats.max_commands_block = n > stats.max_commands_block ? n : stats.max_commands_block;
+
+    LockToGrid(now);
+    LockToCycle();
+    bool bouncing = bounce.Running();
+    bounce.Step(layers, now, master_gain);
+    if(bouncing && bounce.state.load(std::memory_order_relaxed) == kBounceDone)
+        HandOverBounce(now);
+    PROFILE_LAP(audio_profiler, kProfileCommands);
+}
+
+void EngineCore::MixInput(AudioIn in, AudioOut out, size_t size)
+{
+    monitor.SetTarget(monitor_gain, size);
+    if(monitor.value != 0.0f || monitor.target != 0.0f)
+    {
+        // Mic and guitar are mono sources heard in the centre, line is stereo
+        const float* src_l = monitor_channel == 1 ? in[1] : in[0];
+        const float* src_r = monitor_channel == 0 ? in[0] : in[1];
+        for(size_t i = 0; i < size; i++)
+        {
+            float g = monitor.At(i);
+            out[0][i] += src_l[i] * g;
+            out[1][i] += src_r[i] * g;
+        }
+    }
+    monitor.Finish();
+    calibrator.Process(in, out, size);
+}
+
+void EngineCore::EndBlock(size_t size, uint32_t now_us)
+{
+    uint32_t end = Now() + (uint32_t)size;
+    frame_clock.store(end, std::memory_order_relaxed);
+    transport.frames += size;
+
+    clock_seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    clock_frame = end;
+    clock_us    = now_us;
+    clock_seq.fetch_add(1, std::memory_order_release);
+    fx_budget.EndBlock();
+}
+
+void EngineCore::Apply(const LooperCommand& cmd, uint32_t start, size_t size)
+{
+    if(cmd.type == kCmdSetMaster)
+    {
+        master_gain = cmd.value;
+        return;
+    }
+    if(cmd.type == kCmdSetMonitor)
+    {
+        monitor_gain    = cmd.value;
+        monitor_channel = cmd.channel;
+        return;
+    }
+    if(cmd.type == kCmdSetLatency)
+    {
+        latency = cmd.value > 0.0f ? (uint32_t)(cmd.value + 0.5f) : 0;
+        for(int i = 0; i < num_layers; i++)
+            layers[i].input_latency = latency;
+        return;
+    }
+    if(cmd.type == kCmdSetGrid)
+    {
+        grid.Set(cmd.frame, cmd.value, cmd.arg);
+        return;
+    }
+    if(cmd.layer >= num_layers)
+        return;
+
+    LooperLayer& layer = layers[cmd.layer];
+    switch(cmd.type)
+    {
+        case kCmdRecordStart:
+            if(layer.recorded && !layer.paused && !layer.loading)
+                layer.StartOverdub(cmd.channel);
+            else if(!layer.recording && !layer.overdubbing && (cmd.arg & kQuantizeMask) != kQuantizeOff && grid.active)
+                StartTakeOnGrid(layer, cmd, start, size);
+            else if(!layer.recording && !layer.overdubbing)
+            {
+                StartTakeAt(layer, cmd, start, size);
+                layer.cycle_sync = (cmd.arg & kQuantizeCycle) != 0;
+            }
+            break;
+        case kCmdRecordStop:
+            // The take ends where the release arrives at the input. Events
+            // after this block cannot have been seen yet; clamp stale stamps too
+            if(layer.recording)
+            {
+                uint32_t end  = start + (uint32_t)size;
+                uint32_t stop = (int32_t)(cmd.frame - end) > 0 ? end : cmd.frame;
+                if(layer.sync_unit > 0 && grid.active)
+                {
+                    // A whole number of steps from the start, at least one;
+                    // the end may still be to come
+                    int    unit  = layer.sync_unit;
+                    double steps = floor((grid.BeatAt(stop) - layer.sync_start) / unit + 0.5);
+                    layer.sync_beats  = (steps < 1.0 ? 1 : (int)steps) * unit;
+                    layer.sync_locked = false;
+                    stop              = grid.FrameOf(layer.sync_start + layer.sync_beats);
+                }
+                int32_t len = (int32_t)(stop + latency - layer.take_start);
+                if(layer.cycle_sync && len > 0)
+                    len = (int32_t)SnapToCycle(layer, (uint32_t)len, start);
+                layer.StopRecordAt(len > 0 ? (size_t)len : 0);
+            }
+            else
+            {
+                layer.StopOverdubAfter(latency);
+            }
+            break;
+        case kCmdPause: layer.TogglePause(); break;
+        case kCmdUndo:
+            if(!layer.Undo() && cmd.arg != 0)
+                layer.Erase();
+            break;
+        case kCmdRedo: layer.Redo(); break;
+        case kCmdErase: layer.Erase(); break;
+        case kCmdSetSpeed:
+            // Locked while recording or overdubbing
+            if(!layer.recording && !layer.overdubbing && layer.recorded)
+            {
+                layer.speed      = cmd.value;
+                layer.sync_beats = 0; // Set by hand: off the grid
+            }
+            break;
+        case kCmdSetPan:
+            if(!layer.recording && layer.recorded)
+                layer.pan = cmd.value;
+            break;
+        case kCmdSetGain: layer.volume = cmd.value; break;
+        case kCmdSetStretch: layer.stretch = cmd.arg != 0; break;
+        case kCmdBounce:
+        {
+            // Sources are rendered dry and as they are at the start
+            uint8_t refuse = 0;
+            for(int i = 0; i < num_layers && i < kMaxBounceLayers; i++)
+            {
+                bool automated = automation != nullptr && automation[i].Active();
+                bool effects   = fx != nullptr && (fx[i].Enabled(kFxFilter) || fx[i].Enabled(kFxDelay));
+                refuse |= (uint8_t)(automated || effects ? 1 << i : 0);
+            }
+            bounce.Start(layers, num_layers, cmd.arg, cmd.layer, start, refuse);
+            break;
+        }
+        case kCmdSetFx: SetFx(cmd.layer, cmd.arg, cmd.value, size); break;
+        case kCmdAutomate:
+            if(automation != nullptr)
+                automation[cmd.layer].Toggle(layer);
+            break;
+        default: break;
+    }
+}
+
+void EngineCore::HandOverBounce(uint32_t now)
+{
+    // Take frame 0 is where the sources were at the start, so on the cycle
+    // it sits at the counter of that frame
+    if(bounce.in_cycle)
+    {
+        LooperLayer& dest = layers[bounce.dest];
+        dest.cycle_sync   = true;
+        dest.cycle_anchor = transport.At(bounce.start_frame, now);
+    }
+
+    // The take has the sources' moves in it: none of them replays over it,
+    // and effects switched on while it rendered go off with their claims
+    for(int i = 0; i < num_layers && i < kMaxBounceLayers; i++)
+    {
+        if(!(bounce.sources & (1 << i)))
+            continue;
+        if(automation != nullptr)
+            automation[i].Clear();
+        if(fx == nullptr)
+            continue;
+        for(int type = 0; type < kNumFxTypes; type++)
+            if(fx[i].Enabled(type))
+                fx_budget.Release(type);
+        fx[i].Reset();
+    }
+}
+
+void EngineCore::StartTakeAt(LooperLayer& layer, const LooperCommand& cmd, uint32_t start, size_t size)
+{
+    layer.StartTake(cmd.channel);
+    layer.take_start = start;
+    if(preroll.capacity == 0)
+    {
+        // No back-dating: start at the block, shifted by the round trip
+        layer.take_start += latency;
+        layer.record_skip = latency;
+        return;
+    }
+
+    // The press reaches the input `latency` frames later; a take starting
+    // past this block waits for it
+    uint32_t end   = start + (uint32_t)size;
+    uint32_t first = cmd.frame + latency;
+    if((int32_t)(first - end) > 0)
+    {
+        layer.take_start  = first;
+        layer.record_skip = first - start;
+        return;
+    }
+
+    // Back-date to the press, as far as the pre-roll reaches, and copy up to
+    // the end of this block; the block itself is then not recorded again
+    if((int32_t)(first - preroll.Begin()) < 0)
+        first = preroll.Begin();
+    for(uint32_t f = first; f != end; f++)
+        layer.RecordFrame(preroll.Left(f), preroll.Right(f));
+    layer.take_start  = first;
+    layer.record_skip = size;
+
+    uint32_t back      = start - first;
+    stats.max_backdate = (int32_t)back > 0 && back > stats.max_backdate ? back : stats.max_backdate;
+}
+
+void EngineCore::StartTakeOnGrid(LooperLayer& layer, const LooperCommand& cmd, uint32_t start, size_t size)
+{
+    int      unit     = grid.Unit(cmd.arg & kQuantizeMask);
+    int32_t  beat     = grid.NearestBeat(cmd.frame, unit);
+    uint32_t earliest = preroll.capacity > 0 ? preroll.Begin() : start;
+    while((int32_t)(grid.FrameOf(beat) + latency - earliest) < 0)
+        beat += unit;
+
+    LooperCommand on_grid = cmd;
+    on_grid.frame         = grid.FrameOf(beat);
+    uint32_t first        = on_grid.frame + latency;
+    if((int32_t)(first - start) < 0)
+    {
+        StartTakeAt(layer, on_grid, start, size); // back-dated through the pre-roll
+    }
+    else
+    {
+        // This block or a later one: wait for it
+        layer.StartTake(cmd.channel);
+        layer.take_start  = first;
+        layer.record_skip = first - start;
+    }
+    layer.sync_start = beat;
+    layer.sync_unit  = unit;
+}
+
+void EngineCore::LockToGrid(uint32_t now)
+{
+    if(!grid.active || !grid.lock)
+        return;
+
+    // Loop frame 0 sounds on the take's first beat, output_delay after it is rendered
+    double beat = grid.BeatAt(now + output_delay);
+    for(int i = 0; i < num_layers; i++)
+    {
+        LooperLayer& layer = layers[i];
+        if(layer.sync_beats == 0 || !layer.recorded || layer.recording || layer.overdubbing || layer.loading)
+            continue;
+        if(layer.paused)
+        {
+            layer.sync_locked = false; // Comes back in on the grid
+            continue;
+        }
+
+        double len  = (double)layer.record_len;
+        double want = fmod(beat - layer.sync_start, layer.sync_beats);
+        want        = (want < 0.0 ? want + layer.sync_beats : want) * len / layer.sync_beats;
+        double err = (double)layer.play_phase * (1.0 / 4294967296.0) - want;
+        err        = err > 0.5 * len ? err - len : (err < -0.5 * len ? err + len : err);
+        if(!layer.sync_locked || fabs(err) > kGridLockSnap)
+        {
+            // Fresh off the take, unpaused or the clock jumped: go straight
+            // to the grid rather than slide onto it
+            layer.play_phase  = (Phase)(want * 4294967296.0);
+            layer.sync_locked = true;
+            err               = 0.0;
+        }
+        double trim = -err / kGridLockFrames;
+        trim        = trim > kGridLockTrim ? kGridLockTrim : (trim < -kGridLockTrim ? -kGridLockTrim : trim);
+        layer.speed = (float)(len / (layer.sync_beats * grid.frames_per_beat) * (1.0 + trim));
+    }
+}
+
+uint32_t EngineCore::SnapToCycle(LooperLayer& layer, uint32_t len, uint32_t start)
+{
+    if(transport.cycle == 0)
+        len = transport.cycle = MasterTransport::Round(len);
+    else
+        len = transport.Snap(len);
+
+    // Loop frame 0 plays with what was heard when the take started, a round
+    // trip before it reached the input
+    layer.cycle_anchor = transport.At(layer.take_start - latency, start);
+    return len;
+}
+
+void EngineCore::LockToCycle()
+{
+    bool held = false;
+    for(int i = 0; i < num_layers; i++)
+    {
+        LooperLayer& layer = layers[i];
+        if(!layer.cycle_sync)
+            continue;
+        held = held || layer.recorded || layer.recording;
+        if(layer.recording && layer.record_limit > 0)
+        {
+            // Stopped, still recording up to the snapped length: playback
+            // picks up on the counter in whichever block the take ends
+            uint32_t len      = (uint32_t)(layer.write_idx + layer.record_limit);
+            layer.start_phase = PhaseFromIndex(transport.Position(layer.cycle_anchor, len));
+        }
+        else if(layer.recorded && !layer.recording && !layer.paused && !layer.loading && layer.speed == 1.0f)
+        {
+            // Paused or off 1.0x the layer leaves the cycle; it comes back in
+            // where the counter says
+            layer.play_phase = PhaseFromIndex(transport.Position(layer.cycle_anchor, (uint32_t)layer.record_len));
+        }
+    }
+    if(!held)
+        transport.cycle = 0;
+}
+
+void EngineCore::SetFx(int layer, int param, float value, size_t size)
+{
+    if(fx == nullptr)
+        return;
+    LayerFx& effects = fx[layer];
+    int      type    = FxTypeOf(param);
+    bool     was_on  = effects.Enabled(type);
+    effects.Set(param, value, size);
+    bool on = effects.Enabled(type);
+    if(on && !was_on && !fx_budget.Claim(type))
+        effects.Set(param, 0.0f, size); // Does not fit: stays off
+    else if(!on && was_on)
+        fx_budget.Release(type);
+}
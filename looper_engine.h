@@ -0,0 +1,294 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include "automation.h"
+#include "bounce.h"
+#include "control_io.h"
+#include "latency_calibration.h"
+#include "layer_fx.h"
+#include "limiter.h"
+#include "looper_layer.h"
+#include "meter.h"
+#include "midi_clock.h"
+#include "mix_bus.h"
+#include "preroll.h"
+#include "profiler.h"
+#include "spsc_queue.h"
+#include "transport.h"
+
+// The audio side of the looper. The control task (main loop) never touches
+// layer state directly: it sends commands through a wait-free SPSC queue, and
+// Process() applies them at the start of the next block, then renders.
+//
+// Commands are stamped with the engine frame the event happened at, not the
+// frame they arrive: a record start is back-dated to the button press using
+// the pre-roll, and a record stop ends the take on the release sample.
+//
+// The input reaches the engine one codec round trip (`latency`) after the
+// output it was played against, so both ends of a take and every overdub
+// write are moved by that much: new material lines up with what was heard.
+//
+// With an external MIDI clock the control task sends the beat grid on every
+// beat. Record start and stop (arg = Quantize) then land on the nearest beat
+// or bar, so a take is a whole number of them, and with the grid's lock flag
+// such a layer's speed is trimmed every block to keep it on the beat.
+//
+// Without a clock, takes started with kQuantizeCycle follow the master
+// transport (transport.h): the first sets the cycle, the rest stop on a
+// multiple or division of it, and all of them play where the shared frame
+// counter puts them.
+
+enum CommandType : uint8_t
+{
+    kCmdRecordStart, // long press: overdub a playing loop, otherwise record a new take; arg = Quantize | kQuantizeCycle
+    kCmdRecordStop,
+    kCmdPause,       // toggle
+    kCmdUndo,        // arg 1: erase the take when there is nothing to undo
+    kCmdRedo,
+    kCmdErase,
+    kCmdSetSpeed,
+    kCmdSetPan,
+    kCmdSetGain,     // layer volume, master not applied
+    kCmdSetMaster,
+    kCmdSetStretch,  // arg 1: speed keeps pitch (time-stretch), 0: varispeed
+    kCmdSetMonitor,  // direct monitoring: value = gain, channel = input as for recording
+    kCmdSetLatency,  // value = round trip in frames, from calibration
+    kCmdBounce,      // arg = source layer bits, mixed down into layer
+    kCmdSetGrid,     // frame = a beat, value = frames per beat (0: no clock), arg = beats per bar | kGrid* flags
+    kCmdSetFx,       // arg = FxParam, value in its unit; switching an effect on needs room in the FxBudget
+    kCmdAutomate,    // record speed and pan over the next pass of the loop, or clear what was recorded
+};
+
+struct LooperCommand
+{
+    uint32_t frame;   // engine frame clock of the event (button edge or send time)
+    uint8_t  type;    // CommandType
+    uint8_t  layer;
+    uint8_t  channel; // input for kCmdRecordStart and kCmdSetMonitor
+    uint8_t  arg;
+    float    value;
+};
+
+constexpr size_t kCommandQueueSize = 64;
+
+// Grid lock: a phase error is taken out over about this many frames, by
+// trimming the speed no more than kGridLockTrim either way (0.3%, 5 cents);
+// one past kGridLockSnap is a jump, not drift, and is snapped
+constexpr double kGridLockFrames = 48000.0;
+constexpr double kGridLockTrim   = 0.003;
+constexpr double kGridLockSnap   = 4800.0;
+
+struct EngineStats
+{
+    uint32_t commands;           // applied
+    uint32_t max_latency;        // frames from send to apply, past the block end
+    uint32_t max_commands_block; // most commands applied before one block
+    uint32_t max_backdate;       // frames a take start reached back into the pre-roll
+};
+
+// Configuration-independent part of the engine: the command queue, clocks,
+// pre-roll and command handling. The control task and the session store
+// only ever see this.
+struct EngineCore
+{
+    LooperLayer* layers      = nullptr;
+    int          num_layers  = 0;
+    float        master_gain = 0.0f;
+    float        sample_rate = 48000.0f;
+    PreRoll      preroll;
+
+    // Input monitoring, mixed into the output in the same block it arrives
+    float     monitor_gain    = 0.0f;
+    int       monitor_channel = 0; // 0 = Mic, 1 = Guitar, 2 = Line
+    ParamRamp monitor;
+    uint32_t  latency = 0; // codec round trip in frames
+
+    LatencyCalibrator calibrator;
+    LevelMeter        master_meter; // output before the limiter; clips = samples it caught
+    LayerBounce       bounce;       // renders a chunk at the start of every block while running
+    LayerFx*          fx = nullptr; // per layer, run on its voice before the mix
+    LayerAutomation*  automation = nullptr; // per layer, sets its speed and pan before it renders
+    FxBudget          fx_budget;    // measured per block once the firmware gives it a cycle counter
+    ClockGrid         grid;         // external MIDI clock's beats, when there is one
+    uint32_t          output_delay = 0; // frames from rendering a block to it leaving the engine
+    MasterTransport   transport;    // shared frame counter and the cycle takes snap to
+
+    SpscQueue<LooperCommand, kCommandQueueSize> commands;
+    std::atomic<uint32_t>                       frame_clock{0}; // frames rendered
+
+    // Frame clock against the system microsecond clock at the last block,
+    // published under a sequence count so the control side never sees a torn pair
+    std::atomic<uint32_t> clock_seq{0};
+    uint32_t              clock_frame = 0;
+    uint32_t              clock_us    = 0;
+
+    EngineStats stats = {};
+
+    // Control side: queue a command; false when the queue is full
+    bool Send(const LooperCommand& cmd) { return commands.Push(cmd); }
+
+    uint32_t Now() const { return frame_clock.load(std::memory_order_relaxed); }
+
+    // Control side: the engine frame that was captured at system time now_us
+    uint32_t FrameAtUs(uint32_t now_us) const;
+
+    // Audio side, start of a block: capture the input into the pre-roll,
+    // apply queued commands and render a chunk of a bounce under way
+    void BeginBlock(AudioIn in, size_t size);
+
+    // Audio side, after the mix: add the monitored input to out and run a
+    // calibration that is under way
+    void MixInput(AudioIn in, AudioOut out, size_t size);
+
+    // Audio side, end of a block: advance the frame clock and publish it
+    // against now_us, the system time the callback started
+    void EndBlock(size_t size, uint32_t now_us);
+
+    // start: frame clock of this block's first frame
+    void Apply(const LooperCommand& cmd, uint32_t start, size_t size);
+
+    // The block a bounce's take swapped in, at frame clock `now`: reset what
+    // the sources and the destination carried for their old takes, and put
+    // the take on the master cycle when they were on it
+    void HandOverBounce(uint32_t now);
+    void StartTakeAt(LooperLayer& layer, const LooperCommand& cmd, uint32_t start, size_t size);
+
+    // A take starting on the beat or bar nearest the press that the pre-roll
+    // still reaches, or the next one
+    void StartTakeOnGrid(LooperLayer& layer, const LooperCommand& cmd, uint32_t start, size_t size);
+
+    // Trim the speed of layers recorded on the grid so the loop is where the
+    // beat says it should be when this block is heard
+    void LockToGrid(uint32_t now);
+
+    // Length of a take snapped to the master cycle, which the first one sets
+    uint32_t SnapToCycle(LooperLayer& layer, uint32_t len, uint32_t start);
+
+    // Put the layers on the cycle at this block's counter value, and let the
+    // cycle go once none of them is left
+    void LockToCycle();
+
+    // One effect parameter; an effect switched on must fit the budget
+    void SetFx(int layer, int param, float value, size_t size);
+};
+
+// The looper with its configuration fixed at compile time: layer count,
+// frames of stereo loop memory budgeted per layer, processing block size and
+// storage format. Owns the layers and the arena their takes and undo history
+// come from, and runs the per-block loops over constant trip counts.
+//
+// The pool memory itself is passed to Init(): on the Seed it must live in
+// SDRAM, while the engine's own state belongs in internal RAM.
+template <int NumLayers, size_t MaxFrames, size_t BlockSize, typename SampleT = LoopFormat>
+struct LooperEngine : EngineCore
+{
+    // Layers share one arena, so SampleT has to be the format the layer code
+    // is built for; pick it with LOOPER_SAMPLE_FORMAT
+    static_assert(std::is_same<SampleT, LoopFormat>::value, "SampleT must match LOOPER_SAMPLE_FORMAT");
+    static_assert(NumLayers > 0 && BlockSize > 0, "need at least one layer and one frame per block");
+
+    static constexpr int    kNumLayers  = NumLayers;
+    static constexpr size_t kMaxFrames  = MaxFrames;
+    static constexpr size_t kBlockSize  = BlockSize;
+    static constexpr size_t kLayerBlocks =
+        (MaxFrames * 2 * SampleT::kBytes + kArenaBlockBytes - 1) / kArenaBlockBytes;
+    static constexpr size_t kPoolBytes = NumLayers * kLayerBlocks * kArenaBlockBytes;
+    static constexpr size_t kOutputDelay = BlockSize; // limiter lookahead, part of the round trip
+    static_assert(NumLayers * kLayerBlocks <= kMaxArenaBlocks, "pool exceeds the arena's block table");
+
+    SampleArena                  arena;
+    LooperLayer                  layer_array[NumLayers];
+    LayerFx                      fx_array[NumLayers];
+    LayerAutomation              automation_array[NumLayers];
+    MixBus<NumLayers, BlockSize> bus;
+    Limiter<BlockSize>           limiter;
+
+    // pool: kPoolBytes, or pool_bytes when given; preroll_buffer holds
+    // 2 * preroll_frames floats, preroll_frames a power of two, nullptr
+    // disables back-dating; delay_buffer holds NumLayers * 2 * delay_frames
+    // floats, delay_frames a power of two, nullptr goes without the delay
+    void Init(uint8_t* pool,
+              size_t   pool_bytes     = kPoolBytes,
+              float*   preroll_buffer = nullptr,
+              size_t   preroll_frames = 0,
+              float*   delay_buffer   = nullptr,
+              size_t   delay_frames   = 0)
+    {
+        arena.Init(pool, pool_bytes);
+        for(int i = 0; i < NumLayers; i++)
+            layer_array[i].Init(&arena);
+        bus.Init();
+        limiter.Init();
+        calibrator.Init();
+        bounce.Init(&arena);
+        master_meter.Init(sample_rate / BlockSize);
+        for(int i = 0; i < NumLayers; i++)
+            layer_array[i].meter.Init(sample_rate / BlockSize);
+        for(int i = 0; i < NumLayers; i++)
+            fx_array[i].Init(delay_buffer != nullptr ? delay_buffer + i * 2 * delay_frames : nullptr,
+                             (uint32_t)delay_frames, sample_rate);
+        for(int i = 0; i < NumLayers; i++)
+            automation_array[i].Init();
+        fx_budget.Init((uint32_t)(kFxCpuHz / sample_rate * BlockSize), BlockSize);
+        layers       = layer_array;
+        fx           = fx_array;
+        automation   = automation_array;
+        num_layers   = NumLayers;
+        output_delay = kOutputDelay;
+        if(preroll_buffer != nullptr)
+            preroll.Init(preroll_buffer, preroll_frames);
+    }
+
+    // Audio side: apply queued commands, render every layer, mix the audible
+    // ones and the monitored input, meter and limit into out.
+    // size must be a multiple of BlockSize; larger callbacks run in BlockSize steps.
+    void Process(AudioIn in, AudioOut out, size_t size, uint32_t now_us)
+    {
+        for(size_t offset = 0; offset + BlockSize <= size; offset += BlockSize)
+        {
+            const float* block_in[2]  = {in[0] + offset, in[1] + offset};
+            float*       block_out[2] = {out[0] + offset, out[1] + offset};
+            ProcessBlock(block_in, block_out, now_us);
+        }
+    }
+
+    void ProcessBlock(AudioIn in, AudioOut out, uint32_t now_us)
+    {
+        BeginBlock(in, BlockSize);
+        for(int i = 0; i < NumLayers; i++)
+        {
+            LooperLayer& layer   = layer_array[i];
+            LayerFx&     effects = fx_array[i];
+            MixVoice&    voice   = bus.Next();
+            automation_array[i].Block(layer, BlockSize);
+            bool         audible = layer.RenderVoice(in, voice, BlockSize, master_gain);
+            if(!audible && effects.delay.Running())
+            {
+                // The loop is silent, its echoes are not: at the layer's gains
+                voice.gain_l.Snap(layer.gain_l.value);
+                voice.gain_r.Snap(layer.gain_r.value);
+            }
+            if(effects.Process(voice.left, voice.right, BlockSize, audible, &fx_budget))
+            {
+                // Measured as heard: the ramps are linear, so their larger end is the peak gain
+                float gl = fmaxf(voice.gain_l.value, voice.gain_l.target);
+                float gr = fmaxf(voice.gain_r.value, voice.gain_r.target);
+                layer.meter.Add(MeasureBlock(voice.left, voice.right, BlockSize, gl, gr), BlockSize);
+                bus.Add();
+            }
+            else
+                layer.meter.AddSilence();
+            PROFILE_LAP(audio_profiler, kProfileLayer0 + i);
+        }
+        bus.Mix(out);
+        MixInput(in, out, BlockSize);
+
+        BlockLevel level = MeasureBlock(out[0], out[1], BlockSize);
+        master_meter.Add(level, BlockSize);
+        limiter.Process(out, level.peak);
+        PROFILE_LAP(audio_profiler, kProfileLayer0 + NumLayers); // output: mix, meters, limiter
+        EndBlock(BlockSize, now_us);
+    }
+};
@@ -1,241 +1,516 @@
 #include "looper_layer.h"
-#include <math.h>
+
+void LooperLayer::Init(SampleArena* arena)
+{
+    storage.Init(arena);
+    history.Init(&storage);
+    Reset();
+}
 
 void LooperLayer::Reset()
 {
+    history.Clear();
+    storage.Clear();
+    stage.Invalidate();
     record_len = 0;
     write_idx = 0;
-    play_pos = 0.0f;
+    play_phase = 0;
     recording = false;
     recorded = false;
     paused = false;
-    click_count = 0;
+    overdubbing = false;
+    loading = false;
+    resident_len = 0;
+    record_skip = 0;
+    record_limit = 0;
+    overdub_tail = 0;
+    sync_unit = 0;
+    sync_beats = 0;
+    cycle_sync = false;
+    start_phase = 0;
+    streaming = false;
 }
 
-void LooperLayer::Process(int adc_offset,
-                          AudioHandle::InputBuffer in,
-                          AudioHandle::OutputBuffer out,
-                          size_t size,
-                          Switch* record_play_button,
-                          DaisySeed* hw,
-                          int selected_channel,
-                          bool allow_speed_control,
-                          bool allow_pan_control)
+void LooperLayer::UpdateGains(float master_gain, size_t size)
 {
-    // Only process record button if provided (for selected layer)
-    if(record_play_button != nullptr)
+    float gain = volume * master_gain;
+    float target_l = gain * (1.0f - pan);
+    float target_r = gain * pan;
+
+    // Nothing is heard while stopped, so jump instead of ramping from a stale value
+    if(recorded && record_len > 0 && !paused && !recording)
+    {
+        gain_l.SetTarget(target_l, size);
+        gain_r.SetTarget(target_r, size);
+    }
+    else
     {
-        record_play_button->Debounce();
+        gain_l.Snap(target_l);
+        gain_r.Snap(target_r);
+    }
+}
 
-        static bool was_pressed = false;
-        bool pressed = record_play_button->Pressed();
+void LooperLayer::AdvancePhase(size_t size)
+{
+    if(streaming && !stream_primed)
+        return; // A stream starts where its data does
+    uint32_t from = PhaseIndex(play_phase);
+    play_phase += size * PhaseIncrement(speed);
+    while(play_phase >= PhaseFromIndex((uint32_t)record_len))
+        play_phase -= PhaseFromIndex((uint32_t)record_len);
+    if(streaming)
+        stream_pos += (PhaseIndex(play_phase) - from) & (uint32_t)(record_len - 1);
+}
 
-        // Start recording on long press
-        if(record_play_button->TimeHeldMs() > 400 && pressed && !recording)
-        {
-            recording = true;
-            write_idx = 0;
-            recorded = false;
-            paused = false;
-            click_count = 0;
-            speed = 1.0f; // Always start recording at normal speed
-        }
+bool LooperLayer::PlayInto(float* out_l, float* out_r, size_t size, const ParamRamp& ramp_l, const ParamRamp& ramp_r)
+{
+    if(streaming)
+        return PlayStream(out_l, out_r, size, ramp_l, ramp_r);
 
-        // On release
-        if(was_pressed && !pressed)
+    // While a take streams in, stay silent for blocks that would read past the resident frames
+    Phase inc = PhaseIncrement(speed);
+    if(loading)
+    {
+        uint64_t last = PhaseIndex(play_phase) + (((uint32_t)play_phase + size * inc) >> kPhaseFracBits)
+                        + LoopInterp::kPost + 1;
+        if(last > resident_len)
         {
-            if(recording)
-            {
-                recording = false;
-                record_len = write_idx > 0 ? write_idx : 1;
-                play_pos = 0.0f;
-                recorded = true;
-                recorded_channel = selected_channel;
-            }
-            else
-            {
-                uint32_t now = System::GetNow();
-                if(now - last_release < double_click_time)
-                {
-                    click_count++;
-                }
-                else
-                {
-                    click_count = 1;
-                }
-                last_release = now;
-
-                if(click_count == 2)
-                {
-                    recorded = false;
-                    record_len = 0;
-                    play_pos = 0.0f;
-                    click_count = 0;
-                    paused = false;
-                }
-                else if(click_count == 1)
-                {
-                    if(recorded)
-                        paused = !paused;
-                }
-            }
+            AdvancePhase(size);
+            return false;
         }
-        was_pressed = pressed;
     }
 
-    // --- Read pots for this layer ---
-    // ADC layout: [0]=SPEED_POT, [1]=PAN_POT, [2]=MASTER_VOL, [3]=VOLUME1_POT, [4]=VOLUME2_POT, [5]=VOLUME3_POT, [6]=VOLUME4_POT, [7]=VOLUME5_POT
-    // Potentiometers are wired backwards (3V3 and GND swapped), so readings are inverted
-    float speed_pot = 1.0f - hw->adc.GetFloat(0);              // Common speed control
-    float pan_pot   = 1.0f - hw->adc.GetFloat(1);              // Common pan control
-    float master_vol = 1.0f - hw->adc.GetFloat(2);             // Master volume for all layers
-    float vol_pot   = 1.0f - hw->adc.GetFloat(3 + adc_offset); // Individual volume per layer
+    LoopSource src = {storage.arena->pool,
+                      storage.blocks,
+                      kArenaBlockBytes,
+                      storage.frames_per_block,
+                      storage.channels,
+                      (uint32_t)record_len};
+    if(stretch && inc != PhaseIncrement(1.0f) && record_len >= kStretchMinFrames)
+    {
+        stretcher.Render(src, play_phase, inc, out_l, out_r, size, ramp_l, ramp_r);
+        return true;
+    }
+    stretcher.active = false; // Picks up from the play position when next needed
+    ResampleStaged<LoopInterp, LoopFormat>(stage, src, play_phase, inc, out_l, out_r, size, ramp_l, ramp_r);
+    return true;
+}
+
+void LooperLayer::RenderPlayback(AudioOut out, size_t size)
+{
+    PlayInto(out[0], out[1], size, gain_l, gain_r);
+    gain_l.Finish();
+    gain_r.Finish();
+}
 
-    // Speed logic - only allow speed changes when explicitly enabled (hold layer button + turn speed knob)
-    if(!recording && recorded && allow_speed_control)
+void LooperLayer::OverdubBlock(AudioIn in, size_t size, int selected_channel, Phase start)
+{
+    const Phase end = PhaseFromIndex((uint32_t)record_len);
+    const Phase inc = PhaseIncrement(speed);
+    Phase phase = start;
+    for(size_t i = 0; i < size; i++)
     {
-        const float center = 0.5f;
-        const float dead_zone = 0.09f;
-        if(speed_pot < center - dead_zone)
-        {
-            float tt = (speed_pot - 0.0f) / (center - dead_zone);
-            speed = 0.3f + tt * (1.0f - 0.3f);
-        }
-        else if(speed_pot > center + dead_zone)
-        {
-            float tt = (speed_pot - (center + dead_zone)) / (1.0f - (center + dead_zone));
-            speed = 1.0f + tt * (2.0f - 1.0f);
-        }
-        else
-        {
-            speed = 1.0f;
-        }
+        // Same input routing as recording; Line into a mono take is summed
+        float in_l = selected_channel == 1 ? in[1][i] : in[0][i];
+        float in_r = selected_channel == 0 ? in[0][i] : in[1][i];
+        if(storage.channels == 1 && selected_channel == 2)
+            in_l = 0.5f * (in_l + in_r);
+
+        size_t frame = PhaseIndex(phase);
+        history.PrepareWrite(frame);
+        float old_l = storage.Read(frame, 0);
+        float old_r = storage.Read(frame, storage.channels - 1);
+        storage.Write(frame, old_l * feedback + in_l, old_r * feedback + in_r);
+
+        phase += inc;
+        while(phase >= end)
+            phase -= end;
     }
-    // During recording or when speed control is not enabled, speed is locked
+    history.CopyAhead(PhaseIndex(phase), (size_t)record_len, size);
+    stage.Invalidate(); // Staged windows may hold frames just written
+}
 
-    // Pan logic - only allow pan changes when explicitly enabled (hold layer button + turn pan knob)
-    if(!recording && recorded && allow_pan_control)
+void LooperLayer::OverdubInput(AudioIn in, size_t size, Phase block_start)
+{
+    // The first input_latency frames after the press were played before it
+    size_t skip = record_skip < size ? record_skip : size;
+    size_t end = overdub_tail > 0 && overdub_tail < size ? overdub_tail : size;
+    record_skip -= skip;
+    if(end > skip)
     {
-        pan = pan_pot; // Read pan from knob when control is enabled
+        // Speed is locked at 1.0 while overdubbing: one input frame per loop frame
+        const Phase loop_end = PhaseFromIndex((uint32_t)record_len);
+        const Phase back = PhaseFromIndex((uint32_t)(input_latency % record_len));
+        Phase at = block_start + PhaseFromIndex((uint32_t)(skip % record_len));
+        at = at >= loop_end ? at - loop_end : at;
+        at = at >= back ? at - back : at + loop_end - back;
+        const float* part[2] = {in[0] + skip, in[1] + skip};
+        OverdubBlock(part, end - skip, input_channel, at);
     }
-    // During recording or when pan control is not enabled, pan is locked at previous value
+    if(overdub_tail > 0)
+    {
+        overdub_tail -= end;
+        if(overdub_tail == 0)
+            StopOverdub();
+    }
+}
+
+bool LooperLayer::BeginRestore(size_t len, int channels)
+{
+    Reset();
+    storage.Begin(channels);
+    len = storage.Reserve(len);
+    if(len == 0)
+        return false;
+
+    // Taps before frame 0 wrap to the end of the take; keep them silent until it arrives
+    size_t tail = len < (size_t)LoopInterp::kTaps ? len : (size_t)LoopInterp::kTaps;
+    for(size_t i = len - tail; i < len; i++)
+        storage.Write(i, 0.0f, 0.0f);
 
-    volume = powf(vol_pot, 2.5f) * 1.4f;  // Individual volume: 0.0 to 1.4x
-    if(volume < 0.0f) volume = 0.0f;
-    
-    float panL = 1.0f - pan;
-    float panR = pan;
-    
-    // Read master volume as a coefficient (0.0 to 1.43x)
-    // Combined max: 1.4 * 1.43 ≈ 2.0x
-    float master_volume = powf(master_vol, 2.5f) * 1.43f;
-    if(master_volume < 0.0f) master_volume = 0.0f;
+    record_len = len;
+    write_idx = len;
+    resident_len = 0;
+    loading = true;
+    recorded = true;
+    return true;
+}
 
-    // --- Input selection based on selected channel ---
+void LooperLayer::RestoreFrames(size_t frame, const uint8_t* data, size_t frames)
+{
+    if(!loading || frame != resident_len)
+        return;
+    if(frame + frames > record_len)
+        frames = record_len - frame; // Take was cut short by a full arena
+    storage.WriteRaw(frame, data, frames);
+    resident_len = frame + frames;
+    loading = resident_len < record_len;
+    stage.Invalidate(); // Staged windows may have been fetched before these frames arrived
+}
+
+bool LooperLayer::BeginStream(size_t ring, int channels)
+{
+    Reset();
+    storage.Begin(channels);
+    if(storage.Reserve(ring) < ring)
+    {
+        storage.Clear();
+        return false;
+    }
+    // Taps before stream frame 0 read the end of the ring: silence there
+    for(size_t i = ring - LoopInterp::kTaps; i < ring; i++)
+        storage.Write(i, 0.0f, 0.0f);
+
+    record_len = ring;
+    write_idx = ring;
+    recorded = true;
+    streaming = true;
+    stream_primed = false;
+    stream_pos = 0;
+    stream_begin = (uint32_t)-LoopInterp::kTaps;
+    stream_end = 0;
+    stream_resume = 0;
+    stream_fade.Snap(0.0f);
+    stream_underruns = 0;
+    stream_muted = 0;
+    speed = 1.0f;
+    stretch = false;
+    return true;
+}
+
+void LooperLayer::StreamFrames(uint32_t frame, const uint8_t* data, size_t frames)
+{
+    if(!streaming)
+        return;
+    const uint32_t ring = (uint32_t)record_len;
+    if(frame != stream_end)
+        stream_begin = frame; // The reader skipped ahead: the frames before are stale
+    size_t slot = frame & (ring - 1);
+    size_t first = frames < ring - slot ? frames : ring - slot;
+    storage.WriteRaw(slot, data, first);
+    if(first < frames)
+        storage.WriteRaw(0, data + first * storage.FrameBytes(), frames - first);
+    stream_end = frame + (uint32_t)frames;
+    if((int32_t)(stream_end - stream_begin) > (int32_t)ring)
+        stream_begin = stream_end - ring; // Overwritten
+    stage.Invalidate(); // The prefetched window may have been fetched before these frames arrived
+}
+
+bool LooperLayer::PlayStream(float* out_l, float* out_r, size_t size, const ParamRamp& ramp_l, const ParamRamp& ramp_r)
+{
+    // Frames this block and the next one read around the play position
+    Phase inc = PhaseIncrement(speed);
+    int32_t span = (int32_t)((((uint32_t)play_phase) + size * inc) >> kPhaseFracBits);
+    int32_t behind = (int32_t)(stream_pos - stream_begin);
+    int32_t ahead = (int32_t)(stream_end - stream_pos);
+    bool now = behind >= LoopInterp::kPre && ahead > span + LoopInterp::kPost;
+    bool next = now && ahead > 2 * span + LoopInterp::kPost;
+
+    if(!stream_primed)
+    {
+        if(!now || ahead < (int32_t)stream_resume)
+            return false; // Hold at the start until there is enough to play
+        stream_primed = true;
+    }
+
+    float from = stream_fade.value;
+    if(!now)
+    {
+        // The data ran out sooner than a block ahead (a jump in speed): cut
+        if(from > 0.0f)
+            stream_underruns++;
+        stream_fade.Snap(0.0f);
+    }
+    else
+    {
+        bool resume = from > 0.0f || ahead >= (int32_t)stream_resume;
+        float to = next && resume ? 1.0f : 0.0f;
+        if(from > 0.0f && to == 0.0f)
+            stream_underruns++;
+        stream_fade.SetTarget(to, size);
+    }
+    if(stream_fade.value == 0.0f && stream_fade.target == 0.0f)
+    {
+        stream_muted++;
+        AdvancePhase(size);
+        return false;
+    }
+
+    // The fade rides on the caller's gains, as one ramp per side
+    float k = 1.0f / (float)size;
+    ParamRamp faded_l = {ramp_l.value * from, ramp_l.target * stream_fade.target, 0.0f};
+    ParamRamp faded_r = {ramp_r.value * from, ramp_r.target * stream_fade.target, 0.0f};
+    faded_l.step = (faded_l.target - faded_l.value) * k;
+    faded_r.step = (faded_r.target - faded_r.value) * k;
+    stream_fade.Finish();
+
+    LoopSource src = {storage.arena->pool,
+                      storage.blocks,
+                      kArenaBlockBytes,
+                      storage.frames_per_block,
+                      storage.channels,
+                      (uint32_t)record_len};
+    uint32_t start = PhaseIndex(play_phase);
+    ResampleStaged<LoopInterp, LoopFormat>(stage, src, play_phase, inc, out_l, out_r, size, faded_l, faded_r);
+    stream_pos += (PhaseIndex(play_phase) - start) & (uint32_t)(record_len - 1);
+    return true;
+}
+
+void LooperLayer::StopOverdub()
+{
+    if(!overdubbing)
+        return;
+    overdubbing = false;
+    overdub_tail = 0;
+    record_skip = 0;
+    history.EndPass();
+}
+
+bool LooperLayer::Undo()
+{
+    if(!history.Undo())
+        return false;
+    stage.Invalidate();
+    return true;
+}
+
+bool LooperLayer::Redo()
+{
+    if(!history.Redo())
+        return false;
+    stage.Invalidate();
+    return true;
+}
+
+void LooperLayer::StartTake(int channel)
+{
+    if(recording || overdubbing)
+        return;
+    history.Clear();
+    loading = false;
+    recording = true;
+    input_channel = channel;
+    write_idx = 0;
+    record_skip = 0;
+    record_limit = 0;
+    sync_unit = 0;
+    sync_beats = 0;
+    cycle_sync = false;
+    start_phase = 0;
+    streaming = false;
+    storage.Begin(channel == 2 ? 2 : 1); // Mic/Guitar takes are stored mono
+    stage.Invalidate();
+    recorded = false;
+    paused = false;
+    speed = 1.0f; // Always start recording at normal speed
+}
+
+void LooperLayer::StartOverdub(int channel)
+{
+    if(recording || overdubbing || !recorded || paused || loading || streaming)
+        return;
+    overdubbing = true;
+    input_channel = channel;
+    speed = 1.0f; // Overdub at normal speed, one input frame per loop frame
+    record_skip = input_latency;
+    history.BeginPass();
+}
+
+void LooperLayer::StopRecord()
+{
+    if(recording)
+    {
+        recording = false;
+        // Keep at least one (silent) frame; with the arena full there may be none
+        if(write_idx == 0 && storage.Write(0, 0.0f, 0.0f))
+            write_idx = 1;
+        record_len = write_idx;
+        play_phase = start_phase < PhaseFromIndex((uint32_t)record_len) ? start_phase : 0;
+        recorded = record_len > 0;
+        recorded_channel = input_channel;
+    }
+    else
+    {
+        StopOverdub();
+    }
+}
+
+void LooperLayer::StopRecordAt(size_t frames)
+{
+    if(recording && frames > write_idx)
+    {
+        record_limit = frames - write_idx; // The rest is still to come
+        return;
+    }
+    if(recording && frames < write_idx)
+        write_idx = frames; // Drop what was recorded after the release
+    StopRecord();
+}
+
+void LooperLayer::StopOverdubAfter(size_t frames)
+{
+    if(!overdubbing)
+        return;
+    if(frames == 0)
+        StopOverdub();
+    else
+        overdub_tail = frames;
+}
+
+void LooperLayer::RecordFrame(float mic_in, float guitar_in)
+{
+    // Grows the take block by block until the shared arena runs out
+    bool written = false;
+    if(input_channel == 0) // Mic - record from left input (mono)
+    {
+        written = storage.Write(write_idx, mic_in, mic_in);
+    }
+    else if(input_channel == 1) // Guitar - record from right input (mono)
+    {
+        written = storage.Write(write_idx, guitar_in, guitar_in);
+    }
+    else if(input_channel == 2) // Line - record from both inputs (true stereo)
+    {
+        written = storage.Write(write_idx, mic_in, guitar_in);
+    }
+    if(written)
+        write_idx++;
+}
+
+void LooperLayer::TogglePause()
+{
+    if(recorded)
+        paused = !paused;
+}
+
+void LooperLayer::Erase()
+{
+    StopOverdub();
+    history.Clear();
+    loading = false;
+    recording = false;
+    recorded = false;
+    record_len = 0;
+    storage.Clear();
+    stage.Invalidate();
+    play_phase = 0;
+    paused = false;
+    sync_unit = 0;
+    sync_beats = 0;
+    cycle_sync = false;
+    start_phase = 0;
+    streaming = false;
+}
+
+bool LooperLayer::RecordBlock(AudioIn in, size_t size, float master_gain)
+{
+    UpdateGains(master_gain, size);
+
+    // --- Input selection based on the channel the take was started with ---
     // Channel 0 = Mic (Left input), Channel 1 = Guitar (Right input), Channel 2 = Line (Both inputs)
 
-    for(size_t i = 0; i < size; i++)
+    if(recording)
     {
-        float mic_in = in[0][i];      // Left input
-        float guitar_in = in[1][i];   // Right input
-        
-        if(recording)
+        // Left = Mic, Right = Guitar; monitoring is the engine's job
+        size_t skip = record_skip < size ? record_skip : size;
+        size_t end = record_limit > 0 && skip + record_limit < size ? skip + record_limit : size;
+        size_t before = write_idx;
+        for(size_t i = skip; i < end; i++)
+            RecordFrame(in[0][i], in[1][i]);
+        record_skip -= skip;
+        if(record_limit > 0)
         {
-            if(write_idx < buffer_size)
+            // Stop at the release, or now if the arena ran out: the take cannot grow
+            record_limit -= end - skip;
+            if(record_limit == 0 || write_idx - before < end - skip)
             {
-                if(selected_channel == 0) // Mic - record from left input
-                {
-                    buffer_l[write_idx] = mic_in;
-                    buffer_r[write_idx] = mic_in;
-                }
-                else if(selected_channel == 1) // Guitar - record from right input
-                {
-                    buffer_l[write_idx] = guitar_in;
-                    buffer_r[write_idx] = guitar_in;
-                }
-                else if(selected_channel == 2) // Line - record from both inputs (true stereo)
-                {
-                    buffer_l[write_idx] = mic_in;   // Left to left
-                    buffer_r[write_idx] = guitar_in; // Right to right
-                }
-                write_idx++;
+                record_limit = 0;
+                StopRecord();
             }
-            
-            // Pass through during recording (DISABLED - no monitoring during recording)
-            /*
-            if(selected_channel == 0) // Mic
-            {
-                out[0][i] += mic_in * volume * master_volume;
-                out[1][i] += mic_in * volume * master_volume;
-            }
-            else if(selected_channel == 1) // Guitar
-            {
-                out[0][i] += guitar_in * volume * master_volume;
-                out[1][i] += guitar_in * volume * master_volume;
-            }
-            else if(selected_channel == 2) // Line
-            {
-                out[0][i] += mic_in * volume * master_volume;
-                out[1][i] += guitar_in * volume * master_volume;
-            }
-            */
-        }
-        else if(recorded && record_len > 0 && !paused)
-        {
-            int idx0 = (int)play_pos;
-            int idx1 = (idx0 + 1) % record_len;
-            float frac = play_pos - idx0;
-
-            out[0][i] += (buffer_l[idx0] * (1.0f - frac) + buffer_l[idx1] * frac) * volume * master_volume * panL;
-            out[1][i] += (buffer_r[idx0] * (1.0f - frac) + buffer_r[idx1] * frac) * volume * master_volume * panR;
-
-            play_pos += speed;
-            while(play_pos >= record_len) play_pos -= record_len;
-            while(play_pos < 0) play_pos += record_len;
-        }
-        else
-        {
-            // Do not clear output here, so layers can mix
         }
     }
+    return !recording && recorded && record_len > 0 && !paused;
 }
 
-void LooperLayer::ProcessPlaybackOnly(AudioHandle::InputBuffer in,
-                                      AudioHandle::OutputBuffer out,
-                                      size_t size,
-                                      DaisySeed* hw,
-                                      int layer_index)
-{
-    // Only playback, no controls
-    if(recorded && record_len > 0 && !paused)
-    {
-        // Read individual volume for this layer + master volume
-        // ADC layout: [0]=SPEED_POT, [1]=PAN_POT, [2]=MASTER_VOL, [3]=VOLUME1_POT, [4]=VOLUME2_POT, [5]=VOLUME3_POT, [6]=VOLUME4_POT, [7]=VOLUME5_POT
-        // Potentiometers are wired backwards (3V3 and GND swapped), so readings are inverted
-        float master_vol = 1.0f - hw->adc.GetFloat(2);             // Master volume for all layers
-        float vol_pot = 1.0f - hw->adc.GetFloat(3 + layer_index);  // Individual volume per layer
-        
-        float master_volume = powf(master_vol, 2.5f) * 1.43f;  // Master: 0.0 to 1.43x
-        if(master_volume < 0.0f) master_volume = 0.0f;
-        
-        float layer_volume = powf(vol_pot, 2.5f) * 1.4f;      // Individual: 0.0 to 1.4x  
-        if(layer_volume < 0.0f) layer_volume = 0.0f;
-        // Combined maximum: 1.4 * 1.43 ≈ 2.0x
-        
-        float panL = 1.0f - pan;
-        float panR = pan;
-        for(size_t i = 0; i < size; i++)
-        {
-            int idx0 = (int)play_pos;
-            int idx1 = (idx0 + 1) % record_len;
-            float frac = play_pos - idx0;
+void LooperLayer::Render(AudioIn in, AudioOut out, size_t size, float master_gain)
+{
+    bool  playing     = RecordBlock(in, size, master_gain);
+    Phase block_start = play_phase;
+    if(playing)
+        RenderPlayback(out, size);
+    // Do not clear output otherwise, so layers can mix
 
-            out[0][i] += (buffer_l[idx0] * (1.0f - frac) + buffer_l[idx1] * frac) * layer_volume * master_volume * panL;
-            out[1][i] += (buffer_r[idx0] * (1.0f - frac) + buffer_r[idx1] * frac) * layer_volume * master_volume * panR;
+    // Sound on sound: the loop plays its old content, then this block's input is mixed in
+    if(overdubbing)
+        OverdubInput(in, size, block_start);
+}
 
-            play_pos += speed;
-            while(play_pos >= record_len) play_pos -= record_len;
-            while(play_pos < 0) play_pos += record_len;
+bool LooperLayer::RenderVoice(AudioIn in, MixVoice& voice, size_t size, float master_gain)
+{
+    static const ParamRamp kUnity = {1.0f, 1.0f, 0.0f};
+
+    bool  playing     = RecordBlock(in, size, master_gain);
+    Phase block_start = play_phase;
+    bool  audible     = false;
+    if(playing)
+    {
+        // At zero gain for the whole block: keep time, skip the interpolation
+        bool silent = gain_l.value == 0.0f && gain_l.target == 0.0f && gain_r.value == 0.0f && gain_r.target == 0.0f;
+        if(silent)
+            AdvancePhase(size);
+        else
+        {
+            for(size_t i = 0; i < size; i++)
+                voice.left[i] = voice.right[i] = 0.0f;
+            audible = PlayInto(voice.left, voice.right, size, kUnity, kUnity);
+            voice.gain_l = gain_l;
+            voice.gain_r = gain_r;
         }
     }
-}
\ No newline at end of file
+    gain_l.Finish();
+    gain_r.Finish();
+
+    if(overdubbing)
+        OverdubInput(in, size, block_start);
+    return audible;
+}
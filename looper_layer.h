@@ -1,51 +1,153 @@
 #pragma once
-#include "daisy_seed.h"
-#include "daisysp.h"
-
-using namespace daisy;
-using namespace daisy::seed;
+#include "control_io.h"
+#include "control_params.h"
+#include "meter.h"
+#include "mix_bus.h"
+#include "playback_stage.h"
+#include "resampler.h"
+#include "sample_arena.h"
+#include "take_history.h"
+#include "time_stretch.h"
 
 struct LooperLayer
 {
-    float* buffer_l;
-    float* buffer_r;
-    size_t buffer_size;
+    LoopStorage storage; // Blocks claimed from the shared sample arena
+    PlaybackStage stage; // Internal-RAM copy of the frames playback reads next
+    TakeHistory history; // Copy-on-write undo/redo of overdub passes
+    TimeStretch stretcher; // Pitch-preserving playback when stretch is on
 
     size_t record_len = 0;
     size_t write_idx = 0;
-    float play_pos = 0.0f;
+    Phase play_phase = 0; // 32.32 fixed-point play position
 
     bool recording = false;
     bool recorded = false;
     bool paused = false;
+    bool overdubbing = false;
+    bool loading = false;     // Restored take still streaming in from storage
+    size_t resident_len = 0;  // Frames of a restored take already in memory
     int recorded_channel = 0;
 
     // Controls
     float speed = 1.0f;
     float volume = 1.0f;
     float pan = 0.5f;
+    float feedback = 0.9f; // Level of the existing loop kept on each overdub pass
+    bool stretch = false;  // Speed changes tempo only, pitch stays (loops of 4096+ frames)
+
+    // Per-sample smoothed output gains (volume * master * pan)
+    ParamRamp gain_l;
+    ParamRamp gain_r;
+    LevelMeter meter; // Output level after volume, pan and master, set by the engine
+
+    int input_channel = 0; // Input being recorded or overdubbed: 0 = Mic, 1 = Guitar, 2 = Line
+    uint32_t take_start = 0;   // Engine frame clock of the take's first frame
+    size_t record_skip = 0;    // Input frames to pass over before recording (pre-roll copy, latency)
+    size_t record_limit = 0;   // Frames still to record before stopping, 0 = no stop
+    size_t input_latency = 0;  // Round trip in frames: the input lags what was heard by this much
+    size_t overdub_tail = 0;   // Frames still to overdub after the stop, 0 = none pending
 
-    // Multi-click detection
-    uint32_t last_release = 0;
-    int click_count = 0;
-    static constexpr uint32_t double_click_time = 400; // ms
+    // MIDI clock sync: a take started on the beat grid keeps its place on it
+    int32_t sync_start = 0;   // Grid beat of the take's first frame
+    int sync_unit = 0;        // Beats per quantize step while recording, 0 = free
+    int sync_beats = 0;       // Loop length in beats once stopped on the grid, 0 = free running
+    bool sync_locked = false; // Play position has been put on the grid once
 
+    // Master transport: a take snapped to the cycle plays at the position
+    // the shared frame counter gives it while at 1.0x
+    bool cycle_sync = false;
+    uint64_t cycle_anchor = 0; // Counter value at which loop frame 0 plays
+    Phase start_phase = 0;     // Where playback picks up when the take ends
+
+    // Disk streaming (LayerStream): the take is a ring of record_len frames,
+    // a power of two, that stream frames are written into as they arrive
+    bool streaming = false;
+    bool stream_primed = false;    // Playback has started; the position only holds before
+    uint32_t stream_pos = 0;       // Stream frame at the play position
+    uint32_t stream_begin = 0;     // Stream frames begin .. end - 1 are in the ring
+    uint32_t stream_end = 0;
+    uint32_t stream_resume = 0;    // Frames to hold ahead before fading back in
+    ParamRamp stream_fade;         // 0 while starved, 1 while playing
+    uint32_t stream_underruns = 0; // Fades out for want of data
+    uint32_t stream_muted = 0;     // Blocks silent for want of data once primed
+
+    void Init(SampleArena* arena);
     void Reset();
 
-    void Process(int adc_offset,
-                 AudioHandle::InputBuffer in,
-                 AudioHandle::OutputBuffer out,
-                 size_t size,
-                 Switch* record_play_button,
-                 DaisySeed* hw,
-                 int selected_channel,
-                 bool allow_speed_control = false,
-                 bool allow_pan_control = false
-                );
-
-    void ProcessPlaybackOnly(AudioHandle::InputBuffer in,
-                             AudioHandle::OutputBuffer out,
-                             size_t size,
-                             DaisySeed* hw,
-                             int layer_index);
+    // Commands from the control task, applied by the engine between blocks.
+    // Each is a no-op when it does not apply to the layer's current state.
+    void StartTake(int channel);    // Record a new take, replacing the current one
+    void StartOverdub(int channel); // Sound on sound over the playing loop
+    void StopRecord();              // End a take or an overdub pass
+
+    // End the take once it holds `frames` frames: trims frames recorded past
+    // that point, or records on until it has them
+    void StopRecordAt(size_t frames);
+
+    // End the overdub pass once `frames` more input frames are in, so the
+    // last of the performance still arriving through the codec is kept
+    void StopOverdubAfter(size_t frames);
+
+    // Append one input frame to the take being recorded, routed by input_channel
+    void RecordFrame(float mic_in, float guitar_in);
+    void TogglePause();
+    void Erase();                   // Blocks go straight back to the arena
+
+    // Record, play and overdub one block, mixing into out
+    void Render(AudioIn in, AudioOut out, size_t size, float master_gain);
+
+    // Same as Render(), but playback goes into the voice's buffers at unit
+    // gain, with this block's gain ramps alongside, for the engine's mix bus.
+    // Returns false when the layer is silent this block (stopped, paused,
+    // streaming or at zero volume); the buffers are then left untouched.
+    bool RenderVoice(AudioIn in, MixVoice& voice, size_t size, float master_gain);
+
+    // Gains and the record path of one block; true when the loop plays
+    bool RecordBlock(AudioIn in, size_t size, float master_gain);
+
+    // Mix this block of the recorded loop into out at the current speed
+    void RenderPlayback(AudioOut out, size_t size);
+
+    // Playback of one block into out_l/out_r with the given gains; false when
+    // the frames are not resident yet and the block was skipped
+    bool PlayInto(float* out_l, float* out_r, size_t size, const ParamRamp& ramp_l, const ParamRamp& ramp_r);
+
+    // Move the play position on by one block without rendering it
+    void AdvancePhase(size_t size);
+
+    // Mix this block's input into the loop at the frames just played
+    void OverdubBlock(AudioIn in, size_t size, int selected_channel, Phase start);
+
+    // Overdub one block that started playing at block_start, input_latency
+    // frames back so each input frame lands where it was heard
+    void OverdubInput(AudioIn in, size_t size, Phase block_start);
+
+    // Start restoring a saved take of `len` frames: claims its blocks and
+    // marks the layer playable as soon as enough frames are resident.
+    // Returns false when nothing could be claimed.
+    bool BeginRestore(size_t len, int channels);
+
+    // Raw LoopFormat frames of the take being restored, in order
+    void RestoreFrames(size_t frame, const uint8_t* data, size_t frames);
+
+    // Turn the layer into a stream of `channels`: claims a ring of `ring`
+    // frames (a power of two); false when the arena cannot hold it
+    bool BeginStream(size_t ring, int channels);
+
+    // Raw LoopFormat frames of the stream from stream frame `frame` on
+    void StreamFrames(uint32_t frame, const uint8_t* data, size_t frames);
+
+    // PlayInto() for a streaming layer: fades out a block ahead of the data
+    // running out and back in once there is enough again, keeping time
+    bool PlayStream(float* out_l, float* out_r, size_t size, const ParamRamp& ramp_l, const ParamRamp& ramp_r);
+
+    // Close the open overdub pass, if any
+    void StopOverdub();
+
+    // Step through the overdub history; false when there is nothing to undo/redo
+    bool Undo();
+    bool Redo();
+
+    // Ramp the output gains to volume * master_gain * pan over this block
+    void UpdateGains(float master_gain, size_t size);
 };
\ No newline at end of file
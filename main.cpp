@@ -1,14 +1,29 @@
 #include "daisy_seed.h"
 #include "daisysp.h"
 #include "max7219.h"
-#include "looper_layer.h"
+#include "looper_control.h"
+#include "looper_engine.h"
+#include "profiler.h"
+#include "session_store.h"
+#include "layer_stream.h"
+#include "daisy_io.h"
 
 using namespace daisy;
 using namespace daisy::seed;
 using namespace daisysp;
 
-#define kBuffSize 1600000 // ~33 seconds at 48kHz per each layer (5 in total)
-#define kNumLayers 5
+#define kPreRollFrames 65536 // ~1.4 s of input kept so takes start at the press, not 400 ms later
+#define kDelayFrames 32768   // per layer: delay times up to ~0.68 s, in what SDRAM the pool leaves
+
+// MIDI clock in. USB is the Seed's own port, which the profiler's serial log
+// also needs. The UART's RX pin is LAYER1_BTN's on this PCB, so DIN/TRS MIDI
+// needs a board with MIDI_RX moved to a free pin.
+#ifndef LOOPER_MIDI_USB
+#define LOOPER_MIDI_USB !LOOPER_PROFILE
+#endif
+#ifndef LOOPER_MIDI_UART
+#define LOOPER_MIDI_UART 0
+#endif
 
 // ===== PIN DEFINITIONS =====
 // SPI pins for MAX7219 LED driver
@@ -28,6 +43,10 @@ constexpr Pin LAYER3_BTN = D12;
 constexpr Pin LAYER4_BTN = D11;
 constexpr Pin LAYER5_BTN = D6;
 
+// MIDI in (USART1)
+constexpr Pin MIDI_RX = D14;
+constexpr Pin MIDI_TX = D13;
+
 // Channel switch relay pin
 constexpr Pin CHANNEL_SWITCH_RELAY = D25;
 
@@ -48,24 +67,55 @@ constexpr Pin VOLUME4_POT = D19; // Layer 4 volume
 constexpr Pin VOLUME5_POT = D20; // Layer 5 volume
 
 DaisySeed hw;
-Max7219 LedDriver;
-
-float DSY_SDRAM_BSS buffer_l[kNumLayers][kBuffSize];
-float DSY_SDRAM_BSS buffer_r[kNumLayers][kBuffSize];
-
-LooperLayer layers[kNumLayers];
-
-Switch record_play_button;
-Switch layer1_select_button;
-Switch layer2_select_button;
-Switch layer3_select_button;
-Switch layer4_select_button;
-Switch layer5_select_button;
-
-Switch channel_button;
+SeedControls controls;
+SeedSpiOutput led_spi; // DMA frames to the MAX7219
+Max7219 LedDriver;     // Shadow register image; the main loop sends what changed
+
+// Five layers budgeted 12.8 MB of stereo each (~66 s at 48kHz in 16 bit),
+// 48-frame blocks. The pool is shared by all layers and their undo history,
+// so one layer can take more than its share.
+typedef LooperEngine<5, 12800000 / (2 * LoopFormat::kBytes), 48> Engine;
+
+uint8_t DSY_SDRAM_BSS sample_pool[Engine::kPoolBytes];
+float DSY_SDRAM_BSS preroll_pool[2 * kPreRollFrames];
+float DSY_SDRAM_BSS delay_pool[Engine::kNumLayers * 2 * kDelayFrames];
+
+Engine engine;         // Audio side: owns the layers, drains commands and renders
+LooperLayer* layers = engine.layer_array;
+LooperControl control; // Main loop side: buttons, knobs and gestures
+
+// Session persistence on the SD card (loops.bin); buffers stay in AXI SRAM, out of DTCM, for the SDMMC DMA
+SdmmcHandler sd;
+FatFSInterface fsi;
+SdFileDevice session_file;
+PersistChunk persist_chunks[kPersistChunks];
+SessionStore session;
+
+// A backing track streamed from the card (backing.bin, see layer_stream.h)
+// plays on the last layer when that layer is empty after the restore
+SdFileDevice stream_file;
+StreamChunk stream_chunks[kStreamChunks];
+LayerStream stream;
+constexpr int kStreamLayer = Engine::kNumLayers - 1;
+
+SwitchButton record_play_button;
+SwitchButton layer1_select_button;
+SwitchButton layer2_select_button;
+SwitchButton layer3_select_button;
+SwitchButton layer4_select_button;
+SwitchButton layer5_select_button;
+
+SwitchButton channel_button;
 
 // Bypass control
-Switch bypass_button;
+SwitchButton bypass_button;
+
+#if LOOPER_MIDI_USB
+MidiUsbHandler midi_usb;
+#endif
+#if LOOPER_MIDI_UART
+MidiUartHandler midi_uart;
+#endif
 
 // Channel switch relay
 GPIO channel_switch_relay; // D25 - ON = Mic/Guitar, OFF = Line input
@@ -73,20 +123,18 @@ GPIO channel_switch_relay; // D25 - ON = Mic/Guitar, OFF = Line input
 // Bypass relay
 GPIO bypass_relay; // D26 - Write(false) = bypass active, Write(true) = bypass off
 
-// Layer selection
-int selected_layer = 0; // 0 = Layer 1, 1 = Layer 2, ..., 4 = Layer 5
-
-// Input selection
-int selected_channel = 0; // Default: 1 = Guitar, then 0 = Mic, 2 = Line
-bool channel_override_active = false; // True when user has manually changed channel
-
-// Bypass state
-bool bypass_active = true; // True = loop + wet signal, False = only loop
+// What the effects budget measures with
+uint32_t CycleCount()
+{
+    return DWT->CYCCNT;
+}
 
 void SetupHardware()
 {
     hw.Configure();
     hw.Init();
+    hw.SetAudioBlockSize(Engine::kBlockSize); // The engine's loops are built for this size
+    controls.Init(&hw);
 
     // SPI configuration for Daisy Seed rev 7
     SpiHandle::Config spi_cfg;
@@ -105,7 +153,8 @@ void SetupHardware()
     static SpiHandle spi;
     spi.Init(spi_cfg);
 
-    LedDriver.Init(&spi, SPI_CS);
+    led_spi.Init(&spi, SPI_CS);
+    LedDriver.Init(&led_spi);
 
     // Main controls (shared)
     record_play_button.Init(RECORD_PLAY_BTN, 300);        // Record/Play button
@@ -139,15 +188,53 @@ void SetupHardware()
         adc_cfgs[i].InitSingle(adc_pins[i]);
     hw.adc.Init(adc_cfgs, 8);
     hw.adc.Start();
-
-    // Layer buffers
-    for(int i = 0; i < kNumLayers; i++)
-    {
-        layers[i].buffer_l = buffer_l[i];
-        layers[i].buffer_r = buffer_r[i];
-        layers[i].buffer_size = kBuffSize;
-        layers[i].paused = false;
-    }
+    InterpSinc::InitTable();
+    TimeStretch::InitTable();
+
+    // Layer storage comes from the shared arena on demand
+    engine.Init(sample_pool, Engine::kPoolBytes, preroll_pool, kPreRollFrames, delay_pool, kDelayFrames);
+
+    // Effects are admitted against measured cycles: start the DWT counter (the
+    // M7 needs the lock access key first) and size the block at the core clock
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    engine.fx_budget.Init((uint32_t)(SystemCoreClock / hw.AudioSampleRate() * Engine::kBlockSize), Engine::kBlockSize);
+    engine.fx_budget.clock = CycleCount;
+
+    ControlButtons buttons = {&record_play_button,
+                              {&layer1_select_button, &layer2_select_button, &layer3_select_button,
+                               &layer4_select_button, &layer5_select_button},
+                              &channel_button,
+                              &bypass_button};
+    control.Init(&engine, &controls, buttons);
+    control.cycle_sync = true; // layers recorded without a MIDI clock stay in step
+
+#if LOOPER_MIDI_USB
+    MidiUsbHandler::Config midi_usb_cfg;
+    midi_usb_cfg.transport_config.periph = MidiUsbTransport::Config::INTERNAL;
+    midi_usb.Init(midi_usb_cfg);
+    midi_usb.StartReceive();
+#endif
+#if LOOPER_MIDI_UART
+    MidiUartHandler::Config midi_uart_cfg;
+    midi_uart_cfg.transport_config.periph = UartHandler::Config::Peripheral::USART_1;
+    midi_uart_cfg.transport_config.rx     = MIDI_RX;
+    midi_uart_cfg.transport_config.tx     = MIDI_TX;
+    midi_uart.Init(midi_uart_cfg);
+    midi_uart.StartReceive();
+#endif
+
+    // Without a card the looper runs as before, it just cannot save
+    SdmmcHandler::Config sd_cfg;
+    sd_cfg.Defaults();
+    sd.Init(sd_cfg);
+    fsi.Init(FatFSInterface::Config::MEDIA_SD);
+    bool mounted = f_mount(&fsi.GetSDFileSystem(), "/", 1) == FR_OK;
+    StorageDevice* storage = mounted && session_file.Open("loops.bin") ? &session_file : nullptr;
+    session.Init(storage, layers, Engine::kNumLayers, persist_chunks);
+    StorageDevice* backing = mounted && stream_file.Open("backing.bin", false) ? &stream_file : nullptr;
+    stream.Init(backing, &controls, layers, Engine::kNumLayers, stream_chunks, hw.AudioSampleRate());
 }
 
 void UpdateChannelLEDs()
@@ -156,10 +243,10 @@ void UpdateChannelLEDs()
     
     // If user has manually changed channel, show the selected_channel
     // Otherwise, show the recorded channel for recorded layers
-    if(channel_override_active || !layers[selected_layer].recorded)
-        channel_to_show = selected_channel;
+    if(control.channel_override_active || !layers[control.selected_layer].recorded)
+        channel_to_show = control.selected_channel;
     else
-        channel_to_show = layers[selected_layer].recorded_channel;
+        channel_to_show = layers[control.selected_layer].recorded_channel;
 
     uint8_t segs = 0x00;
     if(channel_to_show == 0) segs = LED_CHANNEL_MIC.segment;    // Channel 0 = Mic
@@ -167,9 +254,9 @@ void UpdateChannelLEDs()
     else if(channel_to_show == 2) segs = LED_CHANNEL_LINE.segment;   // Channel 2 = Line
 
     // Add bypass LED if bypass is active
-    if(bypass_active) segs |= LED_BYPASS.segment; // SegC Dig2
+    if(control.bypass_active) segs |= LED_BYPASS.segment; // SegC Dig2
 
-    LedDriver.Send(LED_CHANNEL_GUITAR.digit, segs); // All are on Dig2
+    LedDriver.SetDigit(LED_CHANNEL_GUITAR.digit, segs); // All are on Dig2
 }
 
 void UpdateRelays()
@@ -177,7 +264,7 @@ void UpdateRelays()
     // Control channel switch relay based on selected channel
     // Channel 0/1 = Mic/Guitar (relay ON), Channel 2 = Line (relay OFF)
     
-    if(selected_channel == 2) // Line input
+    if(control.selected_channel == 2) // Line input
     {
         channel_switch_relay.Write(false);  // Deactivate relay for line input
     }
@@ -185,6 +272,15 @@ void UpdateRelays()
     {
         channel_switch_relay.Write(true);   // Activate relay for mic/guitar input
     }
+
+    bypass_relay.Write(!control.bypass_active);
+}
+
+// REC is lit while a layer records or overdubs, and on the destination of a
+// bounce while it renders
+bool LayerRecLit(int i)
+{
+    return layers[i].recording || layers[i].overdubbing || (engine.bounce.Running() && engine.bounce.dest == i);
 }
 
 void UpdateLEDs()
@@ -193,174 +289,234 @@ void UpdateLEDs()
     uint8_t segs_dig1 = 0x00;
 
     // Dig0: Recording/playing status for layers 1-4
-    if(layers[0].recording) segs_dig0 |= LED_LAYER1_REC.segment;
+    if(LayerRecLit(0)) segs_dig0 |= LED_LAYER1_REC.segment;
     if(layers[0].recorded && !layers[0].recording && !layers[0].paused) segs_dig0 |= LED_LAYER1_PLAY.segment;
-    if(layers[1].recording) segs_dig0 |= LED_LAYER2_REC.segment;
+    if(LayerRecLit(1)) segs_dig0 |= LED_LAYER2_REC.segment;
     if(layers[1].recorded && !layers[1].recording && !layers[1].paused) segs_dig0 |= LED_LAYER2_PLAY.segment;
-    if(layers[2].recording) segs_dig0 |= LED_LAYER3_REC.segment;
+    if(LayerRecLit(2)) segs_dig0 |= LED_LAYER3_REC.segment;
     if(layers[2].recorded && !layers[2].recording && !layers[2].paused) segs_dig0 |= LED_LAYER3_PLAY.segment;
-    if(layers[3].recording) segs_dig0 |= LED_LAYER4_REC.segment;
+    if(LayerRecLit(3)) segs_dig0 |= LED_LAYER4_REC.segment;
     if(layers[3].recorded && !layers[3].recording && !layers[3].paused) segs_dig0 |= LED_LAYER4_PLAY.segment;
 
     // Dig1: Layer 5 play/rec
-    if(layers[4].recording) segs_dig1 |= LED_LAYER5_REC.segment;
+    if(LayerRecLit(4)) segs_dig1 |= LED_LAYER5_REC.segment;
     if(layers[4].recorded && !layers[4].recording && !layers[4].paused) segs_dig1 |= LED_LAYER5_PLAY.segment;
 
     // Dig1: Selected layer indicator for all layers
-    if(selected_layer == 0) segs_dig1 |= LED_LAYER1_Selected.segment;
-    if(selected_layer == 1) segs_dig1 |= LED_LAYER2_Selected.segment;
-    if(selected_layer == 2) segs_dig1 |= LED_LAYER3_Selected.segment;
-    if(selected_layer == 3) segs_dig1 |= LED_LAYER4_Selected.segment;
-    if(selected_layer == 4) segs_dig1 |= LED_LAYER5_Selected.segment;
-
-    LedDriver.Send(LED_LAYER1_PLAY.digit, segs_dig0); // Dig0
-    LedDriver.Send(LED_LAYER1_Selected.digit, segs_dig1); // Dig1
+    if(control.selected_layer == 0) segs_dig1 |= LED_LAYER1_Selected.segment;
+    if(control.selected_layer == 1) segs_dig1 |= LED_LAYER2_Selected.segment;
+    if(control.selected_layer == 2) segs_dig1 |= LED_LAYER3_Selected.segment;
+    if(control.selected_layer == 3) segs_dig1 |= LED_LAYER4_Selected.segment;
+    if(control.selected_layer == 4) segs_dig1 |= LED_LAYER5_Selected.segment;
+
+    LedDriver.SetDigit(LED_LAYER1_PLAY.digit, segs_dig0); // Dig0
+    LedDriver.SetDigit(LED_LAYER1_Selected.digit, segs_dig1); // Dig1
 }
 
-void AudioCallback(AudioHandle::InputBuffer in,
-                   AudioHandle::OutputBuffer out,
-                   size_t size)
+// Meter digits. Limiting and clips stay lit for 500 ms after the last one,
+// so a single block is still seen.
+void UpdateMeterLEDs()
 {
-    for(size_t i = 0; i < size; i++)
-    {
-        out[0][i] = 0.0f;
-        out[1][i] = 0.0f;
-    }
+    static const uint32_t kHoldMs = 500;
+    static uint32_t last_limited = 0, limit_until = 0;
+    static uint32_t last_clips[Engine::kNumLayers] = {}, clip_until[Engine::kNumLayers] = {};
+    uint32_t now = control.params.now_ms;
 
-    // Layer select buttons debounce and switching
-    layer1_select_button.Debounce();
-    layer2_select_button.Debounce();
-    layer3_select_button.Debounce();
-    layer4_select_button.Debounce();
-    layer5_select_button.Debounce();
-
-    static bool last_layer_btn[5] = {false, false, false, false, false};
-    bool layer_btn_pressed[5] = {
-        layer1_select_button.Pressed(),
-        layer2_select_button.Pressed(),
-        layer3_select_button.Pressed(),
-        layer4_select_button.Pressed(),
-        layer5_select_button.Pressed()
-    };
-
-    // Check for layer button hold + speed/pan knob interaction
-    int speed_controlled_layer = -1; // Which layer is having its speed controlled
-    int pan_controlled_layer = -1;   // Which layer is having its pan controlled
-    for(int i = 0; i < kNumLayers; i++)
+    uint8_t master = MeterBar(engine.master_meter.peak) & LED_METER_MASTER.segment;
+    if(engine.limiter.limited_blocks != last_limited)
     {
-        // If button is held for more than 200ms, allow speed/pan control for this layer
-        Switch* buttons[5] = {&layer1_select_button, &layer2_select_button, &layer3_select_button, &layer4_select_button, &layer5_select_button};
-        if(buttons[i]->Pressed() && buttons[i]->TimeHeldMs() > 200)
-        {
-            speed_controlled_layer = i;
-            pan_controlled_layer = i;
-            break; // Only one layer can be speed/pan-controlled at a time
-        }
+        last_limited = engine.limiter.limited_blocks;
+        limit_until = now + kHoldMs;
     }
+    if((int32_t)(limit_until - now) > 0) master |= LED_METER_LIMIT.segment;
 
-    // Handle layer selection (only on button press, not during speed control)
-    for(int i = 0; i < kNumLayers; i++)
+    uint8_t signal = 0x00, clip = 0x00;
+    for(int i = 0; i < Engine::kNumLayers; i++)
     {
-        // Only switch layers on button press (not hold for speed/pan control)
-        if(!last_layer_btn[i] && layer_btn_pressed[i] && speed_controlled_layer == -1 && pan_controlled_layer == -1)
+        const LevelMeter& meter = layers[i].meter;
+        if(meter.clips != last_clips[i])
         {
-            selected_layer = i;
-            channel_override_active = false; // Reset override when switching layers
-            // Set selected_channel to match the recorded channel (if any)
-            if(layers[selected_layer].recorded)
-                selected_channel = layers[selected_layer].recorded_channel;
-            UpdateRelays(); // Update relay state when switching layers
+            last_clips[i] = meter.clips;
+            clip_until[i] = now + kHoldMs;
         }
-        last_layer_btn[i] = layer_btn_pressed[i];
+        if(LevelDb(meter.peak) > -40.0f) signal |= LED_METER_SIGNAL.segment >> i;
+        if((int32_t)(clip_until[i] - now) > 0) clip |= LED_METER_CLIP.segment >> i;
     }
 
-    // Process main controls for selected layer
-    layers[selected_layer].Process(
-        selected_layer, // ADC offset: layer 0 uses volume at index 2, layer 1 at index 3, etc.
-        in, out, size,
-        &record_play_button,
-        &hw,
-        selected_channel,
-        (speed_controlled_layer == selected_layer), // Allow speed control if this layer's button is held
-        (pan_controlled_layer == selected_layer)    // Allow pan control if this layer's button is held
-    );
-
-    // Process playback for all non-selected layers (including speed/pan control if button held)
-    for(int i = 0; i < kNumLayers; i++)
+    LedDriver.SetDigit(LED_METER_MASTER.digit, master); // Dig3
+    LedDriver.SetDigit(LED_METER_SIGNAL.digit, signal); // Dig4
+    LedDriver.SetDigit(LED_METER_CLIP.digit, clip);     // Dig5
+}
+
+void AudioCallback(AudioHandle::InputBuffer in,
+                   AudioHandle::OutputBuffer out,
+                   size_t size)
+{
+    PROFILE_BEGIN(audio_profiler);
+
+    // Hand save/restore chunks to and from the main loop
+    session.AudioService();
+    stream.AudioService();
+    PROFILE_LAP(audio_profiler, kProfileSession);
+
+    // Apply the control task's commands, then record, play and overdub every layer
+    engine.Process(in, out, size, System::GetUs());
+    PROFILE_END(audio_profiler);
+}
+
+// Clock, Start, Continue and Stop go to the control task's tempo tracker,
+// stamped as they are read; libDaisy's SystemRealTimeType counts from 0xF8.
+// Polled on every main loop pass, the timing jitter is the loop's, which the
+// tracker filters out.
+template <typename Handler>
+void PollMidi(Handler& midi)
+{
+    midi.Listen();
+    while(midi.HasEvents())
     {
-        if(i != selected_layer)
-        {
-            // For non-selected layers, check if their speed or pan should be controlled
-            bool allow_speed_for_this_layer = (speed_controlled_layer == i);
-            bool allow_pan_for_this_layer = (pan_controlled_layer == i);
-            if(allow_speed_for_this_layer || allow_pan_for_this_layer)
-            {
-                // Process with speed/pan control enabled for this layer
-                layers[i].Process(
-                    i, // ADC offset for this layer's volume
-                    in, out, size,
-                    nullptr, // No record button for non-selected layers
-                    &hw,
-                    layers[i].recorded_channel, // Use the channel this layer was recorded with
-                    allow_speed_for_this_layer, // Allow speed control
-                    allow_pan_for_this_layer    // Allow pan control
-                );
-            }
-            else
-            {
-                // Normal playback only
-                layers[i].ProcessPlaybackOnly(in, out, size, &hw, i);
-            }
-        }
+        MidiEvent event = midi.PopEvent();
+        if(event.type == SystemRealTime)
+            control.ReceiveMidi((uint8_t)(kMidiTimingClock + event.srt_type), System::GetUs());
     }
+}
 
-    UpdateLEDs();
+// Runs from the main loop once per millisecond
+void ControlTask()
+{
+    int events = control.Update();
+    if(events & kEventRelays)
+        UpdateRelays();
+    if(events & kEventSave)
+        session.RequestSave(); // Hold bypass for 2 s: save the session in the background
+    if(events & kEventCalibrated)
+        session.latency.store(control.latency); // Kept with the next save
+    PROFILE_LAP(control_profiler, kProfileControl);
 
-    // Channel selection switch
-    channel_button.Debounce();
+    UpdateLEDs();
+    UpdateChannelLEDs();
+    UpdateMeterLEDs();
+    PROFILE_LAP(control_profiler, kProfileLeds);
+}
 
-    static bool last_channel_btn = false;
-    bool channel_btn_pressed = channel_button.Pressed();
+#if LOOPER_PROFILE
+const char* const kAudioStageNames[] = {"session", "commands", "layer1", "layer2", "layer3", "layer4", "layer5", "output"};
+const char* const kControlStageNames[] = {"control", "leds", "spi", "storage"};
 
-    if(!last_channel_btn && channel_btn_pressed)
+// The logger formats into a short buffer, so send the table a line at a time
+void PrintProfile(const char* title, const Profiler& profiler)
+{
+    static char report[768];
+    profiler.Format(report, sizeof(report));
+    hw.PrintLine("%s", title);
+    char* line = report;
+    for(char* p = report; *p != '\0'; p++)
     {
-        // Custom cycling order: Guitar(1) → Mic(0) → Line(2) → Guitar(1)
-        if(selected_channel == 0)      // Guitar → Mic
-            selected_channel = 1;
-        else if(selected_channel == 1) // Mic → Line  
-            selected_channel = 2;
-        else                          // Line → Guitar
-            selected_channel = 0;
-            
-        channel_override_active = true; // User has manually changed channel
-        UpdateRelays(); // Update relay state when channel button is pressed
+        if(*p == '\n')
+        {
+            *p = '\0';
+            hw.PrintLine("  %s", line);
+            line = p + 1;
+        }
     }
-    last_channel_btn = channel_btn_pressed;
+}
 
-    // Bypass toggle switch
-    bypass_button.Debounce();
-    
-    static bool last_bypass_btn = false;
-    bool bypass_btn_pressed = bypass_button.Pressed();
-    
-    if(!last_bypass_btn && bypass_btn_pressed)
+// Print both profiles over USB serial every 2 s, then start a fresh window
+void ReportProfile()
+{
+    static uint32_t last_report = 0;
+    uint32_t now = System::GetNow();
+    if(now - last_report < 2000)
+        return;
+    last_report = now;
+
+    PrintProfile("audio callback", audio_profiler);
+    PrintProfile("control task (per main loop pass)", control_profiler);
+    const FxBudget& fx = engine.fx_budget;
+    hw.PrintLine("effects: %u of %u cycles used, rest of block %u, filter %u, delay %u, %u refused",
+                 (unsigned)fx.Used(), (unsigned)fx.cycles, (unsigned)fx.rest, (unsigned)fx.cost[kFxFilter],
+                 (unsigned)fx.cost[kFxDelay], (unsigned)fx.refused);
+
+    // A bounce that finished before the last report: what it gave back, the
+    // window just printed being the first wholly after it
+    static int  last_bounce    = kBounceIdle;
+    static bool bounce_pending = false;
+    if(bounce_pending)
     {
-        bypass_active = !bypass_active; // Toggle bypass state
-        bypass_relay.Write(!bypass_active); 
+        BounceReport& r      = engine.bounce.report;
+        r.cycles_after_avg   = audio_profiler.total.Avg();
+        r.cycles_after_max   = audio_profiler.total.max;
+        hw.PrintLine("bounce: %u frames, %u KB freed, %d voices -> %d, callback avg %u -> %u max %u -> %u cycles",
+                     (unsigned)r.frames, (unsigned)(r.blocks_freed * kArenaBlockBytes / 1024),
+                     r.voices_before, r.voices_after, (unsigned)r.cycles_before_avg, (unsigned)r.cycles_after_avg,
+                     (unsigned)r.cycles_before_max, (unsigned)r.cycles_after_max);
+        bounce_pending = false;
     }
-    last_bypass_btn = bypass_btn_pressed;
-
-    UpdateChannelLEDs();
+    int bounce = engine.bounce.state.load();
+    if(bounce != last_bounce && bounce == kBounceDone)
+        bounce_pending = true;
+    last_bounce = bounce;
+    audio_profiler.reset_requested = true;
+    control_profiler.reset_requested = true;
 }
+#endif
 
 int main(void)
 {
     SetupHardware();
     
-    // Initialize hardware state to match default channel (Guitar)
-    UpdateRelays();      // Set relay to correct position for Guitar
-    UpdateChannelLEDs(); // Set LED to show Guitar
-    
+    // Initialize hardware state to match the default channel
+    UpdateRelays();
+    UpdateChannelLEDs();
+
+    // Layers start playing as soon as their first frames are back in SDRAM;
+    // the saved round trip aligns takes without recalibrating
+    if(session.BeginLoad() && session.latency.load() > 0)
+    {
+        control.latency = session.latency.load();
+        control.Send(kCmdSetLatency, 0, (float)control.latency);
+    }
+
+#if LOOPER_PROFILE
+    // Budgets: one audio block, and the 1 ms control tick
+    hw.StartLog(false);
+    audio_profiler.Init(kAudioStageNames, kProfileLayer0 + Engine::kNumLayers + 1,
+                        hw.AudioBlockSize() * 1e6f / hw.AudioSampleRate());
+    control_profiler.Init(kControlStageNames, 4, 1000.0f);
+#endif
+
     hw.StartAudio(AudioCallback);
-    while(1) {}
+    uint32_t last_tick = System::GetNow();
+    bool stream_opened = false;
+    while(1)
+    {
+        PROFILE_BEGIN(control_profiler);
+        session.Poll();      // All SD card I/O happens here, never in the callback
+        if(!stream_opened && !session.Busy())
+        {
+            stream.Open(kStreamLayer); // Once, after the restore
+            stream_opened = true;
+        }
+        stream.Poll();
+        PROFILE_LAP(control_profiler, kProfileStorage);
+        LedDriver.Service(); // Sends only the LED digits that changed
+        PROFILE_LAP(control_profiler, kProfileSpi);
+#if LOOPER_MIDI_USB
+        PollMidi(midi_usb);
+#endif
+#if LOOPER_MIDI_UART
+        PollMidi(midi_uart);
+#endif
+
+        uint32_t now = System::GetNow();
+        if(now != last_tick)
+        {
+            last_tick = now;
+            ControlTask();
+        }
+        PROFILE_END(control_profiler);
+
+#if LOOPER_PROFILE
+        ReportProfile();
+#endif
+    }
 }
\ No newline at end of file
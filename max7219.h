@@ -1,5 +1,7 @@
 #pragma once
-#include "daisy_seed.h"
+#include <stddef.h>
+#include <stdint.h>
+#include "control_io.h"
 
 struct LedIndicator
 {
@@ -38,36 +40,100 @@ constexpr LedIndicator LED_CHANNEL_LINE   = {3, 0x20}; // B  Dig2
 // Bypass indicator
 constexpr LedIndicator LED_BYPASS         = {3, 0x10}; // C  Dig2
 
-
-
+// Meters: master level bar (MeterBar() in meter.h) with the limiter on DP,
+// then one segment per layer for signal and for clipping, layer 1 on A
+constexpr LedIndicator LED_METER_MASTER   = {4, 0x7F}; // G..A Dig3
+constexpr LedIndicator LED_METER_LIMIT    = {4, 0x80}; // DP Dig3
+constexpr LedIndicator LED_METER_SIGNAL   = {5, 0x40}; // A Dig4, layer n: 0x40 >> n
+constexpr LedIndicator LED_METER_CLIP     = {6, 0x40}; // A Dig5, layer n: 0x40 >> n
+
+// MAX7219 driver that never waits on the bus.
+// SetDigit() only writes a shadow register image, so the control task can
+// call it on every pass; Service(), called later in the same main loop,
+// compares the image with what the chip shows and starts one SPI frame for
+// the next digit that differs. Repeated writes of the same value cost no SPI
+// traffic, and several writes to a digit between services collapse into one
+// frame.
 struct Max7219
 {
-    daisy::SpiHandle* spi;
-    daisy::GPIO cs;
+    static constexpr int kDigits = 8;
+
+    SpiOutput* spi = nullptr;
+
+    uint8_t shadow[kDigits] = {}; // wanted segments, Dig0..Dig7
+    uint8_t shown[kDigits]  = {}; // last segments sent to the chip
+    uint8_t frame[2]        = {}; // in flight; must outlive the transfer
+    int     scan            = 0;  // next digit Service() looks at
+
+    // Both run from the main loop: SetDigit() in the control task, Service()
+    // after it, so neither interrupts the other
+    uint32_t writes      = 0; // SetDigit() calls, each a frame before
+    uint32_t frames_sent = 0; // digit frames, not counting Init()
 
-    void Init(daisy::SpiHandle* spi_handle, daisy::Pin cs_pin)
+    void Init(SpiOutput* spi_output)
     {
-        spi = spi_handle;
-        cs.Init(cs_pin, daisy::GPIO::Mode::OUTPUT);
-        cs.Write(true);
+        spi = spi_output;
 
-        // MAX7219 init sequence
-        Send(0x09, 0x00); // Decode mode: none
-        Send(0x0A, 0x00); // Intensity: 0 (minimum brightness)
-        Send(0x0B, 0x07); // Scan limit: all digits
-        Send(0x0C, 0x01); // Normal operation
-        Send(0x0F, 0x00); // Display test: off
+        // MAX7219 init sequence, blocking: runs once before audio starts
+        SendNow(0x09, 0x00); // Decode mode: none
+        SendNow(0x0A, 0x00); // Intensity: 0 (minimum brightness)
+        SendNow(0x0B, 0x07); // Scan limit: all digits
+        SendNow(0x0C, 0x01); // Normal operation
+        SendNow(0x0F, 0x00); // Display test: off
 
         // Clear display
-        for (uint8_t i = 1; i <= 8; i++)
-            Send(i, 0x00);
+        for(uint8_t i = 1; i <= kDigits; i++)
+        {
+            SendNow(i, 0x00);
+            shadow[i - 1] = shown[i - 1] = 0x00;
+        }
+        while(spi->Busy()) {}
+    }
+
+    // digit is the register number as in LedIndicator: 1 = Dig0
+    void SetDigit(uint8_t digit, uint8_t segments)
+    {
+        shadow[digit - 1] = segments;
+        writes            = writes + 1;
+    }
+
+    // Start at most one frame; returns false when the chip is up to date
+    bool Service()
+    {
+        if(spi->Busy())
+            return true;
+        for(int k = 0; k < kDigits; k++)
+        {
+            int     d    = (scan + k) % kDigits;
+            uint8_t segs = shadow[d];
+            if(segs != shown[d])
+            {
+                shown[d] = segs;
+                Start((uint8_t)(d + 1), segs);
+                frames_sent++;
+                scan = (d + 1) % kDigits;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t FramesAvoided() const
+    {
+        uint32_t w = writes;
+        return w > frames_sent ? w - frames_sent : 0;
     }
 
-    void Send(uint8_t reg, uint8_t data)
+    void Start(uint8_t reg, uint8_t data)
     {
-        cs.Write(false);
-        uint8_t buf[2] = {reg, data};
-        spi->BlockingTransmit(buf, 2, 1000);
-        cs.Write(true);
+        frame[0] = reg;
+        frame[1] = data;
+        spi->Transmit(frame, 2);
     }
-};
\ No newline at end of file
+
+    void SendNow(uint8_t reg, uint8_t data)
+    {
+        while(spi->Busy()) {}
+        Start(reg, data);
+    }
+};
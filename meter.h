@@ -0,0 +1,127 @@
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "resampler.h"
+
+// Output level metering, one pass per block.
+//
+// MeasureBlock() is the kernel: peak, sum of squares and the number of
+// samples at or over full scale of a stereo block, with each side scaled by
+// a gain so a layer's unit-gain voice buffer is measured as it will be heard.
+// LevelMeter turns the block values into meter ballistics: a peak that falls
+// at 20 dB/s and an RMS over about 300 ms.
+//
+// The audio side writes the meters; the control side only reads the floats
+// and counters for the display, so a torn read costs one stale LED frame.
+
+struct BlockLevel
+{
+    float    peak;   // largest |sample| * gain
+    float    sum_sq; // of the scaled samples, both sides
+    uint32_t clips;  // scaled samples at or over 1.0
+};
+
+inline BlockLevel MeasureBlock(const float* l, const float* r, size_t size, float gain_l = 1.0f, float gain_r = 1.0f)
+{
+    BlockLevel level = {0.0f, 0.0f, 0};
+    size_t     i     = 0;
+#if LOOPER_RESAMPLE_SIMD
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 one      = _mm_set1_ps(1.0f);
+    const __m128 gl       = _mm_set1_ps(gain_l);
+    const __m128 gr       = _mm_set1_ps(gain_r);
+    __m128       peak     = _mm_setzero_ps();
+    __m128       sum      = _mm_setzero_ps();
+    __m128i      over     = _mm_setzero_si128(); // compare masks are -1 per lane over
+    const size_t tail     = size & ~(size_t)3;
+    for(; i < tail; i += 4)
+    {
+        __m128 a = _mm_and_ps(_mm_mul_ps(_mm_loadu_ps(l + i), gl), abs_mask);
+        __m128 b = _mm_and_ps(_mm_mul_ps(_mm_loadu_ps(r + i), gr), abs_mask);
+        peak     = _mm_max_ps(peak, _mm_max_ps(a, b));
+        sum      = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)));
+        over     = _mm_sub_epi32(over, _mm_castps_si128(_mm_cmpge_ps(a, one)));
+        over     = _mm_sub_epi32(over, _mm_castps_si128(_mm_cmpge_ps(b, one)));
+    }
+    float   lanes[4];
+    int32_t counts[4];
+    _mm_storeu_ps(lanes, peak);
+    level.peak = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, sum);
+    level.sum_sq = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm_storeu_si128((__m128i*)counts, over);
+    level.clips = (uint32_t)(counts[0] + counts[1] + counts[2] + counts[3]);
+#endif
+    for(; i < size; i++)
+    {
+        float a = fabsf(l[i] * gain_l);
+        float b = fabsf(r[i] * gain_r);
+        level.peak = fmaxf(level.peak, fmaxf(a, b));
+        level.sum_sq += a * a + b * b;
+        level.clips += (a >= 1.0f) + (b >= 1.0f);
+    }
+    return level;
+}
+
+struct LevelMeter
+{
+    float    peak    = 0.0f; // held peak, falling at kPeakFallDb per second
+    float    mean_sq = 0.0f; // smoothed mean square per sample
+    uint32_t clips   = 0;    // samples at or over full scale, ever
+
+    float fall      = 1.0f; // peak factor per block
+    float rms_coeff = 1.0f; // smoothing per block
+
+    static constexpr float kPeakFallDb = 20.0f;
+    static constexpr float kRmsSeconds = 0.3f;
+
+    void Init(float blocks_per_second)
+    {
+        fall      = powf(10.0f, -kPeakFallDb / 20.0f / blocks_per_second);
+        rms_coeff = 1.0f - expf(-1.0f / (kRmsSeconds * blocks_per_second));
+        Reset();
+    }
+
+    void Reset()
+    {
+        peak    = 0.0f;
+        mean_sq = 0.0f;
+    }
+
+    // One block of `size` stereo frames
+    void Add(const BlockLevel& level, size_t size)
+    {
+        float held = peak * fall;
+        peak       = level.peak > held ? level.peak : held;
+        mean_sq += (level.sum_sq / (float)(2 * size) - mean_sq) * rms_coeff;
+        clips += level.clips;
+    }
+
+    // A silent block: the meter falls back
+    void AddSilence()
+    {
+        peak *= fall;
+        mean_sq -= mean_sq * rms_coeff;
+    }
+
+    float Rms() const { return sqrtf(mean_sq); }
+};
+
+// dBFS, floored at -120 for silence
+inline float LevelDb(float level)
+{
+    return level > 1e-6f ? 20.0f * log10f(level) : -120.0f;
+}
+
+// Bar graph for one 7-segment digit: segments G, F, E, D, C, B, A light
+// from the bottom as the level passes -42, -36, ... -6 dBFS
+inline uint8_t MeterBar(float level)
+{
+    float   db   = LevelDb(level);
+    uint8_t segs = 0;
+    for(int s = 0; s < 7; s++)
+        if(db >= -42.0f + 6.0f * (float)s)
+            segs |= (uint8_t)(1 << s);
+    return segs;
+}
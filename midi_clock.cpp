@@ -0,0 +1,116 @@
+#include "midi_clock.h"
+
+void MidiClock::Init(float rate)
+{
+    sample_rate = rate;
+    running     = false;
+    restart     = false;
+    ticks       = 0;
+    count       = 0;
+    tick        = 0.0;
+    period      = 0.0;
+    outliers    = 0;
+}
+
+int MidiClock::Receive(uint8_t byte, uint32_t frame)
+{
+    switch(byte)
+    {
+        case kMidiStart:
+            // The first tick after Start is the downbeat
+            running = true;
+            restart = true;
+            ticks   = 0;
+            return kClockStarted;
+        case kMidiContinue:
+            running = true;
+            return kClockStarted;
+        case kMidiStop:
+            if(!running)
+                return 0;
+            running = false;
+            return kClockStopped;
+        case kMidiTimingClock:
+        {
+            uint32_t before = ticks;
+            uint32_t n      = Tick(frame);
+            if(!running || n == 0)
+                return 0;
+            ticks += n;
+            bool beat = before == 0 || (before - 1) / kMidiPpqn != (ticks - 1) / kMidiPpqn;
+            return beat && Settled() ? kClockBeat : 0;
+        }
+        default: return 0;
+    }
+}
+
+uint32_t MidiClock::Tick(uint32_t frame)
+{
+    double   t = (double)(int32_t)(frame - ref);
+    uint32_t n = 1;
+    if(count == 0)
+    {
+        tick = t;
+    }
+    else if(count == 1)
+    {
+        period = t - tick;
+        tick   = t;
+        if(period <= 0.0)
+            count = 0; // Two ticks in one read: start over
+    }
+    else
+    {
+        // Ticks since the last one, to the nearest; the rest is the phase error
+        double e     = t - (tick + period);
+        double steps = floor(e / period + 0.5);
+        if(steps < 0.0 || steps > 3.0)
+        {
+            // Doubled, or a gap no dropped tick explains: ignore / start over
+            outliers++;
+            if(steps < 0.0)
+                return 0;
+            count = 0;
+            tick  = t;
+        }
+        else
+        {
+            if(steps > 0.0)
+                outliers++;
+            n = (uint32_t)steps + 1;
+            e -= steps * period;
+
+            // Loop gains for the bandwidth at this tick rate (critically damped)
+            double w = 2.0 * 3.14159265358979 * bandwidth * period / sample_rate;
+            tick += n * period + 1.41421356 * w * e;
+            period += w * w * e;
+        }
+    }
+    count += n;
+
+    int32_t whole = (int32_t)floor(tick);
+    ref += (uint32_t)whole;
+    tick -= whole;
+    return n;
+}
+
+int MidiClock::Expire(uint32_t now)
+{
+    if(count == 0)
+        return 0;
+    double quiet = period > 0.0 ? 4.0 * period : 0.5 * sample_rate;
+    if((double)(int32_t)(now - ref) - tick < quiet)
+        return 0;
+    count  = 0;
+    period = 0.0;
+    if(!running)
+        return 0;
+    running = false;
+    return kClockStopped;
+}
+
+uint32_t MidiClock::BeatFrame() const
+{
+    double back = (double)((ticks - 1) % kMidiPpqn) * period;
+    return ref + (uint32_t)(int32_t)floor(tick - back + 0.5);
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Sync to an external MIDI clock (24 ticks per quarter note).
+//
+// MidiClock runs on the control side. Bytes arrive from the UART or USB
+// handler stamped with the engine frame they were read at, which can be a
+// millisecond or more late (USB frames, SD card I/O in the main loop). A
+// second-order delay-locked loop turns the ticks into a tempo and filtered
+// tick times; a tick more than half a period off is taken as dropped or
+// doubled rather than allowed to pull the loop.
+//
+// ClockGrid is the engine's copy of the beat grid, sent on every beat with
+// kCmdSetGrid. It places record starts and stops on beats or bars and gives
+// a synced layer the position it should be at.
+
+constexpr int kMidiPpqn = 24;
+
+enum MidiRealtime : uint8_t
+{
+    kMidiTimingClock = 0xF8,
+    kMidiStart       = 0xFA,
+    kMidiContinue    = 0xFB,
+    kMidiStop        = 0xFC,
+};
+
+enum MidiClockEvent
+{
+    kClockBeat    = 1 << 0, // a beat tick, with the tracker settled
+    kClockStarted = 1 << 1,
+    kClockStopped = 1 << 2, // Stop, or the clock went away
+};
+
+struct MidiClock
+{
+    float sample_rate   = 48000.0f;
+    float bandwidth     = 0.5f; // Hz; lower rejects more jitter, follows tempo changes slower
+    int   beats_per_bar = 4;
+
+    bool     running = false; // between Start/Continue and Stop
+    bool     restart = false; // the next grid sent is the transport's beat 0
+    uint32_t ticks   = 0;     // since Start; a beat on every kMidiPpqn-th
+    uint32_t count   = 0;     // ticks through the loop since it was last reset
+
+    // Filtered time of the last tick is ref + tick (frames), the next one due a
+    // period later; ref moves with every tick so the doubles stay small
+    uint32_t ref    = 0;
+    double   tick   = 0.0;
+    double   period = 0.0; // frames per tick
+
+    uint32_t outliers = 0; // ticks taken as dropped or doubled
+
+    static constexpr uint32_t kSettleTicks = 2 * kMidiPpqn; // before the grid is trusted
+
+    void Init(float rate);
+
+    // One received byte at engine frame `frame`; returns MidiClockEvent bits.
+    // Everything but the realtime bytes above is ignored.
+    int Receive(uint8_t byte, uint32_t frame);
+
+    // No tick for four periods (or half a second before the first two): the
+    // clock is treated as stopped. Returns kClockStopped once.
+    int Expire(uint32_t now);
+
+    bool     Settled() const { return count >= kSettleTicks; }
+    double   FramesPerBeat() const { return period * kMidiPpqn; }
+    float    Bpm() const { return period > 0.0 ? (float)(60.0 * sample_rate / FramesPerBeat()) : 0.0f; }
+    uint32_t TickFrame() const { return ref + (uint32_t)(int32_t)floor(tick + 0.5); }
+
+    // The beat the last tick belongs to, and the filtered frame it fell on
+    uint32_t Beat() const { return ticks > 0 ? (ticks - 1) / kMidiPpqn : 0; }
+    uint32_t BeatFrame() const;
+
+    // One timing clock through the loop; returns the ticks it stands for
+    // (more than one after dropped ticks), 0 when it was ignored
+    uint32_t Tick(uint32_t frame);
+};
+
+// Record quantization, the arg of kCmdRecordStart/kCmdRecordStop
+enum Quantize : uint8_t
+{
+    kQuantizeOff,
+    kQuantizeBeat,
+    kQuantizeBar,
+};
+
+// kCmdSetGrid arg: beats per bar in the low bits, plus these flags
+constexpr uint8_t kGridBeatsMask = 0x0F;
+constexpr uint8_t kGridRestart   = 0x10; // the frame is beat 0: the transport (re)started
+constexpr uint8_t kGridLock      = 0x20; // trim synced layers' speed to stay on the grid
+
+struct ClockGrid
+{
+    bool     active          = false;
+    bool     lock            = false;
+    uint32_t frame           = 0;   // engine frame of beat number `beat`
+    int32_t  beat            = 0;   // counted from the transport start
+    double   frames_per_beat = 0.0;
+    int      beats_per_bar   = 4;
+
+    // A beat line from the clock; its number follows on from the last one
+    // unless it is a restart
+    void Set(uint32_t at, float fpb, uint8_t arg)
+    {
+        if(fpb <= 0.0f)
+        {
+            active = false;
+            return;
+        }
+        if(active && !(arg & kGridRestart))
+            beat += (int32_t)floor((double)(int32_t)(at - frame) / frames_per_beat + 0.5);
+        else
+            beat = 0;
+        frame           = at;
+        frames_per_beat = fpb;
+        beats_per_bar   = (arg & kGridBeatsMask) != 0 ? (arg & kGridBeatsMask) : 4;
+        lock            = (arg & kGridLock) != 0;
+        active          = true;
+    }
+
+    int Unit(int quantize) const { return quantize == kQuantizeBar ? beats_per_bar : 1; }
+
+    double BeatAt(uint32_t f) const { return beat + (double)(int32_t)(f - frame) / frames_per_beat; }
+
+    uint32_t FrameOf(int32_t b) const
+    {
+        return frame + (uint32_t)(int32_t)floor((double)(b - beat) * frames_per_beat + 0.5);
+    }
+
+    // Nearest multiple of `unit` beats to frame f
+    int32_t NearestBeat(uint32_t f, int unit) const
+    {
+        return (int32_t)floor(BeatAt(f) / unit + 0.5) * unit;
+    }
+};
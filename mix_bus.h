@@ -0,0 +1,87 @@
+#pragma once
+#include <stddef.h>
+#include "control_io.h"
+#include "control_params.h"
+#include "resampler.h"
+
+// Output mix of the audible layers.
+//
+// Each layer that makes sound this block renders its loop at unit gain into a
+// voice buffer of its own and hands over its gain ramps; silent layers
+// (stopped, paused, streaming, zero volume) add nothing and cost nothing
+// here. Mix() then sums the voices in one pass over the block: per output
+// frame the sum stays in registers and out is written once, instead of every
+// layer reading and writing the whole output block.
+//
+// The sum runs in layer order with the same gain arithmetic as the layers'
+// own mixing (ParamRamp::At), so the result is bit-identical to rendering
+// every layer straight into out.
+
+struct MixVoice
+{
+    float*    left;
+    float*    right;
+    ParamRamp gain_l; // this block's volume * master * pan ramps
+    ParamRamp gain_r;
+};
+
+template <int MaxVoices, size_t Block>
+struct MixBus
+{
+    alignas(16) float buffer[MaxVoices][2][Block];
+    MixVoice voices[MaxVoices];
+    int      count = 0;
+
+    void Init()
+    {
+        for(int v = 0; v < MaxVoices; v++)
+        {
+            voices[v].left  = buffer[v][0];
+            voices[v].right = buffer[v][1];
+        }
+        count = 0;
+    }
+
+    // The slot the next layer renders into; Add() keeps it
+    MixVoice& Next() { return voices[count]; }
+    void      Add() { count++; }
+
+    // out = sum of the voices added since the last Mix()
+    void Mix(AudioOut out)
+    {
+#if LOOPER_RESAMPLE_SIMD
+        const size_t tail = Block & ~(size_t)3;
+        for(size_t i = 0; i < tail; i += 4)
+        {
+            __m128 pos = _mm_set_ps((float)(i + 4), (float)(i + 3), (float)(i + 2), (float)(i + 1));
+            __m128 l   = _mm_setzero_ps();
+            __m128 r   = _mm_setzero_ps();
+            for(int v = 0; v < count; v++)
+            {
+                const MixVoice& voice = voices[v];
+                __m128 gl = _mm_add_ps(_mm_set1_ps(voice.gain_l.value), _mm_mul_ps(_mm_set1_ps(voice.gain_l.step), pos));
+                __m128 gr = _mm_add_ps(_mm_set1_ps(voice.gain_r.value), _mm_mul_ps(_mm_set1_ps(voice.gain_r.step), pos));
+                l = _mm_add_ps(l, _mm_mul_ps(_mm_loadu_ps(voice.left + i), gl));
+                r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(voice.right + i), gr));
+            }
+            _mm_storeu_ps(out[0] + i, l);
+            _mm_storeu_ps(out[1] + i, r);
+        }
+#else
+        const size_t tail = 0;
+#endif
+        for(size_t i = tail; i < Block; i++)
+        {
+            float l = 0.0f, r = 0.0f;
+            for(int v = 0; v < count; v++)
+            {
+                const MixVoice& voice = voices[v];
+                l += voice.left[i] * voice.gain_l.At(i);
+                r += voice.right[i] * voice.gain_r.At(i);
+            }
+            out[0][i] = l;
+            out[1][i] = r;
+        }
+        count = 0;
+    }
+};
@@ -0,0 +1,65 @@
+#include <string.h>
+#include "playback_stage.h"
+
+void PlaybackStage::Fetch(const LoopSource& src, int buf, int64_t first, uint32_t n, size_t frame_bytes)
+{
+    int64_t j = first % (int64_t)src.len;
+    if(j < 0)
+        j += src.len;
+    uint32_t frame = (uint32_t)j;
+
+    start[buf] = frame;
+    count[buf] = n;
+    valid[buf] = true;
+
+    // One contiguous copy per run of frames inside a storage block
+    uint8_t* dst = buffer[buf];
+    while(n > 0)
+    {
+        uint32_t b      = frame / src.frames_per_block;
+        uint32_t offset = frame - b * src.frames_per_block;
+        uint32_t run    = src.frames_per_block - offset;
+        if(run > src.len - frame)
+            run = src.len - frame;
+        if(run > n)
+            run = n;
+
+        size_t bytes = run * frame_bytes;
+        memcpy(dst, src.pool + (size_t)src.blocks[b] * src.block_bytes + offset * frame_bytes, bytes);
+        dst += bytes;
+        stats.bursts++;
+        stats.bytes += bytes;
+
+        n -= run;
+        frame += run;
+        if(frame == src.len)
+            frame = 0;
+    }
+}
+
+void PlaybackStage::Acquire(const LoopSource& src, int64_t first, uint32_t n, size_t frame_bytes)
+{
+    int64_t j = first % (int64_t)src.len;
+    if(j < 0)
+        j += src.len;
+
+    if(valid[active] && start[active] == (uint32_t)j && count[active] >= n)
+        return;
+
+    int idle = 1 - active;
+    if(valid[idle] && start[idle] == (uint32_t)j && count[idle] >= n)
+    {
+        active = idle;
+        stats.prefetch_hits++;
+        return;
+    }
+
+    Fetch(src, active, first, n, frame_bytes);
+    stats.fills++;
+}
+
+void PlaybackStage::Prefetch(const LoopSource& src, int64_t first, uint32_t n, size_t frame_bytes)
+{
+    Fetch(src, 1 - active, first, n, frame_bytes);
+    stats.prefetches++;
+}
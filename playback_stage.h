@@ -0,0 +1,138 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "resampler.h"
+
+// Internal-RAM staging for loop playback.
+// Instead of the interpolation taps reading SDRAM directly (kTaps scattered
+// reads per channel per output frame), each layer copies the window of frames
+// the next output block will touch into a small local buffer and the kernel
+// runs on that copy only. The window is unwrapped, so block boundaries and the
+// loop point cost nothing in the kernel; the copy is a handful of contiguous
+// bursts of whole interleaved frames.
+//
+// Two buffers per layer: after rendering a block the window for the next
+// block is predicted from the new phase and speed and fetched into the idle
+// buffer. If the prediction still holds when the next block starts (same
+// speed, no re-record) that buffer is used as is, otherwise the window is
+// fetched on demand. The fetch is a synchronous copy here; it is the place an
+// MDMA transfer would go to overlap it with the other layers' rendering.
+
+constexpr size_t kStageBytes = 4096; // per buffer: 1024 stereo / 2048 mono 16-bit frames
+
+struct StageStats
+{
+    uint32_t fills;          // windows fetched on demand
+    uint32_t prefetch_hits;  // windows served by the previous block's prefetch
+    uint32_t prefetches;     // predicted windows fetched
+    uint32_t bursts;         // contiguous SDRAM copies
+    uint64_t bytes;          // bytes copied from SDRAM
+};
+
+struct PlaybackStage
+{
+    alignas(16) uint8_t buffer[2][kStageBytes];
+
+    // Window held by each buffer: first frame (modulo len) and frame count
+    uint32_t start[2] = {0, 0};
+    uint32_t count[2] = {0, 0};
+    bool     valid[2] = {false, false};
+    int      active   = 0;
+
+    StageStats stats = {};
+
+    // Drop both windows, call whenever the recorded audio changes
+    void Invalidate()
+    {
+        valid[0] = false;
+        valid[1] = false;
+    }
+
+    // Frames of frame_bytes each that fit one buffer
+    static uint32_t Capacity(size_t frame_bytes) { return (uint32_t)(kStageBytes / frame_bytes); }
+
+    // Copy frames first .. first + n - 1 (taken modulo src.len, first may be
+    // negative) into buffer buf
+    void Fetch(const LoopSource& src, int buf, int64_t first, uint32_t n, size_t frame_bytes);
+
+    // Make buffer `active` hold at least frames first .. first + n - 1,
+    // from the prefetched buffer when it covers them
+    void Acquire(const LoopSource& src, int64_t first, uint32_t n, size_t frame_bytes);
+
+    // Fetch the predicted window into the idle buffer
+    void Prefetch(const LoopSource& src, int64_t first, uint32_t n, size_t frame_bytes);
+};
+
+// Output frames, at most `size`, whose taps fit `capacity` staged frames
+// starting at fractional phase `frac` (low 32 bits of the phase)
+template <typename Interp>
+inline size_t StagedFrames(uint32_t frac, Phase inc, size_t size, uint32_t capacity)
+{
+    Phase limit = PhaseFromIndex(capacity - Interp::kTaps + 1) - 1 - frac;
+    Phase n     = limit / inc + 1;
+    return n < (Phase)size ? (size_t)n : size;
+}
+
+// Same contract and output as ResampleBlock, bit for bit, with every tap read
+// from the layer's stage
+template <typename Interp, typename Fmt, int C>
+inline void ResampleStagedChannels(PlaybackStage&    stage,
+                                   const LoopSource& src,
+                                   Phase&            phase,
+                                   Phase             inc,
+                                   float*            out_l,
+                                   float*            out_r,
+                                   size_t            size,
+                                   const ParamRamp&  gain_l,
+                                   const ParamRamp&  gain_r)
+{
+#if LOOPER_RESAMPLE_SIMD
+    typedef ResampleRunSimd<Interp, Fmt, C> Runner;
+#else
+    typedef ResampleRunScalar<Interp, Fmt, C> Runner;
+#endif
+    const Phase    end         = PhaseFromIndex(src.len);
+    const size_t   frame_bytes = C * Fmt::kBytes;
+    const uint32_t capacity    = PlaybackStage::Capacity(frame_bytes);
+    Interp::Prepare((float)inc * (1.0f / 4294967296.0f));
+
+    size_t done = 0;
+    while(done < size)
+    {
+        size_t   n     = StagedFrames<Interp>((uint32_t)phase, inc, size - done, capacity);
+        int64_t  first = (int64_t)PhaseIndex(phase) - Interp::kPre;
+        uint32_t taps  = (uint32_t)(((uint32_t)phase + (n - 1) * inc) >> kPhaseFracBits) + Interp::kTaps;
+        stage.Acquire(src, first, taps, frame_bytes);
+
+        // Phase relative to the first staged frame; the fraction is unchanged
+        Phase rel = (phase & 0xFFFFFFFFu) + PhaseFromIndex(Interp::kPre);
+        Runner::Run((const typename Fmt::Unit*)stage.buffer[stage.active], rel, inc, out_l, out_r, done, n, gain_l, gain_r);
+
+        phase += n * inc;
+        while(phase >= end)
+            phase -= end;
+        done += n;
+    }
+
+    // Predict the next block's window at the same speed
+    size_t   next  = StagedFrames<Interp>((uint32_t)phase, inc, size, capacity);
+    uint32_t taps  = (uint32_t)(((uint32_t)phase + (next - 1) * inc) >> kPhaseFracBits) + Interp::kTaps;
+    stage.Prefetch(src, (int64_t)PhaseIndex(phase) - Interp::kPre, taps, frame_bytes);
+}
+
+template <typename Interp, typename Fmt>
+inline void ResampleStaged(PlaybackStage&    stage,
+                           const LoopSource& src,
+                           Phase&            phase,
+                           Phase             inc,
+                           float*            out_l,
+                           float*            out_r,
+                           size_t            size,
+                           const ParamRamp&  gain_l,
+                           const ParamRamp&  gain_r)
+{
+    if(src.channels == 1)
+        ResampleStagedChannels<Interp, Fmt, 1>(stage, src, phase, inc, out_l, out_r, size, gain_l, gain_r);
+    else
+        ResampleStagedChannels<Interp, Fmt, 2>(stage, src, phase, inc, out_l, out_r, size, gain_l, gain_r);
+}
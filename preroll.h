@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "control_io.h"
+
+// Always-running capture of the stereo input, indexed by the engine's frame
+// clock, so a take can start at the instant the button went down rather
+// than when the long press was recognised. Frames are interleaved L/R; the
+// capacity is a power of two so indexing survives the frame clock wrapping.
+struct PreRoll
+{
+    float*   buffer   = nullptr; // 2 * capacity floats; SDRAM on the Seed
+    uint32_t capacity = 0;       // frames, power of two
+    uint32_t end      = 0;       // frame clock one past the newest frame
+    uint32_t held     = 0;       // frames written so far, up to capacity
+
+    void Init(float* buf, size_t frames)
+    {
+        buffer   = buf;
+        capacity = (uint32_t)frames;
+        end      = 0;
+        held     = 0;
+        for(size_t i = 0; i < 2 * frames; i++)
+            buffer[i] = 0.0f;
+    }
+
+    // Append one block captured at frames [start, start + size)
+    void Write(AudioIn in, size_t size, uint32_t start)
+    {
+        if(capacity == 0)
+            return;
+        for(size_t i = 0; i < size; i++)
+        {
+            uint32_t slot        = (start + (uint32_t)i) & (capacity - 1);
+            buffer[2 * slot]     = in[0][i];
+            buffer[2 * slot + 1] = in[1][i];
+        }
+        end  = start + (uint32_t)size;
+        held = held + size < capacity ? held + (uint32_t)size : capacity;
+    }
+
+    // Oldest frame still held
+    uint32_t Begin() const { return end - held; }
+
+    float Left(uint32_t frame) const { return buffer[2 * (frame & (capacity - 1))]; }
+    float Right(uint32_t frame) const { return buffer[2 * (frame & (capacity - 1)) + 1]; }
+};
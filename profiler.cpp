@@ -0,0 +1,75 @@
+#include "profiler.h"
+
+#if LOOPER_PROFILE
+
+#include <stdio.h>
+
+#if defined(__arm__)
+#include "stm32h7xx.h"
+#else
+#include <chrono>
+#endif
+
+Profiler audio_profiler;
+Profiler control_profiler;
+
+uint32_t Profiler::Now()
+{
+#if defined(__arm__)
+    return DWT->CYCCNT;
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+void Profiler::Init(const char* const* stage_names, int count, float budget_us)
+{
+#if defined(__arm__)
+    // Start the DWT cycle counter; the M7 needs the lock access key first
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    ticks_per_us = SystemCoreClock / 1000000;
+#else
+    ticks_per_us = 1000;
+#endif
+    names      = stage_names;
+    num_stages = count < kMaxProfileStages ? count : kMaxProfileStages;
+    budget     = (uint32_t)(budget_us * ticks_per_us);
+    Reset();
+    reset_requested = false;
+}
+
+void Profiler::Reset()
+{
+    for(int i = 0; i < kMaxProfileStages; i++)
+        stages[i].Reset();
+    total.Reset();
+    overruns        = 0;
+    reset_requested = false;
+}
+
+size_t Profiler::Format(char* buf, size_t size) const
+{
+    // Integers only: newlib-nano's printf has no float support by default
+    size_t n = 0;
+    n += snprintf(buf + n, n < size ? size - n : 0,
+                  "load %lu.%lu%% peak %lu.%lu%% overruns %lu blocks %lu\n",
+                  (unsigned long)(LoadPermille() / 10), (unsigned long)(LoadPermille() % 10),
+                  (unsigned long)(PeakPermille() / 10), (unsigned long)(PeakPermille() % 10),
+                  (unsigned long)overruns, (unsigned long)total.count);
+    for(int i = 0; i < num_stages && n < size; i++)
+    {
+        const ProfileStats& s = stages[i];
+        if(s.count == 0)
+            continue;
+        n += snprintf(buf + n, size - n, "%-10s min %6lu avg %6lu max %6lu ticks\n",
+                      names[i], (unsigned long)s.min, (unsigned long)s.Avg(), (unsigned long)s.max);
+    }
+    return n < size ? n : size;
+}
+
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-stage timing of the audio callback and the control task.
+// Build with LOOPER_PROFILE=1 to enable; otherwise the PROFILE_* macros
+// expand to nothing and no profiler code or data is linked in.
+//
+// Ticks are DWT cycles on the Cortex-M7 and nanoseconds on the host. Each
+// block, Begin() starts the clock, Lap(stage) charges the time since the
+// previous mark to that stage, and End() checks the total against the budget.
+
+#ifndef LOOPER_PROFILE
+#define LOOPER_PROFILE 0
+#endif
+
+constexpr int kMaxProfileStages = 12;
+
+// Audio callback stages; layer i is kProfileLayer0 + i, and the output stage
+// (mix, meters, limiter) follows the last layer
+enum AudioProfileStage
+{
+    kProfileSession,
+    kProfileCommands, // and a bounce chunk while one runs
+    kProfileLayer0,
+};
+
+// Control task stages
+enum ControlProfileStage
+{
+    kProfileControl, // debounce, knobs, gestures
+    kProfileLeds,    // segment updates
+    kProfileSpi,     // MAX7219 service
+    kProfileStorage, // session save/restore I/O
+};
+
+#if LOOPER_PROFILE
+
+struct ProfileStats
+{
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t count;
+
+    void Reset()
+    {
+        min   = UINT32_MAX;
+        max   = 0;
+        sum   = 0;
+        count = 0;
+    }
+
+    void Add(uint32_t ticks)
+    {
+        min = ticks < min ? ticks : min;
+        max = ticks > max ? ticks : max;
+        sum += ticks;
+        count++;
+    }
+
+    uint32_t Avg() const { return count > 0 ? (uint32_t)(sum / count) : 0; }
+};
+
+struct Profiler
+{
+    const char* const* names        = nullptr;
+    int                num_stages   = 0;
+    uint32_t           budget       = 0; // ticks per block (the deadline)
+    uint32_t           ticks_per_us = 1;
+
+    ProfileStats stages[kMaxProfileStages];
+    ProfileStats total;
+    uint32_t   overruns = 0; // blocks over budget
+
+    uint32_t      start           = 0;
+    uint32_t      mark            = 0;
+    volatile bool reset_requested = false; // honoured by the profiled side at Begin()
+
+    // budget_us: time available per block
+    void Init(const char* const* stage_names, int count, float budget_us);
+
+    static uint32_t Now();
+
+    void Begin()
+    {
+        if(reset_requested)
+            Reset();
+        start = mark = Now();
+    }
+
+    void Lap(int stage)
+    {
+        uint32_t now = Now();
+        if(stage < num_stages)
+            stages[stage].Add(now - mark);
+        mark = now;
+    }
+
+    void End()
+    {
+        uint32_t ticks = Now() - start;
+        total.Add(ticks);
+        if(ticks > budget)
+            overruns++;
+    }
+
+    void Reset();
+
+    // Average and peak load, percent of the budget, in tenths
+    uint32_t LoadPermille() const { return budget > 0 ? (uint32_t)((uint64_t)total.Avg() * 1000 / budget) : 0; }
+    uint32_t PeakPermille() const { return budget > 0 ? (uint32_t)((uint64_t)total.max * 1000 / budget) : 0; }
+
+    // Plain-text table, one line per stage; returns the length written.
+    // Read from another context than the one profiled, figures may be one block stale.
+    size_t Format(char* buf, size_t size) const;
+};
+
+extern Profiler audio_profiler;
+extern Profiler control_profiler;
+
+#define PROFILE_BEGIN(p) (p).Begin()
+#define PROFILE_LAP(p, stage) (p).Lap(stage)
+#define PROFILE_END(p) (p).End()
+
+#else
+
+#define PROFILE_BEGIN(p) ((void)0)
+#define PROFILE_LAP(p, stage) ((void)0)
+#define PROFILE_END(p) ((void)0)
+
+#endif
@@ -0,0 +1,290 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "control_params.h"
+#include "interpolation.h"
+
+#if defined(__SSE2__)
+#define LOOPER_RESAMPLE_SIMD 1
+#else
+#define LOOPER_RESAMPLE_SIMD 0
+#endif
+
+// Block-based varispeed playback of a looped recording.
+//
+// The play position is a 32.32 fixed-point phase, so every integer index up to
+// 2^32 is exact and the interpolation fraction keeps 24 bits of resolution for
+// any loop length. Wrap-around is handled once per segment: the output block is
+// split into runs where all interpolation taps stay inside one storage block,
+// and only the few frames whose taps straddle a block boundary or the loop
+// point take a slow path.
+// The interpolation policy (interpolation.h) and storage format
+// (sample_format.h) are template parameters, so each instantiation only
+// contains the tier and sample conversion it uses.
+
+typedef uint64_t Phase;
+constexpr int kPhaseFracBits = 32;
+
+inline Phase PhaseFromIndex(uint32_t idx)
+{
+    return (Phase)idx << kPhaseFracBits;
+}
+
+// speed * 2^32 is an integer for any speed >= 2^-8, so the conversion is exact
+inline Phase PhaseIncrement(float speed)
+{
+    return (Phase)(speed * 4294967296.0f);
+}
+
+inline uint32_t PhaseIndex(Phase p)
+{
+    return (uint32_t)(p >> kPhaseFracBits);
+}
+
+// Top 24 fraction bits, exactly representable as a float
+inline float PhaseFrac(Phase p)
+{
+    return (float)((uint32_t)p >> 8) * (1.0f / 16777216.0f);
+}
+
+// Read-only view of a recorded loop: interleaved frames (1 or 2 channels) in a
+// table of equally sized blocks, as laid out by LoopStorage
+struct LoopSource
+{
+    const uint8_t*  pool;
+    const uint16_t* blocks;
+    size_t          block_bytes;
+    uint32_t        frames_per_block;
+    int             channels; // 1 = mono, 2 = interleaved stereo
+    uint32_t        len;      // frames, >= 1
+
+    template <typename Fmt>
+    const typename Fmt::Unit* Block(uint32_t b) const
+    {
+        return (const typename Fmt::Unit*)(pool + blocks[b] * block_bytes);
+    }
+
+    template <typename Fmt>
+    float Sample(uint32_t frame, int ch) const
+    {
+        return Fmt::Load(Block<Fmt>(frame / frames_per_block),
+                         (ptrdiff_t)(frame % frames_per_block) * channels + ch);
+    }
+};
+
+// Renders n frames at block offset `offset` from one block's data, phase is
+// relative to the block start. Caller guarantees every tap
+// idx - kPre .. idx + kPost lies inside the block and the loop.
+template <typename Interp, typename Fmt, int C>
+struct ResampleRunScalar
+{
+    typedef typename Fmt::Unit Unit;
+
+    static void Run(const Unit*      data,
+                    Phase            phase,
+                    Phase            inc,
+                    float*           out_l,
+                    float*           out_r,
+                    size_t           offset,
+                    size_t           n,
+                    const ParamRamp& gain_l,
+                    const ParamRamp& gain_r)
+    {
+        for(size_t k = 0; k < n; k++)
+        {
+            const Unit* x    = data + (size_t)PhaseIndex(phase) * C * Fmt::kUnits;
+            float       frac = PhaseFrac(phase);
+            size_t      i    = offset + k;
+            if(C == 1)
+            {
+                float y = Interp::template Interpolate<Fmt, 1>(x, frac);
+                out_l[i] += y * gain_l.At(i);
+                out_r[i] += y * gain_r.At(i);
+            }
+            else
+            {
+                out_l[i] += Interp::template Interpolate<Fmt, C>(x, frac) * gain_l.At(i);
+                out_r[i] += Interp::template Interpolate<Fmt, C>(x + Fmt::kUnits, frac) * gain_r.At(i);
+            }
+            phase += inc;
+        }
+    }
+};
+
+#if LOOPER_RESAMPLE_SIMD
+// SSE2 version of ResampleRunScalar, four frames per step. Uses the same
+// operation order as the scalar path, so results are bit-identical.
+template <typename Interp, typename Fmt, int C>
+struct ResampleRunSimd
+{
+    typedef typename Fmt::Unit Unit;
+
+    static void Run(const Unit*      data,
+                    Phase            phase,
+                    Phase            inc,
+                    float*           out_l,
+                    float*           out_r,
+                    size_t           offset,
+                    size_t           n,
+                    const ParamRamp& gain_l,
+                    const ParamRamp& gain_r)
+    {
+        const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+        const __m128 gl0   = _mm_set1_ps(gain_l.value);
+        const __m128 gls   = _mm_set1_ps(gain_l.step);
+        const __m128 gr0   = _mm_set1_ps(gain_r.value);
+        const __m128 grs   = _mm_set1_ps(gain_r.step);
+
+        size_t k = 0;
+        for(; k + 4 <= n; k += 4)
+        {
+            const Unit*         xl[4];
+            const Unit*         xr[4];
+            alignas(16) int32_t fr[4];
+            for(int j = 0; j < 4; j++)
+            {
+                fr[j] = (int32_t)((uint32_t)phase >> 8);
+                xl[j] = data + (size_t)PhaseIndex(phase) * C * Fmt::kUnits;
+                xr[j] = xl[j] + Fmt::kUnits;
+                phase += inc;
+            }
+
+            size_t i    = offset + k;
+            __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_load_si128((const __m128i*)fr)), scale);
+            __m128 pos  = _mm_set_ps((float)(i + 4), (float)(i + 3), (float)(i + 2), (float)(i + 1));
+            __m128 gl   = _mm_add_ps(gl0, _mm_mul_ps(gls, pos));
+            __m128 gr   = _mm_add_ps(gr0, _mm_mul_ps(grs, pos));
+
+            __m128 yl, yr;
+            if(C == 1)
+            {
+                __m128 y = Interp::template Interpolate4<Fmt, 1>(xl, frac);
+                yl       = _mm_mul_ps(y, gl);
+                yr       = _mm_mul_ps(y, gr);
+            }
+            else
+            {
+                yl = _mm_mul_ps(Interp::template Interpolate4<Fmt, C>(xl, frac), gl);
+                yr = _mm_mul_ps(Interp::template Interpolate4<Fmt, C>(xr, frac), gr);
+            }
+            _mm_storeu_ps(out_l + i, _mm_add_ps(_mm_loadu_ps(out_l + i), yl));
+            _mm_storeu_ps(out_r + i, _mm_add_ps(_mm_loadu_ps(out_r + i), yr));
+        }
+        ResampleRunScalar<Interp, Fmt, C>::Run(data, phase, inc, out_l, out_r, offset + k, n - k, gain_l, gain_r);
+    }
+};
+#endif
+
+// One output frame whose taps cross a block boundary or the loop point,
+// taps gathered one by one modulo len
+template <typename Interp, typename Fmt, int C>
+inline void ResampleGatheredFrame(const LoopSource& src,
+                                  Phase             phase,
+                                  float             gain_l,
+                                  float             gain_r,
+                                  float&            out_l,
+                                  float&            out_r)
+{
+    float   tl[Interp::kTaps], tr[Interp::kTaps];
+    int64_t first = (int64_t)PhaseIndex(phase) - Interp::kPre;
+    for(int t = 0; t < Interp::kTaps; t++)
+    {
+        int64_t j = (first + t) % (int64_t)src.len;
+        if(j < 0)
+            j += src.len;
+        tl[t] = src.Sample<Fmt>((uint32_t)j, 0);
+        tr[t] = src.Sample<Fmt>((uint32_t)j, C - 1);
+    }
+    float frac = PhaseFrac(phase);
+    if(C == 1)
+    {
+        float y = Interp::template Interpolate<FormatF32, 1>(tl + Interp::kPre, frac);
+        out_l += y * gain_l;
+        out_r += y * gain_r;
+    }
+    else
+    {
+        out_l += Interp::template Interpolate<FormatF32, 1>(tl + Interp::kPre, frac) * gain_l;
+        out_r += Interp::template Interpolate<FormatF32, 1>(tr + Interp::kPre, frac) * gain_r;
+    }
+}
+
+// Mixes size frames of the looped source into out, advancing phase by inc per
+// frame. Each segment runs from one block; a segment ends at a block
+// boundary, the loop point or the end of the output block.
+template <typename Interp, typename Fmt, int C, typename Runner>
+inline void ResampleBlockWith(const LoopSource& src,
+                              Phase&            phase,
+                              Phase             inc,
+                              float*            out_l,
+                              float*            out_r,
+                              size_t            size,
+                              const ParamRamp&  gain_l,
+                              const ParamRamp&  gain_r)
+{
+    const Phase    end = PhaseFromIndex(src.len);
+    const uint64_t fpb = src.frames_per_block;
+    Interp::Prepare((float)inc * (1.0f / 4294967296.0f));
+
+    size_t done = 0;
+    while(done < size)
+    {
+        uint32_t idx   = PhaseIndex(phase);
+        uint32_t b     = idx / src.frames_per_block;
+        uint32_t first = b * src.frames_per_block;
+        uint32_t last  = first + fpb < src.len ? (uint32_t)(first + fpb) : src.len;
+
+        if(idx >= first + Interp::kPre && idx + Interp::kPost < last)
+        {
+            // Every tap inside this block until idx + kPost reaches last
+            Phase  rel  = phase - PhaseFromIndex(first);
+            Phase  hi   = PhaseFromIndex(last - Interp::kPost - first);
+            Phase  span = (hi - rel + inc - 1) / inc;
+            size_t n    = span < (Phase)(size - done) ? (size_t)span : size - done;
+            Runner::Run(src.Block<Fmt>(b), rel, inc, out_l, out_r, done, n, gain_l, gain_r);
+            phase += n * inc;
+            done += n;
+        }
+        else
+        {
+            ResampleGatheredFrame<Interp, Fmt, C>(src, phase, gain_l.At(done), gain_r.At(done), out_l[done], out_r[done]);
+            phase += inc;
+            done++;
+        }
+        while(phase >= end)
+            phase -= end;
+    }
+}
+
+template <typename Interp, typename Fmt, int C>
+inline void ResampleBlockChannels(const LoopSource& src,
+                                  Phase&            phase,
+                                  Phase             inc,
+                                  float*            out_l,
+                                  float*            out_r,
+                                  size_t            size,
+                                  const ParamRamp&  gain_l,
+                                  const ParamRamp&  gain_r)
+{
+#if LOOPER_RESAMPLE_SIMD
+    ResampleBlockWith<Interp, Fmt, C, ResampleRunSimd<Interp, Fmt, C>>(src, phase, inc, out_l, out_r, size, gain_l, gain_r);
+#else
+    ResampleBlockWith<Interp, Fmt, C, ResampleRunScalar<Interp, Fmt, C>>(src, phase, inc, out_l, out_r, size, gain_l, gain_r);
+#endif
+}
+
+template <typename Interp, typename Fmt>
+inline void ResampleBlock(const LoopSource& src,
+                          Phase&            phase,
+                          Phase             inc,
+                          float*            out_l,
+                          float*            out_r,
+                          size_t            size,
+                          const ParamRamp&  gain_l,
+                          const ParamRamp&  gain_r)
+{
+    if(src.channels == 1)
+        ResampleBlockChannels<Interp, Fmt, 1>(src, phase, inc, out_l, out_r, size, gain_l, gain_r);
+    else
+        ResampleBlockChannels<Interp, Fmt, 2>(src, phase, inc, out_l, out_r, size, gain_l, gain_r);
+}
@@ -0,0 +1,145 @@
+#include <string.h>
+#include "sample_arena.h"
+
+void SampleArena::Init(uint8_t* memory, size_t bytes)
+{
+    pool       = memory;
+    num_blocks = bytes / kArenaBlockBytes;
+    if(num_blocks > kMaxArenaBlocks)
+        num_blocks = kMaxArenaBlocks;
+
+    // Stack order hands out low addresses first
+    free_count = num_blocks;
+    for(size_t i = 0; i < num_blocks; i++)
+    {
+        free_list[i] = (uint16_t)(num_blocks - 1 - i);
+        in_use[i]    = 0;
+    }
+    peak_used      = 0;
+    alloc_failures = 0;
+}
+
+uint16_t SampleArena::Alloc()
+{
+    if(free_count == 0)
+    {
+        alloc_failures++;
+        return kNoBlock;
+    }
+    uint16_t block = free_list[--free_count];
+    in_use[block]  = 1;
+    if(UsedBlocks() > peak_used)
+        peak_used = UsedBlocks();
+    return block;
+}
+
+void SampleArena::Free(uint16_t block)
+{
+    if(block >= num_blocks || !in_use[block])
+        return;
+    in_use[block]           = 0;
+    free_list[free_count++] = block;
+}
+
+ArenaStats SampleArena::GetStats() const
+{
+    ArenaStats stats;
+    stats.total_blocks     = num_blocks;
+    stats.used_blocks      = UsedBlocks();
+    stats.peak_used_blocks = peak_used;
+    stats.alloc_failures   = alloc_failures;
+
+    size_t run = 0, longest = 0;
+    for(size_t i = 0; i < num_blocks; i++)
+    {
+        run = in_use[i] ? 0 : run + 1;
+        if(run > longest)
+            longest = run;
+    }
+    stats.largest_free_run = longest;
+    stats.utilization      = num_blocks > 0 ? (float)stats.used_blocks / num_blocks : 0.0f;
+    stats.fragmentation    = free_count > 0 ? 1.0f - (float)longest / free_count : 0.0f;
+    return stats;
+}
+
+void LoopStorage::Init(SampleArena* a)
+{
+    arena      = a;
+    num_blocks = 0;
+    Begin(2);
+}
+
+void LoopStorage::Begin(int num_channels)
+{
+    Clear();
+    channels         = num_channels;
+    frames_per_block = kArenaBlockBytes / (channels * LoopFormat::kBytes);
+}
+
+void LoopStorage::Clear()
+{
+    for(size_t i = 0; i < num_blocks; i++)
+        arena->Free(blocks[i]);
+    num_blocks = 0;
+}
+
+bool LoopStorage::Write(size_t frame, float left, float right)
+{
+    if(frame >= CapacityFrames())
+    {
+        uint16_t block = arena->Alloc();
+        if(block == kNoBlock)
+            return false;
+        blocks[num_blocks++] = block;
+    }
+
+    Unit* dst = FramePtr(frame);
+    LoopFormat::Store(dst, 0, left, dither_rng);
+    if(channels == 2)
+        LoopFormat::Store(dst, 1, right, dither_rng);
+    return true;
+}
+
+size_t LoopStorage::Reserve(size_t frames)
+{
+    while(CapacityFrames() < frames)
+    {
+        uint16_t block = arena->Alloc();
+        if(block == kNoBlock)
+            break;
+        blocks[num_blocks++] = block;
+    }
+    return CapacityFrames() < frames ? CapacityFrames() : frames;
+}
+
+void LoopStorage::ReadRaw(size_t frame, uint8_t* dst, size_t frames) const
+{
+    // One copy per storage block the range touches
+    while(frames > 0)
+    {
+        size_t run = frames_per_block - frame % frames_per_block;
+        run        = run < frames ? run : frames;
+        memcpy(dst, FramePtr(frame), run * FrameBytes());
+        dst += run * FrameBytes();
+        frame += run;
+        frames -= run;
+    }
+}
+
+void LoopStorage::WriteRaw(size_t frame, const uint8_t* src, size_t frames)
+{
+    while(frames > 0)
+    {
+        size_t run = frames_per_block - frame % frames_per_block;
+        run        = run < frames ? run : frames;
+        memcpy(FramePtr(frame), src, run * FrameBytes());
+        src += run * FrameBytes();
+        frame += run;
+        frames -= run;
+    }
+}
+
+size_t LoopStorage::SlackBytes(size_t frames) const
+{
+    return num_blocks * kArenaBlockBytes - frames * channels * LoopFormat::kBytes;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_format.h"
+
+// Shared sample memory for all layers.
+// The SDRAM pool is cut into fixed-size blocks. A recording claims blocks one
+// at a time as it grows and an erased layer hands them back immediately, so
+// any single layer can use all the memory the others are not using.
+// Alloc/Free are O(1) (free stack) and safe to call from the audio callback.
+
+constexpr size_t   kArenaBlockBytes = 32 * 1024;      // 16384 mono / 8192 stereo 16-bit frames
+constexpr size_t   kMaxArenaBlocks  = 2048;           // 64 MB of SDRAM
+constexpr uint16_t kNoBlock         = 0xFFFF;
+
+struct ArenaStats
+{
+    size_t total_blocks;
+    size_t used_blocks;
+    size_t peak_used_blocks;
+    size_t alloc_failures;
+    size_t largest_free_run; // longest run of adjacent free blocks
+    float  utilization;      // used / total
+    float  fragmentation;    // 1 - largest_free_run / free blocks, 0 when all free memory is contiguous
+};
+
+struct SampleArena
+{
+    uint8_t* pool       = nullptr;
+    size_t   num_blocks = 0;
+
+    uint16_t free_list[kMaxArenaBlocks];
+    size_t   free_count = 0;
+    uint8_t  in_use[kMaxArenaBlocks];
+
+    size_t peak_used      = 0;
+    size_t alloc_failures = 0;
+
+    void Init(uint8_t* memory, size_t bytes);
+
+    // Returns a block index, or kNoBlock when the pool is exhausted
+    uint16_t Alloc();
+    void     Free(uint16_t block);
+
+    uint8_t* Block(uint16_t block) const { return pool + (size_t)block * kArenaBlockBytes; }
+
+    size_t UsedBlocks() const { return num_blocks - free_count; }
+    size_t FreeBlocks() const { return free_count; }
+
+    // Scans the whole pool, call from the main loop rather than per block
+    ArenaStats GetStats() const;
+};
+
+// One layer's recording: a table of arena blocks holding interleaved frames
+// in LoopFormat. Mono takes store one sample per frame, stereo takes two, so a
+// mono recording only uses half the blocks of a stereo one.
+struct LoopStorage
+{
+    typedef LoopFormat::Unit Unit;
+
+    SampleArena* arena = nullptr;
+    uint16_t     blocks[kMaxArenaBlocks];
+    size_t       num_blocks       = 0;
+    int          channels         = 2;
+    uint32_t     frames_per_block = 0;
+    uint32_t     dither_rng       = 1; // TPDF dither state for integer formats
+
+    void Init(SampleArena* a);
+
+    // Drop the current take and start an empty one with 1 or 2 channels
+    void Begin(int num_channels);
+
+    // Return every block to the arena
+    void Clear();
+
+    size_t FramesPerBlock() const { return frames_per_block; }
+    size_t CapacityFrames() const { return num_blocks * frames_per_block; }
+
+    // Write one frame, claiming a new block when needed.
+    // Returns false when the arena is full and the frame was dropped.
+    bool Write(size_t frame, float left, float right);
+
+    Unit* FramePtr(size_t frame) const
+    {
+        Unit* block = (Unit*)arena->Block(blocks[frame / frames_per_block]);
+        return block + (frame % frames_per_block) * channels * LoopFormat::kUnits;
+    }
+
+    float Read(size_t frame, int ch) const { return LoopFormat::Load(FramePtr(frame), ch); }
+
+    size_t FrameBytes() const { return channels * LoopFormat::kBytes; }
+
+    // Claim blocks up front for a take of `frames` frames; returns the frames
+    // actually covered, less when the arena runs out
+    size_t Reserve(size_t frames);
+
+    // Copy stored frames out / in as raw LoopFormat data (no conversion).
+    // WriteRaw only fills capacity that Reserve() or Write() already claimed.
+    void ReadRaw(size_t frame, uint8_t* dst, size_t frames) const;
+    void WriteRaw(size_t frame, const uint8_t* src, size_t frames);
+
+    // Bytes claimed but not holding audio, for a take of `frames` frames
+    size_t SlackBytes(size_t frames) const;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Loop storage formats.
+// Each format stores one sample in kUnits elements of Unit. Load() converts a
+// stored sample to float and is called directly from the interpolation taps,
+// so playback never needs a separate conversion pass. Store() converts with
+// TPDF dither for the integer formats.
+//
+//   FormatF32   32-bit float, lossless
+//   FormatS16   16-bit, 2x the loop time of float, ~96 dB dithered SNR
+//   FormatS24   packed 24-bit (3 bytes), 1.33x the loop time of float
+
+// Triangular (TPDF) dither noise in LSBs, -1 .. +1
+inline float DitherTpdf(uint32_t& rng)
+{
+    rng           = rng * 1664525u + 1013904223u;
+    uint32_t a    = rng >> 16;
+    rng           = rng * 1664525u + 1013904223u;
+    uint32_t b    = rng >> 16;
+    return ((float)a - (float)b) * (1.0f / 65536.0f);
+}
+
+inline int32_t QuantizeDithered(float x, float scale, int32_t lo, int32_t hi, uint32_t& rng)
+{
+    float   v = x * scale + DitherTpdf(rng);
+    int32_t q = (int32_t)(v < 0.0f ? v - 0.5f : v + 0.5f);
+    return q < lo ? lo : (q > hi ? hi : q);
+}
+
+struct FormatF32
+{
+    typedef float Unit;
+    static constexpr int kUnits = 1;
+    static constexpr int kBytes = 4;
+
+    static inline float Load(const Unit* p, ptrdiff_t i) { return p[i]; }
+
+    static inline void Store(Unit* p, ptrdiff_t i, float x, uint32_t& rng) { p[i] = x; }
+};
+
+struct FormatS16
+{
+    typedef int16_t Unit;
+    static constexpr int kUnits = 1;
+    static constexpr int kBytes = 2;
+
+    static inline float Load(const Unit* p, ptrdiff_t i) { return (float)p[i] * (1.0f / 32768.0f); }
+
+    static inline void Store(Unit* p, ptrdiff_t i, float x, uint32_t& rng)
+    {
+        p[i] = (int16_t)QuantizeDithered(x, 32768.0f, -32768, 32767, rng);
+    }
+};
+
+struct FormatS24
+{
+    typedef uint8_t Unit;
+    static constexpr int kUnits = 3;
+    static constexpr int kBytes = 3;
+
+    // Little-endian, sign in the top byte
+    static inline float Load(const Unit* p, ptrdiff_t i)
+    {
+        const uint8_t* s = p + i * 3;
+        int32_t        v = (int32_t)(((uint32_t)s[2] << 24) | ((uint32_t)s[1] << 16) | ((uint32_t)s[0] << 8)) >> 8;
+        return (float)v * (1.0f / 8388608.0f);
+    }
+
+    static inline void Store(Unit* p, ptrdiff_t i, float x, uint32_t& rng)
+    {
+        int32_t  q = QuantizeDithered(x, 8388608.0f, -8388608, 8388607, rng);
+        uint8_t* s = p + i * 3;
+        s[0]       = (uint8_t)q;
+        s[1]       = (uint8_t)(q >> 8);
+        s[2]       = (uint8_t)(q >> 16);
+    }
+};
+
+// Format of recorded loops. Override with -DLOOPER_SAMPLE_FORMAT=FormatF32 or
+// FormatS24; 16-bit doubles the loop time and halves the SDRAM traffic.
+#ifndef LOOPER_SAMPLE_FORMAT
+#define LOOPER_SAMPLE_FORMAT FormatS16
+#endif
+typedef LOOPER_SAMPLE_FORMAT LoopFormat;
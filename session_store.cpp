@@ -0,0 +1,272 @@
+#include <string.h>
+#include "session_store.h"
+
+static uint32_t RoundUpToSector(uint32_t bytes)
+{
+    return (bytes + kSessionHeaderBytes - 1) / kSessionHeaderBytes * kSessionHeaderBytes;
+}
+
+void SessionStore::Init(StorageDevice* dev, LooperLayer* layer_array, int count, PersistChunk* chunk_pool)
+{
+    device     = dev;
+    layers     = layer_array;
+    num_layers = count < kMaxSessionLayers ? count : kMaxSessionLayers;
+    pool       = chunk_pool;
+    for(int i = 0; i < kPersistChunks; i++)
+        empty.Push(&pool[i]);
+    state.store(kSessionIdle);
+}
+
+bool SessionStore::RequestSave()
+{
+    int idle = kSessionIdle;
+    return device != nullptr && state.compare_exchange_strong(idle, kSessionSaveRequested);
+}
+
+bool SessionStore::BeginLoad()
+{
+    if(device == nullptr || state.load() != kSessionIdle)
+        return false;
+
+    if(!device->Read(0, &header, sizeof(header)))
+    {
+        stats.io_errors++;
+        return false;
+    }
+    bool known = header.version == kSessionVersion || header.version == 1;
+    if(header.magic != kSessionMagic || !known || header.sample_bytes != LoopFormat::kBytes
+       || header.num_layers > kMaxSessionLayers)
+        return false;
+    if(header.version == 1)
+        header.latency = 0; // Past the end of a version 1 header
+    if(header.latency > 0)
+        latency.store(header.latency);
+
+    for(int i = 0; i < kMaxSessionLayers; i++)
+        load_next[i] = 0;
+    for(uint32_t i = (uint32_t)num_layers; i < header.num_layers; i++)
+        header.layers[i].record_len = 0; // More layers saved than this build has
+    load_turn = 0;
+    state.store(kSessionLoading, std::memory_order_release);
+    return true;
+}
+
+void SessionStore::Poll()
+{
+    switch(state.load(std::memory_order_acquire))
+    {
+        case kSessionSaveRequested:
+        {
+            // A save that is cut short must not leave a valid header behind
+            SessionHeader invalid;
+            memset(&invalid, 0, sizeof(invalid));
+            if(!device->Write(0, &invalid, sizeof(invalid)))
+            {
+                stats.io_errors++;
+                state.store(kSessionIdle, std::memory_order_release);
+                break;
+            }
+            write_failures = 0;
+            produced_all.store(false, std::memory_order_relaxed);
+            state.store(kSessionSnapshot, std::memory_order_release);
+            break;
+        }
+        case kSessionSaving: PollSave(); break;
+        case kSessionLoading: PollLoad(); break;
+        default: break;
+    }
+}
+
+void SessionStore::PollSave()
+{
+    // Read the flag first: once it is set every chunk is already in `filled`
+    bool          done = produced_all.load(std::memory_order_acquire);
+    PersistChunk* chunk;
+    if(filled.Pop(chunk))
+    {
+        const SessionLayerHeader& h     = header.layers[chunk->layer];
+        size_t                    bytes = h.channels * LoopFormat::kBytes;
+        if(!device->Write(h.data_offset + chunk->frame * bytes, chunk->data, chunk->frames * bytes))
+            write_failures++; // The header is not written for this save
+        stats.chunks_written++;
+        empty.Push(chunk);
+        return;
+    }
+    if(!done)
+        return;
+
+    if(write_failures == 0 && device->Write(0, &header, sizeof(header)) && device->Flush())
+        stats.saves++;
+    else
+        stats.io_errors++;
+    state.store(kSessionIdle, std::memory_order_release);
+}
+
+void SessionStore::PollLoad()
+{
+    // Round-robin so every layer gets its first chunk, and first audio, early
+    int layer = -1;
+    for(int k = 0; k < num_layers; k++)
+    {
+        int l = (load_turn + k) % num_layers;
+        if(load_next[l] < header.layers[l].record_len)
+        {
+            layer = l;
+            break;
+        }
+    }
+    if(layer < 0)
+    {
+        // Done once audio has handed every chunk back
+        if(empty.Size() == kPersistChunks)
+        {
+            stats.loads++;
+            state.store(kSessionIdle, std::memory_order_release);
+        }
+        return;
+    }
+
+    PersistChunk* chunk;
+    if(!empty.Pop(chunk))
+        return;
+
+    const SessionLayerHeader& h     = header.layers[layer];
+    size_t                    bytes = h.channels * LoopFormat::kBytes;
+    uint32_t                  n     = ChunkFrames(layer);
+    if(n > h.record_len - load_next[layer])
+        n = h.record_len - load_next[layer];
+
+    chunk->layer  = layer;
+    chunk->frame  = load_next[layer];
+    chunk->frames = n;
+    if(!device->Read(h.data_offset + chunk->frame * bytes, chunk->data, n * bytes))
+    {
+        stats.io_errors++;
+        memset(chunk->data, 0, n * bytes); // Keep the take playable, with a gap
+    }
+    stats.chunks_read++;
+    load_next[layer] += n;
+    load_turn = (layer + 1) % num_layers;
+    filled.Push(chunk);
+}
+
+void SessionStore::AudioService()
+{
+    int s = state.load(std::memory_order_acquire);
+    if(s == kSessionSnapshot)
+    {
+        SnapshotLayers();
+        state.store(kSessionSaving, std::memory_order_release);
+        return;
+    }
+
+    if(s == kSessionSaving && !produced_all.load(std::memory_order_relaxed))
+    {
+        for(int k = 0; k < kPersistChunksPerBlock; k++)
+        {
+            while(save_layer < num_layers && header.layers[save_layer].record_len == 0)
+                save_layer++;
+            if(save_layer == num_layers)
+            {
+                produced_all.store(true, std::memory_order_release);
+                break;
+            }
+
+            PersistChunk* chunk;
+            if(!empty.Pop(chunk))
+            {
+                stats.audio_starved++;
+                break;
+            }
+            FillSaveChunk(chunk);
+            filled.Push(chunk);
+        }
+    }
+    else if(s == kSessionLoading)
+    {
+        PersistChunk* chunk;
+        for(int k = 0; k < kPersistChunksPerBlock && filled.Pop(chunk); k++)
+        {
+            InstallChunk(chunk);
+            empty.Push(chunk);
+        }
+    }
+}
+
+void SessionStore::SnapshotLayers()
+{
+    memset(&header, 0, sizeof(header));
+    header.magic        = kSessionMagic;
+    header.version      = kSessionVersion;
+    header.sample_bytes = LoopFormat::kBytes;
+    header.num_layers   = num_layers;
+    header.latency      = latency.load();
+
+    uint32_t offset = kSessionHeaderBytes;
+    for(int i = 0; i < num_layers; i++)
+    {
+        const LooperLayer&  layer = layers[i];
+        SessionLayerHeader& h     = header.layers[i];
+        bool                keep  = layer.recorded && !layer.recording && !layer.loading && !layer.streaming;
+
+        h.record_len       = keep ? (uint32_t)layer.record_len : 0;
+        h.channels         = (uint8_t)layer.storage.channels;
+        h.recorded_channel = (uint8_t)layer.recorded_channel;
+        h.paused           = layer.paused;
+        h.stretch          = layer.stretch;
+        h.speed            = layer.speed;
+        h.pan              = layer.pan;
+        h.feedback         = layer.feedback;
+        h.data_offset      = offset;
+        offset += RoundUpToSector(h.record_len * h.channels * LoopFormat::kBytes);
+    }
+    save_layer = 0;
+    save_frame = 0;
+}
+
+void SessionStore::FillSaveChunk(PersistChunk* chunk)
+{
+    const SessionLayerHeader& h     = header.layers[save_layer];
+    const LooperLayer&        layer = layers[save_layer];
+    uint32_t                  n     = ChunkFrames(save_layer);
+    if(n > h.record_len - save_frame)
+        n = h.record_len - save_frame;
+
+    chunk->layer  = save_layer;
+    chunk->frame  = save_frame;
+    chunk->frames = n;
+
+    // Re-recorded or erased since the snapshot: the old take is gone
+    bool intact = layer.recorded && !layer.recording && layer.record_len == h.record_len
+                  && layer.storage.channels == h.channels;
+    if(intact)
+        layer.storage.ReadRaw(save_frame, chunk->data, n);
+    else
+        memset(chunk->data, 0, n * h.channels * LoopFormat::kBytes);
+
+    save_frame += n;
+    if(save_frame >= h.record_len)
+    {
+        save_layer++;
+        save_frame = 0;
+    }
+}
+
+void SessionStore::InstallChunk(const PersistChunk* chunk)
+{
+    LooperLayer&              layer = layers[chunk->layer];
+    const SessionLayerHeader& h     = header.layers[chunk->layer];
+    if(chunk->frame == 0)
+    {
+        // Never overwrite a take recorded since boot
+        if(layer.recorded || layer.recording || !layer.BeginRestore(h.record_len, h.channels))
+            return;
+        layer.recorded_channel = h.recorded_channel;
+        layer.paused           = h.paused != 0;
+        layer.stretch          = h.stretch != 0;
+        layer.speed            = h.speed;
+        layer.pan              = h.pan;
+        layer.feedback         = h.feedback;
+    }
+    layer.RestoreFrames(chunk->frame, chunk->data, chunk->frames);
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "control_io.h"
+#include "looper_layer.h"
+#include "spsc_queue.h"
+
+// Save/restore of all layers to a StorageDevice.
+//
+// Storage I/O only ever happens in Poll(), called from the idle main loop;
+// the audio callback only calls AudioService(), which never blocks. Audio
+// moves between the two through fixed chunk buffers and a pair of SPSC
+// queues: `filled` carries chunks with data, `empty` returns them.
+//
+//   Save     audio snapshots the layer state, then copies a few chunks per
+//            block out of the arena; main writes them and finally the
+//            header, so a save cut short leaves no valid session behind.
+//   Restore  main reads the header, then reads chunks round-robin across the
+//            layers; audio copies them into the arena. A layer starts playing
+//            as soon as the frames its next block needs are resident.
+//
+// Only one direction is active at a time; the queues change producer and
+// consumer only while every chunk is back in `empty`.
+//
+// File layout: one 512-byte SessionHeader, then each layer's frames as raw
+// LoopFormat data, each layer starting on a 512-byte boundary. Undo history
+// is not saved. The header also keeps the measured round-trip latency, so
+// takes stay aligned after a power cycle without recalibrating.
+
+constexpr uint32_t kSessionMagic          = 0x4F52554F; // "OURO"
+constexpr uint16_t kSessionVersion        = 2; // 1: no latency, still loaded
+constexpr int      kMaxSessionLayers      = 8;
+constexpr size_t   kSessionHeaderBytes    = 512;
+constexpr size_t   kPersistChunkBytes     = 8192;
+constexpr int      kPersistChunks         = 4;
+constexpr int      kPersistChunksPerBlock = 2; // audio-side copies per callback
+
+struct SessionLayerHeader
+{
+    uint32_t record_len; // frames, 0 = empty layer
+    uint32_t data_offset;
+    uint8_t  channels;
+    uint8_t  recorded_channel;
+    uint8_t  paused;
+    uint8_t  stretch;  // 0 in sessions saved before time-stretch
+    float    speed;
+    float    pan;
+    float    feedback;
+};
+
+struct SessionHeader
+{
+    uint32_t           magic;
+    uint16_t           version;
+    uint16_t           sample_bytes; // LoopFormat::kBytes the frames were saved in
+    uint32_t           num_layers;
+    SessionLayerHeader layers[kMaxSessionLayers];
+    uint32_t           latency; // round trip, frames; 0 = never measured
+};
+static_assert(sizeof(SessionHeader) <= kSessionHeaderBytes, "session header must fit its sector");
+
+struct PersistChunk
+{
+    uint32_t layer;
+    uint32_t frame;  // first frame in the take
+    uint32_t frames;
+    alignas(4) uint8_t data[kPersistChunkBytes];
+};
+
+enum SessionState
+{
+    kSessionIdle,
+    kSessionSaveRequested, // main invalidates the stored header
+    kSessionSnapshot,      // audio captures the layer state
+    kSessionSaving,        // audio produces chunks, main writes them
+    kSessionLoading,       // main reads chunks, audio installs them
+};
+
+struct SessionStats
+{
+    uint32_t saves;
+    uint32_t loads;
+    uint32_t chunks_written;
+    uint32_t chunks_read;
+    uint32_t io_errors;
+    uint32_t audio_starved; // blocks where audio had work but no chunk buffer
+};
+
+struct SessionStore
+{
+    StorageDevice* device     = nullptr;
+    LooperLayer*   layers     = nullptr;
+    int            num_layers = 0;
+
+    PersistChunk*                            pool = nullptr;
+    SpscQueue<PersistChunk*, kPersistChunks> filled;
+    SpscQueue<PersistChunk*, kPersistChunks> empty;
+
+    std::atomic<int>  state{kSessionIdle};
+    std::atomic<bool> produced_all{false}; // save: audio has queued every chunk
+
+    SessionHeader header;
+
+    // Save cursor (audio side) and restore cursors (main side)
+    int      save_layer = 0;
+    uint32_t save_frame = 0;
+    uint32_t load_next[kMaxSessionLayers];
+    int      load_turn      = 0;
+    uint32_t write_failures = 0; // chunks of the current save that failed to write
+
+    SessionStats stats = {};
+
+    // Round trip saved with the session: set when a calibration finishes,
+    // and replaced by the saved one on a load
+    std::atomic<uint32_t> latency{0};
+
+    // pool holds kPersistChunks buffers; on the Seed they must be DMA-reachable
+    void Init(StorageDevice* dev, LooperLayer* layer_array, int count, PersistChunk* chunk_pool);
+
+    // Any thread: start a save when idle; false when busy or there is no device
+    bool RequestSave();
+
+    // Main thread: read the header and start streaming the saved layers in;
+    // latency takes the saved one when the session has it
+    bool BeginLoad();
+
+    // Main thread, from the idle loop: at most one storage operation per call
+    void Poll();
+
+    // Audio thread, once per block before the layers are processed
+    void AudioService();
+
+    bool Busy() const { return state.load(std::memory_order_acquire) != kSessionIdle; }
+
+    uint32_t ChunkFrames(int layer) const
+    {
+        return (uint32_t)(kPersistChunkBytes / (header.layers[layer].channels * LoopFormat::kBytes));
+    }
+
+    void SnapshotLayers();
+    void FillSaveChunk(PersistChunk* chunk);
+    void InstallChunk(const PersistChunk* chunk);
+    void PollSave();
+    void PollLoad();
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Wait-free single-producer/single-consumer ring between the audio callback
+// and the main loop. Push() and Pop() never block: a full or empty queue just
+// returns false. N must be a power of two.
+template <typename T, size_t N>
+struct SpscQueue
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+    T                     items[N];
+    std::atomic<uint32_t> head{0}; // next slot to pop, written by the consumer only
+    std::atomic<uint32_t> tail{0}; // next slot to push, written by the producer only
+
+    bool Push(const T& item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == N)
+            return false;
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if(tail.load(std::memory_order_acquire) == h)
+            return false;
+        item = items[h & (N - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t Size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
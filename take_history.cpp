@@ -0,0 +1,215 @@
+#include <string.h>
+#include "take_history.h"
+
+void TakeHistory::Init(LoopStorage* s)
+{
+    storage     = s;
+    ahead_slot  = -1;
+    num_entries = 0;
+    num_levels  = 0;
+    applied     = 0;
+    pass_open   = false;
+}
+
+void TakeHistory::Clear()
+{
+    DropAhead();
+    for(size_t i = 0; i < num_entries; i++)
+        storage->arena->Free(entries[i].block);
+    num_entries = 0;
+    num_levels  = 0;
+    applied     = 0;
+    pass_open   = false;
+}
+
+void TakeHistory::BeginPass()
+{
+    // A new pass makes the undone levels unreachable
+    FreeLevels(applied, num_levels);
+    num_levels = applied;
+    if(num_levels == kMaxUndoLevels)
+        DropOldest();
+
+    levels[num_levels].first = (uint16_t)num_entries;
+    levels[num_levels].count = 0;
+    memset(touched, 0, sizeof(touched));
+    pass_open     = true;
+    pass_undoable = true;
+}
+
+void TakeHistory::EndPass()
+{
+    if(!pass_open)
+        return;
+    DropAhead();
+    pass_open = false;
+    if(pass_undoable && levels[num_levels].count > 0)
+        applied = ++num_levels;
+}
+
+void TakeHistory::PrepareWrite(size_t frame)
+{
+    if(!pass_open || !pass_undoable)
+        return;
+    uint16_t slot = (uint16_t)(frame / storage->frames_per_block);
+    uint8_t  bit  = (uint8_t)(1 << (slot & 7));
+    if(touched[slot >> 3] & bit)
+        return;
+    touched[slot >> 3] |= bit;
+
+    SampleArena* arena = storage->arena;
+    bool         ahead = ahead_slot == slot; // its copy already has a block
+    while((num_entries == kMaxUndoEntries || (!ahead && arena->FreeBlocks() == 0)) && DropOldest()) {}
+    if(!ahead && arena->FreeBlocks() == 0)
+        DropAhead(); // Copying ahead for another slot: its block is needed here
+    if(num_entries == kMaxUndoEntries || (!ahead && arena->FreeBlocks() == 0))
+    {
+        // Every older level is gone and this pass does not fit: give up its
+        // undo and overdub in place from here on
+        DropAhead();
+        for(size_t i = levels[num_levels].first; i < num_entries; i++)
+            arena->Free(entries[i].block);
+        num_entries              = levels[num_levels].first;
+        levels[num_levels].count = 0;
+        pass_undoable            = false;
+        return;
+    }
+
+    uint16_t old = storage->blocks[slot];
+    uint16_t block;
+    if(ahead)
+    {
+        // Copied ahead: at most the chunks it did not get to are left
+        block = ahead_block;
+        memcpy(arena->Block(block) + ahead_copied, arena->Block(old) + ahead_copied, kArenaBlockBytes - ahead_copied);
+        ahead_slot = -1;
+    }
+    else
+    {
+        block = arena->Alloc();
+        memcpy(arena->Block(block), arena->Block(old), kArenaBlockBytes);
+        whole_copies++;
+    }
+    storage->blocks[slot] = block;
+
+    entries[num_entries].slot  = slot;
+    entries[num_entries].block = old;
+    num_entries++;
+    levels[num_levels].count++;
+    if(num_entries > peak_blocks)
+        peak_blocks = num_entries;
+}
+
+void TakeHistory::CopyAhead(size_t frame, size_t len, size_t size)
+{
+    if(!pass_open || !pass_undoable)
+        return;
+    // The first slot from the head's that the pass has not written yet: the
+    // head's own when the block ended on its boundary
+    size_t fpb  = storage->frames_per_block;
+    size_t next = frame / fpb;
+    if(touched[next >> 3] & (1 << (next & 7)))
+    {
+        next = (next + 1) * fpb < len ? next + 1 : 0; // The head wraps to the loop's start
+        if(touched[next >> 3] & (1 << (next & 7)))
+            return;
+    }
+
+    SampleArena* arena = storage->arena;
+    if(ahead_slot != (int)next)
+    {
+        // Leave the last free block to PrepareWrite, which makes room first
+        DropAhead();
+        if(arena->FreeBlocks() < 2 || num_entries == kMaxUndoEntries)
+            return;
+        ahead_slot   = (int)next;
+        ahead_block  = arena->Alloc();
+        ahead_copied = 0;
+    }
+
+    // Done within half a block's worth of loop, a margin over the head's pace
+    size_t chunk = (2 * kArenaBlockBytes * size + fpb - 1) / fpb;
+    chunk        = chunk < kArenaBlockBytes - ahead_copied ? chunk : kArenaBlockBytes - ahead_copied;
+    memcpy(arena->Block(ahead_block) + ahead_copied, arena->Block(storage->blocks[next]) + ahead_copied, chunk);
+    ahead_copied += chunk;
+}
+
+void TakeHistory::DropAhead()
+{
+    if(ahead_slot >= 0)
+        storage->arena->Free(ahead_block);
+    ahead_slot = -1;
+}
+
+bool TakeHistory::Undo()
+{
+    if(!CanUndo())
+        return false;
+    SwapLevel(levels[--applied]);
+    return true;
+}
+
+bool TakeHistory::Redo()
+{
+    if(!CanRedo())
+        return false;
+    SwapLevel(levels[applied++]);
+    return true;
+}
+
+void TakeHistory::SwapLevel(const UndoLevel& level)
+{
+    for(size_t i = level.first; i < (size_t)level.first + level.count; i++)
+    {
+        uint16_t& slot   = storage->blocks[entries[i].slot];
+        uint16_t  live   = slot;
+        slot             = entries[i].block;
+        entries[i].block = live;
+    }
+}
+
+void TakeHistory::FreeLevels(int from, int to)
+{
+    if(from >= to)
+        return;
+    for(size_t i = levels[from].first; i < num_entries; i++)
+        storage->arena->Free(entries[i].block);
+    num_entries = levels[from].first;
+}
+
+bool TakeHistory::DropOldest()
+{
+    if(num_levels == 0)
+        return false;
+
+    // Level 0 holds the oldest versions; nothing newer refers to them
+    size_t n = levels[0].count;
+    for(size_t i = 0; i < n; i++)
+        storage->arena->Free(entries[i].block);
+    memmove(entries, entries + n, (num_entries - n) * sizeof(UndoEntry));
+    num_entries -= n;
+
+    int last = pass_open ? num_levels : num_levels - 1;
+    for(int l = 0; l < last; l++)
+    {
+        levels[l]       = levels[l + 1];
+        levels[l].first = (uint16_t)(levels[l].first - n);
+    }
+    num_levels--;
+    if(applied > 0)
+        applied--;
+    dropped_levels++;
+    return true;
+}
+
+HistoryStats TakeHistory::GetStats() const
+{
+    HistoryStats stats;
+    stats.undo_levels    = applied;
+    stats.redo_levels    = num_levels - applied;
+    stats.blocks         = num_entries;
+    stats.bytes          = num_entries * kArenaBlockBytes;
+    stats.peak_blocks    = peak_blocks;
+    stats.dropped_levels = dropped_levels;
+    return stats;
+}
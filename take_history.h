@@ -0,0 +1,99 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_arena.h"
+
+// Copy-on-write undo/redo for overdubs.
+// An overdub pass never writes into a block the history may still need: the
+// first write to each storage block in a pass copies it to a fresh arena
+// block, swaps the copy into the take's block table and keeps the original in
+// the pass's undo level. Undo and redo swap those table entries back and forth,
+// so a level costs one arena block per block the pass touched, and nothing is
+// copied when undoing.
+//
+// When the arena or the entry table runs out the oldest levels are dropped to
+// make room; if the current pass alone does not fit, it stops being undoable
+// and keeps overdubbing in place.
+//
+// A whole block copied in the audio callback is 64 KB of SDRAM traffic in one
+// block's time, so the copy of the block ahead of the overdub head is made a
+// chunk per audio block while the head is still in the one before: by the
+// time it gets there only the swap is left. Only the pass's first block is
+// copied in one go.
+
+constexpr int    kMaxUndoLevels  = 8;
+constexpr size_t kMaxUndoEntries = 1024; // blocks held across all levels of one layer
+
+struct UndoEntry
+{
+    uint16_t slot;  // index into LoopStorage::blocks
+    uint16_t block; // the other version of that slot
+};
+
+struct UndoLevel
+{
+    uint16_t first; // into TakeHistory::entries
+    uint16_t count;
+};
+
+struct HistoryStats
+{
+    int      undo_levels;
+    int      redo_levels;
+    size_t   blocks;         // arena blocks held by the history
+    size_t   bytes;
+    size_t   peak_blocks;
+    uint32_t dropped_levels; // levels lost to memory pressure
+};
+
+struct TakeHistory
+{
+    LoopStorage* storage = nullptr;
+
+    UndoEntry entries[kMaxUndoEntries];
+    size_t    num_entries = 0;
+    UndoLevel levels[kMaxUndoLevels];
+    int       num_levels = 0; // closed levels; an open pass fills levels[num_levels]
+    int       applied    = 0; // levels currently applied; the rest can be redone
+
+    uint8_t touched[kMaxArenaBlocks / 8]; // slots already copied in the open pass
+    bool    pass_open     = false;
+    bool    pass_undoable = false;
+
+    // The copy being made ahead of the head: slot, its new block, bytes done
+    int      ahead_slot   = -1;
+    uint16_t ahead_block  = 0;
+    size_t   ahead_copied = 0;
+    uint32_t whole_copies = 0; // blocks copied in one go, not ahead
+
+    size_t   peak_blocks    = 0;
+    uint32_t dropped_levels = 0;
+
+    void Init(LoopStorage* s);
+
+    // Free every block held by the history
+    void Clear();
+
+    // Start an overdub pass; discards anything that could be redone
+    void BeginPass();
+    void EndPass();
+
+    // Call before writing `frame` during a pass, copies its block on first touch
+    void PrepareWrite(size_t frame);
+
+    // Once per audio block of `size` frames during a pass, the head at
+    // `frame` of a loop of `len`: copy the next chunk of the block ahead
+    void CopyAhead(size_t frame, size_t len, size_t size);
+    void DropAhead();
+
+    bool CanUndo() const { return !pass_open && applied > 0; }
+    bool CanRedo() const { return !pass_open && applied < num_levels; }
+    bool Undo();
+    bool Redo();
+
+    HistoryStats GetStats() const;
+
+    void SwapLevel(const UndoLevel& level);
+    void FreeLevels(int from, int to);
+    bool DropOldest();
+};
@@ -0,0 +1,168 @@
+#include <math.h>
+#include "time_stretch.h"
+
+float TimeStretch::window[kStretchGrain];
+
+static const int kStretchUnits = kStretchCoarse + kStretchFine;
+
+void TimeStretch::InitTable()
+{
+    const float pi = 3.14159265358979f;
+    for(uint32_t i = 0; i < kStretchGrain; i++)
+        window[i] = 0.5f - 0.5f * cosf(2.0f * pi * (float)i / kStretchGrain);
+}
+
+static inline uint32_t Wrap(int64_t frame, uint32_t len)
+{
+    int64_t f = frame % (int64_t)len;
+    return (uint32_t)(f < 0 ? f + len : f);
+}
+
+static inline Phase WrapPhase(Phase phase, uint32_t len)
+{
+    const Phase end = PhaseFromIndex(len);
+    while(phase >= end)
+        phase -= end;
+    return phase;
+}
+
+// Both channels summed, for matching; frame < len
+static inline float Mono(const LoopSource& src, uint32_t frame)
+{
+    return 0.5f * (src.Sample<LoopFormat>(frame, 0) + src.Sample<LoopFormat>(frame, src.channels - 1));
+}
+
+void TimeStretch::Reset(const LoopSource& src, Phase phase, Phase inc)
+{
+    cur      = PhaseIndex(phase);
+    prev     = Wrap((int64_t)cur - kStretchHop, src.len); // Same frames as cur for the first hop
+    t        = 0;
+    expected = phase;
+    active   = true;
+    BeginSearch(phase, inc, src.len);
+}
+
+void TimeStretch::BeginSearch(Phase phase, Phase inc, uint32_t len)
+{
+    nominal    = WrapPhase(phase + kStretchHop * inc, len);
+    best       = PhaseIndex(nominal);
+    best_score = -1e30f;
+    next_unit  = 0;
+    loaded     = false;
+}
+
+void TimeStretch::LoadSearch(const LoopSource& src)
+{
+    for(uint32_t j = 0; j < kStretchTemplate; j++)
+        templ[j] = Mono(src, Wrap((int64_t)cur + kStretchHop + j * kStretchDecimate, src.len));
+    region_start = Wrap((int64_t)PhaseIndex(nominal) - kStretchTolerance, src.len);
+    for(uint32_t m = 0; m < kStretchRegion; m++)
+        region[m] = Mono(src, Wrap((int64_t)region_start + m * kStretchDecimate, src.len));
+    loaded = true;
+}
+
+float TimeStretch::Score(const LoopSource& src, int unit) const
+{
+    float num = 0.0f, energy = 0.0f;
+    if(unit < kStretchCoarse)
+    {
+        const float* x = region + unit;
+        for(uint32_t j = 0; j < kStretchTemplate; j++)
+        {
+            num += templ[j] * x[j];
+            energy += x[j] * x[j];
+        }
+    }
+    else
+    {
+        int64_t start = (int64_t)region_start + best_coarse * kStretchDecimate + (unit - kStretchCoarse)
+                        - (kStretchDecimate - 1);
+        for(uint32_t j = 0; j < kStretchTemplate; j++)
+        {
+            float x = Mono(src, Wrap(start + j * kStretchDecimate, src.len));
+            num += templ[j] * x;
+            energy += x * x;
+        }
+    }
+    return num / sqrtf(energy + 1e-9f);
+}
+
+int TimeStretch::Search(const LoopSource& src, int n)
+{
+    if(!loaded)
+        LoadSearch(src);
+    int done = 0;
+    for(; done < n && next_unit < kStretchUnits; done++, next_unit++)
+    {
+        float score = Score(src, next_unit);
+        if(score <= best_score)
+            continue;
+        best_score = score;
+        if(next_unit < kStretchCoarse)
+        {
+            best_coarse = next_unit;
+            best        = Wrap((int64_t)region_start + next_unit * kStretchDecimate, src.len);
+        }
+        else
+        {
+            best = Wrap((int64_t)region_start + best_coarse * kStretchDecimate + (next_unit - kStretchCoarse)
+                            - (kStretchDecimate - 1),
+                        src.len);
+        }
+    }
+    return done;
+}
+
+void TimeStretch::Render(const LoopSource& src,
+                         Phase&            phase,
+                         Phase             inc,
+                         float*            out_l,
+                         float*            out_r,
+                         size_t            size,
+                         const ParamRamp&  gain_l,
+                         const ParamRamp&  gain_r)
+{
+    // Re-recorded, erased or restarted since the last block
+    if(!active || phase != expected || cur >= src.len || prev >= src.len)
+        Reset(src, phase, inc);
+
+    // Spread what is left of the search over the blocks left in this hop
+    uint32_t blocks_left = (uint32_t)((kStretchHop - t + size - 1) / size);
+    int      n           = (kStretchUnits - next_unit + (int)blocks_left - 1) / (int)blocks_left;
+    if(n > 0)
+    {
+        uint32_t units        = (uint32_t)Search(src, n);
+        stats.max_block_units = units > stats.max_block_units ? units : stats.max_block_units;
+    }
+
+    const int right = src.channels - 1;
+    for(size_t i = 0; i < size; i++)
+    {
+        // The previous grain fades out over its second half as the new one fades in
+        uint32_t a  = Wrap((int64_t)prev + kStretchHop + t, src.len);
+        uint32_t b  = Wrap((int64_t)cur + t, src.len);
+        float    wa = window[t + kStretchHop];
+        float    wb = window[t];
+        float    l  = wa * src.Sample<LoopFormat>(a, 0) + wb * src.Sample<LoopFormat>(b, 0);
+        float    r  = wa * src.Sample<LoopFormat>(a, right) + wb * src.Sample<LoopFormat>(b, right);
+        out_l[i] += l * gain_l.At(i);
+        out_r[i] += r * gain_r.At(i);
+
+        if(++t == kStretchHop)
+        {
+            if(next_unit < kStretchUnits)
+            {
+                stats.late++;
+                Search(src, kStretchUnits);
+            }
+            prev = cur;
+            cur  = best;
+            t    = 0;
+            stats.grains++;
+            BeginSearch(WrapPhase(phase + (i + 1) * inc, src.len), inc, src.len);
+        }
+    }
+
+    phase    = WrapPhase(phase + size * inc, src.len);
+    expected = phase;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "control_params.h"
+#include "resampler.h"
+#include "sample_format.h"
+
+// Pitch-preserving playback of a loop at a different tempo (WSOLA).
+//
+// Output is a stream of Hann-windowed grains of kStretchGrain frames, one
+// every kStretchHop output frames, each read at the original rate so pitch is
+// unchanged. The grains' source positions advance by speed * kStretchHop, so
+// the loop goes by at `speed`. Each grain may move up to kStretchTolerance
+// frames from its nominal position, to where it best continues the previous
+// grain: the normalised cross-correlation against the frames that would have
+// followed the previous grain, first on every kStretchDecimate-th frame, then
+// at full resolution around the best match.
+//
+// With a 50% overlap only two grains sound at any time, so synthesis needs
+// no accumulation buffer, just the two grain positions. The search for the
+// next grain starts as soon as the current one is placed and is spread evenly
+// over the blocks of the hop, so every block does about the same work; it is
+// only finished in one go when the hop ends first (stats.late).
+
+constexpr uint32_t kStretchGrain      = 1024; // frames per grain
+constexpr uint32_t kStretchHop        = kStretchGrain / 2;
+constexpr uint32_t kStretchTolerance  = 256;  // frames a grain may move either way
+constexpr uint32_t kStretchDecimate   = 4;    // stride of the coarse search
+constexpr uint32_t kStretchTemplate   = kStretchHop / kStretchDecimate; // correlated points
+constexpr int      kStretchCoarse     = 2 * kStretchTolerance / kStretchDecimate + 1;
+constexpr int      kStretchFine       = 2 * kStretchDecimate - 1;
+constexpr uint32_t kStretchRegion     = kStretchCoarse - 1 + kStretchTemplate;
+constexpr uint32_t kStretchMinFrames  = 4 * kStretchGrain; // shorter loops play varispeed
+
+struct StretchStats
+{
+    uint32_t grains;
+    uint32_t late;            // searches finished in one go at the end of a hop
+    uint32_t max_block_units; // most search candidates evaluated in one block
+};
+
+struct TimeStretch
+{
+    // Hann window, periodic, so two grains half a grain apart sum to 1
+    static float window[kStretchGrain];
+
+    // Fill the window; call once at startup
+    static void InitTable();
+
+    float templ[kStretchTemplate]; // frames that would follow the current grain
+    float region[kStretchRegion];  // decimated search span around the nominal position
+
+    uint32_t prev     = 0; // source frame of the fading-out grain's start
+    uint32_t cur      = 0; // source frame of the fading-in grain's start
+    uint32_t t        = 0; // output frames into the current hop
+    Phase    nominal  = 0; // where the next grain belongs, before the search moves it
+    Phase    expected = 0; // play phase after the last block, to notice jumps
+    bool     active   = false;
+
+    // Search for the next grain
+    uint32_t region_start = 0; // source frame of region[0]
+    int      next_unit    = 0; // coarse candidates, then fine offsets
+    bool     loaded       = false;
+    int      best_coarse  = 0;
+    uint32_t best         = 0; // source frame of the best grain so far
+    float    best_score   = 0.0f;
+
+    StretchStats stats = {};
+
+    // Start seamlessly at phase: the first hop plays the loop as it is
+    void Reset(const LoopSource& src, Phase phase, Phase inc);
+
+    // Mix size stretched frames into out with the gain ramps, advancing
+    // phase by inc per frame like varispeed playback would
+    void Render(const LoopSource& src,
+                Phase&            phase,
+                Phase             inc,
+                float*            out_l,
+                float*            out_r,
+                size_t            size,
+                const ParamRamp&  gain_l,
+                const ParamRamp&  gain_r);
+
+    // Start looking for the grain that follows cur, due one hop from phase
+    void BeginSearch(Phase phase, Phase inc, uint32_t len);
+
+    // Evaluate up to n candidates; returns how many were
+    int   Search(const LoopSource& src, int n);
+    void  LoadSearch(const LoopSource& src);
+    float Score(const LoopSource& src, int unit) const;
+};
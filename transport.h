@@ -0,0 +1,60 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Internal master transport for layers recorded without an external clock.
+//
+// The first such take sets the cycle: its length, rounded to a multiple of
+// kCycleGrain frames so the divisions below come out whole. Later takes are
+// stopped at the nearest whole multiple of the cycle or one of its
+// divisions, and every one of these layers plays at the position the shared
+// 64-bit frame counter gives it, (frames - anchor) % length, instead of
+// adding up its own increments. Their lengths divide one another, so the
+// layers keep the same relation to each other for as long as they play.
+
+constexpr uint32_t kCycleGrain       = 24; // divisible by every kCycleDivisions entry
+constexpr uint32_t kCycleDivisions[] = {2, 3, 4, 6, 8};
+
+// kCmdRecordStart arg flag, next to the Quantize value: with no clock
+// running, snap the take to the cycle
+constexpr uint8_t kQuantizeCycle = 0x80;
+constexpr uint8_t kQuantizeMask  = 0x7F;
+
+struct MasterTransport
+{
+    uint64_t frames = 0; // rendered since Init; does not wrap in practice
+    uint32_t cycle  = 0; // frames, 0 until the first take sets it
+
+    // The counter at engine frame f of the 32-bit frame clock, which reads
+    // `now` at the current block; f within 12 hours of it
+    uint64_t At(uint32_t f, uint32_t now) const { return frames + (int64_t)(int32_t)(f - now); }
+
+    // Loop frame playing now for a layer of `len` frames with frame 0 at anchor
+    uint32_t Position(uint64_t anchor, uint32_t len) const
+    {
+        int64_t rel = (int64_t)(frames - anchor) % (int64_t)len;
+        return (uint32_t)(rel < 0 ? rel + len : rel);
+    }
+
+    static uint32_t Round(uint32_t len)
+    {
+        uint32_t n = (len + kCycleGrain / 2) / kCycleGrain;
+        return (n > 0 ? n : 1) * kCycleGrain;
+    }
+
+    // The length nearest len that fits the cycle: a whole number of cycles,
+    // or a cycle divided by one of kCycleDivisions
+    uint32_t Snap(uint32_t len) const
+    {
+        uint32_t n    = (len + cycle / 2) / cycle;
+        uint32_t best = (n > 0 ? n : 1) * cycle;
+        for(uint32_t d : kCycleDivisions)
+        {
+            uint32_t part = cycle / d;
+            uint32_t off  = part > len ? part - len : len - part;
+            if(off < (best > len ? best - len : len - best))
+                best = part;
+        }
+        return best;
+    }
+};